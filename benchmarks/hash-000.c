@@ -0,0 +1,114 @@
+/* PURPOSE: hash<K,V> against tree<K,V> lookups and inserts
+ *
+ * Usage: benchmarks/hash-000 [MAX_SIZE]
+ *
+ * Fills a tree and a hash with 1000, 10000, ... MAX_SIZE
+ * (default 10000000) int and string keys, in scrambled order,
+ * through their index functions (as 'x[key] = value' does),
+ * then looks every key up, and prints nanoseconds per operation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../dang.h"
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* DangTree and DangHash both start with their constant part,
+   which may be NULL when empty, followed by the ref_count. */
+typedef struct
+{
+  void *v;
+  unsigned ref_count;
+} Container;
+
+static void
+time_container (DangValueType *type,
+                const char    *key_name,
+                DangValueType *key_type,
+                const char    *keys,
+                unsigned       n)
+{
+  DangValueIndexInfo *info = type->internals.index_infos;
+  Container *container = dang_new (Container, 1);
+  DangError *error = NULL;
+  double start, insert_time, lookup_time;
+  unsigned i;
+  int32_t value;
+  const void *index;
+
+  container->v = NULL;
+  container->ref_count = 1;
+  start = now ();
+  for (i = 0; i < n; i++)
+    {
+      value = i;
+      index = keys + (size_t) i * key_type->sizeof_instance;
+      if (!info->set (info, &container, &index, &value, TRUE, &error))
+        dang_die ("set failed: %s", error->message);
+    }
+  insert_time = now () - start;
+
+  start = now ();
+  for (i = 0; i < n; i++)
+    {
+      index = keys + (size_t) i * key_type->sizeof_instance;
+      if (!info->get (info, &container, &index, &value, FALSE, &error))
+        dang_die ("get failed: %s", error->message);
+      if (value != (int32_t) i)
+        dang_die ("got wrong value");
+    }
+  lookup_time = now () - start;
+
+  printf ("%-6s %-6s %9u %12.1f %12.1f\n",
+          type->full_name[0] == 'h' ? "hash" : "tree", key_name, n,
+          insert_time * 1e9 / n, lookup_time * 1e9 / n);
+  type->destruct (type, &container);
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned max_size = argc > 1 ? (unsigned) atoi (argv[1]) : 10000000;
+  int32_t *int_keys = dang_new (int32_t, max_size);
+  DangString **string_keys = dang_new (DangString *, max_size);
+  DangValueType *int_type = dang_value_type_int32 ();
+  DangValueType *string_type = dang_value_type_string ();
+  unsigned n, i;
+
+  /* multiplying by an odd number permutes the uint32s */
+  for (i = 0; i < max_size; i++)
+    {
+      char buf[32];
+      int_keys[i] = (int32_t) (i * 2654435761U);
+      snprintf (buf, sizeof (buf), "key%u", (unsigned) int_keys[i]);
+      string_keys[i] = dang_string_new (buf);
+    }
+
+  printf ("%-6s %-6s %9s %12s %12s\n",
+          "type", "keys", "size", "insert ns", "lookup ns");
+  for (n = 1000; n <= max_size; n *= 10)
+    {
+      time_container (dang_value_type_tree (int_type, int_type),
+                      "int", int_type, (char *) int_keys, n);
+      time_container (dang_value_type_hash (int_type, int_type),
+                      "int", int_type, (char *) int_keys, n);
+      time_container (dang_value_type_tree (string_type, int_type),
+                      "string", string_type, (char *) string_keys, n);
+      time_container (dang_value_type_hash (string_type, int_type),
+                      "string", string_type, (char *) string_keys, n);
+    }
+
+  for (i = 0; i < max_size; i++)
+    dang_string_unref (string_keys[i]);
+  dang_free (string_keys);
+  dang_free (int_keys);
+  return 0;
+}
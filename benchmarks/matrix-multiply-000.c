@@ -0,0 +1,150 @@
+/* PURPOSE: matrix multiply throughput, in GFLOPS
+ *
+ * Usage: benchmarks/matrix-multiply-000 [MAX_SIZE]
+ *
+ * Multiplies square int32, float and double matrices of sizes
+ * 64, 128, ... MAX_SIZE (default 2048) with each kernel set the cpu
+ * supports (see dang-tensor-kernels.h), on one thread and split over
+ * the default scheduler's workers (one per cpu), and prints billions of multiply-adds times two per second.
+ * Up to size 512 the naive i-j-k loop that the kernels replaced
+ * is timed too.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../dang.h"
+
+static const char *type_names[DANG_TENSOR_KERNEL_N_TYPES] = { "int32", "float", "double" };
+
+#define NAIVE_MAX_SIZE  512
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define DEFINE_NAIVE(type, ctype)                                       \
+static void                                                             \
+naive__##type (const void *a, const void *b, void *c, unsigned n)       \
+{                                                                       \
+  unsigned i, j, k;                                                     \
+  ctype *out = c;                                                       \
+  for (i = 0; i < n; i++)                                               \
+    for (j = 0; j < n; j++)                                             \
+      {                                                                 \
+        ctype elt = 0;                                                  \
+        const ctype *in_a = (const ctype *) a + i * n;                  \
+        const ctype *in_b = (const ctype *) b + j;                      \
+        for (k = 0; k < n; k++)                                         \
+          {                                                             \
+            elt += *in_a * *in_b;                                       \
+            in_a++;                                                     \
+            in_b += n;                                                  \
+          }                                                             \
+        *out++ = elt;                                                   \
+      }                                                                 \
+}
+DEFINE_NAIVE (int32, int32_t)
+DEFINE_NAIVE (float, float)
+DEFINE_NAIVE (double, double)
+
+static void
+fill (DangTensorKernelType type, void *data, unsigned N)
+{
+  unsigned i;
+  for (i = 0; i < N; i++)
+    switch (type)
+      {
+      case DANG_TENSOR_KERNEL_INT32: ((int32_t *) data)[i] = i % 17; break;
+      case DANG_TENSOR_KERNEL_FLOAT: ((float *) data)[i] = i % 17; break;
+      case DANG_TENSOR_KERNEL_DOUBLE: ((double *) data)[i] = i % 17; break;
+      }
+}
+
+/* runs 'kernels' (or the naive loop, if NULL) for at least 0.2 seconds,
+   on the calling thread alone unless 'split' */
+static double
+time_multiply (const DangTensorKernels *kernels,
+               dang_boolean             split,
+               DangTensorKernelType     type,
+               const void              *a,
+               const void              *b,
+               void                    *c,
+               unsigned                 n)
+{
+  double start = now ();
+  double elapsed;
+  unsigned n_runs = 0;
+  do
+    {
+      if (kernels == NULL)
+        switch (type)
+          {
+          case DANG_TENSOR_KERNEL_INT32: naive__int32 (a, b, c, n); break;
+          case DANG_TENSOR_KERNEL_FLOAT: naive__float (a, b, c, n); break;
+          case DANG_TENSOR_KERNEL_DOUBLE: naive__double (a, b, c, n); break;
+          }
+      else if (!split)
+        kernels->matrix_multiply[type] (a, b, c, n, n, n);
+      else
+        {
+          dang_tensor_kernels = kernels;
+          dang_tensor_matrix_multiply (type, a, b, c, n, n, n);
+        }
+      n_runs++;
+      elapsed = now () - start;
+    }
+  while (elapsed < 0.2);
+  return elapsed / n_runs;
+}
+
+static void
+report (const char *type_name, unsigned n, const char *set_name,
+        const char *threads, double elapsed)
+{
+  printf ("%-7s %5u %-7s %-8s %10.4f %8.2f\n",
+          type_name, n, set_name, threads, elapsed,
+          2.0 * n * n * n / elapsed / 1e9);
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned max_size = argc > 1 ? (unsigned) atoi (argv[1]) : 2048;
+  unsigned n, t, s;
+  void *a = dang_malloc ((size_t) max_size * max_size * 8);
+  void *b = dang_malloc ((size_t) max_size * max_size * 8);
+  void *c = dang_malloc ((size_t) max_size * max_size * 8);
+
+  printf ("%-7s %5s %-7s %-8s %10s %8s\n",
+          "type", "size", "set", "threads", "seconds", "GFLOPS");
+  for (t = 0; t < DANG_TENSOR_KERNEL_N_TYPES; t++)
+    {
+      fill (t, a, max_size * max_size);
+      fill (t, b, max_size * max_size);
+      for (n = 64; n <= max_size; n *= 2)
+        {
+          if (n <= NAIVE_MAX_SIZE)
+            report (type_names[t], n, "naive", "1",
+                    time_multiply (NULL, FALSE, t, a, b, c, n));
+          for (s = DANG_TENSOR_KERNEL_SET_SCALAR; s <= DANG_TENSOR_KERNEL_SET_AVX2; s++)
+            {
+              const DangTensorKernels *kernels = dang_tensor_kernels_get (s);
+              if (kernels == NULL)
+                continue;
+              report (type_names[t], n, dang_tensor_kernel_set_name (s), "1",
+                      time_multiply (kernels, FALSE, t, a, b, c, n));
+              report (type_names[t], n, dang_tensor_kernel_set_name (s), "workers",
+                      time_multiply (kernels, TRUE, t, a, b, c, n));
+            }
+        }
+    }
+  dang_free (a);
+  dang_free (b);
+  dang_free (c);
+  return 0;
+}
@@ -0,0 +1,117 @@
+/* PURPOSE: element-wise tensor kernels, scalar against SSE2 and AVX2
+ *
+ * Usage: benchmarks/tensor-kernels-000 [N_ELEMENTS [N_REPEATS]]
+ *
+ * Times each kernel of each set the cpu supports
+ * (see dang-tensor-kernels.h) on int32, float and double arrays
+ * of N_ELEMENTS (default 1000000), repeated N_REPEATS (default 50)
+ * times, and prints millions of elements per second
+ * and the speedup over the scalar kernel.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../dang.h"
+
+static const char *type_names[DANG_TENSOR_KERNEL_N_TYPES] = { "int32", "float", "double" };
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef enum
+{
+  KERNEL_ADD,
+  KERNEL_SUBTRACT,
+  KERNEL_SCALAR_MULTIPLY,
+  KERNEL_SUM,
+  KERNEL_MIN,
+  KERNEL_MAX
+} Kernel;
+static const char *kernel_names[] = { "add", "subtract", "scalar_multiply", "sum", "min", "max" };
+
+static double
+time_kernel (const DangTensorKernels *kernels,
+             Kernel                   kernel,
+             DangTensorKernelType     type,
+             const void              *a,
+             const void              *b,
+             void                    *c,
+             unsigned                 N,
+             unsigned                 n_repeats)
+{
+  double start = now ();
+  char out[8];
+  unsigned i;
+  for (i = 0; i < n_repeats; i++)
+    switch (kernel)
+      {
+      case KERNEL_ADD: kernels->add[type] (a, b, c, N); break;
+      case KERNEL_SUBTRACT: kernels->subtract[type] (a, b, c, N); break;
+      case KERNEL_SCALAR_MULTIPLY: kernels->scalar_multiply[type] (a, b, c, N); break;
+      case KERNEL_SUM: kernels->sum[type] (out, a, N); break;
+      case KERNEL_MIN: kernels->min[type] (out, a, N); break;
+      case KERNEL_MAX: kernels->max[type] (out, a, N); break;
+      }
+  return now () - start;
+}
+
+static void
+fill (DangTensorKernelType type, void *data, unsigned N)
+{
+  unsigned i;
+  for (i = 0; i < N; i++)
+    switch (type)
+      {
+      case DANG_TENSOR_KERNEL_INT32: ((int32_t *) data)[i] = i % 1000; break;
+      case DANG_TENSOR_KERNEL_FLOAT: ((float *) data)[i] = i % 1000; break;
+      case DANG_TENSOR_KERNEL_DOUBLE: ((double *) data)[i] = i % 1000; break;
+      }
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned N = argc > 1 ? (unsigned) atoi (argv[1]) : 1000000;
+  unsigned n_repeats = argc > 2 ? (unsigned) atoi (argv[2]) : 50;
+  void *a = dang_malloc (N * 8);
+  void *b = dang_malloc (N * 8);
+  void *c = dang_malloc (N * 8);
+  unsigned k, t, s;
+
+  printf ("%-16s %-7s %-7s %10s %10s %8s\n",
+          "kernel", "type", "set", "seconds", "Melts/sec", "speedup");
+  for (t = 0; t < DANG_TENSOR_KERNEL_N_TYPES; t++)
+    {
+      fill (t, a, N);
+      fill (t, b, N);
+      for (k = 0; k < DANG_N_ELEMENTS (kernel_names); k++)
+        {
+          double scalar_time = 0;
+          for (s = DANG_TENSOR_KERNEL_SET_SCALAR; s <= DANG_TENSOR_KERNEL_SET_AVX2; s++)
+            {
+              const DangTensorKernels *kernels = dang_tensor_kernels_get (s);
+              double elapsed;
+              if (kernels == NULL)
+                continue;
+              elapsed = time_kernel (kernels, k, t, a, b, c, N, n_repeats);
+              if (s == DANG_TENSOR_KERNEL_SET_SCALAR)
+                scalar_time = elapsed;
+              printf ("%-16s %-7s %-7s %10.3f %10.1f %7.2fx\n",
+                      kernel_names[k], type_names[t],
+                      dang_tensor_kernel_set_name (s), elapsed,
+                      (double) N * n_repeats / elapsed / 1e6,
+                      scalar_time / elapsed);
+            }
+        }
+    }
+  dang_free (a);
+  dang_free (b);
+  dang_free (c);
+  return 0;
+}
@@ -0,0 +1,122 @@
+/* PURPOSE: scheduler throughput on many small threads
+ *
+ * Usage: benchmarks/threads-000 [N_THREADS [N_WORKERS...]]
+ *
+ * Runs N_THREADS (default 10000) short dang threads on a scheduler
+ * with each number of workers (default: 1, 2, 4 and one per cpu),
+ * and prints the threads run per second.  Every thread copies a
+ * shared global string, so reference-counts are contended.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../dang.h"
+
+#define JOB_ITERATIONS  200
+
+static const char job_source[] =
+  "var greeting = \"hello\";\n"
+  "function job(int n : int)\n"
+  "{\n"
+  "  var total = 0;\n"
+  "  for (var i = 0; i < n; i++)\n"
+  "    {\n"
+  "      var s = greeting;\n"
+  "      total += i;\n"
+  "    }\n"
+  "  return total;\n"
+  "}\n"
+  "assert(job(4) == 6);\n";
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static DangFunction *
+load_job (void)
+{
+  char filename[] = "/tmp/dang-threads-000-XXXXXX";
+  DangRunFileOptions options = DANG_RUN_FILE_OPTIONS_DEFAULTS;
+  DangError *error = NULL;
+  DangNamespaceSymbol *symbol;
+  int fd = mkstemp (filename);
+  if (fd < 0
+   || write (fd, job_source, strlen (job_source)) != (ssize_t) strlen (job_source))
+    dang_die ("error writing %s", filename);
+  close (fd);
+  if (!dang_run_file (filename, &options, &error))
+    dang_die ("error running job source: %s", error->message);
+  unlink (filename);
+
+  symbol = dang_namespace_lookup (dang_namespace_default (), "job");
+  dang_assert (symbol != NULL
+            && symbol->type == DANG_NAMESPACE_SYMBOL_FUNCTIONS);
+  return dang_function_family_is_single (symbol->info.functions);
+}
+
+static void
+run_batch (DangFunction *job,
+           unsigned      n_threads,
+           unsigned      n_workers)
+{
+  DangScheduler *scheduler = dang_scheduler_new (n_workers);
+  DangThread **threads = dang_new (DangThread *, n_threads);
+  int32_t n = JOB_ITERATIONS;
+  void *args[1] = { &n };
+  unsigned rv_offset = DANG_ALIGN (sizeof (DangThreadStackFrame),
+                                   dang_value_type_int32 ()->alignof_instance);
+  double start, elapsed;
+  unsigned i;
+
+  start = now ();
+  for (i = 0; i < n_threads; i++)
+    {
+      threads[i] = dang_thread_new (job, 1, args);
+      dang_scheduler_push (scheduler, threads[i]);
+    }
+  dang_scheduler_wait (scheduler);
+  elapsed = now () - start;
+
+  for (i = 0; i < n_threads; i++)
+    {
+      int32_t rv;
+      dang_assert (threads[i]->status == DANG_THREAD_STATUS_DONE);
+      memcpy (&rv, (char*)threads[i]->rv_frame + rv_offset, sizeof (rv));
+      dang_assert (rv == JOB_ITERATIONS * (JOB_ITERATIONS - 1) / 2);
+      dang_thread_unref (threads[i]);
+    }
+  dang_free (threads);
+
+  printf ("%-10u %-8u %10.3f %14.0f\n",
+          n_threads, dang_scheduler_get_n_workers (scheduler),
+          elapsed, n_threads / elapsed);
+  dang_scheduler_unref (scheduler);
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned n_threads = argc > 1 ? (unsigned) atoi (argv[1]) : 10000;
+  DangFunction *job = load_job ();
+  int i;
+
+  printf ("%-10s %-8s %10s %14s\n", "threads", "workers", "seconds", "threads/sec");
+  if (argc > 2)
+    for (i = 2; i < argc; i++)
+      run_batch (job, n_threads, atoi (argv[i]));
+  else
+    {
+      run_batch (job, n_threads, 1);
+      run_batch (job, n_threads, 2);
+      run_batch (job, n_threads, 4);
+      run_batch (job, n_threads, 0);
+    }
+  dang_cleanup ();
+  return 0;
+}
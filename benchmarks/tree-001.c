@@ -0,0 +1,112 @@
+/* PURPOSE: red-black against B-tree layouts of tree<K,V>
+ *
+ * Usage: benchmarks/tree-001 [MAX_SIZE]
+ *
+ * Fills a tree<int,int> with 1000, 10000, ... MAX_SIZE
+ * (default 10000000) keys, in scrambled order, through its
+ * index functions (as 'x[key] = value' does), looks every key up,
+ * then iterates the entries in order, once with the red-black layout
+ * only and once converting to a B-tree (see dang_tree_btree_threshold),
+ * and prints nanoseconds per operation.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include "../dang.h"
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+sum_values (const void *key,
+            const void *value,
+            void       *func_data)
+{
+  (void) key;
+  *(int64_t *) func_data += *(const int32_t *) value;
+}
+
+static void
+time_tree (const char    *layout,
+           const int32_t *keys,
+           unsigned       n)
+{
+  DangValueType *int_type = dang_value_type_int32 ();
+  DangValueType *type = dang_value_type_tree (int_type, int_type);
+  DangValueIndexInfo *info = type->internals.index_infos;
+  DangTree *tree = dang_new (DangTree, 1);
+  DangError *error = NULL;
+  double start, insert_time, lookup_time, iterate_time;
+  int64_t sum = 0;
+  unsigned i;
+  int32_t value;
+  const void *index;
+
+  tree->v = NULL;
+  tree->ref_count = 1;
+  start = now ();
+  for (i = 0; i < n; i++)
+    {
+      value = i;
+      index = keys + i;
+      if (!info->set (info, &tree, &index, &value, TRUE, &error))
+        dang_die ("set failed: %s", error->message);
+    }
+  insert_time = now () - start;
+
+  start = now ();
+  for (i = 0; i < n; i++)
+    {
+      index = keys + i;
+      if (!info->get (info, &tree, &index, &value, FALSE, &error))
+        dang_die ("get failed: %s", error->message);
+      if (value != (int32_t) i)
+        dang_die ("got wrong value");
+    }
+  lookup_time = now () - start;
+
+  start = now ();
+  dang_constant_tree_foreach ((DangValueTypeTree *) type, tree->v,
+                              sum_values, &sum);
+  iterate_time = now () - start;
+  if (sum != (int64_t) n * (n - 1) / 2)
+    dang_die ("got wrong sum");
+
+  printf ("%-9s %9u %12.1f %12.1f %12.1f\n",
+          layout, n, insert_time * 1e9 / n, lookup_time * 1e9 / n,
+          iterate_time * 1e9 / n);
+  type->destruct (type, &tree);
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned max_size = argc > 1 ? (unsigned) atoi (argv[1]) : 10000000;
+  int32_t *keys = dang_new (int32_t, max_size);
+  unsigned default_threshold = dang_tree_btree_threshold;
+  unsigned n, i;
+
+  /* multiplying by an odd number permutes the uint32s */
+  for (i = 0; i < max_size; i++)
+    keys[i] = (int32_t) (i * 2654435761U);
+
+  printf ("%-9s %9s %12s %12s %12s\n",
+          "layout", "size", "insert ns", "lookup ns", "iterate ns");
+  for (n = 1000; n <= max_size; n *= 10)
+    {
+      dang_tree_btree_threshold = UINT_MAX;
+      time_tree ("red-black", keys, n);
+      dang_tree_btree_threshold = default_threshold;
+      time_tree ("b-tree", keys, n);
+    }
+
+  dang_free (keys);
+  return 0;
+}
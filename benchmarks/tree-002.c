@@ -0,0 +1,164 @@
+/* PURPOSE: bulk tree construction and set operations
+ *
+ * Usage: benchmarks/tree-002 [MAX_SIZE [N_THREADS]]
+ *
+ * Builds a tree<int,int> of 1000, 10000, ... MAX_SIZE
+ * (default 10000000) entries by inserting them one by one,
+ * and with dang_constant_tree_new_from_arrays() from sorted
+ * and from scrambled keys (sorted by N_THREADS threads, default one
+ * per cpu), then times the union, intersection and difference
+ * of two such trees.  Prints nanoseconds per entry.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../dang.h"
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct
+{
+  int32_t last_key;
+  int64_t value_sum;
+} CheckInfo;
+
+static void
+check_entry (const void *key,
+             const void *value,
+             void       *func_data)
+{
+  CheckInfo *info = func_data;
+  if (*(const int32_t *) key <= info->last_key)
+    dang_die ("keys out of order");
+  info->last_key = *(const int32_t *) key;
+  info->value_sum += *(const int32_t *) value;
+}
+
+/* the keys must be 0..n-1 in order, as must the values */
+static void
+check_tree (DangValueType    *type,
+            DangConstantTree *tree,
+            unsigned          n)
+{
+  CheckInfo info = { -1, 0 };
+  dang_constant_tree_foreach ((DangValueTypeTree *) type, tree, check_entry, &info);
+  if (tree->size != n || info.last_key != (int32_t) n - 1
+   || info.value_sum != (int64_t) n * (n - 1) / 2)
+    dang_die ("wrong tree contents");
+}
+
+static void
+time_tree (unsigned       n,
+           const int32_t *sorted,
+           const int32_t *scrambled)
+{
+  DangValueType *int_type = dang_value_type_int32 ();
+  DangValueType *type = dang_value_type_tree (int_type, int_type);
+  DangValueType *constant_type = dang_value_type_constant_tree (int_type, int_type);
+  DangValueTypeTree *ttype = (DangValueTypeTree *) type;
+  DangValueIndexInfo *info = type->internals.index_infos;
+  DangTree *tree = dang_new (DangTree, 1);
+  DangConstantTree *from_sorted, *from_scrambled, *first, *rest, *rv;
+  DangError *error = NULL;
+  double insert_time, sorted_time, scrambled_time;
+  double union_time, intersection_time, difference_time;
+  double start;
+  const void *index;
+  unsigned i;
+
+  tree->v = NULL;
+  tree->ref_count = 1;
+  start = now ();
+  for (i = 0; i < n; i++)
+    {
+      index = scrambled + i;
+      if (!info->set (info, &tree, &index, scrambled + i, TRUE, &error))
+        dang_die ("set failed: %s", error->message);
+    }
+  insert_time = now () - start;
+  check_tree (type, tree->v, n);
+  type->destruct (type, &tree);
+
+  start = now ();
+  from_sorted = dang_constant_tree_new_from_arrays (ttype, n, sorted, sorted);
+  sorted_time = now () - start;
+  check_tree (type, from_sorted, n);
+
+  start = now ();
+  from_scrambled = dang_constant_tree_new_from_arrays (ttype, n, scrambled, scrambled);
+  scrambled_time = now () - start;
+  check_tree (type, from_scrambled, n);
+
+  /* set operations on the first and the rest of the scrambled keys */
+  first = dang_constant_tree_new_from_arrays (ttype, n - n / 2, scrambled, scrambled);
+  rest = dang_constant_tree_new_from_arrays (ttype, n / 2, scrambled + (n - n / 2),
+                                             scrambled + (n - n / 2));
+  start = now ();
+  if (!dang_constant_tree_union (ttype, first, rest, &rv, &error))
+    dang_die ("union failed: %s", error->message);
+  union_time = now () - start;
+  if (rv->size != n)
+    dang_die ("wrong union size");
+  constant_type->destruct (constant_type, &rv);
+
+  start = now ();
+  if (!dang_constant_tree_intersection (ttype, from_sorted, first, &rv, &error))
+    dang_die ("intersection failed: %s", error->message);
+  intersection_time = now () - start;
+  if (rv->size != first->size)
+    dang_die ("wrong intersection size");
+  constant_type->destruct (constant_type, &rv);
+
+  start = now ();
+  if (!dang_constant_tree_difference (ttype, from_sorted, first, &rv, &error))
+    dang_die ("difference failed: %s", error->message);
+  difference_time = now () - start;
+  if (rv->size != rest->size)
+    dang_die ("wrong difference size");
+  constant_type->destruct (constant_type, &rv);
+
+  printf ("%9u %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+          n, insert_time * 1e9 / n, sorted_time * 1e9 / n,
+          scrambled_time * 1e9 / n, union_time * 1e9 / n,
+          intersection_time * 1e9 / n, difference_time * 1e9 / n);
+  constant_type->destruct (constant_type, &from_sorted);
+  constant_type->destruct (constant_type, &from_scrambled);
+  constant_type->destruct (constant_type, &first);
+  constant_type->destruct (constant_type, &rest);
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned max_size = argc > 1 ? (unsigned) atoi (argv[1]) : 10000000;
+  int32_t *sorted = dang_new (int32_t, max_size);
+  int32_t *scrambled = dang_new (int32_t, max_size);
+  unsigned n, i;
+
+  if (argc > 2)
+    dang_scheduler_default_n_workers = atoi (argv[2]);
+  printf ("%9s %9s %9s %9s %9s %9s %9s\n",
+          "size", "insert", "sorted", "scrambled",
+          "union", "intersect", "diff");
+  for (n = 1000; n <= max_size; n *= 10)
+    {
+      /* multiplying by a number prime to 10 permutes 0..n-1 */
+      for (i = 0; i < n; i++)
+        {
+          sorted[i] = i;
+          scrambled[i] = (int32_t) (((uint64_t) i * 7919) % n);
+        }
+      time_tree (n, sorted, scrambled);
+    }
+
+  dang_free (sorted);
+  dang_free (scrambled);
+  return 0;
+}
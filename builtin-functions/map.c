@@ -1,14 +1,21 @@
 #include <string.h>
+#include <pthread.h>
 #include "../dang.h"
 #include "../dang-builtin-functions.h"
 #include "../config.h"
 
 #define MAX_MAP_ARGS            32
 
+/* Maps over at least this many elements are split between
+   the workers of the default scheduler, if 'f' is pure. */
+#define MAP_PARALLEL_MIN_SIZE   4096
+#define MAP_CHUNKS_PER_WORKER   4
+
 typedef struct _TensorMapData TensorMapData;
 struct _TensorMapData
 {
   unsigned n_inputs;
+  DangValueType **tensor_types;
   DangValueType **input_types;          /* element types */
   DangValueType *output_type;           /* element type */
   unsigned rank;
@@ -18,6 +25,7 @@ typedef struct _TensorMapRunData TensorMapRunData;
 struct _TensorMapRunData
 {
   unsigned remaining;
+  DangFunction *chunk_function;         /* if running in parallel */
   DangValueType *output_type;           /* element type */
   unsigned output_size;
   DangTensor *constructing;
@@ -33,16 +41,246 @@ static void
 free_tensor_map_data (void *data)
 {
   TensorMapData *md = data;
+  dang_free (md->tensor_types);
   dang_free (md->input_types);
   dang_free (md);
 }
 
+/* --- running a map on several workers ---
+ *
+ * The output is cut into chunks, each filled in by its own dang thread
+ * on the default scheduler; the thread in map() yields until all
+ * of them have finished.  The job is the func_data of the function
+ * the chunk threads run, so it lives as long as that function.
+ */
+typedef struct _MapChunk MapChunk;
+struct _MapChunk
+{
+  unsigned start, end;
+  unsigned n_built;                     /* only touched by the chunk's thread */
+};
+
+typedef struct _MapJob MapJob;
+struct _MapJob
+{
+  DangValueType state_type;             /* must be first */
+  DangFunction *chunk_function;         /* not ref'd */
+  DangFunction *function;
+  unsigned n_inputs;
+  DangValueType **tensor_types;
+  DangTensor **inputs;                  /* each ref'd */
+  unsigned *input_sizes;
+  DangValueType *output_type;           /* element type */
+  unsigned output_size;
+  char *output;                         /* NULL once it has been taken */
+  unsigned n_chunks;
+  MapChunk *chunks;
+
+  /* protected by 'lock' */
+  pthread_mutex_t lock;
+  unsigned n_running;
+  DangThread *waiter;                   /* ref'd */
+  DangError *error;                     /* the first one thrown */
+};
+
+typedef struct _MapChunkState MapChunkState;
+struct _MapChunkState
+{
+  dang_boolean started;
+  char *input_ptrs[1];                  /* really n_inputs */
+};
+
+static void
+map_job_free (void *data)
+{
+  MapJob *job = data;
+  unsigned i;
+  if (job->output != NULL)
+    {
+      for (i = 0; i < job->n_chunks; i++)
+        dang_value_bulk_destruct (job->output_type,
+                                  job->output + job->chunks[i].start * job->output_size,
+                                  job->chunks[i].n_built);
+      dang_free (job->output);
+    }
+  for (i = 0; i < job->n_inputs; i++)
+    dang_tensor_unref (job->tensor_types[i], job->inputs[i]);
+  dang_assert (job->waiter == NULL);
+  if (job->error)
+    dang_error_unref (job->error);
+  pthread_mutex_destroy (&job->lock);
+  dang_function_unref (job->function);
+  dang_free (job->tensor_types);
+  dang_free (job->inputs);
+  dang_free (job->input_sizes);
+  dang_free (job->chunks);
+  dang_free (job);
+}
+
+static void
+map_job_stop_waiting (MapJob *job)
+{
+  DangThread *waiter;
+  pthread_mutex_lock (&job->lock);
+  waiter = job->waiter;
+  job->waiter = NULL;
+  pthread_mutex_unlock (&job->lock);
+  if (waiter)
+    dang_thread_unref (waiter);
+}
+
+static DANG_C_FUNC_DECLARE (do_map_chunk)
+{
+  MapJob *job = func_data;
+  MapChunk *chunk = job->chunks + * (uint32_t *) args[0];
+  MapChunkState *state = state_data;
+  unsigned at, i;
+  DANG_UNUSED (rv_out);
+  DANG_UNUSED (error);
+  if (state->started)
+    {
+      at = chunk->start + chunk->n_built;
+      dang_c_function_end_subcall (thread, job->function, NULL,
+                                   job->output + at * job->output_size);
+      chunk->n_built++;
+    }
+  state->started = TRUE;
+  at = chunk->start + chunk->n_built;
+  if (at == chunk->end)
+    return DANG_C_FUNCTION_SUCCESS;
+  for (i = 0; i < job->n_inputs; i++)
+    state->input_ptrs[i] = (char *) job->inputs[i]->data + at * job->input_sizes[i];
+  return dang_c_function_begin_subcall (thread, job->function,
+                                        (void **) state->input_ptrs);
+}
+
+/* Run on each chunk's thread once it has finished. */
+static void
+handle_chunk_done (DangThread *thread,
+                   void       *data)
+{
+  MapJob *job = data;
+  DangError *error = NULL;
+  DangThread *waiter = NULL;
+
+  if (thread->status == DANG_THREAD_STATUS_THREW)
+    {
+      if (thread->info.threw.type == dang_value_type_error ())
+        error = dang_error_ref (*(DangError**)thread->info.threw.value);
+      else
+        dang_set_error (&error, "unhandled exception in function passed to map");
+    }
+  else if (thread->status == DANG_THREAD_STATUS_CANCELLED)
+    dang_set_error (&error, "map was cancelled");
+
+  pthread_mutex_lock (&job->lock);
+  if (error != NULL && job->error == NULL)
+    {
+      job->error = error;
+      error = NULL;
+    }
+  if (--job->n_running == 0)
+    {
+      waiter = job->waiter;
+      job->waiter = NULL;
+    }
+  pthread_mutex_unlock (&job->lock);
+
+  if (error != NULL)
+    dang_error_unref (error);
+  if (waiter != NULL)
+    {
+      dang_thread_wakeup (waiter);
+      dang_thread_unref (waiter);
+    }
+  dang_function_unref (job->chunk_function);
+}
+
+/* Start the chunk threads; returns the chunk function,
+   which the caller must unref. */
+static DangFunction *
+map_job_start (TensorMapData *md,
+               DangTensor   **inputs,
+               DangFunction  *function,
+               char          *output,
+               unsigned       total_size,
+               unsigned       n_workers)
+{
+  static DangSignature *chunk_sig;
+  DangScheduler *scheduler = dang_scheduler_get_default ();
+  MapJob *job = dang_new0 (MapJob, 1);
+  unsigned i, chunk_size;
+
+  if (chunk_sig == NULL)
+    {
+      DangFunctionParam param;
+      param.dir = DANG_FUNCTION_PARAM_IN;
+      param.type = dang_value_type_uint32 ();
+      param.name = "chunk";
+      chunk_sig = dang_signature_new (NULL, 1, &param);
+    }
+
+  job->state_type.sizeof_instance = DANG_ALIGN (sizeof (MapChunkState)
+                                                + sizeof (char *) * (md->n_inputs - 1),
+                                                DANG_ALIGNOF_POINTER);
+  job->state_type.alignof_instance = DANG_ALIGNOF_POINTER;
+  job->state_type.full_name = "internal-map-chunk-state";
+  job->function = dang_function_ref (function);
+  job->n_inputs = md->n_inputs;
+  job->tensor_types = dang_memdup (md->tensor_types,
+                                   sizeof (DangValueType *) * md->n_inputs);
+  job->inputs = dang_new (DangTensor *, md->n_inputs);
+  job->input_sizes = dang_new (unsigned, md->n_inputs);
+  for (i = 0; i < md->n_inputs; i++)
+    {
+      job->inputs[i] = inputs[i];
+      DANG_REF_COUNT_INC (inputs[i]->ref_count);
+      job->input_sizes[i] = md->input_types[i]->sizeof_instance;
+    }
+  job->output_type = md->output_type;
+  job->output_size = md->output_type->sizeof_instance;
+  job->output = output;
+
+  job->n_chunks = n_workers * MAP_CHUNKS_PER_WORKER;
+  chunk_size = (total_size + job->n_chunks - 1) / job->n_chunks;
+  job->n_chunks = (total_size + chunk_size - 1) / chunk_size;
+  job->chunks = dang_new (MapChunk, job->n_chunks);
+  for (i = 0; i < job->n_chunks; i++)
+    {
+      job->chunks[i].start = i * chunk_size;
+      job->chunks[i].end = DANG_MIN (total_size, (i + 1) * chunk_size);
+      job->chunks[i].n_built = 0;
+    }
+  pthread_mutex_init (&job->lock, NULL);
+  job->n_running = job->n_chunks;
+  job->chunk_function = dang_function_new_c (chunk_sig, &job->state_type,
+                                             do_map_chunk, job, map_job_free);
+
+  for (i = 0; i < job->n_chunks; i++)
+    {
+      uint32_t index = i;
+      void *arg = &index;
+      DangThread *thread = dang_thread_new (job->chunk_function, 1, &arg);
+      dang_function_ref (job->chunk_function);
+      dang_thread_set_wakeup_func (thread, handle_chunk_done, job);
+      dang_scheduler_push (scheduler, thread);
+      dang_thread_unref (thread);
+    }
+  return job->chunk_function;
+}
+
 static void
 destruct__tensor_run_data (DangValueType *type,
                            void *data)
 {
   TensorMapRunData *rd = data;
   DANG_UNUSED (type);
+  if (rd->chunk_function)
+    {
+      map_job_stop_waiting (rd->chunk_function->c.func_data);
+      dang_function_unref (rd->chunk_function);
+      rd->chunk_function = NULL;
+    }
   if (rd->constructing)
     {
       DangValueType *elt_type = rd->output_type;
@@ -81,12 +319,12 @@ DANG_C_FUNC_DECLARE (do_tensor_map)
       dang_set_error (error, "null-pointer exception");
       return DANG_C_FUNCTION_ERROR;
     }
-  if (rd->constructing == NULL)
+  if (rd->chunk_function == NULL && rd->constructing == NULL)
     {
       /* first time */
       unsigned n_inputs = md->n_inputs;
       unsigned total_size = 1;
-      unsigned i, d;
+      unsigned i, d, n_workers;
       DangValueType *elt_type = md->output_type;
       DangTensor **inputs = dang_newa (DangTensor *, n_inputs);
       rd->output_type = elt_type;
@@ -125,14 +363,48 @@ DANG_C_FUNC_DECLARE (do_tensor_map)
       memcpy (rd->constructing->sizes, inputs[0]->sizes, sizeof(unsigned) * md->rank);
       rd->constructing->ref_count = 1;
       rd->constructing->data = rd->output_data_ptr;
+
+      if (total_size >= MAP_PARALLEL_MIN_SIZE
+       && dang_function_is_pure (f)
+       && (n_workers = dang_scheduler_get_n_workers (dang_scheduler_get_default ())) > 1)
+        {
+          /* the job owns the output until every chunk is done */
+          rd->chunk_function = map_job_start (md, inputs, f, rd->output_data_ptr,
+                                              total_size, n_workers);
+          rd->constructing->data = NULL;
+          rd->start_output_data_ptr = rd->output_data_ptr = NULL;
+        }
     }
-  else
+  else if (rd->chunk_function == NULL)
     {
       /* copy old value in */
       dang_c_function_end_subcall (thread, f, NULL, rd->output_data_ptr);
       run_data_advance (md, rd);
     }
 
+  if (rd->chunk_function != NULL)
+    {
+      MapJob *job = rd->chunk_function->c.func_data;
+      pthread_mutex_lock (&job->lock);
+      if (job->n_running > 0)
+        {
+          /* handle_chunk_done() wakes us */
+          if (job->waiter == NULL)
+            job->waiter = dang_thread_ref (thread);
+          pthread_mutex_unlock (&job->lock);
+          return DANG_C_FUNCTION_YIELDED;
+        }
+      pthread_mutex_unlock (&job->lock);
+      if (job->error != NULL)
+        {
+          *error = dang_error_ref (job->error);
+          return DANG_C_FUNCTION_ERROR;
+        }
+      rd->constructing->data = job->output;
+      job->output = NULL;
+      rd->remaining = 0;
+    }
+
   if (rd->remaining > 0)
     {
       /* setup input args */
@@ -164,6 +436,7 @@ DangFunction *dang_builtin_function_map_tensors (unsigned n_tensor_args,
 
   tensor_map_data = dang_new (TensorMapData, 1);
   tensor_map_data->n_inputs = n_tensor_args;
+  tensor_map_data->tensor_types = dang_memdup (tensor_types, sizeof (DangValueType *) * n_tensor_args);
   tensor_map_data->input_types = dang_new (DangValueType *, tensor_map_data->n_inputs);
   for (i = 0; i < tensor_map_data->n_inputs; i++)
     {
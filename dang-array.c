@@ -38,7 +38,7 @@ array_init_assign (DangValueType *type,
   DANG_UNUSED (type);
   * (DangArray **) dst = arr;
   if (arr)
-    arr->ref_count += 1;
+    DANG_REF_COUNT_INC (arr->ref_count);
 }
 
 static void
@@ -49,10 +49,10 @@ array_assign      (DangValueType *type,
   DangArray *arr = * (DangArray **) src;
   DangArray *orig = * (DangArray **) dst;
   if (arr)
-    arr->ref_count += 1;
+    DANG_REF_COUNT_INC (arr->ref_count);
   if (orig)
     {
-      if (--(orig->ref_count) == 0)
+      if (DANG_REF_COUNT_DEC (orig->ref_count) == 0)
         {
           DangValueTypeArray *atype = (DangValueTypeArray *) type;
           dang_tensor_unref (atype->tensor_type, orig->tensor);
@@ -66,7 +66,7 @@ array_destruct (DangValueType *type,
                 void          *to_destruct)
 {
   DangArray *arr = * (DangArray **) to_destruct;
-  if (arr && --(arr->ref_count) == 0)
+  if (arr && DANG_REF_COUNT_DEC (arr->ref_count) == 0)
     {
       DangValueTypeArray *atype = (DangValueTypeArray *) type;
       dang_tensor_unref (atype->tensor_type, arr->tensor);
@@ -249,7 +249,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE (do_vector_append_element)
           new_vec->len = vec->len;
           new_vec->data = dang_malloc (elt_type->sizeof_instance * new_len);
           dang_value_bulk_copy (atype->element_type, new_vec->data, vec->data, vec->len);
-          vec->ref_count--;
+          DANG_REF_COUNT_DEC (vec->ref_count);
           vec = new_vec;
           array->tensor = (DangTensor *) new_vec;
         }
@@ -305,7 +305,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE (do_vector_append_vector)
           new_dst->len = dst->len;
           new_dst->data = dang_malloc (elt_type->sizeof_instance * new_len);
           dang_value_bulk_copy (atype->element_type, new_dst->data, dst->data, dst->len);
-          dst->ref_count--;
+          DANG_REF_COUNT_DEC (dst->ref_count);
           dst = new_dst;
           array->tensor = (DangTensor *) new_dst;
         }
@@ -353,7 +353,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE (do_tensor_append_tensor)
   if (a == NULL)
     {
       array->tensor = b;
-      b->ref_count++;
+      DANG_REF_COUNT_INC (b->ref_count);
       return TRUE;
     }
   for (i = 1; i < rank; i++)
@@ -386,7 +386,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE (do_tensor_append_tensor)
           memcpy (new_a->sizes, a->sizes, sizeof (unsigned) * atype->rank);
           new_a->data = dang_malloc (elt_type->sizeof_instance * minor_count * new_len);
           dang_value_bulk_copy (elt_type, new_a->data, a->data, minor_count * a->sizes[0]);
-          a->ref_count--;
+          DANG_REF_COUNT_DEC (a->ref_count);
           a = new_a;
           array->tensor = new_a;
         }
@@ -430,7 +430,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE (do_tensor_append_subtensor)
   if (a == NULL)
     {
       array->tensor = b;
-      b->ref_count++;
+      DANG_REF_COUNT_INC (b->ref_count);
       return TRUE;
     }
 
@@ -462,7 +462,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE (do_tensor_append_subtensor)
           memcpy (new_a->sizes, a->sizes, sizeof (unsigned) * rank);
           new_a->data = dang_malloc (elt_type->sizeof_instance * minor_count * new_len);
           dang_value_bulk_copy (elt_type, new_a->data, a->data, minor_count * a->sizes[0]);
-          a->ref_count--;
+          DANG_REF_COUNT_DEC (a->ref_count);
           a = new_a;
           array->tensor = new_a;
         }
@@ -562,7 +562,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE (cast_from_array_to_tensor)
   else
     {
       DangTensor *t = array->tensor;
-      ++(t->ref_count);
+      DANG_REF_COUNT_INC (t->ref_count);
       * (DangTensor **) rv_out = t;
     }
   return TRUE;
@@ -574,7 +574,7 @@ DANG_SIMPLE_C_FUNC_DECLARE (dang_internal_cast_from_tensor_to_array)
   DANG_UNUSED (func_data);
   DANG_UNUSED (error);
   if (t != NULL)
-    t->ref_count++;
+    DANG_REF_COUNT_INC (t->ref_count);
   array = dang_new (DangArray, 1);
   array->ref_count = 1;
   array->tensor = t;
@@ -679,7 +679,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE (array_resize)
     {
       /* create a new tensor */
       DangTensor *old_tensor = array->tensor;
-      array->tensor->ref_count -= 1;
+      DANG_REF_COUNT_DEC (array->tensor->ref_count);
 
       array->tensor = (DangTensor *) dang_new (DangVector, 1);
       array->tensor->ref_count = 1;
@@ -81,13 +81,10 @@ struct _DangBuilderCatchClause
 };
 struct _DangBuilderCatchBlock
 {
-  /* You may assume that 'start' adds the catch block
-     and 'end' removes the catch block, once
-     the end has been set (it's DANG_CODE_OFFSET_INVALID until then).
-     Therefore, there should never be throw stmt that jumps
-     FROM one of these.  If jumping INTO a catch block
-     and DangStepNum IP, then the block must be added
-     if start < IP <= end. */
+  /* The "try" body is the instructions [start, end);
+     end is DANG_STEP_NUM_INVALID until it has been set.
+     No instructions enter or leave the block:  when something throws,
+     the thread looks up the frame's ip in the function's catch blocks. */
   DangStepNum start, end;
 
   size_t n_clauses;
@@ -285,6 +282,21 @@ void          dang_builder_query_vars   (DangBuilder *,
 
 
 
+/* Optimization passes, run by dang_builder_compile() */
+#define DANG_BUILDER_OPTIMIZE_FUSE      (1<<0)  /* superinstructions */
+#define DANG_BUILDER_OPTIMIZE_FOLD      (1<<1)  /* constant folding and propagation */
+#define DANG_BUILDER_OPTIMIZE_DEAD_CODE (1<<2)  /* unreachable code and dead stores */
+#define DANG_BUILDER_OPTIMIZE_TAIL_CALLS (1<<3) /* self-calls reuse the frame */
+#define DANG_BUILDER_OPTIMIZE_TENSOR_EXPRS (1<<4) /* fused element-wise tensor ops */
+#define DANG_BUILDER_OPTIMIZE_DEFAULT   (DANG_BUILDER_OPTIMIZE_FUSE       \
+                                       | DANG_BUILDER_OPTIMIZE_FOLD       \
+                                       | DANG_BUILDER_OPTIMIZE_DEAD_CODE  \
+                                       | DANG_BUILDER_OPTIMIZE_TAIL_CALLS \
+                                       | DANG_BUILDER_OPTIMIZE_TENSOR_EXPRS)
+extern unsigned dang_builder_optimize_flags;
+unsigned      dang_builder_optimize_level_flags (unsigned level);
+void          dang_builder_optimize     (DangBuilder      *builder);
+
 /* Convert the builder into a function */
 dang_boolean  dang_builder_compile      (DangBuilder      *builder,
                                          DangError          **error);
@@ -0,0 +1,545 @@
+#include <string.h>
+#include <pthread.h>
+#include "dang.h"
+#include "magic.h"
+#include "config.h"
+#include "gskrbtreemacros.h"
+
+struct _DangChannel
+{
+  unsigned ref_count;
+  DangValueType *element_type;
+
+  /* everything below is protected by 'lock' */
+  pthread_mutex_t lock;
+  unsigned capacity;
+  unsigned first, n_elements;           /* a ring buffer */
+  char *elements;
+  dang_boolean closed;
+  DangUtilArray senders;                /* of DangThread*, each ref'd */
+  DangUtilArray receivers;              /* of DangThread*, each ref'd */
+};
+
+DangChannel *
+dang_channel_new   (DangValueType *element_type,
+                    unsigned       capacity)
+{
+  DangChannel *channel = dang_new (DangChannel, 1);
+  dang_assert (capacity > 0);
+  channel->ref_count = 1;
+  channel->element_type = element_type;
+  pthread_mutex_init (&channel->lock, NULL);
+  channel->capacity = capacity;
+  channel->first = 0;
+  channel->n_elements = 0;
+  channel->elements = dang_malloc (capacity * element_type->sizeof_instance);
+  channel->closed = FALSE;
+  DANG_UTIL_ARRAY_INIT (&channel->senders, DangThread *);
+  DANG_UTIL_ARRAY_INIT (&channel->receivers, DangThread *);
+  return channel;
+}
+
+DangChannel *
+dang_channel_ref   (DangChannel   *channel)
+{
+  DANG_REF_COUNT_INC (channel->ref_count);
+  return channel;
+}
+
+void
+dang_channel_unref (DangChannel   *channel)
+{
+  DangValueType *type = channel->element_type;
+  if (DANG_REF_COUNT_DEC (channel->ref_count) > 0)
+    return;
+
+  /* waiting threads hold a reference to the channel */
+  dang_assert (channel->senders.len == 0);
+  dang_assert (channel->receivers.len == 0);
+  if (type->destruct != NULL)
+    {
+      unsigned i;
+      for (i = 0; i < channel->n_elements; i++)
+        {
+          unsigned at = (channel->first + i) % channel->capacity;
+          type->destruct (type, channel->elements + at * type->sizeof_instance);
+        }
+    }
+  dang_free (channel->elements);
+  dang_util_array_clear (&channel->senders);
+  dang_util_array_clear (&channel->receivers);
+  pthread_mutex_destroy (&channel->lock);
+  dang_free (channel);
+}
+
+/* Remove and return the first waiter in 'list', or NULL. */
+static DangThread *
+pop_waiter (DangUtilArray *list)
+{
+  DangThread *rv;
+  if (list->len == 0)
+    return NULL;
+  rv = ((DangThread **) list->data)[0];
+  dang_util_array_remove (list, 0, 1);
+  return rv;
+}
+
+static dang_boolean
+remove_waiter (DangUtilArray *list,
+               DangThread    *thread)
+{
+  DangThread **waiters = list->data;
+  unsigned i;
+  for (i = 0; i < list->len; i++)
+    if (waiters[i] == thread)
+      {
+        dang_util_array_remove (list, i, 1);
+        dang_thread_unref (thread);
+        return TRUE;
+      }
+  return FALSE;
+}
+
+static void
+wake_and_unref (DangThread *thread)
+{
+  if (thread != NULL)
+    {
+      dang_thread_wakeup (thread);
+      dang_thread_unref (thread);
+    }
+}
+
+void
+dang_channel_close (DangChannel   *channel)
+{
+  DangThread **waiters;
+  unsigned i, n_senders, n_waiters;
+  pthread_mutex_lock (&channel->lock);
+  channel->closed = TRUE;
+  n_senders = channel->senders.len;
+  n_waiters = n_senders + channel->receivers.len;
+  waiters = dang_new (DangThread *, n_waiters);
+  memcpy (waiters, channel->senders.data, n_senders * sizeof (DangThread *));
+  memcpy (waiters + n_senders, channel->receivers.data,
+          (n_waiters - n_senders) * sizeof (DangThread *));
+  dang_util_array_set_size (&channel->senders, 0);
+  dang_util_array_set_size (&channel->receivers, 0);
+  pthread_mutex_unlock (&channel->lock);
+
+  for (i = 0; i < n_waiters; i++)
+    wake_and_unref (waiters[i]);
+  dang_free (waiters);
+}
+
+unsigned
+dang_channel_get_capacity (DangChannel *channel)
+{
+  return channel->capacity;
+}
+
+/* The thread was cancelled while waiting. */
+static void
+wait_cancelled (void *data)
+{
+  DangChannelWait *wait = data;
+  DangChannel *channel = wait->channel;
+  DangUtilArray *list;
+  DangThread *next = NULL;
+  if (channel == NULL)
+    return;
+  list = wait->sending ? &channel->senders : &channel->receivers;
+  pthread_mutex_lock (&channel->lock);
+  if (!remove_waiter (list, wait->thread))
+    {
+      /* we were woken up already: pass it on */
+      next = pop_waiter (list);
+    }
+  pthread_mutex_unlock (&channel->lock);
+  wake_and_unref (next);
+  wait->channel = NULL;
+  dang_channel_unref (channel);
+}
+
+void
+dang_channel_wait_clear (DangChannelWait *wait)
+{
+  DangChannel *channel = wait->channel;
+  if (channel == NULL)
+    return;
+  pthread_mutex_lock (&channel->lock);
+  remove_waiter (wait->sending ? &channel->senders : &channel->receivers,
+                 wait->thread);
+  pthread_mutex_unlock (&channel->lock);
+  wait->channel = NULL;
+  dang_channel_unref (channel);
+}
+
+/* Must be called with the channel's lock held. */
+static void
+wait_begin (DangChannelWait *wait,
+            DangChannel     *channel,
+            DangThread      *thread,
+            dang_boolean     sending)
+{
+  dang_thread_ref (thread);
+  dang_util_array_append (sending ? &channel->senders : &channel->receivers,
+                          1, &thread);
+  wait->channel = dang_channel_ref (channel);
+  wait->thread = thread;
+  wait->sending = sending;
+  thread->info.yield.yield_cancel_func = wait_cancelled;
+  thread->info.yield.yield_cancel_func_data = wait;
+}
+
+DangChannelResult
+dang_channel_send (DangChannel     *channel,
+                   const void      *value,
+                   DangThread      *thread,
+                   DangChannelWait *wait)
+{
+  DangValueType *type = channel->element_type;
+  DangThread *receiver;
+  void *slot;
+
+  /* after a wakeup (or a spurious one) we may still be queued */
+  dang_channel_wait_clear (wait);
+
+  pthread_mutex_lock (&channel->lock);
+  if (channel->closed)
+    {
+      pthread_mutex_unlock (&channel->lock);
+      return DANG_CHANNEL_CLOSED;
+    }
+  if (channel->n_elements == channel->capacity)
+    {
+      wait_begin (wait, channel, thread, TRUE);
+      pthread_mutex_unlock (&channel->lock);
+      return DANG_CHANNEL_WOULD_BLOCK;
+    }
+  slot = channel->elements
+       + ((channel->first + channel->n_elements) % channel->capacity)
+         * type->sizeof_instance;
+  if (type->init_assign)
+    type->init_assign (type, slot, value);
+  else
+    memcpy (slot, value, type->sizeof_instance);
+  channel->n_elements++;
+  receiver = pop_waiter (&channel->receivers);
+  pthread_mutex_unlock (&channel->lock);
+
+  wake_and_unref (receiver);
+  return DANG_CHANNEL_OK;
+}
+
+DangChannelResult
+dang_channel_recv (DangChannel     *channel,
+                   void            *value_out,
+                   DangThread      *thread,
+                   DangChannelWait *wait)
+{
+  DangValueType *type = channel->element_type;
+  DangThread *sender;
+
+  dang_channel_wait_clear (wait);
+
+  pthread_mutex_lock (&channel->lock);
+  if (channel->n_elements == 0)
+    {
+      if (channel->closed)
+        {
+          pthread_mutex_unlock (&channel->lock);
+          return DANG_CHANNEL_CLOSED;
+        }
+      wait_begin (wait, channel, thread, FALSE);
+      pthread_mutex_unlock (&channel->lock);
+      return DANG_CHANNEL_WOULD_BLOCK;
+    }
+  memcpy (value_out,
+          channel->elements + channel->first * type->sizeof_instance,
+          type->sizeof_instance);
+  channel->first = (channel->first + 1) % channel->capacity;
+  channel->n_elements--;
+  sender = pop_waiter (&channel->senders);
+  pthread_mutex_unlock (&channel->lock);
+
+  wake_and_unref (sender);
+  return DANG_CHANNEL_OK;
+}
+
+/* --- the channel<T> type --- */
+static DangValueTypeChannel *channel_type_tree;
+#define GET_IS_RED(fi)  (fi)->is_red
+#define SET_IS_RED(fi,v)  (fi)->is_red = v
+#define COMPARE_CHANNEL_TREE_NODES(a,b,rv) \
+  if(a->element_type < b->element_type) rv = -1; \
+  else if(a->element_type > b->element_type) rv = 1; \
+  else rv = 0;
+#define GET_CHANNEL_TREE() \
+  channel_type_tree, DangValueTypeChannel *, GET_IS_RED, SET_IS_RED, \
+  parent, left, right, COMPARE_CHANNEL_TREE_NODES
+
+static void
+channel_init_assign (DangValueType *type,
+                     void          *dst,
+                     const void    *src)
+{
+  DangChannel *channel = * (DangChannel **) src;
+  DANG_UNUSED (type);
+  * (DangChannel **) dst = channel ? dang_channel_ref (channel) : NULL;
+}
+
+static void
+channel_assign      (DangValueType *type,
+                     void          *dst,
+                     const void    *src)
+{
+  DangChannel *channel = * (DangChannel **) src;
+  DangChannel *orig = * (DangChannel **) dst;
+  DANG_UNUSED (type);
+  if (channel)
+    dang_channel_ref (channel);
+  if (orig)
+    dang_channel_unref (orig);
+  * (DangChannel **) dst = channel;
+}
+
+static void
+channel_destruct (DangValueType *type,
+                  void          *to_destruct)
+{
+  DangChannel *channel = * (DangChannel **) to_destruct;
+  DANG_UNUSED (type);
+  if (channel)
+    dang_channel_unref (channel);
+}
+
+static char *
+channel_to_string (DangValueType *type,
+                   const void    *data)
+{
+  DangChannel *channel = * (DangChannel **) data;
+  unsigned n_elements, capacity;
+  dang_boolean closed;
+  DANG_UNUSED (type);
+  if (channel == NULL)
+    return dang_strdup ("(null)");
+  pthread_mutex_lock (&channel->lock);
+  n_elements = channel->n_elements;
+  capacity = channel->capacity;
+  closed = channel->closed;
+  pthread_mutex_unlock (&channel->lock);
+  return dang_strdup_printf ("channel(%u/%u%s)", n_elements, capacity,
+                             closed ? ", closed" : "");
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (do_channel_new)
+{
+  int32_t capacity = * (int32_t *) args[0];
+  DangValueTypeChannel *ctype = func_data;
+  if (capacity <= 0)
+    {
+      dang_set_error (error, "channel capacity must be positive (got %d)",
+                      (int) capacity);
+      return FALSE;
+    }
+  * (DangChannel **) rv_out = dang_channel_new (ctype->element_type, capacity);
+  return TRUE;
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (do_channel_close)
+{
+  DangChannel *channel = * (DangChannel **) args[0];
+  DANG_UNUSED (rv_out);
+  DANG_UNUSED (func_data);
+  if (channel == NULL)
+    {
+      dang_set_error (error, "null-pointer exception");
+      return FALSE;
+    }
+  dang_channel_close (channel);
+  return TRUE;
+}
+
+static DangValueType channel_wait_state_type;
+
+static void
+destruct__channel_wait_state (DangValueType *type,
+                              void          *value)
+{
+  DANG_UNUSED (type);
+  dang_channel_wait_clear (value);
+}
+
+static DANG_C_FUNC_DECLARE (do_channel_send)
+{
+  DangChannel *channel = * (DangChannel **) args[0];
+  DANG_UNUSED (rv_out);
+  DANG_UNUSED (func_data);
+  if (channel == NULL)
+    {
+      dang_set_error (error, "null-pointer exception");
+      return DANG_C_FUNCTION_ERROR;
+    }
+  switch (dang_channel_send (channel, args[1], thread, state_data))
+    {
+    case DANG_CHANNEL_OK:
+      return DANG_C_FUNCTION_SUCCESS;
+    case DANG_CHANNEL_WOULD_BLOCK:
+      return DANG_C_FUNCTION_YIELDED;
+    case DANG_CHANNEL_CLOSED:
+    default:
+      dang_set_error (error, "send on closed channel");
+      return DANG_C_FUNCTION_ERROR;
+    }
+}
+
+static DANG_C_FUNC_DECLARE (do_channel_recv)
+{
+  DangChannel *channel = * (DangChannel **) args[0];
+  DangValueTypeChannel *ctype = func_data;
+  DangValueType *etype = ctype->element_type;
+  if (channel == NULL)
+    {
+      dang_set_error (error, "null-pointer exception");
+      return DANG_C_FUNCTION_ERROR;
+    }
+
+  /* the out-param arrives holding a copy of the caller's variable */
+  if (etype->destruct != NULL)
+    {
+      etype->destruct (etype, args[1]);
+      memset (args[1], 0, etype->sizeof_instance);
+    }
+  switch (dang_channel_recv (channel, args[1], thread, state_data))
+    {
+    case DANG_CHANNEL_OK:
+      * (char *) rv_out = 1;
+      return DANG_C_FUNCTION_SUCCESS;
+    case DANG_CHANNEL_WOULD_BLOCK:
+      return DANG_C_FUNCTION_YIELDED;
+    case DANG_CHANNEL_CLOSED:
+    default:
+      * (char *) rv_out = 0;
+      return DANG_C_FUNCTION_SUCCESS;
+    }
+}
+
+static void
+add_channel_method (DangValueTypeChannel *ctype,
+                    const char           *name,
+                    DangFunction         *func)
+{
+  dang_value_type_add_constant_method ((DangValueType *) ctype, name,
+                                       DANG_METHOD_PUBLIC|DANG_METHOD_FINAL,
+                                       func);
+  dang_function_unref (func);
+}
+
+static void
+add_channel_methods (DangValueTypeChannel *ctype)
+{
+  DangFunctionParam params[2];
+  DangSignature *sig;
+  DangFunction *func;
+
+  if (channel_wait_state_type.sizeof_instance == 0)
+    {
+      channel_wait_state_type.sizeof_instance = sizeof (DangChannelWait);
+      channel_wait_state_type.alignof_instance = DANG_ALIGNOF_POINTER;
+      channel_wait_state_type.destruct = destruct__channel_wait_state;
+      channel_wait_state_type.full_name = "internal-channel-wait-state";
+    }
+
+  /* new channel<T>(int capacity) */
+  params[0].dir = DANG_FUNCTION_PARAM_IN;
+  params[0].name = "capacity";
+  params[0].type = dang_value_type_int32 ();
+  sig = dang_signature_new ((DangValueType *) ctype, 1, params);
+  func = dang_function_new_simple_c (sig, do_channel_new, ctype, NULL);
+  dang_value_type_add_ctor ((DangValueType *) ctype, NULL, func);
+  dang_function_unref (func);
+  dang_signature_unref (sig);
+
+  params[0].dir = DANG_FUNCTION_PARAM_IN;
+  params[0].name = "this";
+  params[0].type = (DangValueType *) ctype;
+
+  sig = dang_signature_new (NULL, 1, params);
+  add_channel_method (ctype, "close",
+                      dang_function_new_simple_c (sig, do_channel_close,
+                                                  ctype, NULL));
+  dang_signature_unref (sig);
+
+  params[1].dir = DANG_FUNCTION_PARAM_IN;
+  params[1].name = "value";
+  params[1].type = ctype->element_type;
+  sig = dang_signature_new (NULL, 2, params);
+  add_channel_method (ctype, "send",
+                      dang_function_new_c (sig, &channel_wait_state_type,
+                                           do_channel_send, ctype, NULL));
+  dang_signature_unref (sig);
+
+  params[1].dir = DANG_FUNCTION_PARAM_OUT;
+  sig = dang_signature_new (dang_value_type_boolean (), 2, params);
+  add_channel_method (ctype, "recv",
+                      dang_function_new_c (sig, &channel_wait_state_type,
+                                           do_channel_recv, ctype, NULL));
+  dang_signature_unref (sig);
+}
+
+DangValueType *
+dang_value_type_channel (DangValueType *element_type)
+{
+  DangValueTypeChannel dummy, *out, *conflict = NULL;
+  dummy.element_type = element_type;
+  GSK_RBTREE_LOOKUP (GET_CHANNEL_TREE (), &dummy, out);
+  if (out != NULL)
+    return (DangValueType *) out;
+
+  out = dang_new0 (DangValueTypeChannel, 1);
+  out->base_type.magic = DANG_VALUE_TYPE_MAGIC;
+  out->base_type.ref_count = 0;
+  out->base_type.full_name = dang_strdup_printf ("channel<%s>", element_type->full_name);
+  out->base_type.sizeof_instance = DANG_SIZEOF_POINTER;
+  out->base_type.alignof_instance = DANG_ALIGNOF_POINTER;
+  out->base_type.init_assign = channel_init_assign;
+  out->base_type.assign = channel_assign;
+  out->base_type.destruct = channel_destruct;
+  out->base_type.to_string = channel_to_string;
+  out->base_type.internals.is_templated = element_type->internals.is_templated;
+  out->element_type = element_type;
+  GSK_RBTREE_INSERT (GET_CHANNEL_TREE (), out, conflict);
+  dang_assert (conflict == NULL);
+
+  if (!element_type->internals.is_templated)
+    add_channel_methods (out);
+  return (DangValueType *) out;
+}
+
+dang_boolean
+dang_value_type_is_channel (DangValueType *type)
+{
+  return type->assign == channel_assign;
+}
+
+static void
+free_channel_tree_recursive (DangValueTypeChannel *t)
+{
+  dang_value_type_cleanup (&t->base_type);
+  if (t->left)
+    free_channel_tree_recursive (t->left);
+  if (t->right)
+    free_channel_tree_recursive (t->right);
+  dang_free (t->base_type.full_name);
+  dang_free (t);
+}
+
+void
+_dang_channel_cleanup (void)
+{
+  DangValueTypeChannel *old_tree = channel_type_tree;
+  channel_type_tree = NULL;
+  if (old_tree)
+    free_channel_tree_recursive (old_tree);
+}
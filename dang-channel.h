@@ -0,0 +1,64 @@
+/* --- channel<T>: a bounded queue between dang threads ---
+ *
+ * 'new channel<T>(capacity)' makes a channel that holds up to
+ * 'capacity' values.  c.send(v) yields the calling thread while
+ * the channel is full; c.recv(&v) yields while it is empty, and
+ * returns false once the channel has been closed and drained.
+ * c.close() ends the stream: later sends throw.
+ */
+
+typedef struct _DangChannel DangChannel;
+
+typedef struct _DangValueTypeChannel DangValueTypeChannel;
+struct _DangValueTypeChannel
+{
+  DangValueType base_type;
+  DangValueType *element_type;
+
+  DangValueTypeChannel *left, *right, *parent;
+  dang_boolean is_red;
+};
+
+DangValueType *dang_value_type_channel    (DangValueType *element_type);
+dang_boolean   dang_value_type_is_channel (DangValueType *type);
+
+DangChannel   *dang_channel_new   (DangValueType *element_type,
+                                   unsigned       capacity);
+DangChannel   *dang_channel_ref   (DangChannel   *channel);
+void           dang_channel_unref (DangChannel   *channel);
+void           dang_channel_close (DangChannel   *channel);
+unsigned       dang_channel_get_capacity (DangChannel *channel);
+
+/* For C functions that send or receive.  A DangChannelWait
+   must live in the function's state (zeroed on the first call),
+   and the state's destructor must call dang_channel_wait_clear().
+
+   If the operation would block, the thread is queued on the channel
+   and the function should return DANG_C_FUNCTION_YIELDED,
+   then try again when it is called next. */
+typedef struct _DangChannelWait DangChannelWait;
+struct _DangChannelWait
+{
+  DangChannel *channel;                 /* if queued */
+  DangThread *thread;
+  dang_boolean sending;
+};
+
+typedef enum
+{
+  DANG_CHANNEL_OK,
+  DANG_CHANNEL_WOULD_BLOCK,
+  DANG_CHANNEL_CLOSED
+} DangChannelResult;
+
+/* send() copies 'value'; recv() moves a value into
+   uninitialized memory at 'value_out'. */
+DangChannelResult dang_channel_send (DangChannel     *channel,
+                                     const void      *value,
+                                     DangThread      *thread,
+                                     DangChannelWait *wait);
+DangChannelResult dang_channel_recv (DangChannel     *channel,
+                                     void            *value_out,
+                                     DangThread      *thread,
+                                     DangChannelWait *wait);
+void              dang_channel_wait_clear (DangChannelWait *wait);
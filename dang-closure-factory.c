@@ -202,7 +202,7 @@ dang_closure_factory_new  (DangSignature *underlying_sig,
  */
 DangClosureFactory *dang_closure_factory_ref  (DangClosureFactory*factory)
 {
-  ++(factory->ref_count);
+  DANG_REF_COUNT_INC (factory->ref_count);
   return factory;
 }
 
@@ -214,7 +214,7 @@ DangClosureFactory *dang_closure_factory_ref  (DangClosureFactory*factory)
  */
 void                dang_closure_factory_unref(DangClosureFactory*factory)
 {
-  if (--(factory->ref_count) == 0)
+  if (DANG_REF_COUNT_DEC (factory->ref_count) == 0)
     {
       dang_free (factory->pieces);
       dang_free (factory->zero_regions);
@@ -266,7 +266,7 @@ step__closure_invoke  (void                 *step_data,
   /* Allocate the new blank frame and push it on the stack. */
   dang_assert (closure->underlying->type != DANG_FUNCTION_TYPE_STUB);
   dang_assert (closure->underlying->base.frame_size >= sizeof (DangThreadStackFrame));
-  called = dang_malloc (closure->underlying->base.frame_size);
+  called = dang_thread_alloc_frame (thread, closure->underlying->base.frame_size);
   *pcalled = called;
   called->function = closure->underlying;
   called->ip = closure->underlying->base.steps;
@@ -327,7 +327,7 @@ step__closure_finish  (void                 *step_data,
     if (factory->pieces[i].type == CLOSURE_PIECE_VIRTUAL)
       factory->pieces[i].info.virt->destruct (factory->pieces[i].info.virt,
                                          (char*)called + factory->pieces[i].callee_offset);
-  dang_free (called);
+  dang_thread_free_frame (thread, called);
 
 
   /* return to caller */
@@ -368,8 +368,10 @@ dang_function_new_closure (DangClosureFactory *factory,
 
   func->closure.steps[0].func = step__closure_invoke;
   func->closure.steps[0]._step_data_size = 0;
+  func->closure.steps[0].flags = 0;
   func->closure.steps[1].func = step__closure_finish;
   func->closure.steps[1]._step_data_size = 0;
+  func->closure.steps[1].flags = 0;
   func->base.stack_info->first_step = func->closure.steps + 0;
   func->base.stack_info->last_step = func->closure.steps + 1;
 
@@ -215,6 +215,24 @@ void dang_compile_literal_function_invocation
                                         unsigned             n_params,
                                         DangCompileResult   *params);
 
+/* compile a chain of element-wise tensor operators as one call;
+   FALSE if 'expr' is not such a chain. */
+dang_boolean dang_compile_fused_tensor_expr
+                                       (DangExpr            *expr,
+                                        DangBuilder         *builder,
+                                        DangCompileFlags    *flags,
+                                        DangCompileResult   *result);
+
+/* call a virtual method of the object in params[0],
+   through an inline cache of recently seen classes. */
+void dang_compile_virtual_method_invocation
+                                       (DangSignature       *sig,
+                                        unsigned             class_offset,
+                                        DangBuilder *builder,
+                                        DangCompileResult   *return_value_info,
+                                        unsigned             n_params,
+                                        DangCompileResult   *params);
+
 /* Create a new function from an underlying function,
    by partial application at the end.
    In other words, given a function f: A,B,C,D -> E
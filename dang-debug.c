@@ -7,6 +7,8 @@
 #ifdef DANG_DEBUG
 dang_boolean dang_debug_parse = FALSE;
 dang_boolean dang_debug_disassemble = FALSE;
+dang_boolean dang_debug_frame_sizes = FALSE;
+dang_boolean dang_debug_method_caches = FALSE;
 
 
 
@@ -118,8 +120,72 @@ static void free_simple_c_func_info_recursive (SimpleCFuncInfo *rfi)
     free_simple_c_func_info_recursive (rfi->right);
   dang_free (rfi);
 }
+static unsigned n_frame_sizes = 0;
+static unsigned long total_frame_size = 0;
+static unsigned long total_unshared_frame_size = 0;
+
+void
+dang_debug_note_frame_size (unsigned frame_size,
+                            unsigned unshared_frame_size)
+{
+  n_frame_sizes++;
+  total_frame_size += frame_size;
+  total_unshared_frame_size += unshared_frame_size;
+}
+
+static void
+print_frame_size_summary (void)
+{
+  if (n_frame_sizes == 0)
+    return;
+  fprintf (stderr,
+           "frame-sizes: %u functions: %lu bytes; %lu bytes without slot sharing (%.1f%% smaller)\n",
+           n_frame_sizes, total_frame_size, total_unshared_frame_size,
+           100.0 * (1.0 - (double) total_frame_size / total_unshared_frame_size));
+}
+
+static unsigned n_method_caches = 0;
+static unsigned n_megamorphic_method_caches = 0;
+static unsigned long total_method_cache_hits = 0;
+static unsigned long total_method_cache_misses = 0;
+
+void
+dang_debug_note_method_cache (DangCodePosition *cp,
+                              unsigned          n_classes,
+                              unsigned long     n_hits,
+                              unsigned long     n_misses)
+{
+  if (n_hits + n_misses == 0)
+    return;
+  /* once the cache is full, every new class is a miss */
+  if (n_misses > n_classes)
+    n_megamorphic_method_caches++;
+  n_method_caches++;
+  total_method_cache_hits += n_hits;
+  total_method_cache_misses += n_misses;
+  fprintf (stderr, "method-cache: "DANG_CP_FORMAT": %u classes: %lu hits, %lu misses\n",
+           DANG_CP_ARGS (*cp), n_classes, n_hits, n_misses);
+}
+
+static void
+print_method_cache_summary (void)
+{
+  unsigned long total = total_method_cache_hits + total_method_cache_misses;
+  if (n_method_caches == 0)
+    return;
+  fprintf (stderr,
+           "method-caches: %u call sites (%u megamorphic): %lu hits, %lu misses (%.1f%% hit rate)\n",
+           n_method_caches, n_megamorphic_method_caches,
+           total_method_cache_hits, total_method_cache_misses,
+           100.0 * total_method_cache_hits / total);
+}
+
 void _dang_debug_cleanup ()
 {
+  if (dang_debug_frame_sizes)
+    print_frame_size_summary ();
+  if (dang_debug_method_caches)
+    print_method_cache_summary ();
   //free_run_func_info_recursive (run_func_info_tree);
   free_simple_c_func_info_recursive (simple_c_func_info_tree);
   //run_func_info_tree = NULL;
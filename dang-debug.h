@@ -5,8 +5,24 @@
 #ifdef DANG_DEBUG
 extern dang_boolean dang_debug_parse;
 extern dang_boolean dang_debug_disassemble;
+extern dang_boolean dang_debug_frame_sizes;
+extern dang_boolean dang_debug_method_caches;
 void dang_debug_dump_expr (DangExpr *expr);
 
+/* Record the size of a compiled function's frame,
+   and the size it would have had if no two variables
+   shared a slot; summarized at cleanup. */
+void dang_debug_note_frame_size (unsigned frame_size,
+                                 unsigned unshared_frame_size);
+
+/* Record the inline-cache statistics of a virtual
+   method call site: the number of classes it cached,
+   and how many calls found their class in the cache. */
+void dang_debug_note_method_cache (DangCodePosition *cp,
+                                   unsigned          n_classes,
+                                   unsigned long     n_hits,
+                                   unsigned long     n_misses);
+
 void dang_debug_register_simple_c (DangSimpleCFunc func,
                                    DangNamespace  *ns,
                                    const char     *name);
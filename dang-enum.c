@@ -305,7 +305,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE(do_enum_to_string)
                       v, etype->base_type.full_name);
       return FALSE;
     }
-  * (DangString **) rv_out = dang_string_new (ev->name);
+  * (DangString **) rv_out = dang_string_new_interned (ev->name);
   return TRUE;
 }
 
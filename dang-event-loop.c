@@ -0,0 +1,643 @@
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "dang.h"
+#include "config.h"
+#include "gskrbtreemacros.h"
+
+struct _DangEventSource
+{
+  /* one for the loop, one for the owner; protected by the loop lock */
+  unsigned ref_count;
+
+  /* set (under the loop lock) once it has fired or been removed */
+  dang_boolean fired;
+
+  dang_boolean is_timer;
+  int fd;
+  uint64_t expire;                      /* for timers */
+  DangEventFunc func;
+  void *data;
+  DangDestroyNotify destroy;
+
+  /* timers: the tree sorted by expire time;
+     fds: the list of fd sources (using 'left' and 'right') */
+  DangEventSource *left, *right, *parent;
+  dang_boolean is_red;
+};
+
+static struct
+{
+  pthread_mutex_t lock;
+  dang_boolean started, stopping;
+  pthread_t pthread;
+  int epoll_fd;
+  int wake_fd;                          /* an eventfd to interrupt epoll_wait() */
+  DangEventSource *timers;
+  DangEventSource *fd_sources;
+  DangUtilArray zombies;                /* removed sources the loop may still see */
+} loop = { PTHREAD_MUTEX_INITIALIZER, FALSE, FALSE, 0, -1, -1, NULL, NULL,
+           DANG_UTIL_ARRAY_STATIC_INIT (DangEventSource *) };
+
+#define GET_IS_RED(s)  (s)->is_red
+#define SET_IS_RED(s,v)  (s)->is_red = v
+#define COMPARE_TIMERS(a,b,rv) \
+  if (a->expire < b->expire) rv = -1; \
+  else if (a->expire > b->expire) rv = 1; \
+  else if (a < b) rv = -1; \
+  else if (a > b) rv = 1; \
+  else rv = 0;
+#define GET_TIMER_TREE() \
+  loop.timers, DangEventSource *, GET_IS_RED, SET_IS_RED, \
+  parent, left, right, COMPARE_TIMERS
+
+static uint64_t
+now_usecs (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+wake_loop (void)
+{
+  uint64_t one = 1;
+  if (write (loop.wake_fd, &one, sizeof (one)) < 0 && errno != EAGAIN)
+    dang_warning ("error waking event loop: %s", strerror (errno));
+}
+
+/* must be called with the lock held */
+static void
+source_unref_locked (DangEventSource *source)
+{
+  if (--(source->ref_count) == 0)
+    dang_free (source);
+}
+
+/* Take a pending source out of the timer tree or the epoll set.
+   Must be called with the lock held. */
+static void
+detach_source_locked (DangEventSource *source)
+{
+  source->fired = TRUE;
+  if (source->is_timer)
+    GSK_RBTREE_REMOVE (GET_TIMER_TREE (), source);
+  else
+    {
+      epoll_ctl (loop.epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+      if (source->left)
+        source->left->right = source->right;
+      else
+        loop.fd_sources = source->right;
+      if (source->right)
+        source->right->left = source->left;
+    }
+}
+
+static void *
+loop_main (void *data)
+{
+  struct epoll_event events[64];
+  DangUtilArray fired = DANG_UTIL_ARRAY_STATIC_INIT (DangEventSource *);
+  DANG_UNUSED (data);
+  for (;;)
+    {
+      DangEventSource *first;
+      DangEventSource **at;
+      int timeout = -1;
+      int i, n;
+      uint64_t now;
+
+      pthread_mutex_lock (&loop.lock);
+      if (loop.stopping)
+        {
+          pthread_mutex_unlock (&loop.lock);
+          break;
+        }
+      GSK_RBTREE_FIRST (GET_TIMER_TREE (), first);
+      if (first != NULL)
+        {
+          now = now_usecs ();
+          timeout = first->expire <= now ? 0
+                  : (int) ((first->expire - now + 999) / 1000);
+        }
+      pthread_mutex_unlock (&loop.lock);
+
+      n = epoll_wait (loop.epoll_fd, events, DANG_N_ELEMENTS (events), timeout);
+      if (n < 0)
+        {
+          if (errno != EINTR)
+            dang_die ("epoll_wait failed: %s", strerror (errno));
+          n = 0;
+        }
+
+      /* Collect the sources that fired.  A source removed since
+         epoll_wait() returned is a zombie: it is still allocated,
+         and marked as fired. */
+      pthread_mutex_lock (&loop.lock);
+      for (i = 0; i < n; i++)
+        {
+          DangEventSource *source = events[i].data.ptr;
+          if (source == NULL)
+            {
+              uint64_t count;
+              if (read (loop.wake_fd, &count, sizeof (count)) < 0) {}
+              continue;
+            }
+          if (source->fired)
+            continue;
+          detach_source_locked (source);
+          dang_util_array_append (&fired, 1, &source);
+        }
+      now = now_usecs ();
+      for (;;)
+        {
+          GSK_RBTREE_FIRST (GET_TIMER_TREE (), first);
+          if (first == NULL || first->expire > now)
+            break;
+          detach_source_locked (first);
+          dang_util_array_append (&fired, 1, &first);
+        }
+      at = loop.zombies.data;
+      for (i = 0; i < (int) loop.zombies.len; i++)
+        source_unref_locked (at[i]);
+      dang_util_array_set_size (&loop.zombies, 0);
+      pthread_mutex_unlock (&loop.lock);
+
+      at = fired.data;
+      for (i = 0; i < (int) fired.len; i++)
+        {
+          at[i]->func (at[i]->data);
+          if (at[i]->destroy)
+            at[i]->destroy (at[i]->data);
+        }
+      pthread_mutex_lock (&loop.lock);
+      for (i = 0; i < (int) fired.len; i++)
+        source_unref_locked (at[i]);
+      pthread_mutex_unlock (&loop.lock);
+      dang_util_array_set_size (&fired, 0);
+    }
+  dang_util_array_clear (&fired);
+  return NULL;
+}
+
+/* must be called with the lock held */
+static void
+ensure_started_locked (void)
+{
+  struct epoll_event event;
+  if (loop.started)
+    return;
+
+  /* The loop thread unrefs dang threads, so reference-counts
+     must be atomic before it starts. */
+  dang_scheduler_get_default ();
+
+  loop.epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  if (loop.epoll_fd < 0)
+    dang_die ("epoll_create1 failed: %s", strerror (errno));
+  loop.wake_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (loop.wake_fd < 0)
+    dang_die ("eventfd failed: %s", strerror (errno));
+  memset (&event, 0, sizeof (event));
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  if (epoll_ctl (loop.epoll_fd, EPOLL_CTL_ADD, loop.wake_fd, &event) < 0)
+    dang_die ("epoll_ctl failed: %s", strerror (errno));
+  if (pthread_create (&loop.pthread, NULL, loop_main, NULL) != 0)
+    dang_die ("error creating event-loop thread: %s", strerror (errno));
+  loop.started = TRUE;
+}
+
+static DangEventSource *
+source_new (DangEventFunc     func,
+            void             *data,
+            DangDestroyNotify destroy)
+{
+  DangEventSource *source = dang_new0 (DangEventSource, 1);
+  source->ref_count = 2;
+  source->func = func;
+  source->data = data;
+  source->destroy = destroy;
+  return source;
+}
+
+/* Function: dang_event_source_new_fd
+   Watch a file-descriptor until it is ready.
+
+   Parameters:
+     fd - the file-descriptor, which should be non-blocking.
+     events - DANG_EVENT_READABLE and/or DANG_EVENT_WRITABLE.
+     func - called on the loop's thread when the fd is ready.
+     data - passed to func and destroy.
+     destroy - called after func, or when the source is removed
+       before it fires.  May be NULL.
+     error - set if the fd cannot be watched.
+
+   Returns:
+     the new source, or NULL on error (destroy is not called).
+ */
+DangEventSource *
+dang_event_source_new_fd (int               fd,
+                          unsigned          events,
+                          DangEventFunc     func,
+                          void             *data,
+                          DangDestroyNotify destroy,
+                          DangError       **error)
+{
+  DangEventSource *source = source_new (func, data, destroy);
+  struct epoll_event event;
+  source->fd = fd;
+  memset (&event, 0, sizeof (event));
+  event.events = EPOLLONESHOT
+               | ((events & DANG_EVENT_READABLE) ? EPOLLIN : 0)
+               | ((events & DANG_EVENT_WRITABLE) ? EPOLLOUT : 0);
+  event.data.ptr = source;
+
+  pthread_mutex_lock (&loop.lock);
+  ensure_started_locked ();
+  if (epoll_ctl (loop.epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+      int e = errno;
+      pthread_mutex_unlock (&loop.lock);
+      dang_free (source);
+      if (e == EEXIST)
+        dang_set_error (error, "another thread is already waiting on fd %d", fd);
+      else
+        dang_set_error (error, "cannot wait on fd %d: %s", fd, strerror (e));
+      return NULL;
+    }
+  source->right = loop.fd_sources;
+  if (loop.fd_sources)
+    loop.fd_sources->left = source;
+  loop.fd_sources = source;
+  pthread_mutex_unlock (&loop.lock);
+  return source;
+}
+
+/* Function: dang_event_source_new_timer
+   Call a function once some time has passed.
+
+   Parameters:
+     usecs - the delay, in microseconds.
+     func - called on the loop's thread when the timer expires.
+     data - passed to func and destroy.
+     destroy - called after func, or when the source is removed
+       before it fires.  May be NULL.
+
+   Returns:
+     the new source.
+ */
+DangEventSource *
+dang_event_source_new_timer (uint64_t          usecs,
+                             DangEventFunc     func,
+                             void             *data,
+                             DangDestroyNotify destroy)
+{
+  DangEventSource *source = source_new (func, data, destroy);
+  DangEventSource *conflict = NULL, *first;
+  source->is_timer = TRUE;
+  source->expire = now_usecs () + usecs;
+
+  pthread_mutex_lock (&loop.lock);
+  ensure_started_locked ();
+  GSK_RBTREE_INSERT (GET_TIMER_TREE (), source, conflict);
+  dang_assert (conflict == NULL);
+  GSK_RBTREE_FIRST (GET_TIMER_TREE (), first);
+  if (first == source)
+    wake_loop ();               /* it must wait less */
+  pthread_mutex_unlock (&loop.lock);
+  return source;
+}
+
+dang_boolean
+dang_event_source_has_fired (DangEventSource *source)
+{
+  dang_boolean rv;
+  pthread_mutex_lock (&loop.lock);
+  rv = source->fired;
+  pthread_mutex_unlock (&loop.lock);
+  return rv;
+}
+
+void
+dang_event_source_remove (DangEventSource *source)
+{
+  dang_boolean cancelled = FALSE;
+  DangDestroyNotify destroy = source->destroy;
+  void *data = source->data;
+  pthread_mutex_lock (&loop.lock);
+  if (!source->fired)
+    {
+      detach_source_locked (source);
+      if (loop.stopping || !loop.started)
+        source_unref_locked (source);
+      else
+        dang_util_array_append (&loop.zombies, 1, &source);
+      cancelled = TRUE;
+    }
+  source_unref_locked (source);
+  pthread_mutex_unlock (&loop.lock);
+  if (cancelled && destroy != NULL)
+    destroy (data);
+}
+
+/* --- waking threads --- */
+static void
+wakeup_thread (void *data)
+{
+  dang_thread_wakeup (data);
+}
+
+DangEventSource *
+dang_thread_wait_fd (DangThread *thread,
+                     int         fd,
+                     unsigned    events,
+                     DangError **error)
+{
+  DangEventSource *rv;
+  rv = dang_event_source_new_fd (fd, events, wakeup_thread,
+                                 dang_thread_ref (thread),
+                                 (DangDestroyNotify) dang_thread_unref,
+                                 error);
+  if (rv == NULL)
+    dang_thread_unref (thread);
+  return rv;
+}
+
+DangEventSource *
+dang_thread_wait_timer (DangThread *thread,
+                        uint64_t    usecs)
+{
+  return dang_event_source_new_timer (usecs, wakeup_thread,
+                                      dang_thread_ref (thread),
+                                      (DangDestroyNotify) dang_thread_unref);
+}
+
+/* --- sleep(), read_async() and write_async() --- */
+typedef struct _IoState IoState;
+struct _IoState
+{
+  DangEventSource *source;              /* if waiting */
+  dang_boolean started;
+  unsigned n_written;
+};
+
+static void
+destruct__io_state (DangValueType *type,
+                    void          *value)
+{
+  IoState *state = value;
+  DANG_UNUSED (type);
+  if (state->source != NULL)
+    {
+      dang_event_source_remove (state->source);
+      state->source = NULL;
+    }
+}
+
+static DangValueType io_state_type;
+
+/* Returns FALSE if we were woken up before the source fired. */
+static dang_boolean
+io_state_check_ready (IoState *state)
+{
+  if (state->source == NULL)
+    return TRUE;
+  if (!dang_event_source_has_fired (state->source))
+    return FALSE;
+  dang_event_source_remove (state->source);
+  state->source = NULL;
+  return TRUE;
+}
+
+static dang_boolean
+set_nonblocking (int fd, const char *name, DangError **error)
+{
+  int flags = fcntl (fd, F_GETFL);
+  if (flags < 0
+   || ((flags & O_NONBLOCK) == 0 && fcntl (fd, F_SETFL, flags | O_NONBLOCK) < 0))
+    {
+      dang_set_error (error, "%s: bad fd %d: %s", name, fd, strerror (errno));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static DANG_C_FUNC_DECLARE (do_sleep)
+{
+  IoState *state = state_data;
+  DANG_UNUSED (rv_out);
+  DANG_UNUSED (func_data);
+  DANG_UNUSED (error);
+  if (!state->started)
+    {
+      double seconds = * (double *) args[0];
+      state->started = TRUE;
+      if (seconds <= 0)
+        return DANG_C_FUNCTION_SUCCESS;
+      state->source = dang_thread_wait_timer (thread, (uint64_t) (seconds * 1e6));
+      return DANG_C_FUNCTION_YIELDED;
+    }
+  if (!io_state_check_ready (state))
+    return DANG_C_FUNCTION_YIELDED;
+  return DANG_C_FUNCTION_SUCCESS;
+}
+
+static DANG_C_FUNC_DECLARE (do_read_async)
+{
+  IoState *state = state_data;
+  int fd = * (int32_t *) args[0];
+  int32_t max_length = * (int32_t *) args[1];
+  char *buf;
+  ssize_t n;
+  DANG_UNUSED (func_data);
+  if (!io_state_check_ready (state))
+    return DANG_C_FUNCTION_YIELDED;
+  if (!state->started)
+    {
+      if (!set_nonblocking (fd, "read_async", error))
+        return DANG_C_FUNCTION_ERROR;
+      state->started = TRUE;
+    }
+  if (max_length < 0)
+    {
+      dang_set_error (error, "read_async: negative max_length");
+      return DANG_C_FUNCTION_ERROR;
+    }
+  if (max_length == 0)
+    {
+      * (DangString **) rv_out = dang_string_new ("");
+      return DANG_C_FUNCTION_SUCCESS;
+    }
+
+  buf = dang_malloc (max_length);
+  do
+    n = read (fd, buf, max_length);
+  while (n < 0 && errno == EINTR);
+  if (n < 0 && errno == EAGAIN)
+    {
+      dang_free (buf);
+      state->source = dang_thread_wait_fd (thread, fd, DANG_EVENT_READABLE, error);
+      if (state->source == NULL)
+        return DANG_C_FUNCTION_ERROR;
+      return DANG_C_FUNCTION_YIELDED;
+    }
+  if (n < 0)
+    {
+      dang_set_error (error, "read_async: error reading fd %d: %s",
+                      fd, strerror (errno));
+      dang_free (buf);
+      return DANG_C_FUNCTION_ERROR;
+    }
+
+  /* a read returns at least one byte, so "" means end-of-file */
+  * (DangString **) rv_out = dang_string_new_len (buf, n);
+  dang_free (buf);
+  return DANG_C_FUNCTION_SUCCESS;
+}
+
+static DANG_C_FUNC_DECLARE (do_write_async)
+{
+  IoState *state = state_data;
+  int fd = * (int32_t *) args[0];
+  DangString *str = * (DangString **) args[1];
+  unsigned len = str ? str->len : 0;
+  DANG_UNUSED (rv_out);
+  DANG_UNUSED (func_data);
+  if (!io_state_check_ready (state))
+    return DANG_C_FUNCTION_YIELDED;
+  if (!state->started)
+    {
+      if (!set_nonblocking (fd, "write_async", error))
+        return DANG_C_FUNCTION_ERROR;
+      state->started = TRUE;
+    }
+  while (state->n_written < len)
+    {
+      ssize_t n = write (fd, str->str + state->n_written,
+                         len - state->n_written);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0 && errno == EAGAIN)
+        {
+          state->source = dang_thread_wait_fd (thread, fd, DANG_EVENT_WRITABLE, error);
+          if (state->source == NULL)
+            return DANG_C_FUNCTION_ERROR;
+          return DANG_C_FUNCTION_YIELDED;
+        }
+      if (n < 0)
+        {
+          dang_set_error (error, "write_async: error writing fd %d: %s",
+                          fd, strerror (errno));
+          return DANG_C_FUNCTION_ERROR;
+        }
+      state->n_written += n;
+    }
+  return DANG_C_FUNCTION_SUCCESS;
+}
+
+static void
+add_c_function (DangNamespace *ns,
+                const char    *name,
+                DangCFunc      func,
+                DangValueType *rv_type,
+                unsigned       n_params,
+                DangFunctionParam *params)
+{
+  DangError *error = NULL;
+  DangSignature *sig = dang_signature_new (rv_type, n_params, params);
+  DangFunction *function = dang_function_new_c (sig, &io_state_type, func,
+                                                NULL, NULL);
+  if (!dang_namespace_add_function (ns, name, function, &error))
+    dang_die ("adding '%s' failed: %s", name, error->message);
+  dang_function_unref (function);
+  dang_signature_unref (sig);
+}
+
+void
+_dang_event_loop_init (DangNamespace *ns)
+{
+  DangFunctionParam params[2];
+
+  io_state_type.sizeof_instance = sizeof (IoState);
+  io_state_type.alignof_instance = DANG_ALIGNOF_POINTER;
+  io_state_type.destruct = destruct__io_state;
+  io_state_type.full_name = "internal-io-state";
+
+  params[0].dir = DANG_FUNCTION_PARAM_IN;
+  params[0].name = "seconds";
+  params[0].type = dang_value_type_double ();
+  add_c_function (ns, "sleep", do_sleep, NULL, 1, params);
+
+  params[0].name = "fd";
+  params[0].type = dang_value_type_int32 ();
+  params[1].dir = DANG_FUNCTION_PARAM_IN;
+  params[1].name = "max_length";
+  params[1].type = dang_value_type_int32 ();
+  add_c_function (ns, "read_async", do_read_async,
+                  dang_value_type_string (), 2, params);
+
+  params[1].name = "data";
+  params[1].type = dang_value_type_string ();
+  add_c_function (ns, "write_async", do_write_async, NULL, 2, params);
+}
+
+/* Stop the loop's thread, so no source fires from now on.
+   Sources may still be added and removed until
+   _dang_event_loop_cleanup(). */
+void
+_dang_event_loop_stop (void)
+{
+  pthread_mutex_lock (&loop.lock);
+  if (!loop.started || loop.stopping)
+    {
+      pthread_mutex_unlock (&loop.lock);
+      return;
+    }
+  loop.stopping = TRUE;
+  wake_loop ();
+  pthread_mutex_unlock (&loop.lock);
+  pthread_join (loop.pthread, NULL);
+}
+
+/* Stop the loop.  Sources that have not fired are dropped:
+   the threads waiting on them will never be resumed. */
+void
+_dang_event_loop_cleanup (void)
+{
+  DangEventSource **zombies;
+  unsigned i;
+  _dang_event_loop_stop ();
+  if (!loop.started)
+    return;
+
+  for (;;)
+    {
+      DangEventSource *source = loop.fd_sources;
+      DangDestroyNotify destroy;
+      void *data;
+      if (source == NULL)
+        GSK_RBTREE_FIRST (GET_TIMER_TREE (), source);
+      if (source == NULL)
+        break;
+      destroy = source->destroy;
+      data = source->data;
+      detach_source_locked (source);
+      source_unref_locked (source);
+      if (destroy != NULL)
+        destroy (data);
+    }
+  zombies = loop.zombies.data;
+  for (i = 0; i < loop.zombies.len; i++)
+    source_unref_locked (zombies[i]);
+  dang_util_array_clear (&loop.zombies);
+  close (loop.epoll_fd);
+  close (loop.wake_fd);
+  loop.started = loop.stopping = FALSE;
+}
@@ -0,0 +1,50 @@
+/* --- The event loop: wakes yielded threads when an fd is ready
+ *     or a timer expires ---
+ *
+ * The loop runs epoll on its own OS thread, started on first use.
+ * Each source fires at most once; its function is called
+ * on the loop's thread, usually to dang_thread_wakeup() a thread.
+ *
+ * The builtins sleep(), read_async() and write_async() yield
+ * the calling thread instead of blocking; read_async() and
+ * write_async() put their fd into non-blocking mode.
+ */
+
+typedef struct _DangEventSource DangEventSource;
+typedef void (*DangEventFunc) (void *data);
+
+#define DANG_EVENT_READABLE     (1<<0)
+#define DANG_EVENT_WRITABLE     (1<<1)
+
+/* Only one source may watch an fd at a time. */
+DangEventSource *dang_event_source_new_fd    (int               fd,
+                                              unsigned          events,
+                                              DangEventFunc     func,
+                                              void             *data,
+                                              DangDestroyNotify destroy,
+                                              DangError       **error);
+DangEventSource *dang_event_source_new_timer (uint64_t          usecs,
+                                              DangEventFunc     func,
+                                              void             *data,
+                                              DangDestroyNotify destroy);
+
+dang_boolean     dang_event_source_has_fired (DangEventSource  *source);
+
+/* Stop the source if it has not fired yet, and drop the caller's
+   reference.  Call this exactly once for each source created. */
+void             dang_event_source_remove    (DangEventSource  *source);
+
+/* Create a source that wakes 'thread' up: for C functions that
+   are about to return DANG_C_FUNCTION_YIELDED.  Keep the source
+   in the function's state, and check dang_event_source_has_fired()
+   when called again, since a thread can be woken up early. */
+DangEventSource *dang_thread_wait_fd         (DangThread       *thread,
+                                              int               fd,
+                                              unsigned          events,
+                                              DangError       **error);
+DangEventSource *dang_thread_wait_timer      (DangThread       *thread,
+                                              uint64_t          usecs);
+
+void _dang_event_loop_init (DangNamespace *ns);
+void _dang_event_loop_stop (void);
+void _dang_event_loop_cleanup (void);
@@ -155,6 +155,34 @@ DANG_SIMPLE_C_FUNC_DECLARE(file_unlink)
   return TRUE;
 }
 
+DANG_SIMPLE_C_FUNC_DECLARE(file_pipe)
+{
+  int fds[2];
+  DANG_UNUSED (rv_out);
+  DANG_UNUSED (func_data);
+  if (pipe (fds) < 0)
+    {
+      dang_set_error (error, "pipe: %s", strerror (errno));
+      return FALSE;
+    }
+  * (int32_t *) args[0] = fds[0];
+  * (int32_t *) args[1] = fds[1];
+  return TRUE;
+}
+
+DANG_SIMPLE_C_FUNC_DECLARE(file_close_fd)
+{
+  int fd = * (int32_t *) args[0];
+  DANG_UNUSED (rv_out);
+  DANG_UNUSED (func_data);
+  if (close (fd) < 0)
+    {
+      dang_set_error (error, "close_fd %d: %s", fd, strerror (errno));
+      return FALSE;
+    }
+  return TRUE;
+}
+
 static struct {
   const char *ctor_name;
   const char *fopen_flags;
@@ -241,4 +269,25 @@ void _dang_file_init (DangNamespace *ns)
   dang_function_unref (func);
   dang_signature_unref (sig);
 
+  /* raw file-descriptors, for read_async() and write_async() */
+  params[0].type = dang_value_type_int32 ();
+  params[0].dir = DANG_FUNCTION_PARAM_OUT;
+  params[0].name = "read_fd";
+  params[1].type = dang_value_type_int32 ();
+  params[1].dir = DANG_FUNCTION_PARAM_OUT;
+  params[1].name = "write_fd";
+  sig = dang_signature_new (NULL, 2, params);
+  func = dang_function_new_simple_c (sig, file_pipe, NULL, NULL);
+  dang_namespace_add_function (ns, "pipe", func, NULL);
+  dang_function_unref (func);
+  dang_signature_unref (sig);
+
+  params[0].dir = DANG_FUNCTION_PARAM_IN;
+  params[0].name = "fd";
+  sig = dang_signature_new (NULL, 1, params);
+  func = dang_function_new_simple_c (sig, file_close_fd, NULL, NULL);
+  dang_namespace_add_function (ns, "close_fd", func, NULL);
+  dang_function_unref (func);
+  dang_signature_unref (sig);
+
 }
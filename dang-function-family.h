@@ -75,6 +75,16 @@ DangFunctionFamily *dang_function_family_new_variadic_c (const char *name,
                                                        void *data,
                                                        DangDestroyNotify destroy);
 
+/* For variadic functions that take a function argument:
+   check (or, for untyped functions and families, deduce)
+   its signature given its params.  *sig_out holds a reference. */
+dang_boolean dang_match_function_from_params (DangMatchQueryElement *elt,
+                                              unsigned               n_params,
+                                              DangFunctionParam     *params,
+                                              const char            *name,
+                                              DangSignature        **sig_out,
+                                              DangError            **error);
+
 /* --- template --- */
 DangFunctionFamily *dang_function_family_new_template
                                              (const char         *name,
@@ -1,4 +1,6 @@
 #include <string.h>
+#include "config.h"
+#include "gskqsortmacro.h"
 #include "dang.h"
 
 const char *
@@ -41,6 +43,182 @@ dang_boolean dang_catch_block_is_applicable (DangCatchBlock *catch_block,
   return FALSE;
 }
 
+/* Function: dang_function_find_catch_clause
+   Find the clause that handles an exception thrown at 'ip'.
+   Catch blocks are sorted by their start, so nested blocks follow the
+   blocks that contain them; the innermost applicable one wins.
+
+   Parameters:
+     function - the function whose frame is being unwound.
+     ip - the frame's instruction pointer.
+     is_return_address - whether 'ip' is the step after a call
+       (for a caller's frame), rather than the step that threw.
+     thrown_type - the type of the exception.
+
+   Returns:
+     the clause to jump to, or NULL if the exception
+     should propagate to the caller.
+ */
+DangCatchBlockClause *
+dang_function_find_catch_clause (DangFunction  *function,
+                                 DangStep      *ip,
+                                 dang_boolean   is_return_address,
+                                 DangValueType *thrown_type)
+{
+  DangFunctionStackInfo *stack_info = function->base.stack_info;
+  DangCatchBlockClause *clause;
+  unsigned i;
+  if (stack_info == NULL)
+    return NULL;
+  for (i = stack_info->n_catch_blocks; i > 0; i--)
+    {
+      DangCatchBlock *block = stack_info->catch_blocks + i - 1;
+      dang_boolean active = is_return_address
+                          ? (block->start < ip && ip <= block->end)
+                          : (block->start <= ip && ip < block->end);
+      if (active
+       && dang_catch_block_is_applicable (block, thrown_type, &clause))
+        return clause;
+    }
+  return NULL;
+}
+
+/* index of 'step' in the sorted, unique array 'bounds' */
+static unsigned
+find_bound (DangStep **bounds, unsigned n_bounds, DangStep *step)
+{
+  unsigned start = 0;
+  while (n_bounds > 0)
+    {
+      unsigned mid = start + n_bounds / 2;
+      if (bounds[mid] == step)
+        return mid;
+      if (bounds[mid] < step)
+        {
+          n_bounds -= mid + 1 - start;
+          start = mid + 1;
+        }
+      else
+        n_bounds = mid - start;
+    }
+  dang_assert_not_reached ();
+  return 0;
+}
+
+#define COMPARE_STEP_PTRS(a,b,rv) GSK_QSORT_SIMPLE_COMPARATOR(a,b,rv)
+
+/* Function: dang_function_stack_info_init_live_ranges
+   Precompute which variables with destructors are live at each step,
+   so that unwinding a frame needn't scan all its variables.
+
+   The steps where some variable's liveness changes split the function
+   into ranges; each range lists the variables live throughout it.
+   The ranges and their lists are allocated as a single block.
+
+   Parameters:
+     stack_info - the stack-info whose 'vars' are set.
+ */
+void
+dang_function_stack_info_init_live_ranges (DangFunctionStackInfo *stack_info)
+{
+  DangStep **bounds;
+  unsigned n_bounds = 0, n_ranges, n_indices, i, k;
+  unsigned *counts, *at;
+  DangFunctionLiveRange *ranges;
+
+  stack_info->n_live_ranges = 0;
+  stack_info->live_ranges = NULL;
+
+  bounds = dang_new (DangStep *, stack_info->n_vars * 2);
+  for (i = 0; i < stack_info->n_vars; i++)
+    if (stack_info->vars[i].type->destruct != NULL)
+      {
+        bounds[n_bounds++] = stack_info->vars[i].start;
+        bounds[n_bounds++] = stack_info->vars[i].end;
+      }
+  if (n_bounds == 0)
+    {
+      dang_free (bounds);
+      return;
+    }
+  GSK_QSORT (bounds, DangStep *, n_bounds, COMPARE_STEP_PTRS);
+  n_ranges = 1;
+  for (i = 1; i < n_bounds; i++)
+    if (bounds[i] != bounds[n_ranges - 1])
+      bounds[n_ranges++] = bounds[i];
+
+  /* Count the variables live in each range */
+  counts = dang_new0 (unsigned, n_ranges);
+  n_indices = 0;
+  for (i = 0; i < stack_info->n_vars; i++)
+    if (stack_info->vars[i].type->destruct != NULL)
+      {
+        unsigned s = find_bound (bounds, n_ranges, stack_info->vars[i].start);
+        unsigned e = find_bound (bounds, n_ranges, stack_info->vars[i].end);
+        for (k = s; k < e; k++)
+          counts[k]++;
+        n_indices += e - s;
+      }
+
+  ranges = dang_malloc (sizeof (DangFunctionLiveRange) * n_ranges
+                        + sizeof (unsigned) * n_indices);
+  at = (unsigned *) (ranges + n_ranges);
+  for (k = 0; k < n_ranges; k++)
+    {
+      ranges[k].after = bounds[k];
+      ranges[k].n_vars = 0;
+      ranges[k].vars = at;
+      at += counts[k];
+    }
+  for (i = 0; i < stack_info->n_vars; i++)
+    if (stack_info->vars[i].type->destruct != NULL)
+      {
+        unsigned s = find_bound (bounds, n_ranges, stack_info->vars[i].start);
+        unsigned e = find_bound (bounds, n_ranges, stack_info->vars[i].end);
+        for (k = s; k < e; k++)
+          ranges[k].vars[ranges[k].n_vars++] = i;
+      }
+  dang_free (counts);
+  dang_free (bounds);
+
+  stack_info->n_live_ranges = n_ranges;
+  stack_info->live_ranges = ranges;
+}
+
+/* Function: dang_function_stack_info_find_live_range
+   Find the variables with destructors that are live
+   when going to 'ip'.
+
+   Parameters:
+     stack_info - the function's stack-info.
+     ip - the step about to run (or the return address).
+
+   Returns:
+     the range containing 'ip', or NULL if no such variable is live.
+ */
+DangFunctionLiveRange *
+dang_function_stack_info_find_live_range (DangFunctionStackInfo *stack_info,
+                                          DangStep              *ip)
+{
+  DangFunctionLiveRange *ranges = stack_info->live_ranges;
+  unsigned start = 0, n = stack_info->n_live_ranges;
+
+  /* find the last range whose 'after' is before ip */
+  while (n > 0)
+    {
+      unsigned mid = start + n / 2;
+      if (ranges[mid].after < ip)
+        {
+          n -= mid + 1 - start;
+          start = mid + 1;
+        }
+      else
+        n = mid - start;
+    }
+  if (start == 0 || ranges[start - 1].n_vars == 0)
+    return NULL;
+  return ranges + start - 1;
+}
 
 static void
 free_stack_info (DangFunctionStackInfo *stack_info)
@@ -48,6 +226,7 @@ free_stack_info (DangFunctionStackInfo *stack_info)
   unsigned i;
   dang_free (stack_info->vars);
   dang_free (stack_info->params);
+  dang_free (stack_info->live_ranges);
   for (i = 0; i < stack_info->n_catch_blocks; i++)
     dang_free (stack_info->catch_blocks[i].clauses);
   for (i = 0; i < stack_info->n_file_info; i++)
@@ -64,7 +243,7 @@ void
 dang_function_unref        (DangFunction    *function)
 {
   //dang_warning ("dang_function_unref: %p: %u => %u", function, function->base.ref_count, function->base.ref_count - 1);
-  if (--(function->base.ref_count) == 0)
+  if (DANG_REF_COUNT_DEC (function->base.ref_count) == 0)
     {
       switch (function->type)
         {
@@ -152,14 +331,14 @@ dang_function_stub_set_annotations (DangFunction *function,
 DangFunction *dang_function_ref          (DangFunction    *function)
 {
   //dang_warning ("dang_function_ref: %p: %u => %u", function, function->base.ref_count, function->base.ref_count + 1);
-  ++(function->base.ref_count);
+  DANG_REF_COUNT_INC (function->base.ref_count);
   return function;
 }
 
 DangFunction *dang_function_attach_ref          (DangFunction    *function)
 {
   function->base.is_owned = TRUE;
-  ++(function->base.ref_count);
+  DANG_REF_COUNT_INC (function->base.ref_count);
   return function;
 }
 dang_boolean
@@ -261,7 +440,13 @@ dang_function_call_nonyielding_v (DangFunction *function,
       dang_boolean rv = FALSE;
       DangSignature *sig = function->base.sig;
       DangThread *thread = dang_thread_new (function, sig->n_params, arg_values);
-      dang_thread_run (thread);
+
+      /* Outside the workers we can afford to block until a
+         yielded thread is woken up; a worker must not block. */
+      if (dang_scheduler_get_current () == NULL)
+        dang_thread_run_and_wait (thread);
+      else
+        dang_thread_run (thread);
       switch (thread->status)
         {
         case DANG_THREAD_STATUS_THREW:
@@ -329,6 +514,23 @@ dang_function_call_nonyielding_v (DangFunction *function,
       return rv;
     }
 }
+
+dang_boolean
+dang_function_is_pure (DangFunction *function)
+{
+  switch (function->type)
+    {
+    case DANG_FUNCTION_TYPE_DANG:
+      return function->dang.is_pure;
+    case DANG_FUNCTION_TYPE_SIMPLE_C:
+      return function->simple_c.is_pure;
+    case DANG_FUNCTION_TYPE_CLOSURE:
+      return dang_function_is_pure (function->closure.underlying);
+    default:
+      return FALSE;
+    }
+}
+
 char *dang_function_to_string (DangFunction *func)
 {
   DangStringBuffer buf = DANG_STRING_BUFFER_INIT;
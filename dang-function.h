@@ -8,10 +8,19 @@ typedef void (*DangStepRun) (void                 *step_data,
                   DangThreadStackFrame *stack_frame, \
                   DangThread           *thread)
 
+/* Steps flagged LOCAL only touch the current frame:
+   they never throw, yield, call, or return, so the
+   threaded dispatcher may run them without rechecking the thread. */
+typedef enum
+{
+  DANG_STEP_FLAG_LOCAL = (1<<0)
+} DangStepFlags;
+
 struct _DangStep
 {
   DangStepRun func;
   unsigned _step_data_size;
+  DangStepFlags flags;
   /* step data follows */
 };
 
@@ -47,6 +56,7 @@ typedef struct _DangCatchBlock DangCatchBlock;
 typedef struct _DangFunctionStackVarInfo DangFunctionStackVarInfo;
 typedef struct _DangFunctionStackParamInfo DangFunctionStackParamInfo;
 typedef struct _DangFunctionStackInfo DangFunctionStackInfo;
+typedef struct _DangFunctionLiveRange DangFunctionLiveRange;
 struct _DangFunctionStackVarInfo
 {
   DangStep *start, *end;                /* NOT LIVE when going to 'start';
@@ -60,6 +70,16 @@ struct _DangFunctionStackParamInfo
   DangValueType *type;
 };
 
+/* The variables with destructors that are live for each ip
+   in (after, next_range->after].  The ranges are sorted by 'after';
+   the last one is always empty. */
+struct _DangFunctionLiveRange
+{
+  DangStep *after;
+  unsigned n_vars;
+  unsigned *vars;                       /* indices into stack_info->vars */
+};
+
 struct _DangCatchBlockClause
 {
   DangValueType *type;
@@ -68,8 +88,8 @@ struct _DangCatchBlockClause
 };
 struct _DangCatchBlock
 {
-  DangStep *start, *end;                 /* NOT ACTIVE when going to 'start';
-                                            ACTIVE when going to 'end' */
+  DangStep *start, *end;                 /* the "try" body: a throw from a step
+                                            in [start, end) is caught here */
   unsigned n_clauses;
   DangCatchBlockClause *clauses;
 };
@@ -97,6 +117,8 @@ struct _DangFunctionStackInfo
   DangFunctionStackVarInfo *vars;
   unsigned n_params;
   DangFunctionStackParamInfo *params;
+  unsigned n_live_ranges;
+  DangFunctionLiveRange *live_ranges;
   unsigned n_catch_blocks;
   DangCatchBlock *catch_blocks;
   DangStep *first_step, *last_step;
@@ -129,6 +151,9 @@ struct _DangFunctionDang
      when this function is destroyed. */
   unsigned n_destroy;
   DangFunctionDangDestruct *destroy;
+
+  /* no calls, and no writes outside the frame */
+  dang_boolean is_pure;
 };
 
 /* This is only used for native dang objects. */
@@ -161,6 +186,10 @@ struct _DangFunctionSimpleC
   DangSimpleCFunc func;
   void *func_data;
   DangDestroyNotify func_data_destroy;
+
+  /* Set by whoever registers the function if it writes nothing
+     but its output parameters (see dang_function_is_pure()). */
+  dang_boolean is_pure;
 };
 
 typedef enum
@@ -269,6 +298,13 @@ DangFunction *dang_function_new_c        (DangSignature   *sig,
 void          dang_function_unref        (DangFunction    *function);
 DangFunction *dang_function_ref          (DangFunction    *function);
 
+/* Whether the function may be called on several threads at once,
+   in any order, without changing the results: it cannot yield
+   and writes nothing but its own frame and return-value.
+   This is conservative: a function that has not been compiled
+   yet is not pure. */
+dang_boolean  dang_function_is_pure      (DangFunction    *function);
+
 /* one-line typed-function name */
 char *dang_function_to_string (DangFunction *);
 
@@ -279,6 +315,18 @@ DangFunction *dang_function_concat_get_global (void);
 
 dang_boolean dang_function_needs_registration (DangFunction *function);
 
+/* find the handler for a throw at ip (NULL if uncaught in this frame) */
+DangCatchBlockClause *dang_function_find_catch_clause (DangFunction  *function,
+                                                       DangStep      *ip,
+                                                       dang_boolean   is_return_address,
+                                                       DangValueType *thrown_type);
+/* precompute live_ranges from vars */
+void dang_function_stack_info_init_live_ranges (DangFunctionStackInfo *stack_info);
+
+/* the live range containing ip (NULL if no destructible var is live) */
+DangFunctionLiveRange *
+dang_function_stack_info_find_live_range (DangFunctionStackInfo *stack_info,
+                                          DangStep              *ip);
 dang_boolean dang_function_get_code_position (DangFunction *function,
                                               DangStep     *step,
                                               DangCodePosition *pos_out);
@@ -0,0 +1,726 @@
+#include <string.h>
+#include "dang.h"
+#include "gskrbtreemacros.h"
+#include "magic.h"
+#include "config.h"
+
+#define INITIAL_TABLE_SIZE      8
+
+/* tables are grown before they are more than 3/4 full */
+#define MAX_LOAD(table_size)    ((table_size) / 4 * 3)
+
+#define ENTRY(tt, hash, i)      ((hash)->entries + (size_t) (i) * (tt)->entry_size)
+#define ENTRY_VALUE(tt, entry)  ((entry) + (tt)->value_offset)
+
+/* The hash functions of the integer types are the identity
+   (see dang-value.c), so mix the bits before masking them.
+   0 marks an empty slot. */
+static inline uint32_t
+get_hash_code (DangValueHashTypes *tt,
+               const void         *key)
+{
+  uint32_t h = tt->key->hash (tt->key, key);
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h ? h : 1;
+}
+
+static DangConstantHash *
+constant_hash_alloc (DangValueHashTypes *tt,
+                     unsigned            table_size)
+{
+  size_t entries_offset = sizeof (DangConstantHash)
+                        + table_size * sizeof (uint32_t);
+  DangConstantHash *hash;
+  entries_offset = DANG_ALIGN (entries_offset, tt->entry_alignment);
+  hash = dang_malloc (entries_offset + (size_t) table_size * tt->entry_size);
+  hash->ref_count = 1;
+  hash->size = 0;
+  hash->table_size = table_size;
+  hash->hash_codes = (uint32_t *) (hash + 1);
+  hash->entries = (char *) hash + entries_offset;
+  memset (hash->hash_codes, 0, table_size * sizeof (uint32_t));
+  return hash;
+}
+
+static void
+destruct_entry (DangValueHashTypes *tt,
+                char               *entry)
+{
+  if (tt->key->destruct)
+    tt->key->destruct (tt->key, entry);
+  if (tt->value->destruct)
+    tt->value->destruct (tt->value, ENTRY_VALUE (tt, entry));
+}
+
+static void
+destruct__constant_hash (DangValueType *type,
+                         void          *value)
+{
+  DangConstantHash *hash = * (DangConstantHash **) value;
+  DangValueHashTypes *tt = ((DangValueTypeHash *) type)->owner;
+  unsigned i;
+  if (hash == NULL)
+    return;
+  if (DANG_REF_COUNT_DEC (hash->ref_count) > 0)
+    return;
+  if (tt->key->destruct != NULL || tt->value->destruct != NULL)
+    for (i = 0; i < hash->table_size; i++)
+      if (hash->hash_codes[i] != 0)
+        destruct_entry (tt, ENTRY (tt, hash, i));
+  dang_free (hash);
+}
+
+static void
+destruct__mutable_hash (DangValueType *type,
+                        void          *value)
+{
+  DangHash *hash = * (DangHash **) value;
+  DangValueHashTypes *tt = ((DangValueTypeHash *) type)->owner;
+  if (hash == NULL)
+    return;
+  if (DANG_REF_COUNT_DEC (hash->ref_count) > 0)
+    return;
+  destruct__constant_hash (&tt->types[1].base_type, &hash->v);
+  dang_free (hash);
+}
+
+static void
+init_assign__constant_hash          (DangValueType *type,
+                                     void          *dst,
+                                     const void    *src)
+{
+  DangConstantHash *src_hash = * (DangConstantHash **) src;
+  DANG_UNUSED (type);
+  if (src_hash)
+    DANG_REF_COUNT_INC (src_hash->ref_count);
+  * (DangConstantHash **) dst = src_hash;
+}
+
+static void
+init_assign__mutable_hash          (DangValueType *type,
+                                    void          *dst,
+                                    const void    *src)
+{
+  DangHash *src_hash = * (DangHash **) src;
+  DANG_UNUSED (type);
+  if (src_hash)
+    DANG_REF_COUNT_INC (src_hash->ref_count);
+  * (DangHash **) dst = src_hash;
+}
+
+static void
+assign__constant_hash         (DangValueType *type,
+                               void          *dst,
+                               const void    *src)
+{
+  destruct__constant_hash (type, dst);
+  init_assign__constant_hash (type, dst, src);
+}
+
+static void
+assign__mutable_hash         (DangValueType *type,
+                              void          *dst,
+                              const void    *src)
+{
+  destruct__mutable_hash (type, dst);
+  init_assign__mutable_hash (type, dst, src);
+}
+
+static char *
+to_string__constant_hash (DangValueType *type,
+                          const void    *value)
+{
+  DangConstantHash *hash = * (DangConstantHash **) value;
+  DangValueHashTypes *tt = ((DangValueTypeHash *) type)->owner;
+  DangStringBuffer buf = DANG_STRING_BUFFER_INIT;
+  unsigned i;
+  char *s;
+  dang_string_buffer_append_c (&buf, '{');
+  for (i = 0; hash != NULL && i < hash->table_size; i++)
+    if (hash->hash_codes[i] != 0)
+      {
+        char *entry = ENTRY (tt, hash, i);
+        if (buf.len > 1)
+          dang_string_buffer_append (&buf, ", ");
+        s = dang_value_to_string (tt->key, entry);
+        dang_string_buffer_append (&buf, s);
+        dang_free (s);
+        dang_string_buffer_append (&buf, " => ");
+        s = dang_value_to_string (tt->value, ENTRY_VALUE (tt, entry));
+        dang_string_buffer_append (&buf, s);
+        dang_free (s);
+      }
+  dang_string_buffer_append (&buf, " }");
+  return buf.str;
+}
+static char *
+to_string__mutable_hash (DangValueType *type,
+                         const void    *value)
+{
+  DangHash *hash = * (DangHash **) value;
+  if (hash == NULL)
+    return dang_strdup ("(null)");
+  else
+    return to_string__constant_hash (&((DangValueTypeHash *)type)->owner->types[1].base_type, &hash->v);
+}
+
+/* Returns the slot holding 'key', or else the empty slot that ends its probe sequence. */
+static unsigned
+find_slot (DangValueHashTypes *tt,
+           DangConstantHash   *hash,
+           const void         *key,
+           uint32_t            code)
+{
+  unsigned mask = hash->table_size - 1;
+  unsigned i = code & mask;
+  while (hash->hash_codes[i] != 0)
+    {
+      if (hash->hash_codes[i] == code
+       && tt->key->equal (tt->key, ENTRY (tt, hash, i), key))
+        break;
+      i = (i + 1) & mask;
+    }
+  return i;
+}
+
+/* Make the table in *phash exclusive (a NULL table becomes empty),
+   growing it to hold at least 'min_size' entries. */
+static DangConstantHash *
+unshare_constant_hash (DangValueHashTypes *tt,
+                       DangConstantHash  **phash,
+                       unsigned            min_size)
+{
+  DangConstantHash *old = *phash;
+  DangConstantHash *hash;
+  unsigned table_size = old ? old->table_size : INITIAL_TABLE_SIZE;
+  dang_boolean exclusive = old != NULL && old->ref_count == 1;
+  unsigned mask, i, j;
+  while (min_size > MAX_LOAD (table_size))
+    table_size *= 2;
+  if (exclusive && table_size == old->table_size)
+    return old;
+
+  hash = constant_hash_alloc (tt, table_size);
+  if (old != NULL)
+    {
+      mask = table_size - 1;
+      for (i = 0; i < old->table_size; i++)
+        if (old->hash_codes[i] != 0)
+          {
+            uint32_t code = old->hash_codes[i];
+            char *src = ENTRY (tt, old, i);
+            char *dst;
+            if (table_size == old->table_size)
+              j = i;
+            else
+              for (j = code & mask; hash->hash_codes[j] != 0; j = (j + 1) & mask)
+                ;
+            hash->hash_codes[j] = code;
+            dst = ENTRY (tt, hash, j);
+            if (exclusive)
+              memcpy (dst, src, tt->entry_size);
+            else
+              {
+                dang_value_init_assign (tt->key, dst, src);
+                dang_value_init_assign (tt->value, ENTRY_VALUE (tt, dst),
+                                        ENTRY_VALUE (tt, src));
+              }
+          }
+      hash->size = old->size;
+      if (exclusive)
+        dang_free (old);
+      else
+        destruct__constant_hash (&tt->types[1].base_type, phash);
+    }
+  *phash = hash;
+  return hash;
+}
+
+/* Get a pointer to the value for 'key' in a table that the caller
+   may modify, unsharing the table, and inserting a zeroed value
+   if the key is new. */
+static void *
+constant_hash_get_pointer_for_write (DangValueHashTypes *tt,
+                                     DangConstantHash  **phash,
+                                     const void         *key)
+{
+  uint32_t code = get_hash_code (tt, key);
+  DangConstantHash *hash = *phash;
+  unsigned i;
+  char *entry;
+  if (hash != NULL)
+    {
+      i = find_slot (tt, hash, key, code);
+      if (hash->hash_codes[i] != 0)
+        {
+          /* unsharing without growing keeps the slots */
+          hash = unshare_constant_hash (tt, phash, 0);
+          return ENTRY_VALUE (tt, ENTRY (tt, hash, i));
+        }
+    }
+  hash = unshare_constant_hash (tt, phash, (hash ? hash->size : 0) + 1);
+  i = find_slot (tt, hash, key, code);
+  hash->hash_codes[i] = code;
+  entry = ENTRY (tt, hash, i);
+  dang_value_init_assign_key (tt->key, entry, key);
+  memset (ENTRY_VALUE (tt, entry), 0, tt->value->sizeof_instance);
+  hash->size++;
+  return ENTRY_VALUE (tt, entry);
+}
+
+static dang_boolean
+constant_hash_get_pointer   (DangValueHashTypes *tt,
+                             DangConstantHash  **phash,
+                             const void         *key,
+                             void              **rv_ptr_out,
+                             dang_boolean        may_create,
+                             DangError         **error)
+{
+  DangConstantHash *hash = *phash;
+  if (hash != NULL)
+    {
+      unsigned i = find_slot (tt, hash, key, get_hash_code (tt, key));
+      if (hash->hash_codes[i] != 0)
+        {
+          *rv_ptr_out = ENTRY_VALUE (tt, ENTRY (tt, hash, i));
+          return TRUE;
+        }
+    }
+  if (!may_create)
+    {
+      dang_set_error (error, "key not found in hash");
+      return FALSE;
+    }
+  *rv_ptr_out = constant_hash_get_pointer_for_write (tt, phash, key);
+  return TRUE;
+}
+
+/* Remove 'key', moving the rest of its cluster back
+   so that no probe sequence passes through an empty slot. */
+static dang_boolean
+constant_hash_remove (DangValueHashTypes *tt,
+                      DangConstantHash  **phash,
+                      const void         *key)
+{
+  DangConstantHash *hash = *phash;
+  unsigned mask, i, j;
+  if (hash == NULL)
+    return FALSE;
+  i = find_slot (tt, hash, key, get_hash_code (tt, key));
+  if (hash->hash_codes[i] == 0)
+    return FALSE;
+  hash = unshare_constant_hash (tt, phash, 0);
+  destruct_entry (tt, ENTRY (tt, hash, i));
+  mask = hash->table_size - 1;
+  for (j = (i + 1) & mask; hash->hash_codes[j] != 0; j = (j + 1) & mask)
+    {
+      /* the entry at j may fill the hole at i
+         unless its home slot lies after i */
+      unsigned home = hash->hash_codes[j] & mask;
+      if (((j - home) & mask) >= ((j - i) & mask))
+        {
+          memcpy (ENTRY (tt, hash, i), ENTRY (tt, hash, j), tt->entry_size);
+          hash->hash_codes[i] = hash->hash_codes[j];
+          i = j;
+        }
+    }
+  hash->hash_codes[i] = 0;
+  hash->size--;
+  return TRUE;
+}
+
+static dang_boolean
+index_set__mutable_hash   (DangValueIndexInfo *info,
+                           void          *container,
+                           const void   **indices,
+                           const void    *element_value,
+                           dang_boolean   may_create,
+                           DangError    **error)
+{
+  DangValueTypeHash *htype = (DangValueTypeHash *) (info->owner);
+  DangValueHashTypes *tt = htype->owner;
+  DangHash *hash = * (DangHash **) container;
+  void *value_ptr;
+  if (hash == NULL)
+    {
+      dang_set_error (error, "null pointer exception");
+      return FALSE;
+    }
+  /* a missing key is an error unless may_create */
+  if (!may_create
+   && !constant_hash_get_pointer (tt, &hash->v, indices[0], &value_ptr, FALSE, error))
+    return FALSE;
+  value_ptr = constant_hash_get_pointer_for_write (tt, &hash->v, indices[0]);
+  dang_value_assign (tt->value, value_ptr, element_value);
+  return TRUE;
+}
+
+static dang_boolean
+index_get__mutable_hash (DangValueIndexInfo *info,
+                         void          *container,
+                         const void   **indices,
+                         void          *rv_out,
+                         dang_boolean   may_create,
+                         DangError    **error)
+{
+  DangHash *hash = * (DangHash **) container;
+  DangValueTypeHash *htype = (DangValueTypeHash *)info->owner;
+  DangValueHashTypes *tt = htype->owner;
+  void *value_ptr;
+  if (hash == NULL)
+    {
+      dang_set_error (error, "null pointer exception");
+      return FALSE;
+    }
+  if (!constant_hash_get_pointer (tt, &hash->v, indices[0], &value_ptr, may_create, error))
+    return FALSE;
+  dang_value_init_assign (tt->value, rv_out, value_ptr);
+  return TRUE;
+}
+
+static dang_boolean
+index_get__constant_hash (DangValueIndexInfo *info,
+                          void          *container,
+                          const void   **indices,
+                          void          *rv_out,
+                          dang_boolean   may_create,
+                          DangError    **error)
+{
+  DangValueTypeHash *htype = (DangValueTypeHash *)info->owner;
+  DangValueHashTypes *tt = htype->owner;
+  void *value_ptr;
+  if (!constant_hash_get_pointer (tt, container, indices[0], &value_ptr, may_create, error))
+    return FALSE;
+  dang_value_init_assign (tt->value, rv_out, value_ptr);
+  return TRUE;
+}
+
+dang_boolean
+dang_constant_hash_next (DangValueTypeHash *hash_type,
+                         DangConstantHash  *hash,
+                         unsigned          *position,
+                         const void       **key_out,
+                         const void       **value_out)
+{
+  DangValueHashTypes *tt = hash_type->owner;
+  unsigned i;
+  if (hash == NULL)
+    return FALSE;
+  for (i = *position; i < hash->table_size; i++)
+    if (hash->hash_codes[i] != 0)
+      {
+        const char *entry = ENTRY (tt, hash, i);
+        *key_out = entry;
+        *value_out = ENTRY_VALUE (tt, entry);
+        *position = i + 1;
+        return TRUE;
+      }
+  *position = i;
+  return FALSE;
+}
+
+/* --- methods ---
+ *
+ * Except for make_empty() and remove(), the methods are shared
+ * by the mutable and constant types; their func_data is
+ * the DangValueTypeHash of 'this'.
+ */
+static dang_boolean
+get_this (DangValueTypeHash *htype,
+          void              *arg,
+          DangConstantHash **hash_out,
+          DangError        **error)
+{
+  if (htype == &htype->owner->types[0])
+    {
+      DangHash *hash = * (DangHash **) arg;
+      if (hash == NULL)
+        {
+          dang_set_error (error, "null pointer exception");
+          return FALSE;
+        }
+      *hash_out = hash->v;
+    }
+  else
+    *hash_out = * (DangConstantHash **) arg;
+  return TRUE;
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (constant_hash_to_mutable_hash)
+{
+  DangConstantHash *in = * (DangConstantHash **) args[0];
+  DangHash *out;
+  DANG_UNUSED (func_data);
+  DANG_UNUSED (error);
+  if (in)
+    DANG_REF_COUNT_INC (in->ref_count);
+  out = dang_new (DangHash, 1);
+  out->ref_count = 1;
+  out->v = in;
+  * (DangHash **) rv_out = out;
+  return TRUE;
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (construct_empty_mutable_hash)
+{
+  DangHash *hash = dang_new (DangHash, 1);
+  DANG_UNUSED (func_data);
+  DANG_UNUSED (error);
+  DANG_UNUSED (args);
+  hash->ref_count = 1;
+  hash->v = NULL;
+  * (DangHash **) rv_out = hash;
+  return TRUE;
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (do_hash_size)
+{
+  DangConstantHash *hash;
+  if (!get_this (func_data, args[0], &hash, error))
+    return FALSE;
+  * (uint32_t *) rv_out = hash ? hash->size : 0;
+  return TRUE;
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (do_hash_contains)
+{
+  DangValueHashTypes *tt = ((DangValueTypeHash *) func_data)->owner;
+  DangConstantHash *hash;
+  unsigned i;
+  if (!get_this (func_data, args[0], &hash, error))
+    return FALSE;
+  if (hash == NULL)
+    {
+      * (char *) rv_out = 0;
+      return TRUE;
+    }
+  i = find_slot (tt, hash, args[1], get_hash_code (tt, args[1]));
+  * (char *) rv_out = hash->hash_codes[i] != 0;
+  return TRUE;
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (do_hash_remove)
+{
+  DangValueHashTypes *tt = ((DangValueTypeHash *) func_data)->owner;
+  DangHash *hash = * (DangHash **) args[0];
+  if (hash == NULL)
+    {
+      dang_set_error (error, "null pointer exception");
+      return FALSE;
+    }
+  * (char *) rv_out = constant_hash_remove (tt, &hash->v, args[1]);
+  return TRUE;
+}
+
+/* keys() and values(), as vectors in table order */
+static dang_boolean
+get_entries_vector (DangValueTypeHash *htype,
+                    void              *arg,
+                    dang_boolean       values,
+                    DangVector       **rv_out,
+                    DangError        **error)
+{
+  DangValueHashTypes *tt = htype->owner;
+  DangValueType *elt_type = values ? tt->value : tt->key;
+  unsigned offset = values ? tt->value_offset : 0;
+  DangConstantHash *hash;
+  DangVector *out;
+  char *at;
+  unsigned i;
+  if (!get_this (htype, arg, &hash, error))
+    return FALSE;
+  if (hash == NULL || hash->size == 0)
+    {
+      *rv_out = NULL;
+      return TRUE;
+    }
+  out = dang_new (DangVector, 1);
+  out->ref_count = 1;
+  out->len = hash->size;
+  out->data = dang_malloc (elt_type->sizeof_instance * hash->size);
+  at = out->data;
+  for (i = 0; i < hash->table_size; i++)
+    if (hash->hash_codes[i] != 0)
+      {
+        dang_value_init_assign (elt_type, at, ENTRY (tt, hash, i) + offset);
+        at += elt_type->sizeof_instance;
+      }
+  *rv_out = out;
+  return TRUE;
+}
+static DANG_SIMPLE_C_FUNC_DECLARE (do_hash_keys)
+{
+  return get_entries_vector (func_data, args[0], FALSE, rv_out, error);
+}
+static DANG_SIMPLE_C_FUNC_DECLARE (do_hash_values)
+{
+  return get_entries_vector (func_data, args[0], TRUE, rv_out, error);
+}
+
+static void
+add_method (DangValueTypeHash *htype,
+            const char        *name,
+            DangValueType     *rv_type,
+            DangValueType     *arg_type,
+            DangSimpleCFunc    c_func)
+{
+  DangFunctionParam params[2];
+  DangSignature *sig;
+  DangFunction *func;
+  params[0].type = &htype->base_type;
+  params[0].name = "this";
+  params[0].dir = DANG_FUNCTION_PARAM_IN;
+  params[1].type = arg_type;
+  params[1].name = "key";
+  params[1].dir = DANG_FUNCTION_PARAM_IN;
+  sig = dang_signature_new (rv_type, arg_type ? 2 : 1, params);
+  func = dang_function_new_simple_c (sig, c_func, htype, NULL);
+  dang_value_type_add_constant_method (&htype->base_type, name,
+                                       DANG_METHOD_FINAL|DANG_METHOD_PUBLIC,
+                                       func);
+  dang_function_unref (func);
+  dang_signature_unref (sig);
+}
+
+#define GET_NODE_IS_RED(n)   n->is_red
+#define SET_NODE_IS_RED(n,v)   n->is_red=v
+
+#define COMPARE_HASH_TYPES(a,b,rv)              \
+  if (a->key < b->key) rv = -1;                 \
+  else if (a->key > b->key) rv = 1;             \
+  else if (a->value < b->value) rv = -1;        \
+  else if (a->value > b->value) rv = 1;         \
+  else rv = 0;
+static DangValueHashTypes *top_hash_type = NULL;
+#define GET_HASH_TYPE_TREE() \
+        top_hash_type, DangValueHashTypes *, GET_NODE_IS_RED, SET_NODE_IS_RED, \
+        parent, left, right, COMPARE_HASH_TYPES
+
+static DangValueHashTypes *
+dang_value_hash_types (DangValueType *key,
+                       DangValueType *value)
+{
+  DangValueHashTypes *rv;
+  DangValueHashTypes dummy;
+  DangValueHashTypes *conflict;
+  DangSignature *sig;
+  DangFunction *func;
+  DangFunctionParam param;
+  unsigned i;
+  dummy.key = key;
+  dummy.value = value;
+  GSK_RBTREE_LOOKUP (GET_HASH_TYPE_TREE (), &dummy, rv);
+  if (rv)
+    return rv;
+
+  rv = dang_new0 (DangValueHashTypes, 1);
+
+  rv->key = key;
+  rv->value = value;
+  rv->value_offset = DANG_ALIGN (key->sizeof_instance, value->alignof_instance);
+  rv->entry_alignment = DANG_MAX (key->alignof_instance, value->alignof_instance);
+  rv->entry_size = DANG_ALIGN (rv->value_offset + value->sizeof_instance,
+                               rv->entry_alignment);
+
+  for (i = 0; i < 2; i++)
+    {
+      rv->types[i].base_type.magic = DANG_VALUE_TYPE_MAGIC;
+      rv->types[i].base_type.ref_count = 1;
+      rv->types[i].base_type.full_name = dang_strdup_printf ("hash<%s,%s>", key->full_name, value->full_name);
+      rv->types[i].base_type.sizeof_instance = sizeof (void*);
+      rv->types[i].base_type.alignof_instance = DANG_ALIGNOF_POINTER;
+      rv->types[i].owner = rv;
+      rv->types[i].base_type.internals.index_infos = &rv->types[i].index_info;
+      rv->types[i].index_info.owner = &rv->types[i].base_type;
+      rv->types[i].index_info.n_indices = 1;
+      rv->types[i].index_info.indices = &rv->key;
+      rv->types[i].index_info.element_type = value;
+    }
+
+  rv->types[0].base_type.init_assign = init_assign__mutable_hash;
+  rv->types[0].base_type.assign = assign__mutable_hash;
+  rv->types[0].base_type.destruct = destruct__mutable_hash;
+  rv->types[0].base_type.to_string = to_string__mutable_hash;
+  rv->types[0].index_info.get = index_get__mutable_hash;
+  rv->types[0].index_info.set = index_set__mutable_hash;
+  rv->types[0].index_info.next = NULL;
+  rv->types[1].base_type.init_assign = init_assign__constant_hash;
+  rv->types[1].base_type.assign = assign__constant_hash;
+  rv->types[1].base_type.destruct = destruct__constant_hash;
+  rv->types[1].base_type.to_string = to_string__constant_hash;
+  rv->types[1].index_info.get = index_get__constant_hash;
+  rv->types[1].index_info.set = NULL;
+  rv->types[1].index_info.next = NULL;
+
+  GSK_RBTREE_INSERT (GET_HASH_TYPE_TREE (), rv, conflict);
+  dang_assert (conflict == NULL);
+
+  dang_value_type_add_simple_member (&rv->types[0].base_type,
+                                     "v",
+                                     DANG_MEMBER_PUBLIC_READABLE,
+                                     &rv->types[1].base_type,
+                                     TRUE,
+                                     offsetof (DangHash, v));
+
+  param.type = &rv->types[1].base_type;
+  param.name = "this";
+  param.dir = DANG_FUNCTION_PARAM_IN;
+  sig = dang_signature_new (&rv->types[0].base_type, 1, &param);
+  func = dang_function_new_simple_c (sig, constant_hash_to_mutable_hash, NULL, NULL);
+  dang_value_type_add_constant_method (&rv->types[1].base_type,
+                                       "make_hash",
+                                       DANG_METHOD_FINAL|DANG_METHOD_PUBLIC,
+                                       func);
+  dang_function_unref (func);
+  dang_signature_unref (sig);
+
+  sig = dang_signature_new (&rv->types[0].base_type, 0, NULL);
+  func = dang_function_new_simple_c (sig, construct_empty_mutable_hash, NULL, NULL);
+  dang_value_type_add_constant_method (&rv->types[0].base_type,
+                                       "make_empty",
+                                       DANG_METHOD_FINAL|DANG_METHOD_PUBLIC|DANG_METHOD_STATIC,
+                                       func);
+  dang_signature_unref (sig);
+  dang_function_unref (func);
+
+  for (i = 0; i < 2; i++)
+    {
+      add_method (&rv->types[i], "size",
+                  dang_value_type_uint32 (), NULL, do_hash_size);
+      add_method (&rv->types[i], "contains",
+                  dang_value_type_boolean (), key, do_hash_contains);
+      add_method (&rv->types[i], "keys",
+                  dang_value_type_vector (key), NULL, do_hash_keys);
+      add_method (&rv->types[i], "values",
+                  dang_value_type_vector (value), NULL, do_hash_values);
+    }
+  add_method (&rv->types[0], "remove",
+              dang_value_type_boolean (), key, do_hash_remove);
+  return rv;
+}
+
+/* Whether 'key' may be the key type of a hash. */
+dang_boolean
+dang_value_type_is_hashable (DangValueType *key)
+{
+  return key->hash != NULL && key->equal != NULL;
+}
+
+DangValueType *
+dang_value_type_hash (DangValueType *key,
+                      DangValueType *value)
+{
+  dang_assert (dang_value_type_is_hashable (key));
+  return &dang_value_hash_types (key, value)->types[0].base_type;
+}
+DangValueType *
+dang_value_type_constant_hash (DangValueType *key,
+                               DangValueType *value)
+{
+  dang_assert (dang_value_type_is_hashable (key));
+  return &dang_value_hash_types (key, value)->types[1].base_type;
+}
@@ -0,0 +1,58 @@
+
+typedef struct _DangValueTypeHash DangValueTypeHash;
+typedef struct _DangValueHashTypes DangValueHashTypes;
+typedef struct _DangConstantHash DangConstantHash;
+typedef struct _DangHash DangHash;
+
+struct _DangValueTypeHash
+{
+  DangValueType base_type;
+  DangValueHashTypes *owner;
+  DangValueIndexInfo index_info;
+};
+struct _DangValueHashTypes
+{
+  DangValueType *key, *value;
+  unsigned value_offset;                /* within an entry */
+  unsigned entry_size;
+  unsigned entry_alignment;
+
+  /* for the tree of hash-types */
+  DangValueHashTypes *parent,*left,*right;
+  dang_boolean is_red;
+
+  DangValueTypeHash types[2];           /* 0=mutable, 1=constant */
+};
+
+/* An open-addressed table with linear probing.
+   A slot is empty if its hash code is 0 (see dang-hash.c).
+   Like the other containers, a table with ref_count > 1 is never modified:
+   the mutable hash copies it first. */
+struct _DangConstantHash
+{
+  unsigned ref_count;
+  unsigned size;                        /* number of entries */
+  unsigned table_size;                  /* a power of two */
+  uint32_t *hash_codes;                 /* table_size of them */
+  char *entries;                        /* table_size keys and values */
+};
+
+struct _DangHash
+{
+  DangConstantHash *v;
+  unsigned ref_count;
+};
+
+DangValueType *dang_value_type_constant_hash (DangValueType *key,
+                                              DangValueType *value);
+DangValueType *dang_value_type_hash          (DangValueType *key,
+                                              DangValueType *value);
+dang_boolean   dang_value_type_is_hashable   (DangValueType *key);
+
+/* Iterate the entries of a constant hash, in table order.
+   Start with *position = 0.  Returns FALSE when there are no more. */
+dang_boolean   dang_constant_hash_next       (DangValueTypeHash *hash_type,
+                                              DangConstantHash  *hash,
+                                              unsigned          *position,
+                                              const void       **key_out,
+                                              const void       **value_out);
@@ -10,6 +10,7 @@
 #define UNLIKELY(x) (x)
 
 #define add_simple dang_namespace_add_simple_c_from_params
+#define add_pure_simple dang_namespace_add_pure_simple_c_from_params
 
 /* --- simple, non-lazy well-typed functions --- */
 static dang_boolean
@@ -693,7 +694,7 @@ do_operator_equal_string  (void **args,
       if (b == NULL)
         * (char*) rv = 0;
       else
-        * (char*) rv = (strcmp(a->str, b->str) == 0);
+        * (char*) rv = dang_strings_equal (a, b);
     }
   return TRUE;
 }
@@ -718,7 +719,7 @@ do_operator_notequal_string  (void **args,
       if (b == NULL)
         * (char*) rv = 1;
       else
-        * (char*) rv = (strcmp(a->str, b->str) != 0);
+        * (char*) rv = !dang_strings_equal (a, b);
     }
   return TRUE;
 }
@@ -1028,47 +1029,58 @@ dang_namespace_default (void)
       add_simple (the_ns, "assert", do_assert, NULL,
                   1,
                   DANG_FUNCTION_PARAM_IN, "cond", dang_value_type_boolean ());
-      add_simple (the_ns, "abs", do_abs_float, dang_value_type_float (),
+      add_pure_simple (the_ns, "abs", do_abs_float, dang_value_type_float (),
                   1,
                   DANG_FUNCTION_PARAM_IN, "val", dang_value_type_float ());
-      add_simple (the_ns, "abs", do_abs_double, dang_value_type_double (),
+      add_pure_simple (the_ns, "abs", do_abs_double, dang_value_type_double (),
                   1,
                   DANG_FUNCTION_PARAM_IN, "val", dang_value_type_double ());
-      add_simple (the_ns, "abs", do_abs_int64, dang_value_type_uint64 (),
+      add_pure_simple (the_ns, "abs", do_abs_int64, dang_value_type_uint64 (),
                   1,
                   DANG_FUNCTION_PARAM_IN, "val", dang_value_type_int64 ());
-      add_simple (the_ns, "abs", do_abs_int32, dang_value_type_uint32 (),
+      add_pure_simple (the_ns, "abs", do_abs_int32, dang_value_type_uint32 (),
                   1,
                   DANG_FUNCTION_PARAM_IN, "val", dang_value_type_int32 ());
-      add_simple (the_ns, "abs", do_abs_int16, dang_value_type_uint16 (),
+      add_pure_simple (the_ns, "abs", do_abs_int16, dang_value_type_uint16 (),
                   1,
                   DANG_FUNCTION_PARAM_IN, "val", dang_value_type_int16 ());
-      add_simple (the_ns, "abs", do_abs_int8, dang_value_type_uint8 (),
+      add_pure_simple (the_ns, "abs", do_abs_int8, dang_value_type_uint8 (),
                   1,
                   DANG_FUNCTION_PARAM_IN, "val", dang_value_type_int8 ());
-      add_simple (the_ns, "operator_not", do_operator_not,
+      add_pure_simple (the_ns, "operator_not", do_operator_not,
                   dang_value_type_boolean (),
                   1,
                   DANG_FUNCTION_PARAM_IN, NULL, dang_value_type_boolean ());
-      add_simple (the_ns, "operator_equal", do_operator_boolean_equal,
+      add_pure_simple (the_ns, "operator_equal", do_operator_boolean_equal,
                   dang_value_type_boolean (),
                   2,
                   DANG_FUNCTION_PARAM_IN, NULL, dang_value_type_boolean (),
                   DANG_FUNCTION_PARAM_IN, NULL, dang_value_type_boolean ());
-      add_simple (the_ns, "operator_notequal", do_operator_boolean_notequal,
+      add_pure_simple (the_ns, "operator_notequal", do_operator_boolean_notequal,
                   dang_value_type_boolean (),
                   2,
                   DANG_FUNCTION_PARAM_IN, NULL, dang_value_type_boolean (),
                   DANG_FUNCTION_PARAM_IN, NULL, dang_value_type_boolean ());
+      dang_insn_pack_register_inline_op (do_operator_not, "operator_not",
+                                         dang_value_type_boolean ());
+      dang_insn_pack_register_inline_op (do_operator_boolean_equal, "operator_equal",
+                                         dang_value_type_boolean ());
+      dang_insn_pack_register_inline_op (do_operator_boolean_notequal, "operator_notequal",
+                                         dang_value_type_boolean ());
       _dang_string_init (the_ns);
       _dang_struct_init (the_ns);
 
 #define REGISTER_OPERATOR(cmd, type_suffix, sig)          \
-      dang_namespace_add_simple_c (the_ns,                \
+      do{                                                 \
+      dang_namespace_add_pure_simple_c (the_ns,           \
                                    "operator_" #cmd,      \
                                    sig,                   \
                                    do_operator_##cmd##_##type_suffix, \
-                                   NULL)
+                                   NULL);                 \
+      dang_insn_pack_register_inline_op (do_operator_##cmd##_##type_suffix, \
+                                         "operator_" #cmd, \
+                                         dang_value_type_##type_suffix ()); \
+      }while(0)
 
 #define DECLARE_SIGNATURES              \
       DangFunctionParam tmp_params[2];  \
@@ -1277,7 +1289,7 @@ dang_namespace_default (void)
 #undef REGISTER_OPERATOR
 
 #define REGISTER_CAST_FUNCTION(from_type, to_type) \
-  add_simple (the_ns, \
+  add_pure_simple (the_ns, \
               "operator_cast__" #to_type, \
               operator_cast__to_##to_type##__from_##from_type, \
               dang_value_type_##to_type (), \
@@ -1404,7 +1416,7 @@ dang_namespace_default (void)
         REGISTER_CAST_FUNCTION(char, double);
         REGISTER_CAST_FUNCTION(char, char);
 #define REGISTER_TO_STRING(type_suffix) \
-      add_simple (the_ns, "to_string", do_to_string_##type_suffix, \
+      add_pure_simple (the_ns, "to_string", do_to_string_##type_suffix, \
                   dang_value_type_string (),                                  \
                   1,                                                         \
                   DANG_FUNCTION_PARAM_IN, "a", dang_value_type_##type_suffix ())
@@ -1433,6 +1445,9 @@ dang_namespace_default (void)
       dang_namespace_unref (sys_ns);
       _dang_tensor_init (the_ns);
       _dang_array_init (the_ns);
+      _dang_spawn_init (the_ns);
+      _dang_event_loop_init (the_ns);
+      _dang_io_init (the_ns);
       _dang_enum_init (the_ns);
 
       add_variadic_c_family (the_ns,
@@ -1543,6 +1558,8 @@ void _dang_union_cleanup (void);
 void _dang_function_concat_cleanup (void);
 void _dang_tensor_cleanup (void);
 void _dang_array_cleanup (void);
+void _dang_spawn_cleanup (void);
+void _dang_channel_cleanup (void);
 void _dang_enum_cleanup (void);
 
 
@@ -1550,6 +1567,17 @@ void
 dang_cleanup (void)
 {
   DangNamespace *ns = the_ns;
+
+  /* Let spawned threads finish.  The event loop stops first,
+     so no timer or fd can wake a thread into the scheduler
+     while it is being torn down. */
+  _dang_event_loop_stop ();
+  _dang_scheduler_cleanup ();
+  _dang_event_loop_cleanup ();
+
+  /* before the functions it names are destroyed */
+  _dang_profile_cleanup ();
+
   the_ns = NULL;
   if (ns != NULL)
     {
@@ -1567,12 +1595,15 @@ dang_cleanup (void)
      therefore, type->destruct() is not allowed */
   _dang_tensor_cleanup ();
   _dang_array_cleanup();
+  _dang_spawn_cleanup ();
+  _dang_channel_cleanup ();
   _dang_value_function_cleanup ();
   _dang_template_cleanup ();
   _dang_object_cleanup2 ();
   _dang_struct_cleanup2 ();
   _dang_union_cleanup ();
   _dang_enum_cleanup ();
+  _dang_insn_pack_cleanup ();
 #ifdef DANG_DEBUG
   _dang_debug_cleanup ();
 #endif
@@ -41,6 +41,7 @@ void dang_insn_destruct (DangInsn *insn)
       dang_insn_value_clear (&insn->function_call.function);
       dang_signature_unref (insn->function_call.sig);
       dang_free (insn->function_call.params);
+      dang_free (insn->function_call.tail_destructs);
       break;
     case DANG_INSN_TYPE_JUMP_CONDITIONAL:
       dang_insn_value_clear (&insn->jump_conditional.test_value);
@@ -52,6 +53,13 @@ void dang_insn_destruct (DangInsn *insn)
       dang_free (insn->run_simple_c.args);
       dang_function_unref (insn->run_simple_c.func);
       break;
+    case DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED:
+      np = get_param_count_from_sig (insn->run_simple_c_fused.func->base.sig);
+      for (i = 0; i < np; i++)
+        dang_insn_value_clear (insn->run_simple_c_fused.args + i);
+      dang_free (insn->run_simple_c_fused.args);
+      dang_function_unref (insn->run_simple_c_fused.func);
+      break;
     case DANG_INSN_TYPE_INDEX:
       dang_insn_value_clear (&insn->index.container);
       for (i = 0; i < insn->index.index_info->n_indices; i++)
@@ -66,6 +74,85 @@ void dang_insn_destruct (DangInsn *insn)
     }
 }
 
+static inline void
+foreach_value (DangInsn *insn, DangInsnValue *value,
+               DangInsnVarFunc func, void *data)
+{
+  if (value->location == DANG_INSN_LOCATION_STACK
+   || value->location == DANG_INSN_LOCATION_POINTER)
+    func (insn, value->var, value, data);
+}
+static inline void
+foreach_var_id (DangInsn *insn, DangVarId var,
+                DangInsnVarFunc func, void *data)
+{
+  if (var != DANG_VAR_ID_INVALID)
+    func (insn, var, NULL, data);
+}
+
+void
+dang_insn_foreach_var (DangInsn       *insn,
+                       DangInsnVarFunc func,
+                       void           *data)
+{
+  unsigned i, np;
+  switch (insn->type)
+    {
+    case DANG_INSN_TYPE_INIT:
+      foreach_var_id (insn, insn->init.var, func, data);
+      break;
+    case DANG_INSN_TYPE_DESTRUCT:
+      foreach_var_id (insn, insn->destruct.var, func, data);
+      break;
+    case DANG_INSN_TYPE_ASSIGN:
+      foreach_value (insn, &insn->assign.target, func, data);
+      foreach_value (insn, &insn->assign.source, func, data);
+      break;
+    case DANG_INSN_TYPE_JUMP_CONDITIONAL:
+      foreach_value (insn, &insn->jump_conditional.test_value, func, data);
+      break;
+    case DANG_INSN_TYPE_FUNCTION_CALL:
+      np = get_param_count_from_sig (insn->function_call.sig);
+      foreach_value (insn, &insn->function_call.function, func, data);
+      for (i = 0; i < np; i++)
+        foreach_value (insn, insn->function_call.params + i, func, data);
+      foreach_var_id (insn, insn->function_call.frame_var_id, func, data);
+      for (i = 0; i < insn->function_call.n_tail_destructs; i++)
+        foreach_var_id (insn, insn->function_call.tail_destructs[i], func, data);
+      break;
+    case DANG_INSN_TYPE_RUN_SIMPLE_C:
+      np = get_param_count_from_sig (insn->run_simple_c.func->base.sig);
+      for (i = 0; i < np; i++)
+        foreach_value (insn, insn->run_simple_c.args + i, func, data);
+      break;
+    case DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED:
+      np = get_param_count_from_sig (insn->run_simple_c_fused.func->base.sig);
+      for (i = 0; i < np; i++)
+        foreach_value (insn, insn->run_simple_c_fused.args + i, func, data);
+      foreach_var_id (insn, insn->run_simple_c_fused.assign_target, func, data);
+      break;
+    case DANG_INSN_TYPE_INDEX:
+      foreach_value (insn, &insn->index.container, func, data);
+      for (i = 0; i < insn->index.index_info->n_indices; i++)
+        foreach_value (insn, insn->index.indices + i, func, data);
+      foreach_value (insn, &insn->index.element, func, data);
+      break;
+    case DANG_INSN_TYPE_CREATE_CLOSURE:
+      foreach_var_id (insn, insn->create_closure.target, func, data);
+      if (!insn->create_closure.is_literal)
+        foreach_var_id (insn, insn->create_closure.underlying.function_var, func, data);
+      np = dang_closure_factory_get_n_inputs (insn->create_closure.factory);
+      for (i = 0; i < np; i++)
+        foreach_var_id (insn, insn->create_closure.input_vars[i], func, data);
+      break;
+    case DANG_INSN_TYPE_NEW_TENSOR:
+      foreach_var_id (insn, insn->new_tensor.target, func, data);
+      break;
+    default:
+      break;
+    }
+}
+
 /* --- DangInsnValue --- */
 void
 dang_insn_value_from_compile_result (DangInsnValue *out,
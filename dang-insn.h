@@ -16,14 +16,15 @@ typedef enum
   DANG_INSN_TYPE_JUMP_CONDITIONAL,
   DANG_INSN_TYPE_FUNCTION_CALL,
   DANG_INSN_TYPE_RUN_SIMPLE_C,
-  DANG_INSN_TYPE_PUSH_CATCH_GUARD,
-  DANG_INSN_TYPE_POP_CATCH_GUARD,
   DANG_INSN_TYPE_RETURN,
   DANG_INSN_TYPE_INDEX,
 
   DANG_INSN_TYPE_CREATE_CLOSURE,
   DANG_INSN_TYPE_NEW_TENSOR,
-  DANG_INSN_TYPE_NEW_CONSTANT_TREE
+  DANG_INSN_TYPE_NEW_CONSTANT_TREE,
+
+  /* superinstructions, from dang_builder_optimize() */
+  DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED
 } DangInsnType;
 
 
@@ -94,6 +95,19 @@ struct _DangInsn_FunctionCall
   DangVarId frame_var_id;
   DangInsnValue function;
   DangInsnValue *params;         /* return-value is params[0], if there is a retval */
+
+  /* For calls to virtual methods, the offset of the method
+     in the class of the 'this' parameter, which is on the stack;
+     'function' is then a NULL literal.  0 for other calls. */
+  unsigned virtual_method_offset;
+
+  /* A call of the function to itself, just before it returns:
+     the arguments replace the parameters, the given variables
+     are destructed and the function is restarted in the same frame.
+     The return-value is not stored. */
+  dang_boolean is_tail_call;
+  unsigned n_tail_destructs;
+  DangVarId *tail_destructs;
 };
 
 typedef struct _DangInsn_Jump DangInsn_Jump;
@@ -127,19 +141,6 @@ struct _DangInsn_RunSimpleC     /* from dang_function_new_simple_c */
   DangInsnValue *args;       /* args[0] is the return-value, if non-void */
 };
 
-typedef struct _DangInsn_PushCatchGuard DangInsn_PushCatchGuard;
-struct _DangInsn_PushCatchGuard /* from mf-catch */
-{
-  DangInsn_Base base;
-  unsigned catch_block_index;
-};
-
-typedef struct _DangInsn_PopCatchGuard DangInsn_PopCatchGuard;
-struct _DangInsn_PopCatchGuard  /* from mf-catch */
-{
-  DangInsn_Base base;
-};
-
 typedef struct _DangInsn_Return DangInsn_Return;
 struct _DangInsn_Return         /* from dang_builder_add_return */
 {
@@ -191,6 +192,29 @@ struct _DangInsn_NewConstantTree
   DangValueType *value_type;
 };
 
+/* A RUN_SIMPLE_C merged with the INIT of its return-value
+   and/or the instruction that consumes the return-value. */
+typedef enum
+{
+  DANG_INSN_FUSED_TAIL_NONE,
+  DANG_INSN_FUSED_TAIL_JUMP,
+  DANG_INSN_FUSED_TAIL_JUMP_IF_ZERO,        /* test the return-value */
+  DANG_INSN_FUSED_TAIL_JUMP_IF_NONZERO,     /* test the return-value */
+  DANG_INSN_FUSED_TAIL_ASSIGN               /* memcpy the return-value */
+} DangInsnFusedTail;
+
+typedef struct _DangInsn_RunSimpleCFused DangInsn_RunSimpleCFused;
+struct _DangInsn_RunSimpleCFused  /* from dang_builder_optimize() */
+{
+  DangInsn_Base base;
+  DangFunction *func;
+  DangInsnValue *args;       /* args[0] is the return-value, on the stack */
+  dang_boolean init_return_value;
+  DangInsnFusedTail tail;
+  DangLabelId target;        /* for the JUMP tails */
+  DangVarId assign_target;   /* for the ASSIGN tail */
+};
+
 union _DangInsn
 {
   DangInsnType type;
@@ -205,18 +229,28 @@ union _DangInsn
   DangInsn_JumpConditional jump_conditional;
   DangInsn_Init init;
   DangInsn_RunSimpleC run_simple_c;
-  DangInsn_PushCatchGuard push_catch_guard;
-  DangInsn_PopCatchGuard pop_catch_guard;
   DangInsn_Return return_;
   DangInsn_Index index;
   DangInsn_NewTensor new_tensor;
   DangInsn_NewConstantTree new_constant_tree;
+  DangInsn_RunSimpleCFused run_simple_c_fused;
 };
 
 void dang_insn_init (DangInsn *insn,
                      DangInsnType type);
 void dang_insn_destruct (DangInsn *insn);
 
+/* Call 'func' for each variable the instruction mentions.
+   'value' is the operand that names the variable,
+   or NULL if the instruction names it directly. */
+typedef void (*DangInsnVarFunc) (DangInsn      *insn,
+                                 DangVarId      var,
+                                 DangInsnValue *value,
+                                 void          *data);
+void dang_insn_foreach_var (DangInsn       *insn,
+                            DangInsnVarFunc func,
+                            void           *data);
+
 
 
 typedef struct _DangInsnLabelFixup DangInsnLabelFixup;
@@ -250,6 +284,13 @@ typedef struct
 
 void         dang_insn_pack (DangInsn             *insn,
                              DangInsnPackContext  *context);
+
+/* Operators on primitive types that may be packed as typed steps */
+void         dang_insn_pack_register_inline_op (DangSimpleCFunc func,
+                                                const char     *op_name,
+                                                DangValueType  *type);
+dang_boolean dang_insn_pack_is_inline_op       (DangSimpleCFunc func);
+void         _dang_insn_pack_cleanup (void);
 void         dang_insn_dump (DangInsn *insn,
                              DangBuilderVariable *vars,
                              DangBuilderLabel *labels,
@@ -0,0 +1,308 @@
+#include <string.h>
+#include "dang.h"
+#include "config.h"
+
+/* --- the pump: a C function that moves values through a function ---
+ *
+ * pump(channel<T> input, function<T : U> function [, channel<U> output])
+ * receives each value from 'input', calls 'function' on it
+ * and, if there is an output channel, sends the result there.
+ */
+
+typedef enum
+{
+  PUMP_START,
+  PUMP_RECV,
+  PUMP_CALL,
+  PUMP_SEND
+} PumpPhase;
+
+typedef struct _PumpInfo PumpInfo;
+struct _PumpInfo
+{
+  DangValueType state_type;             /* must be first */
+  DangValueType *input_type;
+  DangValueType *result_type;           /* NULL for void functions */
+  dang_boolean has_output;
+  unsigned input_offset, result_offset; /* within the PumpState */
+};
+
+typedef struct _PumpState PumpState;
+struct _PumpState
+{
+  PumpPhase phase;
+  DangChannelWait wait;
+  DangChannel *output;                  /* closed when the pump finishes */
+
+  /* the value received and the function's result follow */
+};
+
+static void
+destruct__pump_state (DangValueType *type,
+                      void          *value)
+{
+  PumpInfo *info = (PumpInfo *) type;
+  PumpState *state = value;
+  DangValueType *rtype = info->result_type;
+  dang_channel_wait_clear (&state->wait);
+  if (state->phase == PUMP_SEND && rtype != NULL && rtype->destruct != NULL)
+    rtype->destruct (rtype, (char *) state + info->result_offset);
+  if (state->output != NULL)
+    {
+      dang_channel_close (state->output);
+      dang_channel_unref (state->output);
+    }
+}
+
+static DANG_C_FUNC_DECLARE (do_pump)
+{
+  PumpInfo *info = func_data;
+  PumpState *state = state_data;
+  DangChannel *input = * (DangChannel **) args[0];
+  DangFunction *function = * (DangFunction **) args[1];
+  char *input_value = (char *) state + info->input_offset;
+  char *result = (char *) state + info->result_offset;
+  DangValueType *itype = info->input_type;
+  DangValueType *rtype = info->result_type;
+  void *call_args[1];
+  DANG_UNUSED (rv_out);
+
+  for (;;)
+    switch (state->phase)
+      {
+      case PUMP_START:
+        if (input == NULL || function == NULL
+         || (info->has_output && * (DangChannel **) args[2] == NULL))
+          {
+            dang_set_error (error, "null-pointer exception");
+            return DANG_C_FUNCTION_ERROR;
+          }
+        if (info->has_output)
+          state->output = dang_channel_ref (* (DangChannel **) args[2]);
+        state->phase = PUMP_RECV;
+        break;
+
+      case PUMP_RECV:
+        switch (dang_channel_recv (input, input_value, thread, &state->wait))
+          {
+          case DANG_CHANNEL_WOULD_BLOCK:
+            return DANG_C_FUNCTION_YIELDED;
+          case DANG_CHANNEL_CLOSED:
+            return DANG_C_FUNCTION_SUCCESS;
+          case DANG_CHANNEL_OK:
+            break;
+          }
+
+        /* the call gets its own copy of the value */
+        state->phase = PUMP_CALL;
+        call_args[0] = input_value;
+        dang_c_function_begin_subcall (thread, function, call_args);
+        if (itype->destruct != NULL)
+          itype->destruct (itype, input_value);
+        return DANG_C_FUNCTION_BEGAN_CALL;
+
+      case PUMP_CALL:
+        /* the function has returned */
+        dang_c_function_end_subcall (thread, function, NULL, result);
+        if (state->output == NULL)
+          {
+            if (rtype != NULL && rtype->destruct != NULL)
+              rtype->destruct (rtype, result);
+            state->phase = PUMP_RECV;
+          }
+        else
+          state->phase = PUMP_SEND;
+        break;
+
+      case PUMP_SEND:
+        switch (dang_channel_send (state->output, result, thread, &state->wait))
+          {
+          case DANG_CHANNEL_WOULD_BLOCK:
+            return DANG_C_FUNCTION_YIELDED;
+          case DANG_CHANNEL_CLOSED:
+            /* nobody wants the rest */
+            return DANG_C_FUNCTION_SUCCESS;
+          case DANG_CHANNEL_OK:
+            break;
+          }
+        if (rtype->destruct != NULL)
+          rtype->destruct (rtype, result);
+        state->phase = PUMP_RECV;
+        break;
+      }
+}
+
+static DangFunction *
+pump_function_new (DangSignature *function_sig,
+                   dang_boolean   has_output)
+{
+  PumpInfo *info = dang_new0 (PumpInfo, 1);
+  DangFunctionParam params[3];
+  DangSignature *sig;
+  DangFunction *rv;
+  unsigned offset, align;
+
+  dang_assert (function_sig->n_params == 1);
+  dang_assert (function_sig->params[0].dir == DANG_FUNCTION_PARAM_IN);
+  info->input_type = function_sig->params[0].type;
+  info->result_type = function_sig->return_type;
+  if (info->result_type == dang_value_type_void ())
+    info->result_type = NULL;
+  dang_assert (!has_output || info->result_type != NULL);
+  info->has_output = has_output;
+
+  offset = sizeof (PumpState);
+  align = DANG_ALIGNOF_POINTER;
+  offset = DANG_ALIGN (offset, info->input_type->alignof_instance);
+  info->input_offset = offset;
+  offset += info->input_type->sizeof_instance;
+  align = DANG_MAX (align, info->input_type->alignof_instance);
+  if (info->result_type != NULL)
+    {
+      offset = DANG_ALIGN (offset, info->result_type->alignof_instance);
+      info->result_offset = offset;
+      offset += info->result_type->sizeof_instance;
+      align = DANG_MAX (align, info->result_type->alignof_instance);
+    }
+  else
+    info->result_offset = offset;
+  info->state_type.sizeof_instance = offset;
+  info->state_type.alignof_instance = align;
+  info->state_type.destruct = destruct__pump_state;
+  info->state_type.full_name = "internal-pump-state";
+
+  params[0].dir = DANG_FUNCTION_PARAM_IN;
+  params[0].name = "input";
+  params[0].type = dang_value_type_channel (info->input_type);
+  params[1].dir = DANG_FUNCTION_PARAM_IN;
+  params[1].name = "function";
+  params[1].type = dang_value_type_function (function_sig);
+  params[2].dir = DANG_FUNCTION_PARAM_IN;
+  params[2].name = "output";
+  params[2].type = has_output ? dang_value_type_channel (info->result_type) : NULL;
+  sig = dang_signature_new (NULL, has_output ? 3 : 2, params);
+  rv = dang_function_new_c (sig, &info->state_type, do_pump, info, dang_free);
+  dang_signature_unref (sig);
+  return rv;
+}
+
+DangSpawned *
+dang_io_connect (DangChannel  *producer,
+                 DangFunction *consumer)
+{
+  DangFunction *pump = pump_function_new (consumer->base.sig, FALSE);
+  void *args[2] = { &producer, &consumer };
+  DangSpawned *rv = dang_spawn (pump, args);
+  dang_function_unref (pump);
+  return rv;
+}
+
+DangChannel *
+dang_producer_new_filter (DangChannel  *underlying,
+                          DangFunction *function)
+{
+  DangFunction *pump = pump_function_new (function->base.sig, TRUE);
+  DangChannel *rv = dang_channel_new (function->base.sig->return_type,
+                                      dang_channel_get_capacity (underlying));
+  void *args[3] = { &underlying, &function, &rv };
+  DangThread *thread = dang_thread_new (pump, 3, args);
+  dang_scheduler_push (dang_scheduler_get_default (), thread);
+  dang_thread_unref (thread);
+  dang_function_unref (pump);
+  return rv;
+}
+
+/* --- connect() and filter() --- */
+static DANG_SIMPLE_C_FUNC_DECLARE (do_connect)
+{
+  DangChannel *producer = * (DangChannel **) args[0];
+  DangFunction *consumer = * (DangFunction **) args[1];
+  DANG_UNUSED (func_data);
+  if (producer == NULL || consumer == NULL)
+    {
+      dang_set_error (error, "null-pointer exception");
+      return FALSE;
+    }
+  * (DangSpawned **) rv_out = dang_io_connect (producer, consumer);
+  return TRUE;
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (do_filter)
+{
+  DangChannel *underlying = * (DangChannel **) args[0];
+  DangFunction *function = * (DangFunction **) args[1];
+  DANG_UNUSED (func_data);
+  if (underlying == NULL || function == NULL)
+    {
+      dang_set_error (error, "null-pointer exception");
+      return FALSE;
+    }
+  * (DangChannel **) rv_out = dang_producer_new_filter (underlying, function);
+  return TRUE;
+}
+
+/* Match (channel<T>, function<T : U>); func_data is the name. */
+static DANG_FUNCTION_TRY_SIG_FUNC_DECLARE (try_sig__channel_func)
+{
+  const char *name = data;
+  dang_boolean is_filter = strcmp (name, "filter") == 0;
+  DangValueTypeChannel *ctype;
+  DangFunctionParam params[2];
+  DangSignature *func_sig, *sig;
+  DangValueType *rv_type;
+  DangFunction *rv;
+  if (query->n_elements != 2
+   || query->elements[0].type != DANG_MATCH_QUERY_ELEMENT_SIMPLE_INPUT
+   || !dang_value_type_is_channel (query->elements[0].info.simple_input))
+    return NULL;
+  ctype = (DangValueTypeChannel *) query->elements[0].info.simple_input;
+
+  params[0].dir = DANG_FUNCTION_PARAM_IN;
+  params[0].name = NULL;
+  params[0].type = ctype->element_type;
+  if (!dang_match_function_from_params (query->elements + 1, 1, params,
+                                        name, &func_sig, error))
+    return NULL;
+  if (is_filter)
+    {
+      if (func_sig->return_type == NULL
+       || func_sig->return_type == dang_value_type_void ())
+        {
+          dang_set_error (error, "function argument to filter must not return void");
+          dang_signature_unref (func_sig);
+          return NULL;
+        }
+      rv_type = dang_value_type_channel (func_sig->return_type);
+    }
+  else
+    rv_type = dang_value_type_thread (NULL);
+
+  params[0].type = (DangValueType *) ctype;
+  params[1].dir = DANG_FUNCTION_PARAM_IN;
+  params[1].name = NULL;
+  params[1].type = dang_value_type_function (func_sig);
+  sig = dang_signature_new (rv_type, 2, params);
+  rv = dang_function_new_simple_c (sig, is_filter ? do_filter : do_connect,
+                                   NULL, NULL);
+  dang_signature_unref (sig);
+  dang_signature_unref (func_sig);
+  return rv;
+}
+
+void
+_dang_io_init (DangNamespace *ns)
+{
+  static const char *names[] = { "connect", "filter" };
+  DangError *error = NULL;
+  unsigned i;
+  for (i = 0; i < DANG_N_ELEMENTS (names); i++)
+    {
+      DangFunctionFamily *family;
+      family = dang_function_family_new_variadic_c (names[i],
+                                                    try_sig__channel_func,
+                                                    (void *) names[i], NULL);
+      if (!dang_namespace_add_function_family (ns, names[i], family, &error))
+        dang_die ("adding '%s' failed: %s", names[i], error->message);
+      dang_function_family_unref (family);
+    }
+}
@@ -1,40 +1,26 @@
+/* --- streaming pipelines built from channels ---
+ *
+ * A producer is a channel<T> that some thread sends into and closes
+ * when it is done.  A consumer is a function taking one T.
+ * Each stage runs in its own dang thread, and the channels between
+ * them are bounded, so a pipeline runs in bounded memory
+ * however large its input is.
+ *
+ * From dang:
+ *   connect(channel<T> c, function<T> consumer) : thread<void>
+ *   filter(channel<T> c, function<T : U> f) : channel<U>
+ */
 
-/* --- producer --- */
-typedef struct _DangProducerClass DangProducerClass;
-typedef struct _DangProducer DangProducer;
-struct _DangProducerClass
-{
-  DangObjectClass base_class;
-  DangValueType *element_type;
-  DangFunction *advance;
-};
-struct _DangProducer
-{
-  DangObject base_instance;
-  dang_boolean has_entry;
-  /* value follows */
-};
-DangValueType *dang_value_type_producer (DangValueType *element_type);
+/* Spawn a thread that calls 'consumer' on each value received from
+   'producer', finishing once 'producer' is closed and drained. */
+DangSpawned *dang_io_connect (DangChannel  *producer,
+                              DangFunction *consumer);
 
-/* --- consumer --- */
-typedef struct _DangConsumerClass DangConsumerClass;
-typedef struct _DangConsumer DangConsumer;
-struct _DangConsumerClass
-{
-  DangObjectClass base_class;
-  DangValueType *element_type;
-  DangFunction *consume;
-};
-struct _DangConsumer
-{
-  DangObject base_instance;
-};
-DangValueType *dang_value_type_consumer (DangValueType *element_type);
+/* Spawn a thread that sends function(v) for each v received from
+   'underlying' into the returned channel, which has the same capacity.
+   The returned channel is closed when 'underlying' is,
+   or if 'function' throws. */
+DangChannel *dang_producer_new_filter (DangChannel  *underlying,
+                                       DangFunction *function);
 
-
-void dang_io_connect (DangProducer *producer,
-                      DangConsumer *consumer);
-
-
-DangProducer *dang_producer_new_filter (DangProducer *underlying,
-                                        DangFunction *function);
+void _dang_io_init (DangNamespace *ns);
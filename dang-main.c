@@ -34,6 +34,23 @@ usage (void)
    "  --not-interactive   Not interactive mode.\n"
    "  --quiet-exceptions  Do not print exception information.\n"
    "  -I dir              Add directory to include path.\n"
+   "  --dispatch=MODE     Step dispatch: threaded, loop or counting\n"
+   "                      (counting reports the number of steps run).\n"
+   "  --profile[=NAME]    Profile the program, writing a report to NAME.txt\n"
+   "                      and collapsed stacks (for flamegraph tools)\n"
+   "                      to NAME.folded (default NAME: dang-profile).\n"
+   "  -O0, -O1, -O2       Optimization level: none, superinstructions only,\n"
+   "                      or also fold constants, remove dead code,\n"
+   "                      eliminate tail calls and fuse element-wise\n"
+   "                      tensor expressions (default).\n"
+   "  --no-fuse-steps     Do not merge common step sequences into superinstructions.\n"
+   "  --no-fuse-tensor-exprs\n"
+   "                      Run each element-wise tensor operator separately.\n"
+   "  --workers=N         Run spawned threads, and split large matrix\n"
+   "                      multiplies, on N OS threads (default: one per cpu).\n"
+   "  --tensor-kernels=SET\n"
+   "                      Element-wise tensor kernels: scalar, sse2 or avx2\n"
+   "                      (default: the widest the cpu supports).\n"
    "\n"
    "See --help-debug for debugging options.\n"
   );
@@ -47,6 +64,8 @@ debug_options_usage (void)
            "Debug options:\n"
            "  --debug-disassemble        Print opcodes\n"
            "  --debug-dump-exprs         Print parsed expressions.\n"
+           "  --debug-frame-sizes        Print the frame size of each function.\n"
+           "  --debug-method-caches      Print the hit rate of each method call site.\n"
            //"  --debug-run                Print steps as they are run.\n"
            //"  --debug-run-data           Print locals (before the step is executed).\n"
            "  --debug-all                Enable all debugging.\n"
@@ -92,7 +111,7 @@ static void
 function_run (DangFunction *function)
 {
   DangThread *thread = dang_thread_new (function, 0, NULL);
-  dang_thread_run (thread);
+  dang_thread_run_and_wait (thread);
   switch (thread->status)
     {
     case DANG_THREAD_STATUS_YIELDED:
@@ -274,6 +293,10 @@ int main(int argc, char **argv)
             dang_debug_disassemble = TRUE;
           else if (strcmp (argv[i], "--debug-dump-exprs") == 0)
             dang_debug_parse = TRUE;
+          else if (strcmp (argv[i], "--debug-frame-sizes") == 0)
+            dang_debug_frame_sizes = TRUE;
+          else if (strcmp (argv[i], "--debug-method-caches") == 0)
+            dang_debug_method_caches = TRUE;
           //else if (strcmp (argv[i], "--debug-run") == 0)
             //dang_debug_run = TRUE;
           //else if (strcmp (argv[i], "--debug-run-data") == 0)
@@ -312,6 +335,54 @@ int main(int argc, char **argv)
             {
               quiet_exceptions = TRUE;
             }
+          else if (strncmp (argv[i], "--dispatch=", 11) == 0)
+            {
+              if (!dang_thread_dispatch_parse (argv[i] + 11,
+                                               &dang_thread_dispatch))
+                {
+                  fprintf (stderr, "unknown dispatch mode '%s'\n", argv[i] + 11);
+                  return 1;
+                }
+            }
+          else if (strcmp (argv[i], "--profile") == 0
+                || strncmp (argv[i], "--profile=", 10) == 0)
+            {
+              dang_profile_output = argv[i][9] ? argv[i] + 10 : "dang-profile";
+              dang_thread_dispatch = DANG_THREAD_DISPATCH_PROFILING;
+            }
+          else if (strncmp (argv[i], "-O", 2) == 0
+                && argv[i][2] >= '0' && argv[i][2] <= '9' && argv[i][3] == 0)
+            {
+              dang_builder_optimize_flags = dang_builder_optimize_level_flags (argv[i][2] - '0');
+            }
+          else if (strncmp (argv[i], "--workers=", 10) == 0)
+            {
+              dang_scheduler_default_n_workers = atoi (argv[i] + 10);
+            }
+          else if (strncmp (argv[i], "--tensor-kernels=", 17) == 0)
+            {
+              DangTensorKernelSet set;
+              if (!dang_tensor_kernel_set_parse (argv[i] + 17, &set))
+                {
+                  fprintf (stderr, "unknown tensor kernel set '%s'\n", argv[i] + 17);
+                  return 1;
+                }
+              if (dang_tensor_kernels_get (set) == NULL)
+                {
+                  fprintf (stderr, "tensor kernel set '%s' not supported by this cpu\n",
+                           argv[i] + 17);
+                  return 1;
+                }
+              dang_tensor_kernels = dang_tensor_kernels_get (set);
+            }
+          else if (strcmp (argv[i], "--no-fuse-steps") == 0)
+            {
+              dang_builder_optimize_flags &= ~DANG_BUILDER_OPTIMIZE_FUSE;
+            }
+          else if (strcmp (argv[i], "--no-fuse-tensor-exprs") == 0)
+            {
+              dang_builder_optimize_flags &= ~DANG_BUILDER_OPTIMIZE_TENSOR_EXPRS;
+            }
           else if (strcmp (argv[i], "-I") == 0)
             {
               if (i + 1 == (unsigned)argc)
@@ -430,6 +501,9 @@ int main(int argc, char **argv)
   dang_parser_destroy (parser);
 
 cleanup:
+  if (dang_thread_dispatch == DANG_THREAD_DISPATCH_COUNTING)
+    fprintf (stderr, "steps run: %llu\n",
+             (unsigned long long) dang_thread_n_steps_run);
   dang_imports_unref (imports);
   dang_string_unref (filename);
   dang_cleanup ();
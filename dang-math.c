@@ -203,12 +203,12 @@ _dang_math_init (DangNamespace *ns)
   params[0].type = dang_value_type_double ();
   params[0].name = "arg";
   sig = dang_signature_new (dang_value_type_double (), 1, params);
-  dang_namespace_add_simple_c (ns, "sin", sig, do_sin, NULL);
-  dang_namespace_add_simple_c (ns, "cos", sig, do_cos, NULL);
-  dang_namespace_add_simple_c (ns, "tan", sig, do_tan, NULL);
-  dang_namespace_add_simple_c (ns, "exp", sig, do_exp, NULL);
-  dang_namespace_add_simple_c (ns, "log", sig, do_log, NULL);
-  dang_namespace_add_simple_c (ns, "sqrt", sig, do_sqrt, NULL);
+  dang_namespace_add_pure_simple_c (ns, "sin", sig, do_sin, NULL);
+  dang_namespace_add_pure_simple_c (ns, "cos", sig, do_cos, NULL);
+  dang_namespace_add_pure_simple_c (ns, "tan", sig, do_tan, NULL);
+  dang_namespace_add_pure_simple_c (ns, "exp", sig, do_exp, NULL);
+  dang_namespace_add_pure_simple_c (ns, "log", sig, do_log, NULL);
+  dang_namespace_add_pure_simple_c (ns, "sqrt", sig, do_sqrt, NULL);
   dang_namespace_add_const_global (ns, "pi", dang_value_type_double (),
                                    &pi_double, &off, NULL);
   dang_signature_unref (sig);
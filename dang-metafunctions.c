@@ -591,7 +591,6 @@ static DANG_METAFUNCTION_COMPILE_FUNC_DECLARE (compile__catch)
   DangValueType **types;
   DangExpr **cb_exprs;
   DangCatchBlockId cb_id;
-  DangInsn insn;
   DangCompileFlags void_flags = DANG_COMPILE_FLAGS_VOID;
   DangLabelId post_label;
   DangBuilderCatchClause *clauses;
@@ -646,10 +645,9 @@ static DANG_METAFUNCTION_COMPILE_FUNC_DECLARE (compile__catch)
           clauses[i].var_id = var_id->var_id;
         }
     }
-  dang_insn_init (&insn, DANG_INSN_TYPE_PUSH_CATCH_GUARD);
+  /* the catch block covers the "try" body; no code is needed
+     to enter or leave it, throws find it in the function's table */
   cb_id = dang_builder_start_catch_block (builder, N, clauses);
-  insn.push_catch_guard.catch_block_index = cb_id;
-  dang_builder_add_insn (builder, &insn);
 
   /* compile "try" body */
   dang_builder_push_local_scope (builder);
@@ -659,10 +657,7 @@ static DANG_METAFUNCTION_COMPILE_FUNC_DECLARE (compile__catch)
     return;
   dang_compile_result_clear (result, builder);
 
-  /* pop the catch block */
-  dang_insn_init (&insn, DANG_INSN_TYPE_POP_CATCH_GUARD);
   dang_builder_end_catch_block (builder, cb_id);
-  dang_builder_add_insn (builder, &insn);
 
   /* goto after the whole thing */
   post_label = dang_builder_create_label (builder);
@@ -1406,6 +1401,9 @@ DANG_METAFUNCTION_COMPILE_FUNC_DECLARE(compile__define_function)
           dang_error_unref (error);
           return;
         }
+      dang_profile_name_function (function,
+                                  ns == dang_namespace_default () ? NULL : ns->full_name,
+                                  symbol_name);
       dang_function_unref (function);
     }
 
@@ -1865,6 +1863,7 @@ static DANG_METAFUNCTION_ANNOTATE_FUNC_DECLARE(annotate__define_object)
                                            name, flags,
                                            func, error))
                 return FALSE;
+              dang_profile_name_function (func, object_type->full_name, name);
               dang_function_unref (func);
             }
           else
@@ -2968,6 +2967,10 @@ static DANG_METAFUNCTION_COMPILE_FUNC_DECLARE (compile__invoke)
   DangExprTag *tag;
   DangCompileResult object_res;
   dang_boolean need_implicit_this = 0;
+  DangValueMethod *virtual_method = NULL;
+
+  if (dang_compile_fused_tensor_expr (expr, builder, flags, result))
+    return;
 
   tag = dang_expr_get_annotation (builder->annotations, expr->function.args[0], DANG_EXPR_ANNOTATION_TAG);
   dang_assert (tag != NULL);
@@ -3004,6 +3007,14 @@ static DANG_METAFUNCTION_COMPILE_FUNC_DECLARE (compile__invoke)
                                                 method->method_func_type,
                                                 &method->func);
             }
+          else if ((method->flags & DANG_METHOD_MUTABLE) == 0
+                && object_res.type == DANG_COMPILE_RESULT_STACK
+                && dang_value_type_is_object (tag->info.method.method_type))
+            {
+              /* looked up in the class when run, through an inline cache */
+              virtual_method = method;
+              dang_compile_result_init_void (&func_name_res);
+            }
           else
             {
               DangFunction *f = method->get_func;
@@ -3046,7 +3057,8 @@ static DANG_METAFUNCTION_COMPILE_FUNC_DECLARE (compile__invoke)
         {
           DangExpr *type_expr = expr->function.args[0]->function.args[0];
           DangValueType *type = *(DangValueType**)type_expr->value.value;
-          dang_object_note_method_stubs (type, builder->function->stub.cc);
+          if (dang_value_type_is_object (type))
+            dang_object_note_method_stubs (type, builder->function->stub.cc);
         }
       fnflags.permit_literal = 1;
       dang_compile (expr->function.args[0], builder, &fnflags, &func_name_res);
@@ -3077,7 +3089,7 @@ static DANG_METAFUNCTION_COMPILE_FUNC_DECLARE (compile__invoke)
           dang_assert (arg->function.n_args == 1);
           arg = arg->function.args[0];
 
-          if (sig->params[i].dir == DANG_FUNCTION_PARAM_IN)
+          if (sig->params[target_param].dir == DANG_FUNCTION_PARAM_IN)
             {
               dang_compile_result_set_error (result, &expr->any.code_position,
                                              "got '&' on input parameter");
@@ -3086,15 +3098,15 @@ static DANG_METAFUNCTION_COMPILE_FUNC_DECLARE (compile__invoke)
         }
       else
         {
-          if (sig->params[i].dir != DANG_FUNCTION_PARAM_IN)
+          if (sig->params[target_param].dir != DANG_FUNCTION_PARAM_IN)
             {
-              const char *n = dang_function_param_dir_name (sig->params[i].dir);
+              const char *n = dang_function_param_dir_name (sig->params[target_param].dir);
               dang_compile_result_set_error (result, &expr->any.code_position,
                                              "need '&' on %s parameter", n);
               return;
             }
         }
-      switch (sig->params[i].dir)
+      switch (sig->params[target_param].dir)
         {
         case DANG_FUNCTION_PARAM_IN: f = &subflags_in; break;
         case DANG_FUNCTION_PARAM_OUT: f = &subflags_out; break;
@@ -3123,8 +3135,12 @@ static DANG_METAFUNCTION_COMPILE_FUNC_DECLARE (compile__invoke)
                                       dang_builder_add_tmp (builder, rettype),
                                       FALSE, TRUE, FALSE);
     }
-  dang_compile_function_invocation (&func_name_res, builder,
-                                    ret_res, sig->n_params, results);
+  if (virtual_method != NULL)
+    dang_compile_virtual_method_invocation (sig, virtual_method->offset, builder,
+                                            ret_res, sig->n_params, results);
+  else
+    dang_compile_function_invocation (&func_name_res, builder,
+                                      ret_res, sig->n_params, results);
   if (ret_res)
     {
       *result = *ret_res;
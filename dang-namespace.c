@@ -403,6 +403,22 @@ dang_function_new_simple_c_from_params (DangSimpleCFunc func,
   return rv;
 }
 
+static void
+add_simple_c_function (DangNamespace *ns,
+                       const char    *name,
+                       DangFunction  *function,
+                       dang_boolean   is_pure)
+{
+  DangError *error = NULL;
+  function->simple_c.is_pure = is_pure;
+  if (!dang_namespace_add_function (ns, name, function, &error))
+    {
+      dang_die ("error adding simple c function '%s' to namespace '%s' (%s)",
+                ns->full_name, name, error->message);
+    }
+  dang_function_unref (function);
+}
+
 void
 dang_namespace_add_simple_c_from_params (DangNamespace *ns,
                              const char    *name,
@@ -413,17 +429,28 @@ dang_namespace_add_simple_c_from_params (DangNamespace *ns,
 {
   DangFunction *function;
   va_list args;
-  DangError *error = NULL;
   va_start (args, n_params);
   function = dang_function_new_simple_c_from_params_valist (func, rv_type,
                                                       n_params, args);
   va_end (args);
-  if (!dang_namespace_add_function (ns, name, function, &error))
-    {
-      dang_die ("error adding simple c function '%s' to namespace '%s' (%s)",
-                ns->full_name, name, error->message);
-    }
-  dang_function_unref (function);
+  add_simple_c_function (ns, name, function, FALSE);
+}
+
+void
+dang_namespace_add_pure_simple_c_from_params (DangNamespace *ns,
+                             const char    *name,
+                             DangSimpleCFunc func,
+                             DangValueType *rv_type,
+                             unsigned       n_params,
+                             ...)
+{
+  DangFunction *function;
+  va_list args;
+  va_start (args, n_params);
+  function = dang_function_new_simple_c_from_params_valist (func, rv_type,
+                                                      n_params, args);
+  va_end (args);
+  add_simple_c_function (ns, name, function, TRUE);
 }
 
 
@@ -433,13 +460,18 @@ void dang_namespace_add_simple_c             (DangNamespace *ns,
                                               DangSimpleCFunc func,
                                               void           *func_data)
 {
-  DangFunction *function;
-  DangError *error = NULL;
-  function = dang_function_new_simple_c (sig, func, func_data, NULL);
-  if (!dang_namespace_add_function (ns, name, function, &error))
-    {
-      dang_die ("error adding simple c function '%s' to namespace '%s' (%s)",
-                ns->full_name, name, error->message);
-    }
-  dang_function_unref (function);
+  add_simple_c_function (ns, name,
+                         dang_function_new_simple_c (sig, func, func_data, NULL),
+                         FALSE);
+}
+
+void dang_namespace_add_pure_simple_c        (DangNamespace *ns,
+                                              const char    *name,
+                                              DangSignature *sig,
+                                              DangSimpleCFunc func,
+                                              void           *func_data)
+{
+  add_simple_c_function (ns, name,
+                         dang_function_new_simple_c (sig, func, func_data, NULL),
+                         TRUE);
 }
@@ -126,6 +126,20 @@ void dang_namespace_add_simple_c_from_params (DangNamespace *ns,
                                               DangValueType *rv_type,
                                               unsigned       n_params,
                                               ...);
+
+/* The same, for functions that write nothing but their
+   output parameters (see dang_function_is_pure()). */
+void dang_namespace_add_pure_simple_c        (DangNamespace *ns,
+                                              const char    *name,
+                                              DangSignature *sig,
+                                              DangSimpleCFunc func,
+                                              void           *func_data);
+void dang_namespace_add_pure_simple_c_from_params (DangNamespace *ns,
+                                              const char    *name,
+                                              DangSimpleCFunc func,
+                                              DangValueType *rv_type,
+                                              unsigned       n_params,
+                                              ...);
 DangFunction *dang_function_new_simple_c_from_params (DangSimpleCFunc func,
                                              DangValueType *rv_type,
                                              unsigned       n_params,
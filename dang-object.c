@@ -555,6 +555,7 @@ dang_object_add_constructor (DangValueType  *object_type,
   new_func->base.steps = &new_func->new_object.step;
   new_func->new_object.step.func = step__new;
   new_func->new_object.step._step_data_size = 0;
+  new_func->new_object.step.flags = 0;
   new_func->new_object.object_type = object_type;
   new_func->new_object.must_unref_constructor = 0;
   if (!func->base.is_owned)
@@ -648,7 +649,7 @@ dang_object_unref (void *obj)
   dang_assert (o->ref_count > 0);
   dang_assert (dang_value_type_is_object (o->the_class->type));
   DEBUG_OBJECT_REF_COUNT_MSG (("dang_object_unref(%p:%s): %u => %u", o, o->the_class->type->full_name, o->ref_count, o->ref_count-1));
-  if (--(o->ref_count) == 0)
+  if (DANG_REF_COUNT_DEC (o->ref_count) == 0)
     {
       for (c = (DangValueTypeObject *) o->the_class->type;
            c != NULL;
@@ -670,7 +671,7 @@ dang_object_ref (void *obj)
   dang_assert (dang_value_type_is_object (o->the_class->type));
   dang_assert (o->ref_count > 0);
   DEBUG_OBJECT_REF_COUNT_MSG (("dang_object_ref(%p:%s): %u => %u", o, o->the_class->type->full_name, o->ref_count, o->ref_count+1));
-  ++(o->ref_count);
+  DANG_REF_COUNT_INC (o->ref_count);
   return o;
 }
 
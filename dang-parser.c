@@ -370,6 +370,8 @@ default_parse           (DangParser *parser,
           { "vector", DANG_DEFAULTPARSER_TOKEN_VECTOR },
           { "matrix", DANG_DEFAULTPARSER_TOKEN_MATRIX },
           { "tree", DANG_DEFAULTPARSER_TOKEN_TREE },
+          { "hash", DANG_DEFAULTPARSER_TOKEN_HASH },
+          { "channel", DANG_DEFAULTPARSER_TOKEN_CHANNEL },
         };
         for (i = 0; i < DANG_N_ELEMENTS (reserved_words); i++)
           if (strcmp (reserved_words[i].word, token->v_bareword.name) == 0)
@@ -0,0 +1,556 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "config.h"
+#include "gskrbtreemacros.h"
+#include "gskqsortmacro.h"
+#include "dang.h"
+
+const char *dang_profile_output = NULL;
+
+/* Calling contexts deeper than this are folded into their parent. */
+#define MAX_DEPTH               1000
+
+/* Steps are counted in an array indexed by their offset
+   from the function's first step, in units of STEP_GRANULE. */
+#define STEP_GRANULE            sizeof (unsigned)
+
+/* Number of source lines listed in the report. */
+#define MAX_REPORT_LINES        50
+
+typedef struct _ProfileFunction ProfileFunction;
+typedef struct _ProfileNode ProfileNode;
+typedef struct _ShadowFrame ShadowFrame;
+
+struct _ProfileFunction
+{
+  DangFunction *function;
+  char *name;
+
+  uint64_t calls, steps, self_ns;
+
+  /* allocated once the function runs, if it has steps */
+  DangStep *first_step;
+  unsigned n_step_counts;
+  uint64_t *step_counts;
+
+  /* used while writing the report */
+  uint64_t total_ns;
+  unsigned n_active;
+
+  ProfileFunction *left, *right, *parent;
+  dang_boolean is_red;
+};
+
+/* A node of the calling-context tree: one per distinct chain of callers. */
+struct _ProfileNode
+{
+  ProfileFunction *pfunction;           /* NULL for the root */
+  ProfileNode *parent, *first_child, *next_sibling;
+  unsigned depth;
+  uint64_t self_ns;
+};
+
+/* The profiler's view of a thread's stack. */
+struct _ShadowFrame
+{
+  DangThreadStackFrame *frame;
+  DangFunction *function;
+  ProfileFunction *pfunction;
+  ProfileNode *node;
+};
+
+struct _DangProfileThread
+{
+  DangUtilArray shadow;                 /* of ShadowFrame */
+  uint64_t last_time;
+};
+
+static ProfileFunction *profile_function_tree = NULL;
+static ProfileNode profile_root;
+
+#define GET_IS_RED(pf)  (pf)->is_red
+#define SET_IS_RED(pf,v)  (pf)->is_red = v
+#define PROFILE_FUNCTION_COMPARE(a,b, rv) \
+    GSK_QSORT_SIMPLE_COMPARATOR(a->function, b->function, rv)
+#define COMPARE_KEY_TO_PROFILE_FUNCTION(a,b, rv) \
+    GSK_QSORT_SIMPLE_COMPARATOR(a, b->function, rv)
+#define GET_PROFILE_FUNCTION_TREE() \
+  profile_function_tree, ProfileFunction *, GET_IS_RED, SET_IS_RED, \
+  parent, left, right, PROFILE_FUNCTION_COMPARE
+
+static inline uint64_t
+get_time_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static ProfileFunction *
+get_profile_function (DangFunction *function)
+{
+  ProfileFunction *pf, *conflict;
+  GSK_RBTREE_LOOKUP_COMPARATOR (GET_PROFILE_FUNCTION_TREE (),
+                                function, COMPARE_KEY_TO_PROFILE_FUNCTION,
+                                pf);
+  if (pf != NULL)
+    return pf;
+  pf = dang_new0 (ProfileFunction, 1);
+  pf->function = dang_function_ref (function);
+  GSK_RBTREE_INSERT (GET_PROFILE_FUNCTION_TREE (), pf, conflict);
+  dang_assert (conflict == NULL);
+  return pf;
+}
+
+void
+dang_profile_name_function (DangFunction  *function,
+                            const char    *prefix,
+                            const char    *name)
+{
+  ProfileFunction *pf;
+  if (dang_profile_output == NULL)
+    return;
+  pf = get_profile_function (function);
+  if (pf->name != NULL)
+    return;
+  if (prefix != NULL && prefix[0] != 0)
+    pf->name = dang_strdup_printf ("%s.%s", prefix, name);
+  else
+    pf->name = dang_strdup (name);
+}
+
+/* --- Tracking the stack --- */
+static ShadowFrame *
+push_shadow_frame (DangProfileThread    *profile,
+                   ProfileNode          *parent,
+                   DangThreadStackFrame *frame)
+{
+  DangFunction *function = frame->function;
+  ProfileNode *node, **p_child;
+  ProfileFunction *pf;
+  ShadowFrame *shadow;
+
+  if (parent->pfunction != NULL && parent->pfunction->function == function)
+    {
+      /* direct recursion shares its caller's node */
+      node = parent;
+    }
+  else
+    {
+      for (p_child = &parent->first_child; *p_child != NULL;
+           p_child = &(*p_child)->next_sibling)
+        if ((*p_child)->pfunction->function == function)
+          break;
+      node = *p_child;
+      if (node != NULL)
+        {
+          /* move to front: callers usually have a few hot callees */
+          *p_child = node->next_sibling;
+          node->next_sibling = parent->first_child;
+          parent->first_child = node;
+        }
+      else if (parent->depth >= MAX_DEPTH)
+        node = parent;
+      else
+        {
+          node = dang_new0 (ProfileNode, 1);
+          node->pfunction = get_profile_function (function);
+          node->parent = parent;
+          node->depth = parent->depth + 1;
+          node->next_sibling = parent->first_child;
+          parent->first_child = node;
+        }
+    }
+
+  pf = node->pfunction;
+  if (pf == NULL || pf->function != function)
+    pf = get_profile_function (function);
+  if (pf->step_counts == NULL
+   && function->base.stack_info != NULL
+   && function->base.stack_info->first_step != NULL)
+    {
+      DangFunctionStackInfo *stack_info = function->base.stack_info;
+      pf->first_step = stack_info->first_step;
+      pf->n_step_counts = ((char*)stack_info->last_step
+                           - (char*)stack_info->first_step) / STEP_GRANULE + 1;
+      pf->step_counts = dang_new0 (uint64_t, pf->n_step_counts);
+    }
+  pf->calls++;
+
+  dang_util_array_set_size (&profile->shadow, profile->shadow.len + 1);
+  shadow = DANG_UTIL_ARRAY_INDEX_PTR (&profile->shadow, ShadowFrame,
+                                      profile->shadow.len - 1);
+  shadow->frame = frame;
+  shadow->function = function;
+  shadow->pfunction = pf;
+  shadow->node = node;
+  return shadow;
+}
+
+static void
+charge_time (DangProfileThread *profile)
+{
+  uint64_t now = get_time_ns ();
+  if (profile->shadow.len > 0)
+    {
+      ShadowFrame *top = DANG_UTIL_ARRAY_INDEX_PTR (&profile->shadow,
+                                                    ShadowFrame,
+                                                    profile->shadow.len - 1);
+      top->node->self_ns += now - profile->last_time;
+      top->pfunction->self_ns += now - profile->last_time;
+    }
+  profile->last_time = now;
+}
+
+static inline dang_boolean
+shadow_matches (ShadowFrame *shadow, DangThreadStackFrame *frame)
+{
+  return shadow->frame == frame && shadow->function == frame->function;
+}
+
+/* The current frame is not the top of the shadow stack:
+   pop back to it (a return or throw) or its caller (a call).
+   Failing that, rebuild the shadow stack from the frame's callers. */
+static ShadowFrame *
+change_frame (DangProfileThread    *profile,
+              DangThreadStackFrame *frame)
+{
+  DangUtilArray chain = DANG_UTIL_ARRAY_STATIC_INIT (DangThreadStackFrame *);
+  DangThreadStackFrame *at;
+  ShadowFrame *top = NULL;
+  unsigned i;
+
+  charge_time (profile);
+
+  while (profile->shadow.len > 0)
+    {
+      top = DANG_UTIL_ARRAY_INDEX_PTR (&profile->shadow, ShadowFrame,
+                                       profile->shadow.len - 1);
+      if (shadow_matches (top, frame))
+        return top;
+      if (frame->caller != NULL && shadow_matches (top, frame->caller))
+        return push_shadow_frame (profile, top->node, frame);
+      profile->shadow.len--;
+    }
+
+  for (at = frame; at != NULL; at = at->caller)
+    dang_util_array_append (&chain, 1, &at);
+  top = NULL;
+  for (i = chain.len; i > 0; i--)
+    {
+      at = DANG_UTIL_ARRAY_INDEX (&chain, DangThreadStackFrame *, i - 1);
+      top = push_shadow_frame (profile, top ? top->node : &profile_root, at);
+    }
+  dang_util_array_clear (&chain);
+  return top;
+}
+
+/* The calling-context tree is shared, so with several workers
+   (see dang-scheduler.h) profiled threads take turns.
+   A thread may run nested threads (via C functions), so only
+   the outermost one on each OS thread takes the lock. */
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread unsigned profile_lock_depth;
+
+void
+dang_profile_thread_start (DangThread *thread)
+{
+  if (profile_lock_depth++ == 0)
+    pthread_mutex_lock (&profile_lock);
+  if (thread->profile == NULL)
+    {
+      thread->profile = dang_new (DangProfileThread, 1);
+      DANG_UTIL_ARRAY_INIT (&thread->profile->shadow, ShadowFrame);
+    }
+  thread->profile->last_time = get_time_ns ();
+}
+
+void
+dang_profile_step (DangThread *thread)
+{
+  DangProfileThread *profile = thread->profile;
+  DangThreadStackFrame *frame = thread->stack_frame;
+  ShadowFrame *top;
+  ProfileFunction *pf;
+  size_t offset;
+
+  if (DANG_LIKELY (profile->shadow.len > 0))
+    {
+      top = DANG_UTIL_ARRAY_INDEX_PTR (&profile->shadow, ShadowFrame,
+                                       profile->shadow.len - 1);
+      if (DANG_UNLIKELY (!shadow_matches (top, frame)))
+        top = change_frame (profile, frame);
+    }
+  else
+    top = change_frame (profile, frame);
+
+  pf = top->pfunction;
+  pf->steps++;
+  offset = (char*)frame->ip - (char*)pf->first_step;
+  if (offset < pf->n_step_counts * STEP_GRANULE)
+    pf->step_counts[offset / STEP_GRANULE]++;
+}
+
+void
+dang_profile_thread_stop (DangThread *thread)
+{
+  charge_time (thread->profile);
+  if (--profile_lock_depth == 0)
+    pthread_mutex_unlock (&profile_lock);
+}
+
+void
+dang_profile_thread_free (DangProfileThread *profile)
+{
+  dang_util_array_clear (&profile->shadow);
+  dang_free (profile);
+}
+
+/* --- Writing the report --- */
+static const char *
+get_function_name (ProfileFunction *pf)
+{
+  if (pf->name == NULL)
+    {
+      DangFunction *function = pf->function;
+      DangCodePosition cp;
+      if (function->base.stack_info != NULL
+       && function->base.stack_info->first_step != NULL
+       && dang_function_get_code_position (function,
+                                           function->base.stack_info->first_step,
+                                           &cp))
+        {
+          pf->name = dang_strdup_printf (DANG_CP_FORMAT, DANG_CP_ARGS (cp));
+          dang_code_position_clear (&cp);
+        }
+      else
+        pf->name = dang_strdup_printf ("[%s]",
+                                       dang_function_type_name (function->type));
+    }
+  return pf->name;
+}
+
+/* Computes the inclusive time of the functions, and writes
+   the collapsed stacks.  A function's inclusive time only counts
+   its outermost activation on each path, so recursion is not double-counted. */
+static uint64_t
+report_node (ProfileNode *node,
+             const char **path,
+             FILE        *folded)
+{
+  ProfileFunction *pf = node->pfunction;
+  ProfileNode *child;
+  uint64_t total = node->self_ns;
+
+  if (pf != NULL)
+    {
+      path[node->depth - 1] = get_function_name (pf);
+      pf->n_active++;
+      if (folded != NULL && node->self_ns >= 1000)
+        {
+          unsigned i;
+          for (i = 0; i < node->depth; i++)
+            fprintf (folded, "%s%s", i ? ";" : "", path[i]);
+          fprintf (folded, " %llu\n",
+                   (unsigned long long) (node->self_ns / 1000));
+        }
+    }
+  for (child = node->first_child; child != NULL; child = child->next_sibling)
+    total += report_node (child, path, folded);
+  if (pf != NULL && --pf->n_active == 0)
+    pf->total_ns += total;
+  return total;
+}
+
+static void
+collect_profile_functions (ProfileFunction *pf,
+                           DangUtilArray   *out)
+{
+  if (pf == NULL)
+    return;
+  collect_profile_functions (pf->left, out);
+  dang_util_array_append (out, 1, &pf);
+  collect_profile_functions (pf->right, out);
+}
+
+typedef struct _LineCount LineCount;
+struct _LineCount
+{
+  DangCodePosition cp;
+  ProfileFunction *pfunction;
+  uint64_t steps;
+};
+
+static void
+collect_line_counts (ProfileFunction *pf,
+                     DangUtilArray   *out)
+{
+  DangFunctionStackInfo *stack_info = pf->function->base.stack_info;
+  DangStep *step;
+  if (pf->step_counts == NULL || stack_info->n_file_info == 0)
+    return;
+  for (step = stack_info->first_step;
+       step <= stack_info->last_step;
+       step = (DangStep *) ((char*)(step + 1) + step->_step_data_size))
+    {
+      size_t index = ((char*)step - (char*)pf->first_step) / STEP_GRANULE;
+      LineCount lc;
+      if (pf->step_counts[index] == 0)
+        continue;
+      if (!dang_function_get_code_position (pf->function, step, &lc.cp))
+        continue;
+      lc.pfunction = pf;
+      lc.steps = pf->step_counts[index];
+      dang_util_array_append (out, 1, &lc);
+    }
+}
+
+static void
+write_report (const char *basename)
+{
+  DangUtilArray pfs = DANG_UTIL_ARRAY_STATIC_INIT (ProfileFunction *);
+  DangUtilArray lines = DANG_UTIL_ARRAY_STATIC_INIT (LineCount);
+  const char *path[MAX_DEPTH];
+  ProfileFunction **pf_array;
+  LineCount *line_array;
+  uint64_t total_ns, total_steps = 0;
+  unsigned n_lines;
+  char *report_name, *folded_name;
+  FILE *report, *folded;
+  unsigned i;
+
+  report_name = dang_strdup_printf ("%s.txt", basename);
+  folded_name = dang_strdup_printf ("%s.folded", basename);
+  report = fopen (report_name, "w");
+  if (report == NULL)
+    {
+      dang_warning ("error creating %s: %s", report_name, strerror (errno));
+      goto done;
+    }
+  folded = fopen (folded_name, "w");
+  if (folded == NULL)
+    dang_warning ("error creating %s: %s", folded_name, strerror (errno));
+
+  total_ns = report_node (&profile_root, path, folded);
+  if (folded != NULL)
+    fclose (folded);
+
+  /* Functions, by self time */
+  collect_profile_functions (profile_function_tree, &pfs);
+  pf_array = pfs.data;
+  for (i = 0; i < pfs.len; i++)
+    total_steps += pf_array[i]->steps;
+#define COMPARE_BY_SELF_TIME(a,b,rv)                            \
+  rv = a->self_ns > b->self_ns ? -1 : a->self_ns < b->self_ns ? 1 \
+     : a->steps > b->steps ? -1 : a->steps < b->steps ? 1 : 0;
+  GSK_QSORT (pf_array, ProfileFunction *, pfs.len, COMPARE_BY_SELF_TIME);
+#undef COMPARE_BY_SELF_TIME
+  fprintf (report, "Total: %.3f ms, %llu steps\n\n",
+           total_ns / 1e6, (unsigned long long) total_steps);
+  fprintf (report, "%10s %12s %10s %6s %10s  %s\n",
+           "calls", "steps", "self-ms", "self%", "total-ms", "function");
+  for (i = 0; i < pfs.len; i++)
+    {
+      ProfileFunction *pf = pf_array[i];
+      if (pf->calls == 0)
+        continue;
+      fprintf (report, "%10llu %12llu %10.3f %5.1f%% %10.3f  %s\n",
+               (unsigned long long) pf->calls,
+               (unsigned long long) pf->steps,
+               pf->self_ns / 1e6,
+               total_ns ? 100.0 * pf->self_ns / total_ns : 0.0,
+               pf->total_ns / 1e6,
+               get_function_name (pf));
+    }
+
+  /* Source lines, by steps run */
+  for (i = 0; i < pfs.len; i++)
+    collect_line_counts (pf_array[i], &lines);
+  line_array = lines.data;
+#define COMPARE_BY_LINE(a,b,rv)                                         \
+  rv = a.pfunction < b.pfunction ? -1 : a.pfunction > b.pfunction ? 1 \
+     : a.cp.line < b.cp.line ? -1 : a.cp.line > b.cp.line ? 1          \
+     : strcmp (a.cp.filename->str, b.cp.filename->str);
+  GSK_QSORT (line_array, LineCount, lines.len, COMPARE_BY_LINE);
+#undef COMPARE_BY_LINE
+  n_lines = 0;
+  for (i = 0; i < lines.len; i++)
+    if (n_lines > 0
+     && line_array[n_lines-1].pfunction == line_array[i].pfunction
+     && line_array[n_lines-1].cp.line == line_array[i].cp.line
+     && strcmp (line_array[n_lines-1].cp.filename->str,
+                line_array[i].cp.filename->str) == 0)
+      {
+        line_array[n_lines-1].steps += line_array[i].steps;
+        dang_code_position_clear (&line_array[i].cp);
+      }
+    else
+      line_array[n_lines++] = line_array[i];
+  lines.len = n_lines;
+#define COMPARE_BY_STEPS(a,b,rv) \
+  rv = a.steps > b.steps ? -1 : a.steps < b.steps ? 1 : 0;
+  GSK_QSORT (line_array, LineCount, lines.len, COMPARE_BY_STEPS);
+#undef COMPARE_BY_STEPS
+  fprintf (report, "\n%12s %6s  %s\n", "steps", "steps%", "line");
+  for (i = 0; i < lines.len; i++)
+    {
+      if (i < MAX_REPORT_LINES)
+        fprintf (report, "%12llu %5.1f%%  "DANG_CP_FORMAT" (%s)\n",
+                 (unsigned long long) line_array[i].steps,
+                 total_steps ? 100.0 * line_array[i].steps / total_steps : 0.0,
+                 DANG_CP_ARGS (line_array[i].cp),
+                 get_function_name (line_array[i].pfunction));
+      dang_code_position_clear (&line_array[i].cp);
+    }
+  fclose (report);
+  if (folded != NULL)
+    fprintf (stderr, "profile written to %s and %s\n", report_name, folded_name);
+  else
+    fprintf (stderr, "profile written to %s\n", report_name);
+
+done:
+  dang_util_array_clear (&pfs);
+  dang_util_array_clear (&lines);
+  dang_free (report_name);
+  dang_free (folded_name);
+}
+
+static void
+free_profile_nodes (ProfileNode *node)
+{
+  while (node->first_child != NULL)
+    {
+      ProfileNode *child = node->first_child;
+      node->first_child = child->next_sibling;
+      free_profile_nodes (child);
+      dang_free (child);
+    }
+}
+
+static void
+free_profile_functions (ProfileFunction *pf)
+{
+  if (pf == NULL)
+    return;
+  free_profile_functions (pf->left);
+  free_profile_functions (pf->right);
+  dang_function_unref (pf->function);
+  dang_free (pf->name);
+  dang_free (pf->step_counts);
+  dang_free (pf);
+}
+
+void
+_dang_profile_cleanup (void)
+{
+  if (profile_root.first_child == NULL && profile_function_tree == NULL)
+    return;
+
+  /* --dispatch=profiling without --profile still gets a report */
+  write_report (dang_profile_output ? dang_profile_output : "dang-profile");
+  free_profile_nodes (&profile_root);
+  free_profile_functions (profile_function_tree);
+  profile_function_tree = NULL;
+}
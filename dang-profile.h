@@ -0,0 +1,35 @@
+/* --- Profiling ---
+ *
+ * With --profile, threads run their steps through the profiling
+ * dispatcher (DANG_THREAD_DISPATCH_PROFILING), which counts every step
+ * and notices when the current frame changes, building a tree of
+ * calling contexts.  Each node of the tree counts the calls,
+ * steps and time spent in a function when called from a given chain
+ * of callers.  At exit, a report and a collapsed-stack file
+ * (one line per call chain, as used by flamegraph tools) are written.
+ *
+ * When profiling is off, the normal dispatchers are used,
+ * so there is no overhead.
+ */
+
+typedef struct _DangProfileThread DangProfileThread;
+
+/* The basename of the report files,
+   or NULL if profiling is disabled. */
+extern const char *dang_profile_output;
+
+/* Called by the profiling dispatcher. */
+void dang_profile_thread_start (DangThread *thread);
+void dang_profile_step         (DangThread *thread);
+void dang_profile_thread_stop  (DangThread *thread);
+void dang_profile_thread_free  (DangProfileThread *profile);
+
+/* Give a function a name in the report:
+   "prefix.name", or just "name" if prefix is NULL.
+   Unnamed functions are named by their first line. */
+void dang_profile_name_function (DangFunction  *function,
+                                 const char    *prefix,
+                                 const char    *name);
+
+/* Write the reports, if profiling, and free everything. */
+void _dang_profile_cleanup (void);
@@ -0,0 +1,487 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include "dang.h"
+
+/* --- Deques of threads ---
+   The owning worker pushes and pops at the back,
+   so it runs the thread it queued most recently;
+   other workers steal from the front. */
+typedef struct _Deque Deque;
+struct _Deque
+{
+  pthread_mutex_t lock;
+  DangThread **threads;                 /* ring-buffer */
+  unsigned alloced;                     /* a power of two */
+  unsigned first, count;
+};
+
+static void
+deque_init (Deque *deque)
+{
+  pthread_mutex_init (&deque->lock, NULL);
+  deque->alloced = 64;
+  deque->threads = dang_new (DangThread *, deque->alloced);
+  deque->first = deque->count = 0;
+}
+
+static void
+deque_clear (Deque *deque)
+{
+  dang_assert (deque->count == 0);
+  pthread_mutex_destroy (&deque->lock);
+  dang_free (deque->threads);
+}
+
+static void
+deque_push_back (Deque *deque, DangThread *thread)
+{
+  pthread_mutex_lock (&deque->lock);
+  if (deque->count == deque->alloced)
+    {
+      unsigned new_alloced = deque->alloced * 2;
+      DangThread **new_threads = dang_new (DangThread *, new_alloced);
+      unsigned n_at_end = deque->alloced - deque->first;
+      memcpy (new_threads, deque->threads + deque->first,
+              n_at_end * sizeof (DangThread *));
+      memcpy (new_threads + n_at_end, deque->threads,
+              deque->first * sizeof (DangThread *));
+      dang_free (deque->threads);
+      deque->threads = new_threads;
+      deque->alloced = new_alloced;
+      deque->first = 0;
+    }
+  deque->threads[(deque->first + deque->count) & (deque->alloced - 1)] = thread;
+  __atomic_store_n (&deque->count, deque->count + 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock (&deque->lock);
+}
+
+static DangThread *
+deque_pop_back (Deque *deque)
+{
+  DangThread *rv = NULL;
+  pthread_mutex_lock (&deque->lock);
+  if (deque->count > 0)
+    {
+      __atomic_store_n (&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+      rv = deque->threads[(deque->first + deque->count) & (deque->alloced - 1)];
+    }
+  pthread_mutex_unlock (&deque->lock);
+  return rv;
+}
+
+static DangThread *
+deque_pop_front (Deque *deque)
+{
+  DangThread *rv = NULL;
+  if (__atomic_load_n (&deque->count, __ATOMIC_RELAXED) == 0)
+    return NULL;                /* don't bother locking */
+  pthread_mutex_lock (&deque->lock);
+  if (deque->count > 0)
+    {
+      rv = deque->threads[deque->first];
+      deque->first = (deque->first + 1) & (deque->alloced - 1);
+      __atomic_store_n (&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+    }
+  pthread_mutex_unlock (&deque->lock);
+  return rv;
+}
+
+/* --- Workers --- */
+typedef struct _Worker Worker;
+struct _Worker
+{
+  DangScheduler *scheduler;
+  unsigned index;
+  pthread_t pthread;
+  Deque deque;
+};
+
+struct _DangScheduler
+{
+  unsigned ref_count;
+  unsigned n_workers;
+  Worker *workers;
+
+  /* threads pushed from outside the workers */
+  Deque injected;
+
+  /* Updated atomically.  A worker goes to sleep only after
+     incrementing n_idle and seeing n_queued==0, while a pusher
+     increments n_queued and then checks n_idle, so one of them
+     always notices the other. */
+  unsigned n_queued;                    /* threads in any deque */
+  unsigned n_pending;                   /* threads queued or running */
+  unsigned n_idle;                      /* workers waiting for work */
+
+  pthread_mutex_t lock;
+  pthread_cond_t work_available;
+  pthread_cond_t all_done;
+  dang_boolean stopping;
+};
+
+/* the worker running on this OS thread, if any */
+static __thread Worker *current_worker;
+
+unsigned dang_scheduler_default_n_workers = 0;
+static DangScheduler *default_scheduler;
+static pthread_mutex_t default_scheduler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static DangThread *
+take_thread (Worker *worker)
+{
+  DangScheduler *scheduler = worker->scheduler;
+  DangThread *thread;
+  unsigned i;
+
+  thread = deque_pop_back (&worker->deque);
+  for (i = 1; thread == NULL && i < scheduler->n_workers; i++)
+    {
+      Worker *victim = scheduler->workers
+                     + (worker->index + i) % scheduler->n_workers;
+      thread = deque_pop_front (&victim->deque);
+    }
+  if (thread == NULL)
+    thread = deque_pop_front (&scheduler->injected);
+  if (thread != NULL)
+    __atomic_sub_fetch (&scheduler->n_queued, 1, __ATOMIC_SEQ_CST);
+  return thread;
+}
+
+static void
+run_thread (DangScheduler *scheduler,
+            DangThread    *thread)
+{
+  switch (thread->status)
+    {
+    case DANG_THREAD_STATUS_NOT_STARTED:
+      dang_thread_run (thread);
+      break;
+    case DANG_THREAD_STATUS_YIELDED:
+      dang_thread_resume (thread);
+      break;
+    case DANG_THREAD_STATUS_CANCELLED:
+      /* cancelled while it was being woken up */
+      break;
+    default:
+      dang_warning ("scheduled thread was in an invalid state '%s'",
+                    dang_thread_status_name (thread->status));
+      break;
+    }
+  dang_thread_unref (thread);
+
+  if (__atomic_sub_fetch (&scheduler->n_pending, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+      pthread_mutex_lock (&scheduler->lock);
+      pthread_cond_broadcast (&scheduler->all_done);
+      pthread_mutex_unlock (&scheduler->lock);
+    }
+}
+
+static void *
+worker_main (void *data)
+{
+  Worker *worker = data;
+  DangScheduler *scheduler = worker->scheduler;
+  current_worker = worker;
+  for (;;)
+    {
+      DangThread *thread = take_thread (worker);
+      dang_boolean stop;
+      if (thread != NULL)
+        {
+          run_thread (scheduler, thread);
+          continue;
+        }
+
+      pthread_mutex_lock (&scheduler->lock);
+      __atomic_add_fetch (&scheduler->n_idle, 1, __ATOMIC_SEQ_CST);
+      while (__atomic_load_n (&scheduler->n_queued, __ATOMIC_SEQ_CST) == 0
+          && !scheduler->stopping)
+        pthread_cond_wait (&scheduler->work_available, &scheduler->lock);
+      __atomic_sub_fetch (&scheduler->n_idle, 1, __ATOMIC_SEQ_CST);
+      stop = scheduler->stopping
+          && __atomic_load_n (&scheduler->n_queued, __ATOMIC_SEQ_CST) == 0;
+      pthread_mutex_unlock (&scheduler->lock);
+      if (stop)
+        break;
+    }
+  current_worker = NULL;
+  return NULL;
+}
+
+/* --- Public API --- */
+
+/* Function: dang_scheduler_new
+   Create a scheduler and start its workers.
+
+   Parameters:
+     n_workers - the number of OS threads to run dang threads on,
+       or 0 to use one per online cpu.
+
+   Returns:
+     the new scheduler.
+ */
+DangScheduler *
+dang_scheduler_new (unsigned n_workers)
+{
+  DangScheduler *scheduler;
+  unsigned i;
+
+  if (n_workers == 0)
+    {
+      long n_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+      n_workers = n_cpus > 0 ? (unsigned) n_cpus : 1;
+    }
+
+  /* No worker has started yet, so nothing can be racing
+     on a reference-count while we switch to atomic updates. */
+  dang_is_threaded = TRUE;
+
+  scheduler = dang_new0 (DangScheduler, 1);
+  scheduler->ref_count = 1;
+  scheduler->n_workers = n_workers;
+  deque_init (&scheduler->injected);
+  pthread_mutex_init (&scheduler->lock, NULL);
+  pthread_cond_init (&scheduler->work_available, NULL);
+  pthread_cond_init (&scheduler->all_done, NULL);
+  scheduler->workers = dang_new0 (Worker, n_workers);
+  for (i = 0; i < n_workers; i++)
+    {
+      scheduler->workers[i].scheduler = scheduler;
+      scheduler->workers[i].index = i;
+      deque_init (&scheduler->workers[i].deque);
+    }
+  for (i = 0; i < n_workers; i++)
+    if (pthread_create (&scheduler->workers[i].pthread, NULL,
+                        worker_main, scheduler->workers + i) != 0)
+      dang_die ("error creating worker thread: %s", strerror (errno));
+  return scheduler;
+}
+
+DangScheduler *
+dang_scheduler_ref (DangScheduler *scheduler)
+{
+  DANG_REF_COUNT_INC (scheduler->ref_count);
+  return scheduler;
+}
+
+void
+dang_scheduler_unref (DangScheduler *scheduler)
+{
+  unsigned i;
+  if (DANG_REF_COUNT_DEC (scheduler->ref_count) > 0)
+    return;
+
+  dang_scheduler_wait (scheduler);
+
+  pthread_mutex_lock (&scheduler->lock);
+  scheduler->stopping = TRUE;
+  pthread_cond_broadcast (&scheduler->work_available);
+  pthread_mutex_unlock (&scheduler->lock);
+  for (i = 0; i < scheduler->n_workers; i++)
+    pthread_join (scheduler->workers[i].pthread, NULL);
+
+  for (i = 0; i < scheduler->n_workers; i++)
+    deque_clear (&scheduler->workers[i].deque);
+  dang_free (scheduler->workers);
+  deque_clear (&scheduler->injected);
+  pthread_mutex_destroy (&scheduler->lock);
+  pthread_cond_destroy (&scheduler->work_available);
+  pthread_cond_destroy (&scheduler->all_done);
+  dang_free (scheduler);
+}
+
+unsigned
+dang_scheduler_get_n_workers (DangScheduler *scheduler)
+{
+  return scheduler->n_workers;
+}
+
+/* Function: dang_scheduler_push
+   Queue a thread to be run (or resumed) by one of the workers.
+   From a worker, the thread goes onto that worker's deque.
+
+   Parameters:
+     scheduler - the scheduler to run the thread.
+     thread - a thread that has not started, or has yielded.
+ */
+void
+dang_scheduler_push (DangScheduler *scheduler,
+                     DangThread    *thread)
+{
+  Worker *worker = current_worker;
+  dang_assert (thread->status == DANG_THREAD_STATUS_NOT_STARTED
+            || thread->status == DANG_THREAD_STATUS_YIELDED
+            || thread->status == DANG_THREAD_STATUS_CANCELLED);
+
+  dang_thread_ref (thread);
+  __atomic_add_fetch (&scheduler->n_pending, 1, __ATOMIC_ACQ_REL);
+  if (worker != NULL && worker->scheduler == scheduler)
+    deque_push_back (&worker->deque, thread);
+  else
+    deque_push_back (&scheduler->injected, thread);
+  __atomic_add_fetch (&scheduler->n_queued, 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n (&scheduler->n_idle, __ATOMIC_SEQ_CST) > 0)
+    {
+      pthread_mutex_lock (&scheduler->lock);
+      pthread_cond_signal (&scheduler->work_available);
+      pthread_mutex_unlock (&scheduler->lock);
+    }
+}
+
+void
+dang_scheduler_wait (DangScheduler *scheduler)
+{
+  dang_assert (current_worker == NULL || current_worker->scheduler != scheduler);
+  pthread_mutex_lock (&scheduler->lock);
+  while (__atomic_load_n (&scheduler->n_pending, __ATOMIC_ACQUIRE) > 0)
+    pthread_cond_wait (&scheduler->all_done, &scheduler->lock);
+  pthread_mutex_unlock (&scheduler->lock);
+}
+
+DangScheduler *
+dang_scheduler_get_current (void)
+{
+  return current_worker ? current_worker->scheduler : NULL;
+}
+
+DangScheduler *
+dang_scheduler_get_default (void)
+{
+  DangScheduler *rv = __atomic_load_n (&default_scheduler, __ATOMIC_ACQUIRE);
+  if (rv != NULL)
+    return rv;
+  pthread_mutex_lock (&default_scheduler_lock);
+  if (default_scheduler == NULL)
+    __atomic_store_n (&default_scheduler,
+                      dang_scheduler_new (dang_scheduler_default_n_workers),
+                      __ATOMIC_RELEASE);
+  rv = default_scheduler;
+  pthread_mutex_unlock (&default_scheduler_lock);
+  return rv;
+}
+
+/* --- dang_scheduler_run_parts() ---
+ * A dang thread is pushed for all but one part; each thread, and
+ * the caller, claims parts until none are left.  The job is the
+ * func_data of the function the threads run, so it lives as long
+ * as that function: a thread that starts after the caller has
+ * returned finds nothing to claim.
+ */
+typedef struct _PartsJob PartsJob;
+struct _PartsJob
+{
+  DangValueType state_type;             /* empty */
+  DangSchedulerPartFunc func;
+  void *data;
+  unsigned n_parts;
+
+  /* updated atomically */
+  unsigned next_part;
+  unsigned n_parts_left;
+
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+};
+
+static void
+parts_job_free (void *data)
+{
+  PartsJob *job = data;
+  pthread_mutex_destroy (&job->lock);
+  pthread_cond_destroy (&job->done);
+  dang_free (job);
+}
+
+/* Run parts until none are left to claim. */
+static void
+parts_job_run (PartsJob *job)
+{
+  unsigned i;
+  while ((i = __atomic_fetch_add (&job->next_part, 1, __ATOMIC_RELAXED)) < job->n_parts)
+    {
+      job->func (i, job->data);
+      if (__atomic_sub_fetch (&job->n_parts_left, 1, __ATOMIC_ACQ_REL) == 0)
+        {
+          pthread_mutex_lock (&job->lock);
+          pthread_cond_broadcast (&job->done);
+          pthread_mutex_unlock (&job->lock);
+        }
+    }
+}
+
+static DANG_C_FUNC_DECLARE (do_run_parts)
+{
+  DANG_UNUSED (thread);
+  DANG_UNUSED (args);
+  DANG_UNUSED (rv_out);
+  DANG_UNUSED (state_data);
+  DANG_UNUSED (error);
+  parts_job_run (func_data);
+  return DANG_C_FUNCTION_SUCCESS;
+}
+
+void
+dang_scheduler_run_parts (DangScheduler        *scheduler,
+                          unsigned              n_parts,
+                          DangSchedulerPartFunc func,
+                          void                 *data)
+{
+  static DangSignature *parts_sig;
+  DangFunction *function;
+  PartsJob *job;
+  unsigned i;
+
+  if (n_parts <= 1)
+    {
+      if (n_parts == 1)
+        func (0, data);
+      return;
+    }
+  if (__atomic_load_n (&parts_sig, __ATOMIC_ACQUIRE) == NULL)
+    {
+      DangSignature *sig = dang_signature_new (NULL, 0, NULL);
+      DangSignature *expected = NULL;
+      if (!__atomic_compare_exchange_n (&parts_sig, &expected, sig, FALSE,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        dang_signature_unref (sig);
+    }
+
+  job = dang_new0 (PartsJob, 1);
+  job->state_type.alignof_instance = 1;
+  job->state_type.full_name = "internal-scheduler-parts-state";
+  job->func = func;
+  job->data = data;
+  job->n_parts = n_parts;
+  job->n_parts_left = n_parts;
+  pthread_mutex_init (&job->lock, NULL);
+  pthread_cond_init (&job->done, NULL);
+  function = dang_function_new_c (parts_sig, &job->state_type,
+                                  do_run_parts, job, parts_job_free);
+
+  for (i = 1; i < n_parts; i++)
+    {
+      DangThread *thread = dang_thread_new (function, 0, NULL);
+      dang_scheduler_push (scheduler, thread);
+      dang_thread_unref (thread);
+    }
+  parts_job_run (job);
+
+  pthread_mutex_lock (&job->lock);
+  while (__atomic_load_n (&job->n_parts_left, __ATOMIC_ACQUIRE) > 0)
+    pthread_cond_wait (&job->done, &job->lock);
+  pthread_mutex_unlock (&job->lock);
+  dang_function_unref (function);
+}
+
+void
+_dang_scheduler_cleanup (void)
+{
+  if (default_scheduler != NULL)
+    {
+      dang_scheduler_unref (default_scheduler);
+      default_scheduler = NULL;
+    }
+}
@@ -1,13 +1,56 @@
+/* --- DangScheduler: runs DangThreads on a pool of worker OS threads ---
+ *
+ * Each worker has a deque of threads waiting to run.  A worker
+ * runs the thread most recently pushed onto its own deque;
+ * when that is empty it steals the oldest thread from another
+ * worker's deque.  Threads pushed from outside any worker
+ * go onto a shared queue.
+ *
+ * A thread runs until it finishes, throws or yields.
+ * A yielded thread is resumed by pushing it again.
+ *
+ * Once a scheduler has been created, reference-counts are
+ * updated atomically (see DANG_REF_COUNT_INC()).
+ */
 
 typedef struct _DangScheduler DangScheduler;
-struct _DangScheduler
-{
-  unsigned ref_count;
-  DangSchedulerQueue *run_queue_start, *run_queue_end;
-};
 
-void        dang_scheduler_push (DangScheduler *scheduler,
-                                 DangThread    *thread);
-DangThread *dang_scheduler_pop  (DangScheduler *scheduler);
+/* n_workers==0 means one worker per online cpu */
+DangScheduler *dang_scheduler_new   (unsigned       n_workers);
+DangScheduler *dang_scheduler_ref   (DangScheduler *scheduler);
 
+/* the last unref waits for all threads, then stops the workers */
+void           dang_scheduler_unref (DangScheduler *scheduler);
 
+unsigned       dang_scheduler_get_n_workers (DangScheduler *scheduler);
+
+/* Queue a thread that is NOT_STARTED or YIELDED.
+   The scheduler holds a reference until it has run. */
+void           dang_scheduler_push  (DangScheduler *scheduler,
+                                     DangThread    *thread);
+
+/* Wait until every pushed thread has finished, thrown or yielded.
+   Must not be called from a worker. */
+void           dang_scheduler_wait  (DangScheduler *scheduler);
+
+/* the scheduler of the worker we are running on, or NULL */
+DangScheduler *dang_scheduler_get_current (void);
+
+/* The scheduler used by spawn() and dang_thread_wakeup(),
+   created on first use with dang_scheduler_default_n_workers
+   workers (0, the default, means one per online cpu). */
+DangScheduler *dang_scheduler_get_default (void);
+extern unsigned dang_scheduler_default_n_workers;
+
+/* Call func(i, data) for each i in 0..n_parts-1, the parts being
+   shared between the workers and the calling thread, and return
+   once all of them have finished.  The caller only waits for
+   parts that are already running, so it may be a worker. */
+typedef void (*DangSchedulerPartFunc) (unsigned part,
+                                       void    *data);
+void           dang_scheduler_run_parts (DangScheduler        *scheduler,
+                                         unsigned              n_parts,
+                                         DangSchedulerPartFunc func,
+                                         void                 *data);
+
+void _dang_scheduler_cleanup (void);
@@ -116,12 +116,12 @@ DangSignature *dang_signature_new          (DangValueType     *return_type,
 
 DangSignature *dang_signature_ref          (DangSignature*sig)
 {
-  ++(sig->ref_count);
+  DANG_REF_COUNT_INC (sig->ref_count);
   return sig;
 }
 void           dang_signature_unref        (DangSignature*sig)
 {
-  if (--(sig->ref_count) == 0)
+  if (DANG_REF_COUNT_DEC (sig->ref_count) == 0)
     {
       unsigned i;
       for (i = 0; i < sig->n_params; i++)
@@ -0,0 +1,424 @@
+#include <string.h>
+#include <pthread.h>
+#include "dang.h"
+#include "magic.h"
+#include "config.h"
+#include "gskrbtreemacros.h"
+
+struct _DangSpawned
+{
+  unsigned ref_count;
+  DangThread *thread;
+  DangValueType *result_type;           /* NULL for void functions */
+
+  /* 'finished' and 'waiters' are protected by 'lock' */
+  pthread_mutex_t lock;
+  dang_boolean finished;
+  DangUtilArray waiters;                /* of DangThread*, each ref'd */
+};
+
+static DangSpawned *
+spawned_ref (DangSpawned *spawned)
+{
+  DANG_REF_COUNT_INC (spawned->ref_count);
+  return spawned;
+}
+
+static void
+spawned_unref (DangSpawned *spawned)
+{
+  if (DANG_REF_COUNT_DEC (spawned->ref_count) > 0)
+    return;
+  dang_assert (spawned->waiters.len == 0);
+  dang_util_array_clear (&spawned->waiters);
+  pthread_mutex_destroy (&spawned->lock);
+  dang_thread_unref (spawned->thread);
+  dang_free (spawned);
+}
+
+/* --- the thread<T> type --- */
+static DangValueTypeThread *thread_type_tree;
+#define GET_IS_RED(fi)  (fi)->is_red
+#define SET_IS_RED(fi,v)  (fi)->is_red = v
+#define COMPARE_THREAD_TREE_NODES(a,b,rv) \
+  if(a->result_type < b->result_type) rv = -1; \
+  else if(a->result_type > b->result_type) rv = 1; \
+  else rv = 0;
+#define GET_THREAD_TREE() \
+  thread_type_tree, DangValueTypeThread *, GET_IS_RED, SET_IS_RED, \
+  parent, left, right, COMPARE_THREAD_TREE_NODES
+
+static void
+thread_init_assign (DangValueType *type,
+                    void          *dst,
+                    const void    *src)
+{
+  DangSpawned *spawned = * (DangSpawned **) src;
+  DANG_UNUSED (type);
+  * (DangSpawned **) dst = spawned ? spawned_ref (spawned) : NULL;
+}
+
+static void
+thread_assign      (DangValueType *type,
+                    void          *dst,
+                    const void    *src)
+{
+  DangSpawned *spawned = * (DangSpawned **) src;
+  DangSpawned *orig = * (DangSpawned **) dst;
+  DANG_UNUSED (type);
+  if (spawned)
+    spawned_ref (spawned);
+  if (orig)
+    spawned_unref (orig);
+  * (DangSpawned **) dst = spawned;
+}
+
+static void
+thread_destruct (DangValueType *type,
+                 void          *to_destruct)
+{
+  DangSpawned *spawned = * (DangSpawned **) to_destruct;
+  DANG_UNUSED (type);
+  if (spawned)
+    spawned_unref (spawned);
+}
+
+static char *
+thread_to_string (DangValueType *type,
+                  const void    *data)
+{
+  DangSpawned *spawned = * (DangSpawned **) data;
+  DangThreadStatus status;
+  DANG_UNUSED (type);
+  if (spawned == NULL)
+    return dang_strdup ("(null)");
+  pthread_mutex_lock (&spawned->lock);
+  status = spawned->finished ? spawned->thread->status
+                             : DANG_THREAD_STATUS_RUNNING;
+  pthread_mutex_unlock (&spawned->lock);
+  return dang_strdup_printf ("thread(%s)", dang_thread_status_name (status));
+}
+
+DangValueType *
+dang_value_type_thread (DangValueType *result_type)
+{
+  DangValueTypeThread dummy, *out, *conflict = NULL;
+  if (result_type == NULL)
+    result_type = dang_value_type_void ();
+  dummy.result_type = result_type;
+  GSK_RBTREE_LOOKUP (GET_THREAD_TREE (), &dummy, out);
+  if (out != NULL)
+    return (DangValueType *) out;
+
+  out = dang_new0 (DangValueTypeThread, 1);
+  out->base_type.magic = DANG_VALUE_TYPE_MAGIC;
+  out->base_type.ref_count = 0;
+  out->base_type.full_name = dang_strdup_printf ("thread<%s>", result_type->full_name);
+  out->base_type.sizeof_instance = DANG_SIZEOF_POINTER;
+  out->base_type.alignof_instance = DANG_ALIGNOF_POINTER;
+  out->base_type.init_assign = thread_init_assign;
+  out->base_type.assign = thread_assign;
+  out->base_type.destruct = thread_destruct;
+  out->base_type.to_string = thread_to_string;
+  out->base_type.internals.is_templated = result_type->internals.is_templated;
+  out->result_type = result_type;
+  GSK_RBTREE_INSERT (GET_THREAD_TREE (), out, conflict);
+  dang_assert (conflict == NULL);
+  return (DangValueType *) out;
+}
+
+dang_boolean
+dang_value_type_is_thread (DangValueType *type)
+{
+  return type->assign == thread_assign;
+}
+
+/* --- spawn() --- */
+
+/* Run on the spawned thread, once it has finished. */
+static void
+handle_spawned_done (DangThread *thread,
+                     void       *data)
+{
+  DangSpawned *spawned = data;
+  DangThread **waiters;
+  unsigned i, n_waiters;
+  DANG_UNUSED (thread);
+
+  pthread_mutex_lock (&spawned->lock);
+  spawned->finished = TRUE;
+  n_waiters = spawned->waiters.len;
+  waiters = dang_memdup (spawned->waiters.data, n_waiters * sizeof (DangThread *));
+  dang_util_array_set_size (&spawned->waiters, 0);
+  pthread_mutex_unlock (&spawned->lock);
+
+  for (i = 0; i < n_waiters; i++)
+    {
+      dang_thread_wakeup (waiters[i]);
+      dang_thread_unref (waiters[i]);
+    }
+  dang_free (waiters);
+  spawned_unref (spawned);
+}
+
+DangSpawned *
+dang_spawn (DangFunction *function,
+            void        **args)
+{
+  DangSignature *sig = function->base.sig;
+  DangSpawned *spawned;
+
+  spawned = dang_new (DangSpawned, 1);
+  spawned->ref_count = 1;
+  spawned->thread = dang_thread_new (function, sig->n_params, args);
+  if (sig->return_type == NULL || sig->return_type == dang_value_type_void ())
+    spawned->result_type = NULL;
+  else
+    spawned->result_type = sig->return_type;
+  pthread_mutex_init (&spawned->lock, NULL);
+  spawned->finished = FALSE;
+  DANG_UTIL_ARRAY_INIT (&spawned->waiters, DangThread *);
+
+  dang_thread_set_wakeup_func (spawned->thread, handle_spawned_done,
+                               spawned_ref (spawned));
+  dang_scheduler_push (dang_scheduler_get_default (), spawned->thread);
+  return spawned;
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (do_spawn)
+{
+  DangFunction *function = * (DangFunction **) args[0];
+  DANG_UNUSED (func_data);
+  if (function == NULL)
+    {
+      dang_set_error (error, "null-pointer exception");
+      return FALSE;
+    }
+  * (DangSpawned **) rv_out = dang_spawn (function, args + 1);
+  return TRUE;
+}
+
+static DANG_FUNCTION_TRY_SIG_FUNC_DECLARE (try_sig__spawn)
+{
+  unsigned n_args;
+  DangFunctionParam *fparams;
+  DangSignature *func_sig, *sig;
+  DangFunction *rv;
+  unsigned i;
+  DANG_UNUSED (data);
+  if (query->n_elements == 0)
+    return NULL;
+  n_args = query->n_elements - 1;
+  fparams = dang_newa (DangFunctionParam, n_args + 1);
+  for (i = 0; i < n_args; i++)
+    {
+      if (query->elements[i+1].type != DANG_MATCH_QUERY_ELEMENT_SIMPLE_INPUT)
+        {
+          dang_set_error (error, "all args but the first to spawn() must be simple input parameters");
+          return NULL;
+        }
+      fparams[i+1].type = query->elements[i+1].info.simple_input;
+      fparams[i+1].dir = DANG_FUNCTION_PARAM_IN;
+      fparams[i+1].name = NULL;
+    }
+  if (!dang_match_function_from_params (query->elements + 0,
+                                        n_args, fparams + 1,
+                                        "spawn", &func_sig, error))
+    return NULL;
+
+  /* the arguments are copied into f's frame, so cast them first */
+  for (i = 0; i < n_args; i++)
+    fparams[i+1].type = func_sig->params[i].type;
+  fparams[0].type = dang_value_type_function (func_sig);
+  fparams[0].dir = DANG_FUNCTION_PARAM_IN;
+  fparams[0].name = NULL;
+  sig = dang_signature_new (dang_value_type_thread (func_sig->return_type),
+                            n_args + 1, fparams);
+  rv = dang_function_new_simple_c (sig, do_spawn, NULL, NULL);
+  dang_signature_unref (sig);
+  dang_signature_unref (func_sig);
+  return rv;
+}
+
+/* --- join() --- */
+typedef struct _JoinState JoinState;
+struct _JoinState
+{
+  DangSpawned *spawned;                 /* if waiting */
+  DangThread *thread;
+};
+
+static void
+remove_waiter (DangSpawned *spawned,
+               DangThread  *thread)
+{
+  DangThread **waiters = spawned->waiters.data;
+  unsigned i;
+  for (i = 0; i < spawned->waiters.len; i++)
+    if (waiters[i] == thread)
+      {
+        dang_util_array_remove (&spawned->waiters, i, 1);
+        dang_thread_unref (thread);
+        return;
+      }
+}
+
+/* the joining thread was cancelled while waiting */
+static void
+join_cancelled (void *data)
+{
+  JoinState *state = data;
+  pthread_mutex_lock (&state->spawned->lock);
+  remove_waiter (state->spawned, state->thread);
+  pthread_mutex_unlock (&state->spawned->lock);
+  state->spawned = NULL;
+}
+
+static DANG_C_FUNC_DECLARE (do_join)
+{
+  DangSpawned *spawned = * (DangSpawned **) args[0];
+  JoinState *state = state_data;
+  DangThread *child;
+  DANG_UNUSED (func_data);
+  if (spawned == NULL)
+    {
+      dang_set_error (error, "null-pointer exception");
+      return DANG_C_FUNCTION_ERROR;
+    }
+
+  pthread_mutex_lock (&spawned->lock);
+  if (!spawned->finished)
+    {
+      /* wait for handle_spawned_done() to wake us;
+         after a spurious wakeup we are still registered. */
+      if (state->spawned == NULL)
+        {
+          dang_thread_ref (thread);
+          dang_util_array_append (&spawned->waiters, 1, &thread);
+          state->spawned = spawned;
+          state->thread = thread;
+        }
+      pthread_mutex_unlock (&spawned->lock);
+      thread->info.yield.yield_cancel_func = join_cancelled;
+      thread->info.yield.yield_cancel_func_data = state;
+      return DANG_C_FUNCTION_YIELDED;
+    }
+  pthread_mutex_unlock (&spawned->lock);
+  state->spawned = NULL;
+
+  child = spawned->thread;
+  switch (child->status)
+    {
+    case DANG_THREAD_STATUS_DONE:
+      if (spawned->result_type != NULL)
+        {
+          DangValueType *rtype = spawned->result_type;
+          unsigned offset = DANG_ALIGN (sizeof (DangThreadStackFrame),
+                                        rtype->alignof_instance);
+          void *src = (char*)child->rv_frame + offset;
+          if (rtype->init_assign)
+            rtype->init_assign (rtype, rv_out, src);
+          else
+            memcpy (rv_out, src, rtype->sizeof_instance);
+        }
+      return DANG_C_FUNCTION_SUCCESS;
+
+    case DANG_THREAD_STATUS_THREW:
+      if (child->info.threw.type == dang_value_type_error ())
+        *error = dang_error_ref (*(DangError**)child->info.threw.value);
+      else if (child->info.threw.type != NULL)
+        {
+          char *str = dang_value_to_string (child->info.threw.type,
+                                            child->info.threw.value);
+          dang_set_error (error, "unhandled exception of type %s: %s",
+                          child->info.threw.type->full_name, str);
+          dang_free (str);
+        }
+      else
+        dang_set_error (error, "function threw no value");
+      return DANG_C_FUNCTION_ERROR;
+
+    case DANG_THREAD_STATUS_CANCELLED:
+      dang_set_error (error, "joined thread was cancelled");
+      return DANG_C_FUNCTION_ERROR;
+
+    default:
+      dang_assert_not_reached ();
+      return DANG_C_FUNCTION_ERROR;
+    }
+}
+
+static DANG_FUNCTION_TRY_SIG_FUNC_DECLARE (try_sig__join)
+{
+  static DangValueType join_state_type;
+  DangValueTypeThread *ttype;
+  DangFunctionParam param;
+  DangSignature *sig;
+  DangFunction *rv;
+  DANG_UNUSED (data);
+  DANG_UNUSED (error);
+  if (query->n_elements != 1
+   || query->elements[0].type != DANG_MATCH_QUERY_ELEMENT_SIMPLE_INPUT
+   || !dang_value_type_is_thread (query->elements[0].info.simple_input))
+    return NULL;
+  ttype = (DangValueTypeThread *) query->elements[0].info.simple_input;
+
+  if (join_state_type.sizeof_instance == 0)
+    {
+      join_state_type.sizeof_instance = sizeof (JoinState);
+      join_state_type.alignof_instance = DANG_ALIGNOF_POINTER;
+      join_state_type.full_name = "internal-join-state";
+    }
+
+  param.dir = DANG_FUNCTION_PARAM_IN;
+  param.type = (DangValueType *) ttype;
+  param.name = NULL;
+  sig = dang_signature_new (ttype->result_type == dang_value_type_void ()
+                            ? NULL : ttype->result_type,
+                            1, &param);
+  rv = dang_function_new_c (sig, &join_state_type, do_join, NULL, NULL);
+  dang_signature_unref (sig);
+  return rv;
+}
+
+void
+_dang_spawn_init (DangNamespace *the_ns)
+{
+  DangError *error = NULL;
+  DangFunctionFamily *family;
+
+  family = dang_function_family_new_variadic_c ("spawn", try_sig__spawn,
+                                                NULL, NULL);
+  if (!dang_namespace_add_function_family (the_ns, "spawn",
+                                           family, &error))
+    dang_die ("adding 'spawn' failed: %s", error->message);
+  dang_function_family_unref (family);
+
+  family = dang_function_family_new_variadic_c ("join", try_sig__join,
+                                                NULL, NULL);
+  if (!dang_namespace_add_function_family (the_ns, "join",
+                                           family, &error))
+    dang_die ("adding 'join' failed: %s", error->message);
+  dang_function_family_unref (family);
+}
+
+static void
+free_thread_tree_recursive (DangValueTypeThread *t)
+{
+  dang_value_type_cleanup (&t->base_type);
+  if (t->left)
+    free_thread_tree_recursive (t->left);
+  if (t->right)
+    free_thread_tree_recursive (t->right);
+  dang_free (t->base_type.full_name);
+  dang_free (t);
+}
+
+void
+_dang_spawn_cleanup (void)
+{
+  DangValueTypeThread *old_tree = thread_type_tree;
+  thread_type_tree = NULL;
+  if (old_tree)
+    free_thread_tree_recursive (old_tree);
+}
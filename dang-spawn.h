@@ -0,0 +1,30 @@
+/* --- spawn() and join(): concurrent dang threads ---
+ *
+ * spawn(f, args...) starts f(args...) on the default scheduler
+ * (see dang_scheduler_get_default()) and returns a thread<T>,
+ * where T is f's return type.  join(t) yields the calling thread
+ * until t has finished, then returns its result
+ * (or rethrows its uncaught exception).
+ */
+
+/* the value of a thread<T> is a DangSpawned* (opaque) */
+typedef struct _DangSpawned DangSpawned;
+
+typedef struct _DangValueTypeThread DangValueTypeThread;
+struct _DangValueTypeThread
+{
+  DangValueType base_type;
+  DangValueType *result_type;           /* void for void functions */
+
+  DangValueTypeThread *left, *right, *parent;
+  dang_boolean is_red;
+};
+
+DangValueType *dang_value_type_thread    (DangValueType *result_type);
+dang_boolean   dang_value_type_is_thread (DangValueType *type);
+
+/* Start function(args...), returning a thread<T> value. */
+DangSpawned   *dang_spawn (DangFunction *function,
+                           void        **args);
+
+void _dang_spawn_init (DangNamespace *ns);
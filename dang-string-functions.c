@@ -197,46 +197,46 @@ static DANG_SIMPLE_C_FUNC_DECLARE(do_cast_to_string_from_bytes)
 void
 _dang_string_init (DangNamespace *def)
 {
-  dang_namespace_add_simple_c_from_params
+  dang_namespace_add_pure_simple_c_from_params
         (def, "n_chars", do_n_chars,
          dang_value_type_uint32 (),
          1,
          DANG_FUNCTION_PARAM_IN, "str", dang_value_type_string ());
-  dang_namespace_add_simple_c_from_params
+  dang_namespace_add_pure_simple_c_from_params
         (def, "n_bytes", do_n_bytes,
          dang_value_type_uint32 (),
          1,
          DANG_FUNCTION_PARAM_IN, "str", dang_value_type_string ());
-  dang_namespace_add_simple_c_from_params
+  dang_namespace_add_pure_simple_c_from_params
         (def, "split", do_string_split,
          dang_value_type_vector (dang_value_type_string ()),
          2,
          DANG_FUNCTION_PARAM_IN, "delim", dang_value_type_string (),
          DANG_FUNCTION_PARAM_IN, "to_split", dang_value_type_string ());
-  dang_namespace_add_simple_c_from_params
+  dang_namespace_add_pure_simple_c_from_params
         (def, "join", do_string_join,
          dang_value_type_string (),
          2,
          DANG_FUNCTION_PARAM_IN, "delim", dang_value_type_string (),
          DANG_FUNCTION_PARAM_IN, "strs",
               dang_value_type_vector (dang_value_type_string ()));
-  dang_namespace_add_simple_c_from_params
+  dang_namespace_add_pure_simple_c_from_params
         (def, "concat", do_string_concat,
          dang_value_type_string (),
          1,
          DANG_FUNCTION_PARAM_IN, "strs",
               dang_value_type_vector (dang_value_type_string ()));
-  dang_namespace_add_simple_c_from_params
+  dang_namespace_add_pure_simple_c_from_params
         (def, "operator_cast__tensor_1__char", do_cast_to_char_array,
          dang_value_type_vector (dang_value_type_char ()),
          1,
          DANG_FUNCTION_PARAM_IN, "str", dang_value_type_string ());
-  dang_namespace_add_simple_c_from_params
+  dang_namespace_add_pure_simple_c_from_params
         (def, "operator_cast__tensor_1__uint8", do_cast_to_byte_array,
          dang_value_type_vector (dang_value_type_uint8 ()),
          1,
          DANG_FUNCTION_PARAM_IN, "str", dang_value_type_string ());
-  dang_namespace_add_simple_c_from_params
+  dang_namespace_add_pure_simple_c_from_params
         (def, "operator_cast__string", do_cast_to_string,
          dang_value_type_string (),
          1,
@@ -244,7 +244,7 @@ _dang_string_init (DangNamespace *def)
               dang_value_type_vector (dang_value_type_char ()));
 
   /* validates utf8 */
-  dang_namespace_add_simple_c_from_params
+  dang_namespace_add_pure_simple_c_from_params
         (def, "operator_cast__string", do_cast_to_string_from_bytes,
          dang_value_type_string (),
          1,
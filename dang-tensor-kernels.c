@@ -0,0 +1,609 @@
+#include <string.h>
+#include "dang.h"
+#include "config.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DANG_TENSOR_KERNELS_X86 1
+#include <immintrin.h>
+#define TARGET(isa)     __attribute__ ((target (isa)))
+#else
+#define DANG_TENSOR_KERNELS_X86 0
+#endif
+
+#define ADD_OP(a,b)             ((a) + (b))
+#define SUBTRACT_OP(a,b)        ((a) - (b))
+
+/* --- scalar --- */
+#define DEFINE_SCALAR_BINARY(name, ctype, op)                           \
+static void name (const void *a, const void *b, void *c, unsigned N)    \
+{                                                                       \
+  const ctype *a_at = a;                                                \
+  const ctype *b_at = b;                                                \
+  ctype *c_at = c;                                                      \
+  while (N--)                                                           \
+    *c_at++ = op (*a_at++, *b_at++);                                    \
+}
+#define DEFINE_SCALAR_SCALE(name, ctype)                                \
+static void name (const void *a, const void *b, void *c, unsigned N)    \
+{                                                                       \
+  const ctype *a_at = a;                                                \
+  ctype s = * (const ctype *) b;                                        \
+  ctype *c_at = c;                                                      \
+  while (N--)                                                           \
+    *c_at++ = *a_at++ * s;                                              \
+}
+#define DEFINE_SCALAR_SUM(name, ctype)                                  \
+static void name (void *out, const void *in, unsigned N)                \
+{                                                                       \
+  const ctype *a = in;                                                  \
+  ctype v = 0;                                                          \
+  while (N--)                                                           \
+    v += *a++;                                                          \
+  * (ctype *) out = v;                                                  \
+}
+#define DEFINE_SCALAR_EXTREME(name, ctype, cmp)                         \
+static void name (void *out, const void *in, unsigned N)                \
+{                                                                       \
+  const ctype *a = in;                                                  \
+  ctype v = *a++;                                                       \
+  while (--N)                                                           \
+    {                                                                   \
+      if (*a cmp v)                                                     \
+        v = *a;                                                         \
+      a++;                                                              \
+    }                                                                   \
+  * (ctype *) out = v;                                                  \
+}
+#define DEFINE_SCALAR_KERNELS(type, ctype)                              \
+  DEFINE_SCALAR_BINARY (add__scalar__##type, ctype, ADD_OP)             \
+  DEFINE_SCALAR_BINARY (subtract__scalar__##type, ctype, SUBTRACT_OP)   \
+  DEFINE_SCALAR_SCALE (scalar_multiply__scalar__##type, ctype)          \
+  DEFINE_SCALAR_SUM (sum__scalar__##type, ctype)                        \
+  DEFINE_SCALAR_EXTREME (min__scalar__##type, ctype, <)                 \
+  DEFINE_SCALAR_EXTREME (max__scalar__##type, ctype, >)
+DEFINE_SCALAR_KERNELS (int32, int32_t)
+DEFINE_SCALAR_KERNELS (float, float)
+DEFINE_SCALAR_KERNELS (double, double)
+
+/* --- matrix multiply ---
+ *
+ * C = A * B is computed a block at a time, so that the part of B
+ * being used stays in cache: for each GEMM_NC-column slab of B,
+ * for each GEMM_KC-row slice of that slab, the slice is copied
+ * ("packed") into panels of NR columns, stored k-major.
+ * Then each GEMM_MC-row block of the matching columns of A
+ * is packed into panels of MR rows, stored k-major,
+ * and a micro-kernel multiplies one MR-row panel by one NR-column panel,
+ * adding the MR x NR result into C.  Panels that run past the edge
+ * of the matrix are padded with zeros.
+ *
+ * Each set provides only the micro-kernel; MR is always GEMM_MR.
+ */
+#define GEMM_MR         4
+#define GEMM_KC         256
+#define GEMM_MC         128
+#define GEMM_NC         2048
+
+#define DEFINE_GEMM_PACK(type, ctype)                                   \
+static void                                                             \
+pack_a__##type (ctype *dst, const ctype *a, unsigned lda,               \
+                unsigned m, unsigned k)                                 \
+{                                                                       \
+  unsigned i, p, r;                                                     \
+  for (i = 0; i < m; i += GEMM_MR)                                      \
+    for (p = 0; p < k; p++)                                             \
+      for (r = 0; r < GEMM_MR; r++)                                     \
+        *dst++ = i + r < m ? a[(i + r) * lda + p] : 0;                  \
+}                                                                       \
+static void                                                             \
+pack_b__##type (ctype *dst, const ctype *b, unsigned ldb,               \
+                unsigned k, unsigned n, unsigned nr)                    \
+{                                                                       \
+  unsigned j, p, c;                                                     \
+  for (j = 0; j < n; j += nr)                                           \
+    for (p = 0; p < k; p++)                                             \
+      for (c = 0; c < nr; c++)                                          \
+        *dst++ = j + c < n ? b[p * ldb + j + c] : 0;                    \
+}
+DEFINE_GEMM_PACK (int32, int32_t)
+DEFINE_GEMM_PACK (float, float)
+DEFINE_GEMM_PACK (double, double)
+
+#define DEFINE_GEMM_DRIVER(name, type, ctype, micro, NR)                \
+static void                                                             \
+name (const void *a, const void *b, void *c,                            \
+      unsigned na, unsigned nb, unsigned nc)                            \
+{                                                                       \
+  const ctype *A = a;                                                   \
+  const ctype *B = b;                                                   \
+  ctype *C = c;                                                         \
+  ctype *a_pack = dang_new (ctype, GEMM_MC * GEMM_KC);                  \
+  ctype *b_pack = dang_new (ctype, GEMM_KC * (GEMM_NC + NR));           \
+  unsigned ic, jc, pc, ir, jr;                                          \
+  memset (C, 0, sizeof (ctype) * na * nc);                              \
+  for (jc = 0; jc < nc; jc += GEMM_NC)                                  \
+    {                                                                   \
+      unsigned n = DANG_MIN (GEMM_NC, nc - jc);                         \
+      for (pc = 0; pc < nb; pc += GEMM_KC)                              \
+        {                                                               \
+          unsigned k = DANG_MIN (GEMM_KC, nb - pc);                     \
+          pack_b__##type (b_pack, B + pc * nc + jc, nc, k, n, NR);      \
+          for (ic = 0; ic < na; ic += GEMM_MC)                          \
+            {                                                           \
+              unsigned m = DANG_MIN (GEMM_MC, na - ic);                 \
+              pack_a__##type (a_pack, A + ic * nb + pc, nb, m, k);      \
+              for (jr = 0; jr < n; jr += NR)                            \
+                for (ir = 0; ir < m; ir += GEMM_MR)                     \
+                  micro (k, a_pack + ir * k, b_pack + jr * k,           \
+                         C + (ic + ir) * nc + jc + jr, nc,              \
+                         DANG_MIN (GEMM_MR, m - ir),                    \
+                         DANG_MIN (NR, n - jr));                        \
+            }                                                           \
+        }                                                               \
+    }                                                                   \
+  dang_free (a_pack);                                                   \
+  dang_free (b_pack);                                                   \
+}
+
+/* Micro-kernels add the m x n corner of the GEMM_MR x NR product
+   of the packed panels 'ap' and 'bp' to c. */
+#define GEMM_SCALAR_NR  4
+#define DEFINE_SCALAR_GEMM(type, ctype)                                 \
+static void                                                             \
+gemm_micro__scalar__##type (unsigned k, const ctype *ap,                \
+                            const ctype *bp, ctype *c, unsigned ldc,    \
+                            unsigned m, unsigned n)                     \
+{                                                                       \
+  ctype acc[GEMM_MR][GEMM_SCALAR_NR];                                   \
+  unsigned p, r, j;                                                     \
+  memset (acc, 0, sizeof (acc));                                        \
+  for (p = 0; p < k; p++)                                               \
+    {                                                                   \
+      for (r = 0; r < GEMM_MR; r++)                                     \
+        for (j = 0; j < GEMM_SCALAR_NR; j++)                            \
+          acc[r][j] += ap[r] * bp[j];                                   \
+      ap += GEMM_MR;                                                    \
+      bp += GEMM_SCALAR_NR;                                             \
+    }                                                                   \
+  for (r = 0; r < m; r++)                                               \
+    for (j = 0; j < n; j++)                                             \
+      c[r * ldc + j] += acc[r][j];                                      \
+}                                                                       \
+DEFINE_GEMM_DRIVER (matrix_multiply__scalar__##type, type, ctype,       \
+                    gemm_micro__scalar__##type, GEMM_SCALAR_NR)
+DEFINE_SCALAR_GEMM (int32, int32_t)
+DEFINE_SCALAR_GEMM (float, float)
+DEFINE_SCALAR_GEMM (double, double)
+
+#define KERNEL_TABLE(set, SET)                                          \
+  {                                                                     \
+    DANG_TENSOR_KERNEL_SET_##SET,                                       \
+    { add__##set##__int32, add__##set##__float, add__##set##__double }, \
+    { subtract__##set##__int32, subtract__##set##__float,               \
+      subtract__##set##__double },                                      \
+    { scalar_multiply__##set##__int32, scalar_multiply__##set##__float, \
+      scalar_multiply__##set##__double },                               \
+    { sum__##set##__int32, sum__##set##__float, sum__##set##__double }, \
+    { min__##set##__int32, min__##set##__float, min__##set##__double }, \
+    { max__##set##__int32, max__##set##__float, max__##set##__double }, \
+    { matrix_multiply__##set##__int32, matrix_multiply__##set##__float, \
+      matrix_multiply__##set##__double }                                \
+  }
+
+static const DangTensorKernels scalar_kernels = KERNEL_TABLE (scalar, SCALAR);
+
+#if DANG_TENSOR_KERNELS_X86
+/* --- vector kernels ---
+ *
+ * Each loop handles 'width' elements at a time with unaligned
+ * loads and stores, then finishes the last few one by one.
+ * The vector types are described by a prefix:
+ *   PREFIX##_VEC        the vector type
+ *   PREFIX##_WIDTH      the number of elements in a vector
+ *   PREFIX##_LOAD(p)    load a vector from p
+ *   PREFIX##_STORE(p,v) store v to p
+ *   PREFIX##_SET1(x)    a vector of x's
+ *   PREFIX##_ADD(a,b), PREFIX##_SUB(a,b), PREFIX##_MUL(a,b),
+ *   PREFIX##_MIN(a,b), PREFIX##_MAX(a,b)
+ * MIN and MAX return 'b' where the comparison fails (as with NaNs),
+ * matching the scalar loops, which only replace the
+ * running value when the comparison is true.
+ */
+#define SSE2_INT32_VEC          __m128i
+#define SSE2_INT32_WIDTH        4
+#define SSE2_INT32_LOAD(p)      _mm_loadu_si128 ((const __m128i *) (p))
+#define SSE2_INT32_STORE(p,v)   _mm_storeu_si128 ((__m128i *) (p), v)
+#define SSE2_INT32_SET1(x)      _mm_set1_epi32 (x)
+#define SSE2_INT32_ADD          _mm_add_epi32
+#define SSE2_INT32_SUB          _mm_sub_epi32
+#define SSE2_INT32_MUL          sse2_mullo_epi32
+#define SSE2_INT32_MIN(a,b)     sse2_select_epi32 (_mm_cmplt_epi32 (a, b), a, b)
+#define SSE2_INT32_MAX(a,b)     sse2_select_epi32 (_mm_cmpgt_epi32 (a, b), a, b)
+
+#define SSE2_FLOAT_VEC          __m128
+#define SSE2_FLOAT_WIDTH        4
+#define SSE2_FLOAT_LOAD(p)      _mm_loadu_ps (p)
+#define SSE2_FLOAT_STORE(p,v)   _mm_storeu_ps (p, v)
+#define SSE2_FLOAT_SET1(x)      _mm_set1_ps (x)
+#define SSE2_FLOAT_ADD          _mm_add_ps
+#define SSE2_FLOAT_SUB          _mm_sub_ps
+#define SSE2_FLOAT_MUL          _mm_mul_ps
+#define SSE2_FLOAT_MIN          _mm_min_ps
+#define SSE2_FLOAT_MAX          _mm_max_ps
+
+#define SSE2_DOUBLE_VEC         __m128d
+#define SSE2_DOUBLE_WIDTH       2
+#define SSE2_DOUBLE_LOAD(p)     _mm_loadu_pd (p)
+#define SSE2_DOUBLE_STORE(p,v)  _mm_storeu_pd (p, v)
+#define SSE2_DOUBLE_SET1(x)     _mm_set1_pd (x)
+#define SSE2_DOUBLE_ADD         _mm_add_pd
+#define SSE2_DOUBLE_SUB         _mm_sub_pd
+#define SSE2_DOUBLE_MUL         _mm_mul_pd
+#define SSE2_DOUBLE_MIN         _mm_min_pd
+#define SSE2_DOUBLE_MAX         _mm_max_pd
+
+#define AVX2_INT32_VEC          __m256i
+#define AVX2_INT32_WIDTH        8
+#define AVX2_INT32_LOAD(p)      _mm256_loadu_si256 ((const __m256i *) (p))
+#define AVX2_INT32_STORE(p,v)   _mm256_storeu_si256 ((__m256i *) (p), v)
+#define AVX2_INT32_SET1(x)      _mm256_set1_epi32 (x)
+#define AVX2_INT32_ADD          _mm256_add_epi32
+#define AVX2_INT32_SUB          _mm256_sub_epi32
+#define AVX2_INT32_MUL          _mm256_mullo_epi32
+#define AVX2_INT32_MIN          _mm256_min_epi32
+#define AVX2_INT32_MAX          _mm256_max_epi32
+
+#define AVX2_FLOAT_VEC          __m256
+#define AVX2_FLOAT_WIDTH        8
+#define AVX2_FLOAT_LOAD(p)      _mm256_loadu_ps (p)
+#define AVX2_FLOAT_STORE(p,v)   _mm256_storeu_ps (p, v)
+#define AVX2_FLOAT_SET1(x)      _mm256_set1_ps (x)
+#define AVX2_FLOAT_ADD          _mm256_add_ps
+#define AVX2_FLOAT_SUB          _mm256_sub_ps
+#define AVX2_FLOAT_MUL          _mm256_mul_ps
+#define AVX2_FLOAT_MIN          _mm256_min_ps
+#define AVX2_FLOAT_MAX          _mm256_max_ps
+
+#define AVX2_DOUBLE_VEC         __m256d
+#define AVX2_DOUBLE_WIDTH       4
+#define AVX2_DOUBLE_LOAD(p)     _mm256_loadu_pd (p)
+#define AVX2_DOUBLE_STORE(p,v)  _mm256_storeu_pd (p, v)
+#define AVX2_DOUBLE_SET1(x)     _mm256_set1_pd (x)
+#define AVX2_DOUBLE_ADD         _mm256_add_pd
+#define AVX2_DOUBLE_SUB         _mm256_sub_pd
+#define AVX2_DOUBLE_MUL         _mm256_mul_pd
+#define AVX2_DOUBLE_MIN         _mm256_min_pd
+#define AVX2_DOUBLE_MAX         _mm256_max_pd
+
+/* SSE2 has no 32-bit multiply or select */
+static inline TARGET ("sse2") __m128i
+sse2_mullo_epi32 (__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32 (a, b);
+  __m128i odd = _mm_mul_epu32 (_mm_srli_epi64 (a, 32), _mm_srli_epi64 (b, 32));
+  return _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, _MM_SHUFFLE (0, 0, 2, 0)),
+                             _mm_shuffle_epi32 (odd, _MM_SHUFFLE (0, 0, 2, 0)));
+}
+static inline TARGET ("sse2") __m128i
+sse2_select_epi32 (__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128 (_mm_and_si128 (mask, a), _mm_andnot_si128 (mask, b));
+}
+
+#define DEFINE_VECTOR_BINARY(name, isa, ctype, V, vop, op)              \
+static TARGET (isa) void                                                \
+name (const void *a, const void *b, void *c, unsigned N)                \
+{                                                                       \
+  const ctype *a_at = a;                                                \
+  const ctype *b_at = b;                                                \
+  ctype *c_at = c;                                                      \
+  for (; N >= V##_WIDTH; N -= V##_WIDTH)                                \
+    {                                                                   \
+      V##_STORE (c_at, vop (V##_LOAD (a_at), V##_LOAD (b_at)));         \
+      a_at += V##_WIDTH;                                                \
+      b_at += V##_WIDTH;                                                \
+      c_at += V##_WIDTH;                                                \
+    }                                                                   \
+  while (N--)                                                           \
+    *c_at++ = op (*a_at++, *b_at++);                                    \
+}
+#define DEFINE_VECTOR_SCALE(name, isa, ctype, V)                        \
+static TARGET (isa) void                                                \
+name (const void *a, const void *b, void *c, unsigned N)                \
+{                                                                       \
+  const ctype *a_at = a;                                                \
+  ctype s = * (const ctype *) b;                                        \
+  V##_VEC vs = V##_SET1 (s);                                            \
+  ctype *c_at = c;                                                      \
+  for (; N >= V##_WIDTH; N -= V##_WIDTH)                                \
+    {                                                                   \
+      V##_STORE (c_at, V##_MUL (V##_LOAD (a_at), vs));                  \
+      a_at += V##_WIDTH;                                                \
+      c_at += V##_WIDTH;                                                \
+    }                                                                   \
+  while (N--)                                                           \
+    *c_at++ = *a_at++ * s;                                              \
+}
+
+/* Folds keep one running value per lane, then combine the lanes
+   in order, then fold in the last few elements. */
+#define DEFINE_VECTOR_SUM(name, isa, ctype, V)                          \
+static TARGET (isa) void                                                \
+name (void *out, const void *in, unsigned N)                            \
+{                                                                       \
+  const ctype *a = in;                                                  \
+  ctype lanes[V##_WIDTH];                                               \
+  ctype v = 0;                                                          \
+  unsigned i;                                                           \
+  if (N >= V##_WIDTH)                                                   \
+    {                                                                   \
+      V##_VEC acc = V##_SET1 (0);                                       \
+      for (; N >= V##_WIDTH; N -= V##_WIDTH)                            \
+        {                                                               \
+          acc = V##_ADD (acc, V##_LOAD (a));                            \
+          a += V##_WIDTH;                                               \
+        }                                                               \
+      V##_STORE (lanes, acc);                                           \
+      for (i = 0; i < V##_WIDTH; i++)                                   \
+        v += lanes[i];                                                  \
+    }                                                                   \
+  while (N--)                                                           \
+    v += *a++;                                                          \
+  * (ctype *) out = v;                                                  \
+}
+#define DEFINE_VECTOR_EXTREME(name, isa, ctype, V, vop, cmp)            \
+static TARGET (isa) void                                                \
+name (void *out, const void *in, unsigned N)                            \
+{                                                                       \
+  const ctype *a = in;                                                  \
+  ctype lanes[V##_WIDTH];                                               \
+  ctype v;                                                              \
+  unsigned i;                                                           \
+  if (N >= V##_WIDTH)                                                   \
+    {                                                                   \
+      V##_VEC acc = V##_LOAD (a);                                       \
+      a += V##_WIDTH;                                                   \
+      for (N -= V##_WIDTH; N >= V##_WIDTH; N -= V##_WIDTH)              \
+        {                                                               \
+          V##_VEC x = V##_LOAD (a);                                     \
+          acc = vop (x, acc);                                           \
+          a += V##_WIDTH;                                               \
+        }                                                               \
+      V##_STORE (lanes, acc);                                           \
+      v = lanes[0];                                                     \
+      for (i = 1; i < V##_WIDTH; i++)                                   \
+        if (lanes[i] cmp v)                                             \
+          v = lanes[i];                                                 \
+    }                                                                   \
+  else                                                                  \
+    {                                                                   \
+      v = *a++;                                                         \
+      N--;                                                              \
+    }                                                                   \
+  for (; N > 0; N--, a++)                                               \
+    if (*a cmp v)                                                       \
+      v = *a;                                                           \
+  * (ctype *) out = v;                                                  \
+}
+
+#define DEFINE_VECTOR_KERNELS(set, isa, type, ctype, V)                 \
+  DEFINE_VECTOR_BINARY (add__##set##__##type, isa, ctype, V,            \
+                        V##_ADD, ADD_OP)                                \
+  DEFINE_VECTOR_BINARY (subtract__##set##__##type, isa, ctype, V,       \
+                        V##_SUB, SUBTRACT_OP)                           \
+  DEFINE_VECTOR_SCALE (scalar_multiply__##set##__##type, isa, ctype, V) \
+  DEFINE_VECTOR_SUM (sum__##set##__##type, isa, ctype, V)               \
+  DEFINE_VECTOR_EXTREME (min__##set##__##type, isa, ctype, V,           \
+                         V##_MIN, <)                                    \
+  DEFINE_VECTOR_EXTREME (max__##set##__##type, isa, ctype, V,           \
+                         V##_MAX, >)
+
+/* The micro-kernel keeps GEMM_MR x 2 vectors of C in registers,
+   so NR is twice the vector width. */
+#define DEFINE_VECTOR_GEMM(set, isa, type, ctype, V)                    \
+static TARGET (isa) void                                                \
+gemm_micro__##set##__##type (unsigned k, const ctype *ap,               \
+                             const ctype *bp, ctype *c, unsigned ldc,   \
+                             unsigned m, unsigned n)                    \
+{                                                                       \
+  V##_VEC acc[GEMM_MR][2];                                              \
+  ctype tmp[2 * V##_WIDTH];                                             \
+  unsigned p, r, j;                                                     \
+  for (r = 0; r < GEMM_MR; r++)                                         \
+    acc[r][0] = acc[r][1] = V##_SET1 (0);                               \
+  for (p = 0; p < k; p++)                                               \
+    {                                                                   \
+      V##_VEC b0 = V##_LOAD (bp);                                       \
+      V##_VEC b1 = V##_LOAD (bp + V##_WIDTH);                           \
+      for (r = 0; r < GEMM_MR; r++)                                     \
+        {                                                               \
+          V##_VEC ar = V##_SET1 (ap[r]);                                \
+          acc[r][0] = V##_ADD (acc[r][0], V##_MUL (ar, b0));            \
+          acc[r][1] = V##_ADD (acc[r][1], V##_MUL (ar, b1));            \
+        }                                                               \
+      ap += GEMM_MR;                                                    \
+      bp += 2 * V##_WIDTH;                                              \
+    }                                                                   \
+  for (r = 0; r < m; r++)                                               \
+    {                                                                   \
+      ctype *c_row = c + r * ldc;                                       \
+      if (n == 2 * V##_WIDTH)                                           \
+        {                                                               \
+          V##_STORE (c_row, V##_ADD (V##_LOAD (c_row), acc[r][0]));     \
+          V##_STORE (c_row + V##_WIDTH,                                 \
+                     V##_ADD (V##_LOAD (c_row + V##_WIDTH), acc[r][1]));\
+        }                                                               \
+      else                                                              \
+        {                                                               \
+          V##_STORE (tmp, acc[r][0]);                                   \
+          V##_STORE (tmp + V##_WIDTH, acc[r][1]);                       \
+          for (j = 0; j < n; j++)                                       \
+            c_row[j] += tmp[j];                                         \
+        }                                                               \
+    }                                                                   \
+}                                                                       \
+DEFINE_GEMM_DRIVER (matrix_multiply__##set##__##type, type, ctype,      \
+                    gemm_micro__##set##__##type, 2 * V##_WIDTH)
+
+DEFINE_VECTOR_KERNELS (sse2, "sse2", int32, int32_t, SSE2_INT32)
+DEFINE_VECTOR_KERNELS (sse2, "sse2", float, float, SSE2_FLOAT)
+DEFINE_VECTOR_KERNELS (sse2, "sse2", double, double, SSE2_DOUBLE)
+DEFINE_VECTOR_KERNELS (avx2, "avx2", int32, int32_t, AVX2_INT32)
+DEFINE_VECTOR_KERNELS (avx2, "avx2", float, float, AVX2_FLOAT)
+DEFINE_VECTOR_KERNELS (avx2, "avx2", double, double, AVX2_DOUBLE)
+DEFINE_VECTOR_GEMM (sse2, "sse2", int32, int32_t, SSE2_INT32)
+DEFINE_VECTOR_GEMM (sse2, "sse2", float, float, SSE2_FLOAT)
+DEFINE_VECTOR_GEMM (sse2, "sse2", double, double, SSE2_DOUBLE)
+DEFINE_VECTOR_GEMM (avx2, "avx2", int32, int32_t, AVX2_INT32)
+DEFINE_VECTOR_GEMM (avx2, "avx2", float, float, AVX2_FLOAT)
+DEFINE_VECTOR_GEMM (avx2, "avx2", double, double, AVX2_DOUBLE)
+
+static const DangTensorKernels sse2_kernels = KERNEL_TABLE (sse2, SSE2);
+static const DangTensorKernels avx2_kernels = KERNEL_TABLE (avx2, AVX2);
+#endif
+
+const DangTensorKernels *dang_tensor_kernels = &scalar_kernels;
+
+const DangTensorKernels *
+dang_tensor_kernels_get (DangTensorKernelSet set)
+{
+  switch (set)
+    {
+    case DANG_TENSOR_KERNEL_SET_SCALAR:
+      return &scalar_kernels;
+#if DANG_TENSOR_KERNELS_X86
+    case DANG_TENSOR_KERNEL_SET_SSE2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("sse2") ? &sse2_kernels : NULL;
+    case DANG_TENSOR_KERNEL_SET_AVX2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("avx2") ? &avx2_kernels : NULL;
+#endif
+    default:
+      return NULL;
+    }
+}
+
+DangTensorKernelSet
+dang_tensor_kernel_set_best (void)
+{
+  if (dang_tensor_kernels_get (DANG_TENSOR_KERNEL_SET_AVX2) != NULL)
+    return DANG_TENSOR_KERNEL_SET_AVX2;
+  if (dang_tensor_kernels_get (DANG_TENSOR_KERNEL_SET_SSE2) != NULL)
+    return DANG_TENSOR_KERNEL_SET_SSE2;
+  return DANG_TENSOR_KERNEL_SET_SCALAR;
+}
+
+static const char *kernel_set_names[] = { "scalar", "sse2", "avx2" };
+
+const char *
+dang_tensor_kernel_set_name (DangTensorKernelSet set)
+{
+  if ((unsigned) set < DANG_N_ELEMENTS (kernel_set_names))
+    return kernel_set_names[set];
+  return "*bad-kernel-set*";
+}
+
+dang_boolean
+dang_tensor_kernel_set_parse (const char *name,
+                              DangTensorKernelSet *set_out)
+{
+  unsigned i;
+  for (i = 0; i < DANG_N_ELEMENTS (kernel_set_names); i++)
+    if (strcmp (name, kernel_set_names[i]) == 0)
+      {
+        *set_out = i;
+        return TRUE;
+      }
+  return FALSE;
+}
+
+/* --- dang_tensor_matrix_multiply() --- */
+/* Products with fewer multiply-adds than this run on the calling thread. */
+#define MATRIX_MULTIPLY_MIN_SPLIT_OPS   (1 << 21)
+/* ...and each part gets at least this many rows. */
+#define MATRIX_MULTIPLY_MIN_SPLIT_ROWS  32
+
+typedef struct _MatrixMultiplyParts MatrixMultiplyParts;
+struct _MatrixMultiplyParts
+{
+  DangTensorMatrixMultiplyKernel kernel;
+  const char *a;
+  const void *b;
+  char *c;
+  unsigned na, nb, nc;
+  size_t elt_size;
+  unsigned rows_per_part;
+};
+
+static void
+matrix_multiply_part (unsigned part,
+                      void    *data)
+{
+  MatrixMultiplyParts *mm = data;
+  unsigned row = part * mm->rows_per_part;
+  mm->kernel (mm->a + (size_t) row * mm->nb * mm->elt_size,
+              mm->b,
+              mm->c + (size_t) row * mm->nc * mm->elt_size,
+              DANG_MIN (mm->rows_per_part, mm->na - row),
+              mm->nb, mm->nc);
+}
+
+/**
+ * dang_tensor_matrix_multiply:
+ * @type: the element type.
+ * @a: the na x nb matrix, row-major.
+ * @b: the nb x nc matrix, row-major.
+ * @c: the na x nc result, row-major.
+ * @na,nb,nc: the matrix sizes.
+ *
+ * Compute c = a * b with the current kernels.
+ * Large products are split by rows into one part per worker
+ * of the default scheduler; the calling thread runs parts too.
+ */
+void
+dang_tensor_matrix_multiply (DangTensorKernelType type,
+                             const void          *a,
+                             const void          *b,
+                             void                *c,
+                             unsigned             na,
+                             unsigned             nb,
+                             unsigned             nc)
+{
+  DangTensorMatrixMultiplyKernel kernel = dang_tensor_kernels->matrix_multiply[type];
+  DangScheduler *scheduler;
+  MatrixMultiplyParts mm;
+  unsigned n_parts, rows_per_part;
+
+  if (na < 2 * MATRIX_MULTIPLY_MIN_SPLIT_ROWS
+   || (double) na * nb * nc < MATRIX_MULTIPLY_MIN_SPLIT_OPS)
+    {
+      kernel (a, b, c, na, nb, nc);
+      return;
+    }
+  scheduler = dang_scheduler_get_default ();
+  n_parts = dang_scheduler_get_n_workers (scheduler);
+  if (n_parts > na / MATRIX_MULTIPLY_MIN_SPLIT_ROWS)
+    n_parts = na / MATRIX_MULTIPLY_MIN_SPLIT_ROWS;
+  if (n_parts <= 1)
+    {
+      kernel (a, b, c, na, nb, nc);
+      return;
+    }
+
+  /* keep whole micro-kernel panels in each part */
+  rows_per_part = (na + n_parts - 1) / n_parts;
+  rows_per_part = (rows_per_part + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+  n_parts = (na + rows_per_part - 1) / rows_per_part;
+
+  mm.kernel = kernel;
+  mm.a = a;
+  mm.b = b;
+  mm.c = c;
+  mm.na = na;
+  mm.nb = nb;
+  mm.nc = nc;
+  mm.elt_size = type == DANG_TENSOR_KERNEL_DOUBLE ? 8 : 4;
+  mm.rows_per_part = rows_per_part;
+  dang_scheduler_run_parts (scheduler, n_parts, matrix_multiply_part, &mm);
+}
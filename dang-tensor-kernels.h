@@ -0,0 +1,87 @@
+/* --- element-wise tensor kernels ---
+ *
+ * The inner loops of tensor '+', '-', tensor-by-scalar '*'
+ * and sum(), average(), min() and max() over int32, float and double
+ * tensors, in a portable scalar version and in SSE2 and AVX2 versions
+ * for x86.  At startup the widest set this cpu supports (per CPUID)
+ * is selected.
+ *
+ * Matrix multiplication (see dang_tensor_matrix_multiply())
+ * is likewise done by a packed, cache-blocked kernel in each set.
+ *
+ * The vector sums of floats and doubles add the elements
+ * in a different order than the scalar loop,
+ * so they may round differently.
+ */
+
+typedef enum
+{
+  DANG_TENSOR_KERNEL_INT32,
+  DANG_TENSOR_KERNEL_FLOAT,
+  DANG_TENSOR_KERNEL_DOUBLE
+} DangTensorKernelType;
+#define DANG_TENSOR_KERNEL_N_TYPES      3
+
+/* c[i] = a[i] OP b[i]; for scalar_multiply, 'b' is a single element */
+typedef void (*DangTensorBinaryKernel) (const void *a,
+                                        const void *b,
+                                        void       *c,
+                                        unsigned    N);
+
+/* *out = the fold of in[0..N-1]; min and max require N > 0 */
+typedef void (*DangTensorFoldKernel)   (void       *out,
+                                        const void *in,
+                                        unsigned    N);
+
+/* c (na x nc) = a (na x nb) * b (nb x nc); all row-major */
+typedef void (*DangTensorMatrixMultiplyKernel) (const void *a,
+                                                const void *b,
+                                                void       *c,
+                                                unsigned    na,
+                                                unsigned    nb,
+                                                unsigned    nc);
+
+typedef enum
+{
+  DANG_TENSOR_KERNEL_SET_SCALAR,
+  DANG_TENSOR_KERNEL_SET_SSE2,
+  DANG_TENSOR_KERNEL_SET_AVX2
+} DangTensorKernelSet;
+
+typedef struct _DangTensorKernels DangTensorKernels;
+struct _DangTensorKernels
+{
+  DangTensorKernelSet set;
+
+  /* indexed by DangTensorKernelType */
+  DangTensorBinaryKernel add[DANG_TENSOR_KERNEL_N_TYPES];
+  DangTensorBinaryKernel subtract[DANG_TENSOR_KERNEL_N_TYPES];
+  DangTensorBinaryKernel scalar_multiply[DANG_TENSOR_KERNEL_N_TYPES];
+  DangTensorFoldKernel sum[DANG_TENSOR_KERNEL_N_TYPES];
+  DangTensorFoldKernel min[DANG_TENSOR_KERNEL_N_TYPES];
+  DangTensorFoldKernel max[DANG_TENSOR_KERNEL_N_TYPES];
+  DangTensorMatrixMultiplyKernel matrix_multiply[DANG_TENSOR_KERNEL_N_TYPES];
+};
+
+/* the kernels in use */
+extern const DangTensorKernels *dang_tensor_kernels;
+
+/* NULL if the cpu does not support the set */
+const DangTensorKernels *dang_tensor_kernels_get (DangTensorKernelSet set);
+
+/* the widest set the cpu supports */
+DangTensorKernelSet dang_tensor_kernel_set_best (void);
+
+const char  *dang_tensor_kernel_set_name  (DangTensorKernelSet set);
+dang_boolean dang_tensor_kernel_set_parse (const char *name,
+                                           DangTensorKernelSet *set_out);
+
+/* c = a * b with the kernels in use; may split the work between
+   the default scheduler's workers */
+void dang_tensor_matrix_multiply (DangTensorKernelType type,
+                                  const void          *a,
+                                  const void          *b,
+                                  void                *c,
+                                  unsigned             na,
+                                  unsigned             nb,
+                                  unsigned             nc);
@@ -31,7 +31,7 @@ tensor_init_assign (DangValueType   *type,
   DangTensor *src_tensor = * (DangTensor **) src;
   DANG_UNUSED (type);
   if (src_tensor)
-    src_tensor->ref_count += 1;
+    DANG_REF_COUNT_INC (src_tensor->ref_count);
   *p_dst_tensor = src_tensor;
 }
 
@@ -39,7 +39,7 @@ void dang_tensor_unref (DangValueType *type,
                         DangTensor    *tensor)
 {
   DangValueTypeTensor *ttype = (DangValueTypeTensor *) type;
-  if (--(tensor->ref_count) > 0)
+  if (DANG_REF_COUNT_DEC (tensor->ref_count) > 0)
     return;
   if (ttype->element_type->destruct != NULL)
     {
@@ -703,6 +703,7 @@ variadic_c__operator_equal (DangMatchQuery *query,
   rv = dang_function_new_simple_c (sig,
                                    invert ? do_tensor_operator_notequal : do_tensor_operator_equal,
                                    func_data, free_chain_func_data);
+  rv->simple_c.is_pure = TRUE;
   dang_signature_unref (sig);
   return rv;
 }
@@ -754,6 +755,7 @@ variadic_c__dims (DangMatchQuery *query,
   sig = dang_signature_new (dang_value_type_vector (dang_value_type_uint32 ()),
                             1, params);
   rv = dang_function_new_simple_c (sig, do_tensor_dims, (void*)rank, NULL);
+  rv->simple_c.is_pure = TRUE;
   dang_signature_unref (sig);
   return rv;
 }
@@ -793,6 +795,7 @@ try_sig__vector__length (DangMatchQuery *query,
   params[0].type = query->elements[0].info.simple_input;
   sig = dang_signature_new (dang_value_type_uint32 (), 1, params);
   rv = dang_function_new_simple_c (sig, do_vector_length, NULL, NULL);
+  rv->simple_c.is_pure = TRUE;
   dang_signature_unref (sig);
   return rv;
 }
@@ -825,7 +828,7 @@ try_sig__vector__length (DangMatchQuery *query,
 
    NOTE: The pointer placed in *sig_out does hold a reference.
  */
-static dang_boolean
+dang_boolean
 dang_match_function_from_params (DangMatchQueryElement *elt,
                                  unsigned               n_params,
                                  DangFunctionParam     *params,
@@ -1242,6 +1245,36 @@ typedef struct {
 
 
 
+/* Set an error unless tensors of the given rank
+   have the same sizes, for the operator 'op_name'. */
+static dang_boolean
+check_sizes_match (unsigned        rank,
+                   const unsigned *a_sizes,
+                   const unsigned *b_sizes,
+                   const char     *op_name,
+                   DangError     **error)
+{
+  unsigned i;
+  for (i = 0; i < rank; i++)
+    if (a_sizes[i] != b_sizes[i])
+      break;
+  if (i == rank)
+    return TRUE;
+  if (rank == 1)
+    dang_set_error (error, "vector arguments to %s differ in size (%u v %u)",
+                    op_name, a_sizes[0], b_sizes[0]);
+  else if (rank == 2)
+    dang_set_error (error, "matrix arguments to %s differ in size (%ux%u v %ux%u)",
+                    op_name,
+                    a_sizes[0], a_sizes[1],
+                    b_sizes[0], b_sizes[1]);
+  else
+    dang_set_error (error, "tensor arguments to %s differ in size in index %u: %u v %u",
+                    op_name,
+                    i, a_sizes[i], b_sizes[i]);
+  return FALSE;
+}
+
 static DANG_SIMPLE_C_FUNC_DECLARE (do_elementwise_op)
 {
   ElementwiseOpFuncInfo *fi = func_data;
@@ -1256,18 +1289,11 @@ static DANG_SIMPLE_C_FUNC_DECLARE (do_elementwise_op)
     a = dang_tensor_empty ();
   if (b == NULL)
     b = dang_tensor_empty ();
+  if (!check_sizes_match (rank, a->sizes, b->sizes, fi->op_name, error))
+    return FALSE;
   total_elements = a->sizes[0];
-  if (b->sizes[0] != a->sizes[0])
-    {
-      i = 0;
-      goto size_mismatch;
-    }
   for (i = 1; i < rank; i++)
-    {
-      if (a->sizes[i] != b->sizes[i])
-        goto size_mismatch;
-      total_elements *= a->sizes[i];
-    }
+    total_elements *= a->sizes[i];
   c = dang_malloc (DANG_TENSOR_SIZEOF (rank));
   c->ref_count = 1;
   c->data = dang_malloc (total_elements * fi->op_info->type->sizeof_instance);
@@ -1276,29 +1302,6 @@ static DANG_SIMPLE_C_FUNC_DECLARE (do_elementwise_op)
   fi->op_info->op (a->data, b->data, c->data, total_elements);
   *(DangTensor **)rv_out = c;
   return TRUE;
-
-size_mismatch:
-  if (rank == 1)
-    {
-      dang_set_error (error, "vector arguments to %s differ in size (%u v %u)",
-                      fi->op_name, a->sizes[0], b->sizes[0]);
-      return FALSE;
-    }
-  else if (rank == 2)
-    {
-      dang_set_error (error, "matrix arguments to %s differ in size (%ux%u v %ux%u)",
-                      fi->op_name,
-                      a->sizes[0], a->sizes[1],
-                      b->sizes[0], b->sizes[1]);
-      return FALSE;
-    }
-  else
-    {
-      dang_set_error (error, "tensor arguments to %s differ in size in index %u: %u v %u",
-                      fi->op_name,
-                      i, a->sizes[i], b->sizes[i]);
-      return FALSE;
-    }
 }
 
 static DangFunction *
@@ -1354,33 +1357,26 @@ try_sig__tensor__bulk_op (DangMatchQuery *query,
   func_data->rank = ttype->rank;
   func_data->op_name = op_name;
   rv = dang_function_new_simple_c (sig, do_elementwise_op, func_data, dang_free);
+  rv->simple_c.is_pure = TRUE;
 
   dang_signature_unref (sig);
 
   return rv;
 }
 
-#define DEFINE_DO_BULK_OP(func_name, type, op_macro)                      \
+/* The bulk ops and some statistics run the kernels
+   selected in dang-tensor-kernels.c. */
+#define DEFINE_DO_BULK_OP(func_name, kernel, TYPE)                        \
 static void func_name (const void *a, const void *b, void *c, unsigned N) \
 {                                                                         \
-  const type *a_at = a;                                                   \
-  const type *b_at = b;                                                   \
-  type *c_at = c;                                                         \
-  while (N--)                                                             \
-    {                                                                     \
-      *c_at = op_macro (*a_at, *b_at);                                    \
-      a_at++;                                                             \
-      b_at++;                                                             \
-      c_at++;                                                             \
-    }                                                                     \
+  dang_tensor_kernels->kernel[DANG_TENSOR_KERNEL_##TYPE] (a, b, c, N);    \
 }
 
 static BulkOpTableEntry add__op_table[3];
 
-#define ADD_MACRO(a,b)  ((a) + (b))
-DEFINE_DO_BULK_OP(add_bulk__int32, int32_t, ADD_MACRO)
-DEFINE_DO_BULK_OP(add_bulk__float, float, ADD_MACRO)
-DEFINE_DO_BULK_OP(add_bulk__double, double, ADD_MACRO)
+DEFINE_DO_BULK_OP(add_bulk__int32, add, INT32)
+DEFINE_DO_BULK_OP(add_bulk__float, add, FLOAT)
+DEFINE_DO_BULK_OP(add_bulk__double, add, DOUBLE)
 
 static DangFunction *
 try_sig__tensor__operator_add       (DangMatchQuery *query,
@@ -1403,10 +1399,9 @@ try_sig__tensor__operator_add       (DangMatchQuery *query,
                                    "+", error);
 }
 
-#define SUBTRACT_MACRO(a,b)  ((a) - (b))
-DEFINE_DO_BULK_OP(subtract_bulk__int32, int32_t, SUBTRACT_MACRO)
-DEFINE_DO_BULK_OP(subtract_bulk__float, float, SUBTRACT_MACRO)
-DEFINE_DO_BULK_OP(subtract_bulk__double, double, SUBTRACT_MACRO)
+DEFINE_DO_BULK_OP(subtract_bulk__int32, subtract, INT32)
+DEFINE_DO_BULK_OP(subtract_bulk__float, subtract, FLOAT)
+DEFINE_DO_BULK_OP(subtract_bulk__double, subtract, DOUBLE)
 
 static BulkOpTableEntry subtract__op_table[3];
 static DangFunction *
@@ -1444,25 +1439,9 @@ struct _ScalarMultiplyInfo
   ScalarMultiplyFunc op;
 };
 
-#define DEFINE_DO_SCALAR_MULTIPLY(func_name, type)              \
-static void func_name(const void *tensor_data,                  \
-                      const void *scalar,                       \
-                      void *output,                             \
-                      unsigned N)                               \
-{                                                               \
-  const type *in = tensor_data;                                 \
-  type *out = output;                                           \
-  type s = *(const type*)scalar;                                \
-  while (N--)                                                   \
-    {                                                           \
-      *out = *in * s;                                           \
-      out++;                                                    \
-      in++;                                                     \
-    }                                                           \
-}
-DEFINE_DO_SCALAR_MULTIPLY(scalar_multiply__int32, int32_t)
-DEFINE_DO_SCALAR_MULTIPLY(scalar_multiply__float, float)
-DEFINE_DO_SCALAR_MULTIPLY(scalar_multiply__double, double)
+DEFINE_DO_BULK_OP(scalar_multiply__int32, scalar_multiply, INT32)
+DEFINE_DO_BULK_OP(scalar_multiply__float, scalar_multiply, FLOAT)
+DEFINE_DO_BULK_OP(scalar_multiply__double, scalar_multiply, DOUBLE)
 
 static DANG_SIMPLE_C_FUNC_DECLARE (do_scalar_multiply)
 {
@@ -1558,6 +1537,185 @@ possible_match:
   func_data->elt_size = elt_type->sizeof_instance;
   func_data->rank = rank;
   rv = dang_function_new_simple_c (sig, do_scalar_multiply, func_data, dang_free);
+  rv->simple_c.is_pure = TRUE;
+  dang_signature_unref (sig);
+  return rv;
+}
+
+/* --- fused element-wise expressions --- */
+dang_boolean
+dang_tensor_function_get_op (DangFunction *function,
+                             DangTensorOp *op_out)
+{
+  if (function->type != DANG_FUNCTION_TYPE_SIMPLE_C)
+    return FALSE;
+  if (function->simple_c.func == do_elementwise_op)
+    {
+      ElementwiseOpFuncInfo *fi = function->simple_c.func_data;
+      *op_out = strcmp (fi->op_name, "+") == 0 ? DANG_TENSOR_OP_ADD
+                                                : DANG_TENSOR_OP_SUBTRACT;
+      return TRUE;
+    }
+  if (function->simple_c.func == do_scalar_multiply)
+    {
+      ScalarMultiplyInfo *smi = function->simple_c.func_data;
+      *op_out = smi->tensor_first ? DANG_TENSOR_OP_SCALE
+                                  : DANG_TENSOR_OP_SCALE_LEFT;
+      return TRUE;
+    }
+  return FALSE;
+}
+
+/* Fused expressions are run FUSED_CHUNK_SIZE elements at a time,
+   each step but the last writing into its own chunk-sized buffer,
+   so the intermediate values stay in cache. */
+#define FUSED_CHUNK_SIZE        512
+
+typedef struct _FusedExprInfo FusedExprInfo;
+struct _FusedExprInfo
+{
+  DangTensorKernelType kernel_type;
+  unsigned elt_size;
+  unsigned rank;
+  unsigned n_params;
+  dang_boolean *param_is_tensor;
+  unsigned n_steps;
+  DangTensorFusedStep *steps;
+};
+
+static DANG_SIMPLE_C_FUNC_DECLARE (do_fused_expr)
+{
+  FusedExprInfo *fi = func_data;
+  const DangTensorKernels *kernels = dang_tensor_kernels;
+  DangTensorKernelType kt = fi->kernel_type;
+  unsigned n_params = fi->n_params;
+  unsigned chunk_bytes = FUSED_CHUNK_SIZE * fi->elt_size;
+  DangTensor **tensors = dang_newa (DangTensor *, n_params);
+  const unsigned **step_sizes = dang_newa (const unsigned *, fi->n_steps);
+  const unsigned *sizes;
+  DangTensor *out;
+  char *buffers;
+  unsigned total_elements, at, i, s;
+  DANG_UNUSED (error);
+
+#define OPERAND_SIZES(o) \
+  ((o) < n_params ? tensors[o]->sizes : step_sizes[(o) - n_params])
+#define OPERAND_DATA(o) \
+  ((o) < n_params ? (const char *) tensors[o]->data + at * fi->elt_size \
+                  : buffers + ((o) - n_params) * chunk_bytes)
+
+  for (i = 0; i < n_params; i++)
+    if (fi->param_is_tensor[i])
+      {
+        tensors[i] = *(DangTensor **) args[i];
+        if (tensors[i] == NULL)
+          tensors[i] = dang_tensor_empty ();
+      }
+
+  /* check sizes in the order the unfused operators would */
+  for (s = 0; s < fi->n_steps; s++)
+    {
+      const DangTensorFusedStep *step = fi->steps + s;
+      step_sizes[s] = OPERAND_SIZES (step->a);
+      if (step->op != DANG_TENSOR_OP_SCALE
+       && !check_sizes_match (fi->rank, step_sizes[s], OPERAND_SIZES (step->b),
+                              step->op == DANG_TENSOR_OP_ADD ? "+" : "-",
+                              error))
+        return FALSE;
+    }
+
+  sizes = step_sizes[fi->n_steps - 1];
+  out = dang_malloc (DANG_TENSOR_SIZEOF (fi->rank));
+  out->ref_count = 1;
+  total_elements = 1;
+  for (i = 0; i < fi->rank; i++)
+    {
+      out->sizes[i] = sizes[i];
+      total_elements *= sizes[i];
+    }
+  out->data = dang_malloc (total_elements * fi->elt_size);
+  buffers = dang_malloc ((fi->n_steps - 1) * chunk_bytes);
+
+  for (at = 0; at < total_elements; at += FUSED_CHUNK_SIZE)
+    {
+      unsigned n = DANG_MIN (FUSED_CHUNK_SIZE, total_elements - at);
+      for (s = 0; s < fi->n_steps; s++)
+        {
+          const DangTensorFusedStep *step = fi->steps + s;
+          void *dst = s + 1 == fi->n_steps
+                    ? (char *) out->data + at * fi->elt_size
+                    : buffers + s * chunk_bytes;
+          switch (step->op)
+            {
+            case DANG_TENSOR_OP_ADD:
+              kernels->add[kt] (OPERAND_DATA (step->a), OPERAND_DATA (step->b), dst, n);
+              break;
+            case DANG_TENSOR_OP_SUBTRACT:
+              kernels->subtract[kt] (OPERAND_DATA (step->a), OPERAND_DATA (step->b), dst, n);
+              break;
+            default:
+              kernels->scalar_multiply[kt] (OPERAND_DATA (step->a), args[step->b], dst, n);
+              break;
+            }
+        }
+    }
+#undef OPERAND_SIZES
+#undef OPERAND_DATA
+
+  dang_free (buffers);
+  *(DangTensor **)rv_out = out;
+  return TRUE;
+}
+
+DangFunction *
+dang_tensor_fused_function_new (DangValueType             *tensor_type,
+                                unsigned                   n_params,
+                                DangValueType            **param_types,
+                                unsigned                   n_steps,
+                                const DangTensorFusedStep *steps)
+{
+  DangValueTypeTensor *ttype = (DangValueTypeTensor *) tensor_type;
+  DangValueType *elt_type = ttype->element_type;
+  DangFunctionParam *params = dang_newa (DangFunctionParam, n_params);
+  DangTensorKernelType kernel_type;
+  FusedExprInfo *fi;
+  DangSignature *sig;
+  DangFunction *rv;
+  unsigned i;
+
+  dang_assert (n_steps > 0);
+  if (elt_type == dang_value_type_int32 ())
+    kernel_type = DANG_TENSOR_KERNEL_INT32;
+  else if (elt_type == dang_value_type_float ())
+    kernel_type = DANG_TENSOR_KERNEL_FLOAT;
+  else if (elt_type == dang_value_type_double ())
+    kernel_type = DANG_TENSOR_KERNEL_DOUBLE;
+  else
+    return NULL;
+
+  /* one allocation, freed by dang_free() */
+  fi = dang_malloc (sizeof (FusedExprInfo)
+                    + sizeof (DangTensorFusedStep) * n_steps
+                    + sizeof (dang_boolean) * n_params);
+  fi->kernel_type = kernel_type;
+  fi->elt_size = elt_type->sizeof_instance;
+  fi->rank = ttype->rank;
+  fi->n_params = n_params;
+  fi->n_steps = n_steps;
+  fi->steps = (DangTensorFusedStep *) (fi + 1);
+  memcpy (fi->steps, steps, sizeof (DangTensorFusedStep) * n_steps);
+  fi->param_is_tensor = (dang_boolean *) (fi->steps + n_steps);
+  for (i = 0; i < n_params; i++)
+    {
+      params[i].dir = DANG_FUNCTION_PARAM_IN;
+      params[i].name = NULL;
+      params[i].type = param_types[i];
+      fi->param_is_tensor[i] = param_types[i] == tensor_type;
+    }
+
+  sig = dang_signature_new (tensor_type, n_params, params);
+  rv = dang_function_new_simple_c (sig, do_fused_expr, fi, dang_free);
+  rv->simple_c.is_pure = TRUE;
   dang_signature_unref (sig);
   return rv;
 }
@@ -1642,6 +1800,7 @@ try_sig__tensor__statistic  (DangMatchQuery *query,
         sfi->type_info = stat->type_infos + i;
         sfi->rank = ttype->rank;
         rv = dang_function_new_simple_c (sig, do_statistic, sfi, dang_free);
+        rv->simple_c.is_pure = TRUE;
         dang_signature_unref (sig);
         return rv;
       }
@@ -1686,17 +1845,29 @@ static void average__##type (void *out, const void *in, unsigned N) \
   *o /= N;                                                         \
 }
 
+#define DEFINE_KERNEL_STATISTIC(type, name, TYPE)                    \
+static void name##__##type (void *out, const void *in, unsigned N)   \
+{                                                                    \
+  dang_tensor_kernels->name[DANG_TENSOR_KERNEL_##TYPE] (out, in, N); \
+}
+
 #define DEFINE_ALL_STATISTICS(type, ctype) \
   DEFINE_MIN(type, ctype) \
   DEFINE_MAX(type, ctype) \
   DEFINE_SUM(type, ctype) \
   DEFINE_PRODUCT(type, ctype) \
   DEFINE_AVERAGE(type, ctype)
+#define DEFINE_ALL_KERNEL_STATISTICS(type, ctype, TYPE) \
+  DEFINE_KERNEL_STATISTIC(type, min, TYPE) \
+  DEFINE_KERNEL_STATISTIC(type, max, TYPE) \
+  DEFINE_KERNEL_STATISTIC(type, sum, TYPE) \
+  DEFINE_PRODUCT(type, ctype) \
+  DEFINE_AVERAGE(type, ctype)
 
-DEFINE_ALL_STATISTICS(int32, int32_t)
+DEFINE_ALL_KERNEL_STATISTICS(int32, int32_t, INT32)
 DEFINE_ALL_STATISTICS(uint32, uint32_t)
-DEFINE_ALL_STATISTICS(float, float)
-DEFINE_ALL_STATISTICS(double, double)
+DEFINE_ALL_KERNEL_STATISTICS(float, float, FLOAT)
+DEFINE_ALL_KERNEL_STATISTICS(double, double, DOUBLE)
   
 /* transpose() */
 
@@ -1870,6 +2041,7 @@ try_sig__matrix_transpose  (DangMatchQuery *query,
   param.type = type;
   sig = dang_signature_new (type, 1, &param);
   rv = dang_function_new_simple_c (sig, func, func_data, NULL);
+  rv->simple_c.is_pure = TRUE;
   dang_signature_unref (sig);
   return rv;
 }
@@ -1996,6 +2168,7 @@ try_sig__diag  (DangMatchQuery *query,
   param.type = type;
   sig = dang_signature_new (rv_type, 1, &param);
   rv = dang_function_new_simple_c (sig, func, elt_type, NULL);
+  rv->simple_c.is_pure = TRUE;
   dang_signature_unref (sig);
   return rv;
 }
@@ -2263,6 +2436,7 @@ success:
   sig = dang_signature_new (dang_value_type_tensor (elt_type, out_rank),
                             2, params);
   rv = dang_function_new_simple_c (sig, func, concat_info, dang_free);
+  rv->simple_c.is_pure = TRUE;
   dang_signature_unref (sig);
   return rv;
 }
@@ -2721,6 +2895,7 @@ try_sig__matrix_rows_or_cols  (DangMatchQuery *query,
   rv = dang_function_new_simple_c (sig,
                                    (DangSimpleCFunc) data,
                                    elt_type, NULL);
+  rv->simple_c.is_pure = TRUE;
   dang_signature_unref (sig);
   return rv;
 }
@@ -2824,6 +2999,7 @@ try_sig__reshape  (DangMatchQuery *query,
   reshape_info->output_rank = query->n_elements - 1;
   reshape_info->element_type = ttype->element_type;
   rv = dang_function_new_simple_c (sig, do_reshape, reshape_info, dang_free);
+  rv->simple_c.is_pure = TRUE;
   dang_signature_unref (sig);
   return rv;
 }
@@ -2862,14 +3038,12 @@ add_variadic_c_family_data (DangNamespace *ns,
 #define add_variadic_c_family(ns, long_name, name, func) \
   add_variadic_c_family_data(ns, long_name, name, func, NULL)
 
-#define DEFINE_MATRIX_MULTIPLY(type, ctype)                     \
+#define DEFINE_MATRIX_MULTIPLY(type, ctype, TYPE)               \
 static DANG_SIMPLE_C_FUNC_DECLARE(multiply_matrices__##type)    \
 {                                                               \
   DangTensor *a = *(DangTensor **) args[0];                     \
   DangTensor *b = *(DangTensor **) args[1];                     \
   DangTensor *rv;                                               \
-  unsigned na, nb, nc, i, j, k;                                 \
-  ctype *out;                                                   \
   DANG_UNUSED (func_data);                                      \
   if (a == NULL)                                                \
     a = dang_tensor_empty ();                                   \
@@ -2879,26 +3053,14 @@ static DANG_SIMPLE_C_FUNC_DECLARE(multiply_matrices__##type)    \
     return FALSE;                                               \
                                                                 \
   rv = dang_malloc (sizeof (DangMatrix));                       \
-  na = rv->sizes[0] = a->sizes[0];                              \
-  nb = a->sizes[1];                                             \
-  nc = rv->sizes[1] = b->sizes[1];                              \
+  rv->sizes[0] = a->sizes[0];                                   \
+  rv->sizes[1] = b->sizes[1];                                   \
   rv->ref_count = 1;                                            \
-  out = rv->data = dang_new (ctype, rv->sizes[0] * rv->sizes[1]);\
-                                                                \
-  for (i = 0; i < na; i++)                                      \
-    for (j = 0; j < nc; j++)                                    \
-      {                                                         \
-        ctype elt = 0;                                          \
-        const ctype *in_a = (ctype*)a->data + i * nb;           \
-        const ctype *in_b = (ctype*)b->data + j;                \
-        for (k = 0; k < nb; k++)                                \
-          {                                                     \
-            elt += *in_a * *in_b;                               \
-            in_a++;                                             \
-            in_b += nc;                                         \
-          }                                                     \
-        *out++ = elt;                                           \
-      }                                                         \
+  rv->data = dang_new (ctype, rv->sizes[0] * rv->sizes[1]);     \
+  dang_tensor_matrix_multiply (DANG_TENSOR_KERNEL_##TYPE,       \
+                               a->data, b->data, rv->data,      \
+                               a->sizes[0], a->sizes[1],        \
+                               b->sizes[1]);                    \
   *(DangTensor**)rv_out = rv;                                   \
   return TRUE;                                                  \
 }
@@ -2929,9 +3091,9 @@ static DANG_SIMPLE_C_FUNC_DECLARE(dot_product__##type)          \
   return TRUE;                                                  \
 }
 
-DEFINE_MATRIX_MULTIPLY(float, float);
-DEFINE_MATRIX_MULTIPLY(double, double);
-DEFINE_MATRIX_MULTIPLY(int32, int32_t);
+DEFINE_MATRIX_MULTIPLY(float, float, FLOAT);
+DEFINE_MATRIX_MULTIPLY(double, double, DOUBLE);
+DEFINE_MATRIX_MULTIPLY(int32, int32_t, INT32);
 DEFINE_DOT_PRODUCT(float, float);
 DEFINE_DOT_PRODUCT(double, double);
 DEFINE_DOT_PRODUCT(int32, int32_t);
@@ -2952,6 +3114,8 @@ _dang_tensor_init (DangNamespace *the_ns)
     TRUE
   };
 
+  dang_tensor_kernels = dang_tensor_kernels_get (dang_tensor_kernel_set_best ());
+
   family = dang_function_family_new_variadic_c ("tensor_to_string",
                                                 variadic_c__generic_substrings, 
                                                 &vsd_to_string,
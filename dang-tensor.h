@@ -50,6 +50,46 @@ void dang_tensor_oob_error (DangError **error,
                             unsigned    index);
 void _dang_tensor_init (DangNamespace *the_ns);
 
+/* --- fused element-wise expressions ---
+ *
+ * A chain like 'a + b * 2.0 - c' can be run as one function
+ * that makes a single pass over its operands and allocates
+ * only the result, instead of one tensor per operator.
+ * See dang_compile_fused_tensor_expr().
+ */
+typedef enum
+{
+  DANG_TENSOR_OP_ADD,           /* tensor + tensor */
+  DANG_TENSOR_OP_SUBTRACT,      /* tensor - tensor */
+  DANG_TENSOR_OP_SCALE,         /* tensor * scalar */
+  DANG_TENSOR_OP_SCALE_LEFT     /* scalar * tensor */
+} DangTensorOp;
+
+/* Whether 'function' is one of the element-wise tensor operators
+   (as returned by the 'operator_add', 'operator_subtract'
+   and 'operator_multiply' families), and which. */
+dang_boolean dang_tensor_function_get_op (DangFunction *function,
+                                          DangTensorOp *op_out);
+
+/* Operands 0..n_params-1 are the parameters of the fused function;
+   operand n_params+i is the result of step i.
+   For SCALE, 'a' is the tensor and 'b' is the scalar parameter;
+   SCALE_LEFT is not used. */
+typedef struct _DangTensorFusedStep DangTensorFusedStep;
+struct _DangTensorFusedStep
+{
+  DangTensorOp op;
+  unsigned a, b;
+};
+
+/* A function of the parameters returning the result
+   of the last step, or NULL if the element-type has no kernels. */
+DangFunction *dang_tensor_fused_function_new (DangValueType             *tensor_type,
+                                              unsigned                   n_params,
+                                              DangValueType            **param_types,
+                                              unsigned                   n_steps,
+                                              const DangTensorFusedStep *steps);
+
 typedef struct _DangMatrix DangMatrix;
 struct _DangMatrix
 {
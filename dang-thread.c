@@ -1,7 +1,14 @@
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 #include "dang.h"
 
+/* values of thread->wakeup_state */
+#define WAKEUP_NONE             0
+#define WAKEUP_PENDING          1       /* resume as soon as it yields */
+#define WAKEUP_PARKED           2       /* yielded; waiting for a wakeup */
+#define WAKEUP_CANCELLED        3       /* ignore wakeups */
+
 const char *dang_thread_status_name (DangThreadStatus status)
 {
   switch (status)
@@ -16,6 +23,33 @@ const char *dang_thread_status_name (DangThreadStatus status)
   return "*bad-status*";
 }
 
+DangThreadDispatch dang_thread_dispatch = DANG_THREAD_DISPATCH_DEFAULT;
+uint64_t dang_thread_n_steps_run = 0;
+
+static const char *dispatch_names[] = { "loop", "threaded", "counting", "profiling" };
+
+const char *
+dang_thread_dispatch_name (DangThreadDispatch dispatch)
+{
+  if ((unsigned) dispatch < DANG_N_ELEMENTS (dispatch_names))
+    return dispatch_names[dispatch];
+  return "*bad-dispatch*";
+}
+
+dang_boolean
+dang_thread_dispatch_parse (const char *name,
+                            DangThreadDispatch *dispatch_out)
+{
+  unsigned i;
+  for (i = 0; i < DANG_N_ELEMENTS (dispatch_names); i++)
+    if (strcmp (name, dispatch_names[i]) == 0)
+      {
+        *dispatch_out = i;
+        return TRUE;
+      }
+  return FALSE;
+}
+
 void dang_thread_pop_frame (DangThread *thread)
 {
   DangThreadStackFrame *stack_frame = thread->stack_frame;
@@ -27,13 +61,80 @@ void dang_thread_pop_frame (DangThread *thread)
     }
 }
 
+/* --- frame allocation --- */
+#define FRAME_ALIGN             16
+#define STACK_SEGMENT_SIZE      (32*1024)
+#define STACK_SEGMENT_HEADER    DANG_ALIGN (sizeof (DangThreadStackSegment), FRAME_ALIGN)
+#define STACK_SEGMENT_DATA(seg) ((char*)(seg) + STACK_SEGMENT_HEADER)
+
+static DangThreadStackSegment *
+push_stack_segment (DangThread *thread,
+                    unsigned    min_size)
+{
+  DangThreadStackSegment *seg = thread->spare_segment;
+  if (seg != NULL && (unsigned)(seg->end - STACK_SEGMENT_DATA (seg)) >= min_size)
+    thread->spare_segment = NULL;
+  else
+    {
+      unsigned alloc = DANG_MAX (STACK_SEGMENT_SIZE, STACK_SEGMENT_HEADER + min_size);
+      seg = dang_malloc (alloc);
+      seg->end = (char*)seg + alloc;
+    }
+  seg->at = STACK_SEGMENT_DATA (seg);
+  seg->prev = thread->stack_segment;
+  thread->stack_segment = seg;
+  return seg;
+}
+
+static void
+pop_stack_segment (DangThread *thread)
+{
+  DangThreadStackSegment *kill = thread->stack_segment;
+  thread->stack_segment = kill->prev;
+
+  /* keep one segment around, so that a call sequence
+     at a segment boundary does not call malloc repeatedly */
+  if (thread->spare_segment != NULL)
+    dang_free (thread->spare_segment);
+  thread->spare_segment = kill;
+}
+
+void *
+dang_thread_alloc_frame (DangThread *thread,
+                         unsigned    frame_size)
+{
+  DangThreadStackSegment *seg = thread->stack_segment;
+  unsigned size = DANG_ALIGN (frame_size, FRAME_ALIGN);
+  void *rv;
+  if (DANG_UNLIKELY (seg == NULL || (unsigned)(seg->end - seg->at) < size))
+    seg = push_stack_segment (thread, size);
+  rv = seg->at;
+  seg->at += size;
+  return rv;
+}
+
+void
+dang_thread_free_frame (DangThread *thread,
+                        void       *frame)
+{
+  DangThreadStackSegment *seg = thread->stack_segment;
+  while (!(STACK_SEGMENT_DATA (seg) <= (char*)frame && (char*)frame < seg->end))
+    {
+      /* everything in this segment was allocated after 'frame' */
+      pop_stack_segment (thread);
+      seg = thread->stack_segment;
+    }
+  dang_assert ((char*)frame < seg->at);
+  seg->at = frame;
+}
+
 static DangThreadStackFrame *
 dang_thread_push_frame (DangThread   *thread,
                         DangFunction *function,
                         void        **arguments)
 {
   DangSignature *sig = function->base.sig;
-  DangThreadStackFrame *frame = dang_malloc (function->base.frame_size);
+  DangThreadStackFrame *frame = dang_thread_alloc_frame (thread, function->base.frame_size);
   unsigned offset = sizeof (DangThreadStackFrame);
   unsigned i;
   frame->function = function;
@@ -71,30 +172,6 @@ dang_thread_push_frame (DangThread   *thread,
   return frame;
 }
 
-void
-dang_thread_pop_catch_guard (DangThread *thread)
-{
-  DangThreadCatchGuard *kill = thread->catch_guards;
-  thread->catch_guards = thread->catch_guards->parent;
-  dang_free (kill);
-}
-
-void
-dang_thread_push_catch_guard (DangThread *thread,
-                              DangThreadStackFrame *stack_frame,
-                              DangCatchBlock *catch_block)
-{
-  DangThreadCatchGuard *catch;
-  DangFunctionStackInfo *stack_info = thread->stack_frame->function->base.stack_info;
-  dang_assert (stack_info->catch_blocks <= catch_block
-            && catch_block < stack_info->catch_blocks + stack_info->n_catch_blocks);
-  catch = dang_new (DangThreadCatchGuard, 1);
-  catch->parent = thread->catch_guards;
-  catch->stack_frame = stack_frame;
-  catch->catch_block = catch_block;
-  thread->catch_guards = catch;
-}
-
 DangThread   *
 dang_thread_new (DangFunction *function,
                  unsigned      n_arguments,
@@ -105,9 +182,14 @@ dang_thread_new (DangFunction *function,
   thread->status = DANG_THREAD_STATUS_NOT_STARTED;
   thread->stack_frame = NULL;
   thread->ref_count = 1;
-  thread->catch_guards = NULL;
+  thread->stack_segment = NULL;
+  thread->spare_segment = NULL;
+  thread->profile = NULL;
+  thread->done_func = NULL;
+  thread->done_func_data = NULL;
+  thread->wakeup_state = WAKEUP_NONE;
   thread->rv_frame = dang_thread_push_frame (thread, function, arguments);
-  thread->rv_function = function;
+  thread->rv_function = dang_function_ref (function);
   dang_thread_ref (thread);   /* unref'd when the last frame is popped */
   return thread;
 }
@@ -118,31 +200,22 @@ dang_thread_unwind_one_frame (DangThread *thread)
 {
   DangThreadStackFrame *kill;
   DangFunctionStackInfo *stack_info;
+  DangFunctionLiveRange *live;
   unsigned i;
 
   dang_assert (thread->stack_frame != NULL);
 
   kill = thread->stack_frame;
 
-  /* Unwind catch blocks added by this stack-frame */
-  while (thread->catch_guards != NULL
-      && thread->catch_guards->stack_frame == kill)
-    dang_thread_pop_catch_guard (thread);
-
   /* Destruct variables that have destructors */
   stack_info = kill->function->base.stack_info;
-  for (i = 0; i < stack_info->n_vars; i++)
-    {
-      if (stack_info->vars[i].start < kill->ip
-       && kill->ip < stack_info->vars[i].end
-       && stack_info->vars[i].type->destruct)
-        {
-          unsigned offset = stack_info->vars[i].offset;
-          DangValueType *type = stack_info->vars[i].type;
-          void *value = ((char*)kill) + offset;
-          type->destruct (type, value);
-        }
-    }
+  live = dang_function_stack_info_find_live_range (stack_info, kill->ip);
+  if (live != NULL)
+    for (i = 0; i < live->n_vars; i++)
+      {
+        DangFunctionStackVarInfo *v = stack_info->vars + live->vars[i];
+        v->type->destruct (v->type, (char*)kill + v->offset);
+      }
 
   /* XXX: someday, permit input parameters to be memcpyd */
   for (i = 0; i < stack_info->n_params; i++)
@@ -158,18 +231,25 @@ dang_thread_unwind_one_frame (DangThread *thread)
 
 
   thread->stack_frame = kill->caller;
-  dang_free (kill);
+  dang_thread_free_frame (thread, kill);
 
   return (thread->stack_frame == NULL);
 }
 
-/* dynamically go to the catch block destination.
- * (may initialize, destruct vars,
- * create or destroy catch_guards)
- */
+static inline dang_boolean
+range_has_var (DangFunctionLiveRange *range, unsigned var_index)
+{
+  unsigned i;
+  if (range == NULL)
+    return FALSE;
+  for (i = 0; i < range->n_vars; i++)
+    if (range->vars[i] == var_index)
+      return TRUE;
+  return FALSE;
+}
+
 /* implement the goto to the catch block.
- * (may initialize, destruct vars,
- * create or destroy catch_guards)
+ * (may initialize and destruct vars)
  */
 static void
 dang_thread_force_goto (DangThread *thread,
@@ -179,94 +259,124 @@ dang_thread_force_goto (DangThread *thread,
   DangFunction *function = frame->function;
   DangFunctionStackInfo *stack_info = function->base.stack_info;
   DangStep *old_ip = thread->stack_frame->ip;
-  DangCatchBlock **new_catch_blocks;
-  unsigned n_new_catch_blocks = 0;
-  DangCatchBlock **old_catch_blocks;
-  unsigned n_old_catch_blocks = 0;
-  unsigned max_common, n_common;
-  DangThreadCatchGuard *catch;
+  DangFunctionLiveRange *was_live, *will_be_live;
   unsigned i;
   dang_assert (stack_info != NULL);
   dang_assert (stack_info->first_step <= new_ip
                && new_ip <= stack_info->last_step);
 
-  /* Compute the new catch blocks that should be active at the target label. */
-  new_catch_blocks = dang_new (DangCatchBlock *, stack_info->n_catch_blocks);
-  for (i = 0; i < stack_info->n_catch_blocks; i++)
+  /* Destruct the variables that die, and zero the ones that
+     come to life (the catch-block will destruct them).
+     Variables without destructors need neither. */
+  was_live = dang_function_stack_info_find_live_range (stack_info, old_ip);
+  will_be_live = dang_function_stack_info_find_live_range (stack_info, new_ip);
+  if (was_live != will_be_live)
     {
-      DangCatchBlock *block = stack_info->catch_blocks + i;
-      if (block->start < new_ip && new_ip <= block->end)
-        new_catch_blocks[n_new_catch_blocks++] = block;
-      else if (new_ip > block->end)
-        break;                  /* since the list is sorted, we can bail out */
+      if (was_live != NULL)
+        for (i = 0; i < was_live->n_vars; i++)
+          if (!range_has_var (will_be_live, was_live->vars[i]))
+            {
+              DangFunctionStackVarInfo *v = stack_info->vars + was_live->vars[i];
+              v->type->destruct (v->type, (char*)frame + v->offset);
+            }
+      if (will_be_live != NULL)
+        for (i = 0; i < will_be_live->n_vars; i++)
+          if (!range_has_var (was_live, will_be_live->vars[i]))
+            {
+              DangFunctionStackVarInfo *v = stack_info->vars + will_be_live->vars[i];
+              memset ((char*)frame + v->offset, 0, v->type->sizeof_instance);
+            }
     }
 
-  /* Compute the old catch blocks that should be active */
-  for (catch = thread->catch_guards;
-       catch != NULL && catch->stack_frame == thread->stack_frame;
-       catch = catch->parent)
-    n_old_catch_blocks++;
-  catch = thread->catch_guards;
-  old_catch_blocks = dang_new (DangCatchBlock *, n_old_catch_blocks);
-  for (i = 0; i < n_old_catch_blocks; i++)
+  /* finally, jump to the new address */
+  frame->ip = new_ip;
+}
+
+static void
+run_steps_loop (DangThread *thread)
+{
+  while (DANG_LIKELY (thread->status == DANG_THREAD_STATUS_RUNNING))
     {
-      old_catch_blocks[n_old_catch_blocks - 1 - i] = catch->catch_block;
-      catch = catch->parent;
+      DangStep *step = thread->stack_frame->ip;
+      step->func (step + 1, thread->stack_frame, thread);
     }
+}
 
-  /* Find how many catch blocks are the same for both the source and target ip */
-  max_common = DANG_MIN (n_new_catch_blocks, n_old_catch_blocks);
-  for (n_common = 0; n_common < max_common; n_common++)
-    if (new_catch_blocks[n_common] != old_catch_blocks[n_common])
-      break;
-
-  /* Pop old catch blocks */
-  for (i = 0; i < n_old_catch_blocks - n_common; i++)
-    dang_thread_pop_catch_guard (thread);
-
-  /* Push new catch blocks */
-  for (i = n_common; i < n_new_catch_blocks; i++)
-    dang_thread_push_catch_guard (thread, frame, new_catch_blocks[i]);
-
-  dang_free (old_catch_blocks);
-  dang_free (new_catch_blocks);
-
-
-  /* Compute dead and live variables */
-  for (i = 0; i < stack_info->n_vars; i++)
+/* Local steps cannot change thread->stack_frame or thread->status,
+   so we keep the frame in hand and run them back-to-back. */
+static void
+run_steps_threaded (DangThread *thread)
+{
+  while (DANG_LIKELY (thread->status == DANG_THREAD_STATUS_RUNNING))
     {
-      DangFunctionStackVarInfo *v = stack_info->vars + i;
-      dang_boolean was_live = (v->start < old_ip && old_ip <= v->end);
-      dang_boolean will_be_live = (v->start < new_ip && new_ip <= v->end);
-      if (was_live && !will_be_live)
+      DangThreadStackFrame *frame = thread->stack_frame;
+      DangStep *step;
+      do
         {
-          if (v->type->destruct != NULL)
-            {
-              v->type->destruct (v->type, (char*)frame + v->offset);
-            }
-        }
-      else if (!was_live && will_be_live)
-        {
-          memset ((char*)frame + v->offset, 0, v->type->sizeof_instance);
+          step = frame->ip;
+          step->func (step + 1, frame, thread);
         }
+      while (step->flags & DANG_STEP_FLAG_LOCAL);
     }
-
-  /* finally, jump to the new address */
-  frame->ip = new_ip;
 }
 
 static void
-resume_running (DangThread *thread)
+run_steps_counting (DangThread *thread)
 {
-resume_running:
+  uint64_t n_steps = 0;
+  while (DANG_LIKELY (thread->status == DANG_THREAD_STATUS_RUNNING))
+    {
+      DangStep *step = thread->stack_frame->ip;
+      n_steps++;
+      step->func (step + 1, thread->stack_frame, thread);
+    }
+  __atomic_add_fetch (&dang_thread_n_steps_run, n_steps, __ATOMIC_RELAXED);
+}
 
+static void
+run_steps_profiling (DangThread *thread)
+{
+  dang_profile_thread_start (thread);
   while (DANG_LIKELY (thread->status == DANG_THREAD_STATUS_RUNNING))
     {
       DangStep *step = thread->stack_frame->ip;
-#ifdef DANG_DEBUG
-#endif
+      dang_profile_step (thread);
       step->func (step + 1, thread->stack_frame, thread);
     }
+  dang_profile_thread_stop (thread);
+}
+
+static void
+thread_finished (DangThread *thread)
+{
+  DangThreadDoneFunc func = thread->done_func;
+  if (func != NULL)
+    {
+      thread->done_func = NULL;
+      func (thread, thread->done_func_data);
+    }
+}
+
+static void
+resume_running (DangThread *thread)
+{
+resume_running:
+
+  switch (dang_thread_dispatch)
+    {
+    case DANG_THREAD_DISPATCH_LOOP:
+      run_steps_loop (thread);
+      break;
+    case DANG_THREAD_DISPATCH_THREADED:
+      run_steps_threaded (thread);
+      break;
+    case DANG_THREAD_DISPATCH_COUNTING:
+      run_steps_counting (thread);
+      break;
+    case DANG_THREAD_DISPATCH_PROFILING:
+      run_steps_profiling (thread);
+      break;
+    }
   switch (thread->status)
     {
     case DANG_THREAD_STATUS_NOT_STARTED:
@@ -275,21 +385,23 @@ resume_running:
       break;
     case DANG_THREAD_STATUS_THREW:
       {
-        /* see if we can find a catch() block that matches the type thrown */
+        /* see if we can find a catch() block that matches the type thrown:
+           look up each frame's ip in its function's catch blocks.
+           The top frame's ip is the step that threw;
+           the callers' are the steps after their calls. */
         DangThreadStackFrame *unwind_dest;
-        DangCatchBlockClause *clause;
-        while (thread->catch_guards)
+        DangCatchBlockClause *clause = NULL;
+        for (unwind_dest = thread->stack_frame;
+             unwind_dest != NULL;
+             unwind_dest = unwind_dest->caller)
           {
-            DangThreadCatchGuard *kill;
-            if (dang_catch_block_is_applicable (thread->catch_guards->catch_block,
-                                                thread->info.threw.type,
-                                                &clause))
+            clause = dang_function_find_catch_clause (unwind_dest->function,
+                                                      unwind_dest->ip,
+                                                      unwind_dest != thread->stack_frame,
+                                                      thread->info.threw.type);
+            if (clause != NULL)
               break;
-            kill = thread->catch_guards;
-            thread->catch_guards = thread->catch_guards->parent;
-            dang_free (kill);
           }
-        unwind_dest = thread->catch_guards ? thread->catch_guards->stack_frame : NULL;
 
         /* unwind the stack to that point. */
         dang_assert (thread->stack_frame != NULL);
@@ -297,14 +409,14 @@ resume_running:
           dang_thread_unwind_one_frame (thread);
 
         /* if uncaught, return. */
-        if (thread->catch_guards == NULL)
+        if (unwind_dest == NULL)
           {
+            thread_finished (thread);
             dang_thread_unref (thread);
             return;
           }
 
-        /* jump, fixing up variables and exception blocks;
-           this will free the catch block we are currently in */
+        /* jump, fixing up variables */
         dang_thread_force_goto (thread, clause->catch_target);
 
         if (clause->catch_var_offset != 0)
@@ -326,7 +438,23 @@ resume_running:
         goto resume_running;
       }
     case DANG_THREAD_STATUS_YIELDED:
+      {
+        /* Park, unless a wakeup arrived while we were stopping. */
+        unsigned state = WAKEUP_NONE;
+        if (!__atomic_compare_exchange_n (&thread->wakeup_state, &state,
+                                          WAKEUP_PARKED, FALSE,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+          {
+            dang_assert (state == WAKEUP_PENDING);
+            __atomic_store_n (&thread->wakeup_state, WAKEUP_NONE, __ATOMIC_RELEASE);
+            thread->status = DANG_THREAD_STATUS_RUNNING;
+            goto resume_running;
+          }
+      }
+      break;
     case DANG_THREAD_STATUS_DONE:
+      thread_finished (thread);
+      break;
     case DANG_THREAD_STATUS_CANCELLED:
       break;
     }
@@ -355,10 +483,117 @@ void
 dang_thread_resume (DangThread *thread)
 {
   dang_assert (thread->status == DANG_THREAD_STATUS_YIELDED);
+  __atomic_store_n (&thread->wakeup_state, WAKEUP_NONE, __ATOMIC_RELEASE);
   thread->status = DANG_THREAD_STATUS_RUNNING;
   resume_running (thread);
 }
 
+void
+dang_thread_set_wakeup_func (DangThread        *thread,
+                             DangThreadDoneFunc func,
+                             void              *func_data)
+{
+  dang_assert (thread->done_func == NULL);
+  thread->done_func = func;
+  thread->done_func_data = func_data;
+}
+
+static void
+wakeup_thread_when_done (DangThread *thread,
+                         void       *data)
+{
+  DangThread *to_resume = data;
+  DANG_UNUSED (thread);
+  dang_thread_wakeup (to_resume);
+  dang_thread_unref (to_resume);
+}
+
+void
+dang_thread_set_wakeup_thread (DangThread *yielded_thread,
+                               DangThread *to_resume)
+{
+  dang_thread_set_wakeup_func (yielded_thread, wakeup_thread_when_done,
+                               dang_thread_ref (to_resume));
+}
+
+/* Function: dang_thread_wakeup
+   Resume a thread that has yielded.
+
+   The waker may run on another worker while the thread is
+   still stopping, so the two meet at thread->wakeup_state:
+   whichever comes second resumes the thread.
+
+   Parameters:
+     thread - the thread to resume.
+ */
+void
+dang_thread_wakeup (DangThread *thread)
+{
+  for (;;)
+    {
+      unsigned state = __atomic_load_n (&thread->wakeup_state, __ATOMIC_ACQUIRE);
+      if (state == WAKEUP_PENDING || state == WAKEUP_CANCELLED)
+        return;
+      if (state == WAKEUP_NONE)
+        {
+          if (__atomic_compare_exchange_n (&thread->wakeup_state, &state,
+                                           WAKEUP_PENDING, FALSE,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return;
+        }
+      else if (__atomic_compare_exchange_n (&thread->wakeup_state, &state,
+                                            WAKEUP_NONE, FALSE,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+          DangScheduler *scheduler = dang_scheduler_get_current ();
+          if (scheduler == NULL)
+            scheduler = dang_scheduler_get_default ();
+          dang_scheduler_push (scheduler, thread);
+          return;
+        }
+    }
+}
+
+typedef struct _RunWaiter RunWaiter;
+struct _RunWaiter
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  dang_boolean done;
+};
+
+static void
+run_waiter_done (DangThread *thread,
+                 void       *data)
+{
+  RunWaiter *waiter = data;
+  DANG_UNUSED (thread);
+  pthread_mutex_lock (&waiter->lock);
+  waiter->done = TRUE;
+  pthread_cond_signal (&waiter->cond);
+  pthread_mutex_unlock (&waiter->lock);
+}
+
+void
+dang_thread_run_and_wait (DangThread *thread)
+{
+  RunWaiter waiter;
+  dang_assert (thread->status == DANG_THREAD_STATUS_NOT_STARTED);
+  pthread_mutex_init (&waiter.lock, NULL);
+  pthread_cond_init (&waiter.cond, NULL);
+  waiter.done = FALSE;
+  dang_thread_set_wakeup_func (thread, run_waiter_done, &waiter);
+
+  dang_thread_run (thread);
+
+  pthread_mutex_lock (&waiter.lock);
+  while (!waiter.done)
+    pthread_cond_wait (&waiter.cond, &waiter.lock);
+  pthread_mutex_unlock (&waiter.lock);
+  pthread_mutex_destroy (&waiter.lock);
+  pthread_cond_destroy (&waiter.cond);
+}
+
 void
 dang_thread_cancel(DangThread   *thread)
 {
@@ -369,8 +604,12 @@ dang_thread_cancel(DangThread   *thread)
 
   if (thread->status == DANG_THREAD_STATUS_YIELDED)
     {
+      /* a wakeup may still be on its way: make it a no-op */
+      __atomic_store_n (&thread->wakeup_state, WAKEUP_CANCELLED, __ATOMIC_RELEASE);
+
       /* cancel yield callback */
-      thread->info.yield.yield_cancel_func (thread->info.yield.yield_cancel_func_data);
+      if (thread->info.yield.yield_cancel_func != NULL)
+        thread->info.yield.yield_cancel_func (thread->info.yield.yield_cancel_func_data);
     }
   if (thread->stack_frame != NULL)
     {
@@ -379,6 +618,7 @@ dang_thread_cancel(DangThread   *thread)
       must_unref = TRUE;
     }
   thread->status = DANG_THREAD_STATUS_CANCELLED;
+  thread_finished (thread);
   if (must_unref)
     dang_thread_unref (thread);
 }
@@ -445,14 +685,14 @@ dang_thread_get_backtrace (DangThread *thread)
 DangThread *
 dang_thread_ref (DangThread *thread)
 {
-  ++(thread->ref_count);
+  DANG_REF_COUNT_INC (thread->ref_count);
   return thread;
 }
 
 void
 dang_thread_unref (DangThread *thread)
 {
-  if (--(thread->ref_count) == 0)
+  if (DANG_REF_COUNT_DEC (thread->ref_count) == 0)
     {
       dang_assert (thread->stack_frame == NULL);
       if (thread->rv_frame != NULL
@@ -477,7 +717,7 @@ dang_thread_unref (DangThread *thread)
                 type->destruct (type, (char*)thread->rv_frame + offset);
               offset += type->sizeof_instance;
             }
-          dang_free (thread->rv_frame);
+          dang_thread_free_frame (thread, thread->rv_frame);
         }
       else if (thread->status == DANG_THREAD_STATUS_THREW)
         {
@@ -489,6 +729,13 @@ dang_thread_unref (DangThread *thread)
               dang_free (thread->info.threw.value);
             }
         }
+      while (thread->stack_segment != NULL)
+        pop_stack_segment (thread);
+      if (thread->spare_segment != NULL)
+        dang_free (thread->spare_segment);
+      if (thread->profile != NULL)
+        dang_profile_thread_free (thread->profile);
+      dang_function_unref (thread->rv_function);
       dang_free (thread);
     }
 }
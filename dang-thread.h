@@ -22,21 +22,40 @@ typedef DangDestroyNotify DangThreadYieldCancelFunc;
 typedef void (*DangThreadDoneFunc) (DangThread *thread,
                                     void *done_func_data);
 
-typedef struct _DangThreadCatchGuard DangThreadCatchGuard;
-struct _DangThreadCatchGuard
+/* Frames are allocated from a per-thread stack of segments,
+   so that they never move (a yielded thread's frames stay valid). */
+typedef struct _DangThreadStackSegment DangThreadStackSegment;
+struct _DangThreadStackSegment
 {
-  DangThreadStackFrame *stack_frame;
-  DangCatchBlock *catch_block;
-  DangThreadCatchGuard *parent;
+  DangThreadStackSegment *prev;
+  char *at;                     /* first free byte */
+  char *end;
+  /* the frames follow */
 };
 
 struct _DangThread
 {
   DangThreadStatus status;
   DangThreadStackFrame *stack_frame;
-  DangThreadCatchGuard *catch_guards;
   unsigned ref_count;
 
+  /* storage for stack frames */
+  DangThreadStackSegment *stack_segment;
+  DangThreadStackSegment *spare_segment;
+
+  /* only used by the profiling dispatcher */
+  DangProfileThread *profile;
+
+  /* Called once, when the thread finishes (returns, throws
+     an uncaught exception or is cancelled);
+     see dang_thread_set_wakeup_func(). */
+  DangThreadDoneFunc done_func;
+  void *done_func_data;
+
+  /* Set atomically, so that a wakeup can arrive
+     before the yielding thread has stopped running:
+     see dang_thread_wakeup(). */
+  unsigned wakeup_state;
 
   /* only should be used if state==DONE */
   DangThreadStackFrame *rv_frame;
@@ -51,12 +70,6 @@ struct _DangThread
          if the thread is destroyed. */
       DangThreadYieldCancelFunc yield_cancel_func;
       void *yield_cancel_func_data;
-
-      /* Function that may be set by the caller of dang_thread_run()
-         to receive notification that the function finally returned or
-         threw an exception. */
-      DangThreadDoneFunc done_func;
-      void *done_func_data;
     } yield;
     struct {
       void *value;
@@ -80,26 +93,65 @@ void          dang_thread_throw(DangThread   *thread,
                                 void          *value);
 void          dang_thread_throw_error(DangThread   *thread,
                                       DangError    *error);
-/* TODO: revise this api to allow the DangThreadCatch to lie in 'stack_frame' */
-void          dang_thread_push_catch_guard (DangThread *thread,
-                                            DangThreadStackFrame *stack_frame,
-                                            DangCatchBlock *catch_block);
-void          dang_thread_pop_catch_guard  (DangThread *thread);
-
 void          dang_thread_resume           (DangThread *thread);
 
-/* when a thread you are running goes into a "yielded" state, you can
-   either of these functions once to tell the system what to do when
-   the function returns. */
+/* Call either of these functions once to tell the system what to do
+   when the thread finishes: for a thread that may yield, do so
+   before running it. */
 void          dang_thread_set_wakeup_func  (DangThread *thread,
                                             DangThreadDoneFunc func,
                                             void       *func_data);
 void          dang_thread_set_wakeup_thread(DangThread *yielded_thread,
                                             DangThread *to_resume);
+
+/* Resume a thread that has yielded, or is about to yield:
+   it is pushed onto the calling worker's scheduler
+   (or the default scheduler).  If the thread has not
+   stopped yet, it just carries on running, so yielding
+   C functions must recheck their condition when resumed. */
+void          dang_thread_wakeup           (DangThread *thread);
+
+/* Run a thread on the calling OS thread; if it yields,
+   block until it has been resumed and finished. */
+void          dang_thread_run_and_wait     (DangThread *thread);
  
 void dang_thread_throw_null_pointer_exception (DangThread *);
 void dang_thread_throw_array_bounds_exception (DangThread *);
 char *dang_thread_get_backtrace (DangThread *);
 
+/* --- Step dispatch --- */
+/* How resume_running() executes steps:
+     LOOP      -- the reference loop: recheck the thread after every step.
+     THREADED  -- run frame-local steps (DANG_STEP_FLAG_LOCAL) back-to-back,
+                  only rechecking the thread after steps that may
+                  throw, yield, call or return.
+     COUNTING  -- like LOOP, but counts steps in dang_thread_n_steps_run.
+     PROFILING -- like LOOP, but reports each step to the profiler
+                  (see dang-profile.h). */
+typedef enum
+{
+  DANG_THREAD_DISPATCH_LOOP,
+  DANG_THREAD_DISPATCH_THREADED,
+  DANG_THREAD_DISPATCH_COUNTING,
+  DANG_THREAD_DISPATCH_PROFILING
+} DangThreadDispatch;
+
+#ifndef DANG_THREAD_DISPATCH_DEFAULT
+#define DANG_THREAD_DISPATCH_DEFAULT DANG_THREAD_DISPATCH_THREADED
+#endif
+
+extern DangThreadDispatch dang_thread_dispatch;
+extern uint64_t dang_thread_n_steps_run;
+const char  *dang_thread_dispatch_name  (DangThreadDispatch dispatch);
+dang_boolean dang_thread_dispatch_parse (const char *name,
+                                         DangThreadDispatch *dispatch_out);
+
 /* useful from various "return" implementations */
 void dang_thread_pop_frame (DangThread *thread);
+
+/* Frames must be freed in the reverse order of allocation;
+   freeing a frame frees everything allocated after it. */
+void *dang_thread_alloc_frame (DangThread *thread,
+                               unsigned    frame_size);
+void  dang_thread_free_frame  (DangThread *thread,
+                               void       *frame);
@@ -152,7 +152,7 @@ dang_token_interpolated_string_take (unsigned n_pieces,
     {
       DangString **val = dang_new (DangString *, 1);
       DangToken *rv2;
-      *val = dang_string_new (pieces[0].info.string);
+      *val = dang_string_new_interned (pieces[0].info.string);
       rv2 = dang_token_literal_take (dang_value_type_string(), val);
       dang_token_unref (rv);
       rv = rv2;
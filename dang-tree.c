@@ -22,40 +22,32 @@
                                                            (char*)node + ttype->value_offset);
 #define IMPLEMENT_TREE_VALUE_FUNCS(suffix)                         \
 static void                                                        \
-destruct_tree_node__##suffix (DangValueTreeTypes *ttype,            \
-                              DangTreeNode      *node)             \
+unref_tree_node__##suffix (DangValueTreeTypes *ttype,               \
+                           DangTreeNode      *node)                \
 {                                                                  \
-  DESTRUCT__##suffix                                               \
-  if (node->left)                                                  \
-    destruct_tree_node__##suffix (ttype, node->left);              \
-  if (node->right)                                                 \
-    destruct_tree_node__##suffix (ttype, node->right);             \
-  node->parent = ttype->recycling_list;                            \
-  ttype->recycling_list = node;                                    \
+  while (node != NULL && DANG_REF_COUNT_DEC (node->ref_count) == 0) \
+    {                                                              \
+      DangTreeNode *right = node->right;                           \
+      DESTRUCT__##suffix                                           \
+      unref_tree_node__##suffix (ttype, node->left);               \
+      dang_free (node);                                            \
+      node = right;                                                \
+    }                                                              \
 }                                                                  \
 static DangTreeNode *                                              \
 copy_tree_node__##suffix (DangValueTreeTypes *ttype,                \
-                          DangTreeNode      *parent,               \
                           DangTreeNode      *node)                 \
 {                                                                  \
-  DangTreeNode *new_node;                                          \
-  if (node == NULL)                                                \
-    return NULL;                                                   \
-  if (ttype->recycling_list)                                       \
-    {                                                              \
-      new_node = ttype->recycling_list;                            \
-      ttype->recycling_list = new_node->parent;                    \
-    }                                                              \
-  else                                                             \
-    new_node = dang_malloc (ttype->node_size);                     \
-                                                                   \
+  DangTreeNode *new_node = dang_malloc (ttype->node_size);         \
   COPY__##suffix                                                   \
-  new_node->left = copy_tree_node__##suffix (ttype, new_node, node->left);   \
-  new_node->right = copy_tree_node__##suffix (ttype, new_node, node->right); \
-  new_node->parent = parent;                                       \
+  new_node->ref_count = 1;                                         \
   new_node->is_red = node->is_red;                                 \
-  new_node->is_defunct = 0;                                        \
-  new_node->visit_count = 0;                                       \
+  new_node->left = node->left;                                     \
+  new_node->right = node->right;                                   \
+  if (node->left)                                                  \
+    DANG_REF_COUNT_INC (node->left->ref_count);                    \
+  if (node->right)                                                 \
+    DANG_REF_COUNT_INC (node->right->ref_count);                   \
   return new_node;                                                 \
 }
 
@@ -64,6 +56,112 @@ IMPLEMENT_TREE_VALUE_FUNCS(k)
 IMPLEMENT_TREE_VALUE_FUNCS(v)
 IMPLEMENT_TREE_VALUE_FUNCS(kv)
 
+/* --- B-tree nodes --- */
+unsigned dang_tree_btree_threshold = 256;
+
+#define BNODE_KEY(tt, node, i)                                        \
+  ((char *) ((node) + 1) + (size_t) (i) * (tt)->key->sizeof_instance)
+#define BNODE_VALUE(tt, node, i)                                      \
+  ((char *) (node) + (tt)->bnode_values_offset                        \
+   + (size_t) (i) * (tt)->value->sizeof_instance)
+#define BNODE_CHILDREN(tt, node)                                      \
+  ((DangTreeBNode **) ((char *) (node) + (tt)->bnode_children_offset))
+
+static DangTreeBNode *
+alloc_bnode (DangValueTreeTypes *tt,
+             dang_boolean        is_leaf)
+{
+  DangTreeBNode *node;
+  node = dang_malloc (is_leaf ? tt->bnode_leaf_size : tt->bnode_internal_size);
+  node->ref_count = 1;
+  node->n_keys = 0;
+  node->is_leaf = is_leaf;
+  return node;
+}
+
+static void
+unref_bnode (DangValueTreeTypes *tt,
+             DangTreeBNode      *node)
+{
+  unsigned i;
+  if (DANG_REF_COUNT_DEC (node->ref_count) > 0)
+    return;
+  dang_value_bulk_destruct (tt->key, BNODE_KEY (tt, node, 0), node->n_keys);
+  dang_value_bulk_destruct (tt->value, BNODE_VALUE (tt, node, 0), node->n_keys);
+  if (!node->is_leaf)
+    for (i = 0; i <= node->n_keys; i++)
+      unref_bnode (tt, BNODE_CHILDREN (tt, node)[i]);
+  dang_free (node);
+}
+
+/* copy one node; the copy shares the node's children */
+static DangTreeBNode *
+copy_bnode (DangValueTreeTypes *tt,
+            DangTreeBNode      *node)
+{
+  DangTreeBNode *new_node = alloc_bnode (tt, node->is_leaf);
+  unsigned i;
+  new_node->n_keys = node->n_keys;
+  dang_value_bulk_copy (tt->key, BNODE_KEY (tt, new_node, 0),
+                        BNODE_KEY (tt, node, 0), node->n_keys);
+  dang_value_bulk_copy (tt->value, BNODE_VALUE (tt, new_node, 0),
+                        BNODE_VALUE (tt, node, 0), node->n_keys);
+  if (!node->is_leaf)
+    for (i = 0; i <= node->n_keys; i++)
+      {
+        DangTreeBNode *child = BNODE_CHILDREN (tt, node)[i];
+        DANG_REF_COUNT_INC (child->ref_count);
+        BNODE_CHILDREN (tt, new_node)[i] = child;
+      }
+  return new_node;
+}
+
+/* --- in-order traversal --- */
+static void
+foreach_node (DangValueTreeTypes *tt,
+              DangTreeNode       *node,
+              DangTreeForeachFunc func,
+              void               *func_data)
+{
+  while (node != NULL)
+    {
+      foreach_node (tt, node->left, func, func_data);
+      func (node + 1, (char*)node + tt->value_offset, func_data);
+      node = node->right;
+    }
+}
+
+static void
+foreach_bnode (DangValueTreeTypes *tt,
+               DangTreeBNode      *node,
+               DangTreeForeachFunc func,
+               void               *func_data)
+{
+  unsigned i;
+  for (i = 0; i < node->n_keys; i++)
+    {
+      if (!node->is_leaf)
+        foreach_bnode (tt, BNODE_CHILDREN (tt, node)[i], func, func_data);
+      func (BNODE_KEY (tt, node, i), BNODE_VALUE (tt, node, i), func_data);
+    }
+  if (!node->is_leaf)
+    foreach_bnode (tt, BNODE_CHILDREN (tt, node)[i], func, func_data);
+}
+
+void
+dang_constant_tree_foreach (DangValueTypeTree  *tree_type,
+                            DangConstantTree   *tree,
+                            DangTreeForeachFunc func,
+                            void               *func_data)
+{
+  if (tree == NULL)
+    return;
+  if (tree->btree_top != NULL)
+    foreach_bnode (tree_type->owner, tree->btree_top, func, func_data);
+  else
+    foreach_node (tree_type->owner, tree->top, func, func_data);
+}
+
 static void
 destruct__constant_tree (DangValueType *type,
                          void          *value)
@@ -72,12 +170,14 @@ destruct__constant_tree (DangValueType *type,
   DangValueTreeTypes *tt = ((DangValueTypeTree *) type)->owner;
   if (ctree == NULL)
     return;
-  if (--(ctree->ref_count) > 0)
+  if (DANG_REF_COUNT_DEC (ctree->ref_count) > 0)
     return;
-  if (ctree->top)
-    tt->destruct_tree_node (tt, ctree->top);
+  tt->unref_tree_node (tt, ctree->top);
+  if (ctree->btree_top != NULL)
+    unref_bnode (tt, ctree->btree_top);
   if (ctree->compare != NULL)
     dang_function_unref (ctree->compare);
+  dang_free (ctree);
 }
 
 static void
@@ -88,9 +188,10 @@ destruct__mutable_tree (DangValueType *type,
   DangValueTreeTypes *tt = ((DangValueTypeTree *) type)->owner;
   if (tree == NULL)
     return;
-  if (--(tree->ref_count) > 0)
+  if (DANG_REF_COUNT_DEC (tree->ref_count) > 0)
     return;
   destruct__constant_tree (&tt->types[1].base_type, &tree->v);
+  dang_free (tree);
 }
 
 static void
@@ -101,7 +202,7 @@ init_assign__constant_tree          (DangValueType *type,
   DangConstantTree *src_tree = * (DangConstantTree **) src;
   DANG_UNUSED (type);
   if (src_tree)
-    src_tree->ref_count++;
+    DANG_REF_COUNT_INC (src_tree->ref_count);
   * (DangConstantTree **) dst = src_tree;
 }
 
@@ -113,7 +214,7 @@ init_assign__mutable_tree          (DangValueType *type,
   DangTree *src_tree = * (DangTree **) src;
   DANG_UNUSED (type);
   if (src_tree)
-    src_tree->ref_count++;
+    DANG_REF_COUNT_INC (src_tree->ref_count);
   * (DangTree **) dst = src_tree;
 }
 
@@ -135,25 +236,29 @@ assign__mutable_tree         (DangValueType *type,
   init_assign__mutable_tree (type, dst, src);
 }
 
+typedef struct _ToStringInfo ToStringInfo;
+struct _ToStringInfo
+{
+  DangValueTreeTypes *tt;
+  DangStringBuffer buf;
+};
+
 static void
-append_string_recursive (DangValueTreeTypes *tt,
-                         DangTreeNode      *node,
-                         DangStringBuffer  *buf)
+append_entry_to_string (const void *key,
+                        const void *value,
+                        void       *func_data)
 {
+  ToStringInfo *info = func_data;
   char *s;
-  if (node == NULL)
-    return;
-  append_string_recursive (tt, node->left, buf);
-  if (buf->len > 1)
-    dang_string_buffer_append (buf, ", ");
-  s = dang_value_to_string (tt->key, node + 1);
-  dang_string_buffer_append (buf, s);
+  if (info->buf.len > 1)
+    dang_string_buffer_append (&info->buf, ", ");
+  s = dang_value_to_string (info->tt->key, key);
+  dang_string_buffer_append (&info->buf, s);
   dang_free (s);
-  dang_string_buffer_append (buf, " => ");
-  s = dang_value_to_string (tt->value, (char*)node + tt->value_offset);
-  dang_string_buffer_append (buf, s);
+  dang_string_buffer_append (&info->buf, " => ");
+  s = dang_value_to_string (info->tt->value, value);
+  dang_string_buffer_append (&info->buf, s);
   dang_free (s);
-  append_string_recursive (tt, node->right, buf);
 }
 
 static char *
@@ -161,11 +266,13 @@ to_string__constant_tree (DangValueType *type,
                           const void    *value)
 {
   DangConstantTree *tree = * (DangConstantTree **) value;
-  DangStringBuffer buf = DANG_STRING_BUFFER_INIT;
-  dang_string_buffer_append_c (&buf, '{');
-  append_string_recursive (((DangValueTypeTree*)type)->owner, tree->top, &buf);
-  dang_string_buffer_append (&buf, " }");
-  return buf.str;
+  ToStringInfo info = { NULL, DANG_STRING_BUFFER_INIT };
+  info.tt = ((DangValueTypeTree*)type)->owner;
+  dang_string_buffer_append_c (&info.buf, '{');
+  dang_constant_tree_foreach ((DangValueTypeTree*)type, tree,
+                              append_entry_to_string, &info);
+  dang_string_buffer_append (&info.buf, " }");
+  return info.buf.str;
 }
 static char *
 to_string__mutable_tree (DangValueType *type,
@@ -203,12 +310,6 @@ compare_node_keys (DangValueTreeTypes *tt,
 
 #define GET_NODE_IS_RED(n)   n->is_red
 #define SET_NODE_IS_RED(n,v)   n->is_red=v
-#define COMPARE_NODES(a,b,rv) \
-{ if (!compare_node_keys (tt, tree, a + 1, b + 1, &rv, error)) \
-    return FALSE; }
-#define GET_TREE(ttype, tree) \
-  tree->top, DangTreeNode *, GET_NODE_IS_RED, SET_NODE_IS_RED, parent, left, right, \
-  COMPARE_NODES
 
 #define COMPARE_TREE_TYPES(a,b,rv)              \
   if (a->key < b->key) rv = -1;                 \
@@ -221,6 +322,491 @@ static DangValueTreeTypes *top_tree_type = NULL;
         top_tree_type, DangValueTreeTypes *, GET_NODE_IS_RED, SET_NODE_IS_RED, \
         parent, left, right, COMPARE_TREE_TYPES
 
+/* --- updates by path-copying ---
+ *
+ * A tree is changed only through nodes it owns exclusively:
+ * walking down from the top, any shared node (ref_count > 1)
+ * is replaced by a copy, which takes new references to its subtrees,
+ * so those are in turn shared and copied if the walk goes on into them.
+ * So an update on a tree that shares structure with others
+ * (snapshots taken with '.v', or copies of a constant tree)
+ * copies only the O(log n) nodes on its path.
+ */
+
+/* LLRB trees with n nodes are at most 2 log2(n) deep */
+#define MAX_TREE_DEPTH          128
+
+#define IS_RED(node)            ((node) != NULL && (node)->is_red)
+
+/* Make the node in *pnode exclusive, given that the node containing
+   pnode is; returns the (possibly new) node. */
+static inline DangTreeNode *
+unshare_node (DangValueTreeTypes *tt,
+              DangTreeNode      **pnode)
+{
+  DangTreeNode *node = *pnode;
+  if (node != NULL && node->ref_count > 1)
+    {
+      *pnode = tt->copy_tree_node (tt, node);
+      tt->unref_tree_node (tt, node);
+    }
+  return *pnode;
+}
+
+static DangConstantTree *
+unshare_constant_tree (DangValueTreeTypes *tt,
+                       DangConstantTree  **ptree)
+{
+  DangConstantTree *tree = *ptree;
+  DangConstantTree *copy;
+  if (tree != NULL && tree->ref_count == 1)
+    return tree;
+  copy = dang_new (DangConstantTree, 1);
+  copy->ref_count = 1;
+  if (tree == NULL)
+    {
+      copy->top = NULL;
+      copy->btree_top = NULL;
+      copy->compare = NULL;
+      copy->size = 0;
+    }
+  else
+    {
+      copy->top = tree->top;
+      if (copy->top != NULL)
+        DANG_REF_COUNT_INC (copy->top->ref_count);
+      copy->btree_top = tree->btree_top;
+      if (copy->btree_top != NULL)
+        DANG_REF_COUNT_INC (copy->btree_top->ref_count);
+      copy->compare = tree->compare ? dang_function_ref (tree->compare) : NULL;
+      copy->size = tree->size;
+      destruct__constant_tree (&tt->types[1].base_type, ptree);
+    }
+  *ptree = copy;
+  return copy;
+}
+
+static DangTreeNode *
+rotate_left (DangValueTreeTypes *tt,
+             DangTreeNode      **pnode)
+{
+  DangTreeNode *h = *pnode;
+  DangTreeNode *x = unshare_node (tt, &h->right);
+  h->right = x->left;
+  x->left = h;
+  x->is_red = h->is_red;
+  h->is_red = 1;
+  *pnode = x;
+  return x;
+}
+
+static DangTreeNode *
+rotate_right (DangValueTreeTypes *tt,
+              DangTreeNode      **pnode)
+{
+  DangTreeNode *h = *pnode;
+  DangTreeNode *x = unshare_node (tt, &h->left);
+  h->left = x->right;
+  x->right = h;
+  x->is_red = h->is_red;
+  h->is_red = 1;
+  *pnode = x;
+  return x;
+}
+
+/* Insert 'new_node' at the end of the path 'dirs' (0=left, 1=right)
+   below *pnode, restoring the LLRB invariants on the way back up. */
+static void
+insert_node (DangValueTreeTypes *tt,
+             DangTreeNode      **pnode,
+             const uint8_t      *dirs,
+             DangTreeNode       *new_node)
+{
+  DangTreeNode *h;
+  if (*pnode == NULL)
+    {
+      *pnode = new_node;
+      return;
+    }
+  h = unshare_node (tt, pnode);
+  insert_node (tt, *dirs ? &h->right : &h->left, dirs + 1, new_node);
+
+  if (IS_RED (h->right) && !IS_RED (h->left))
+    h = rotate_left (tt, pnode);
+  if (IS_RED (h->left) && IS_RED (h->left->left))
+    h = rotate_right (tt, pnode);
+  if (IS_RED (h->left) && IS_RED (h->right))
+    {
+      h->is_red = !h->is_red;
+      unshare_node (tt, &h->left)->is_red = !h->is_red;
+      unshare_node (tt, &h->right)->is_red = !h->is_red;
+    }
+}
+
+/* Find 'key', recording the path taken in 'dirs'. */
+static dang_boolean
+find_node (DangValueTreeTypes *tt,
+           DangConstantTree   *tree,
+           const void         *key,
+           uint8_t            *dirs,
+           unsigned           *depth_out,
+           DangTreeNode      **node_out,
+           DangError         **error)
+{
+  DangTreeNode *n = tree ? tree->top : NULL;
+  unsigned depth = 0;
+  int cmp;
+  while (n != NULL)
+    {
+      if (!compare_node_keys (tt, tree, key, n + 1, &cmp, error))
+        return FALSE;
+      if (cmp == 0)
+        break;
+      dang_assert (depth < MAX_TREE_DEPTH);
+      dirs[depth++] = cmp > 0;
+      n = cmp < 0 ? n->left : n->right;
+    }
+  *depth_out = depth;
+  *node_out = n;
+  return TRUE;
+}
+
+/* --- B-trees ---
+ *
+ * Insertion splits full nodes on the way down,
+ * unsharing the path as the red-black insertion does.
+ */
+#define BNODE_MIN_DEGREE        DANG_TREE_BNODE_MIN_DEGREE
+#define BNODE_MAX_KEYS          DANG_TREE_BNODE_MAX_KEYS
+
+static inline DangTreeBNode *
+unshare_bnode (DangValueTreeTypes *tt,
+               DangTreeBNode     **pnode)
+{
+  DangTreeBNode *node = *pnode;
+  if (node->ref_count > 1)
+    {
+      *pnode = copy_bnode (tt, node);
+      unref_bnode (tt, node);
+    }
+  return *pnode;
+}
+
+/* Find the first key in 'node' not less than 'key'. */
+static dang_boolean
+bnode_search (DangValueTreeTypes *tt,
+              DangConstantTree   *tree,
+              DangTreeBNode      *node,
+              const void         *key,
+              unsigned           *index_out,
+              dang_boolean       *found_out,
+              DangError         **error)
+{
+  unsigned lo = 0, hi = node->n_keys;
+  int cmp;
+  dang_boolean found = FALSE;
+
+  /* No early exit on equality, which only adds a mispredicted branch:
+     'found' is whether key equals the key at 'hi'. */
+  while (lo < hi)
+    {
+      unsigned mid = (lo + hi) / 2;
+      if (!compare_node_keys (tt, tree, key, BNODE_KEY (tt, node, mid), &cmp, error))
+        return FALSE;
+      if (cmp > 0)
+        lo = mid + 1;
+      else
+        {
+          hi = mid;
+          found = (cmp == 0);
+        }
+    }
+  *index_out = lo;
+  *found_out = found;
+  return TRUE;
+}
+
+static dang_boolean
+btree_lookup (DangValueTreeTypes *tt,
+              DangConstantTree   *tree,
+              const void         *key,
+              void              **rv_ptr_out,
+              DangError         **error)
+{
+  DangTreeBNode *node = tree->btree_top;
+  unsigned i;
+  dang_boolean found;
+  for (;;)
+    {
+      if (!bnode_search (tt, tree, node, key, &i, &found, error))
+        return FALSE;
+      if (found)
+        {
+          *rv_ptr_out = BNODE_VALUE (tt, node, i);
+          return TRUE;
+        }
+      if (node->is_leaf)
+        {
+          *rv_ptr_out = NULL;
+          return TRUE;
+        }
+      node = BNODE_CHILDREN (tt, node)[i];
+    }
+}
+
+/* Split the full, exclusive child 'i' of 'parent' in two,
+   moving its median key up into 'parent'. */
+static void
+split_bnode_child (DangValueTreeTypes *tt,
+                   DangTreeBNode      *parent,
+                   unsigned            i)
+{
+  DangTreeBNode **children = BNODE_CHILDREN (tt, parent);
+  DangTreeBNode *left = children[i];
+  DangTreeBNode *right = alloc_bnode (tt, left->is_leaf);
+  unsigned key_size = tt->key->sizeof_instance;
+  unsigned value_size = tt->value->sizeof_instance;
+  unsigned n_after = parent->n_keys - i;
+
+  right->n_keys = BNODE_MIN_DEGREE - 1;
+  memcpy (BNODE_KEY (tt, right, 0), BNODE_KEY (tt, left, BNODE_MIN_DEGREE),
+          key_size * (BNODE_MIN_DEGREE - 1));
+  memcpy (BNODE_VALUE (tt, right, 0), BNODE_VALUE (tt, left, BNODE_MIN_DEGREE),
+          value_size * (BNODE_MIN_DEGREE - 1));
+  if (!left->is_leaf)
+    memcpy (BNODE_CHILDREN (tt, right), BNODE_CHILDREN (tt, left) + BNODE_MIN_DEGREE,
+            sizeof (DangTreeBNode *) * BNODE_MIN_DEGREE);
+  left->n_keys = BNODE_MIN_DEGREE - 1;
+
+  memmove (BNODE_KEY (tt, parent, i + 1), BNODE_KEY (tt, parent, i), key_size * n_after);
+  memmove (BNODE_VALUE (tt, parent, i + 1), BNODE_VALUE (tt, parent, i), value_size * n_after);
+  memmove (children + i + 2, children + i + 1, sizeof (DangTreeBNode *) * n_after);
+  memcpy (BNODE_KEY (tt, parent, i), BNODE_KEY (tt, left, BNODE_MIN_DEGREE - 1), key_size);
+  memcpy (BNODE_VALUE (tt, parent, i), BNODE_VALUE (tt, left, BNODE_MIN_DEGREE - 1), value_size);
+  children[i + 1] = right;
+  parent->n_keys++;
+}
+
+/* Like constant_tree_get_pointer_for_write(), for an exclusive B-tree. */
+static dang_boolean
+btree_get_pointer_for_write (DangValueTreeTypes *tt,
+                             DangConstantTree   *tree,
+                             const void         *key,
+                             void              **rv_ptr_out,
+                             DangError         **error)
+{
+  DangTreeBNode *node = unshare_bnode (tt, &tree->btree_top);
+  DangTreeBNode *child;
+  dang_boolean found;
+  unsigned i;
+  int cmp;
+
+  if (node->n_keys == BNODE_MAX_KEYS)
+    {
+      DangTreeBNode *top = alloc_bnode (tt, FALSE);
+      BNODE_CHILDREN (tt, top)[0] = node;
+      split_bnode_child (tt, top, 0);
+      tree->btree_top = node = top;
+    }
+  for (;;)
+    {
+      if (!bnode_search (tt, tree, node, key, &i, &found, error))
+        return FALSE;
+      if (found)
+        break;
+      if (node->is_leaf)
+        {
+          unsigned n_after = node->n_keys - i;
+          memmove (BNODE_KEY (tt, node, i + 1), BNODE_KEY (tt, node, i),
+                   tt->key->sizeof_instance * n_after);
+          memmove (BNODE_VALUE (tt, node, i + 1), BNODE_VALUE (tt, node, i),
+                   tt->value->sizeof_instance * n_after);
+          dang_value_init_assign_key (tt->key, BNODE_KEY (tt, node, i), key);
+          memset (BNODE_VALUE (tt, node, i), 0, tt->value->sizeof_instance);
+          node->n_keys++;
+          tree->size++;
+          break;
+        }
+      child = unshare_bnode (tt, BNODE_CHILDREN (tt, node) + i);
+      if (child->n_keys == BNODE_MAX_KEYS)
+        {
+          split_bnode_child (tt, node, i);
+          if (!compare_node_keys (tt, tree, key, BNODE_KEY (tt, node, i), &cmp, error))
+            return FALSE;
+          if (cmp == 0)
+            break;
+          if (cmp > 0)
+            i++;
+          child = BNODE_CHILDREN (tt, node)[i];
+        }
+      node = child;
+    }
+  *rv_ptr_out = BNODE_VALUE (tt, node, i);
+  return TRUE;
+}
+
+/* Build a B-tree of the given height from 'n' sorted entries,
+   copying them.  max_sizes[h] is the most entries a tree
+   of height h can hold.  The entries are divided evenly between
+   the fewest children that can hold them, so every node but the top
+   is at least about half full. */
+static DangTreeBNode *
+build_bnodes (DangValueTreeTypes *tt,
+              unsigned            height,
+              const size_t       *max_sizes,
+              size_t              n,
+              const void        **keys,
+              const void        **values)
+{
+  DangTreeBNode *node = alloc_bnode (tt, height == 0);
+  size_t n_children, per_child, extra, at;
+  unsigned i;
+  if (height == 0)
+    {
+      dang_assert (n <= BNODE_MAX_KEYS);
+      for (i = 0; i < n; i++)
+        {
+          dang_value_init_assign_key (tt->key, BNODE_KEY (tt, node, i), keys[i]);
+          dang_value_init_assign (tt->value, BNODE_VALUE (tt, node, i), values[i]);
+        }
+      node->n_keys = n;
+      return node;
+    }
+
+  n_children = (n + 1 + max_sizes[height - 1]) / (max_sizes[height - 1] + 1);
+  if (n_children < 2)
+    n_children = 2;
+  dang_assert (n_children <= BNODE_MAX_KEYS + 1);
+  per_child = (n - (n_children - 1)) / n_children;
+  extra = (n - (n_children - 1)) % n_children;
+  at = 0;
+  for (i = 0; i < n_children; i++)
+    {
+      size_t n_sub = per_child + (i < extra ? 1 : 0);
+      BNODE_CHILDREN (tt, node)[i] = build_bnodes (tt, height - 1, max_sizes, n_sub,
+                                                   keys + at, values + at);
+      at += n_sub;
+      if (i + 1 < n_children)
+        {
+          dang_value_init_assign_key (tt->key, BNODE_KEY (tt, node, i), keys[at]);
+          dang_value_init_assign (tt->value, BNODE_VALUE (tt, node, i), values[at]);
+          at++;
+        }
+    }
+  node->n_keys = n_children - 1;
+  return node;
+}
+
+static DangTreeBNode *
+build_btree (DangValueTreeTypes *tt,
+             size_t              n,
+             const void        **keys,
+             const void        **values)
+{
+  size_t max_sizes[16];
+  unsigned height = 0;
+  max_sizes[0] = BNODE_MAX_KEYS;
+  while (max_sizes[height] < n)
+    {
+      dang_assert (height + 1 < DANG_N_ELEMENTS (max_sizes));
+      max_sizes[height + 1] = (max_sizes[height] + 1) * (BNODE_MAX_KEYS + 1) - 1;
+      height++;
+    }
+  return build_bnodes (tt, height, max_sizes, n, keys, values);
+}
+
+typedef struct _GatherInfo GatherInfo;
+struct _GatherInfo
+{
+  const void **keys;
+  const void **values;
+  size_t n;
+};
+
+static void
+gather_entry (const void *key,
+              const void *value,
+              void       *func_data)
+{
+  GatherInfo *info = func_data;
+  info->keys[info->n] = key;
+  info->values[info->n] = value;
+  info->n++;
+}
+
+/* Replace the red-black nodes of the exclusive 'tree' by a B-tree. */
+static void
+convert_to_btree (DangValueTreeTypes *tt,
+                  DangConstantTree   *tree)
+{
+  GatherInfo info;
+  info.keys = dang_new (const void *, 2 * tree->size);
+  info.values = info.keys + tree->size;
+  info.n = 0;
+  foreach_node (tt, tree->top, gather_entry, &info);
+  dang_assert (info.n == tree->size);
+  tree->btree_top = build_btree (tt, info.n, info.keys, info.values);
+  dang_free (info.keys);
+  tt->unref_tree_node (tt, tree->top);
+  tree->top = NULL;
+}
+
+/* Get a pointer to the value for 'key' in a tree that the caller
+   may modify, unsharing the tree and the path to the value,
+   and inserting a zeroed value if the key is new. */
+static dang_boolean
+constant_tree_get_pointer_for_write (DangValueTreeTypes *tt,
+                                     DangConstantTree  **ptree,
+                                     const void         *key,
+                                     void              **rv_ptr_out,
+                                     DangError         **error)
+{
+  uint8_t dirs[MAX_TREE_DEPTH];
+  unsigned depth, i;
+  DangTreeNode *n;
+  DangTreeNode **pnode;
+  DangConstantTree *tree;
+
+  if (*ptree != NULL && (*ptree)->btree_top != NULL)
+    {
+      tree = unshare_constant_tree (tt, ptree);
+      return btree_get_pointer_for_write (tt, tree, key, rv_ptr_out, error);
+    }
+  if (!find_node (tt, *ptree, key, dirs, &depth, &n, error))
+    return FALSE;
+  tree = unshare_constant_tree (tt, ptree);
+  if (n != NULL)
+    {
+      pnode = &tree->top;
+      for (i = 0; i < depth; i++)
+        {
+          n = unshare_node (tt, pnode);
+          pnode = dirs[i] ? &n->right : &n->left;
+        }
+      n = unshare_node (tt, pnode);
+    }
+  else
+    {
+      n = dang_malloc (tt->node_size);
+      n->ref_count = 1;
+      n->is_red = 1;
+      n->left = n->right = NULL;
+      dang_value_init_assign_key (tt->key, n + 1, key);
+      memset ((char*)n + tt->value_offset, 0, tt->value->sizeof_instance);
+      insert_node (tt, &tree->top, dirs, n);
+      tree->top->is_red = 0;
+      tree->size++;
+      if (tree->size > dang_tree_btree_threshold)
+        {
+          /* the B-tree holds copies of the entries */
+          convert_to_btree (tt, tree);
+          return btree_lookup (tt, tree, key, rv_ptr_out, error);
+        }
+    }
+  *rv_ptr_out = ((char*)n) + tt->value_offset;
+  return TRUE;
+}
+
 static dang_boolean
 constant_tree_get_pointer   (DangValueTreeTypes *tt,
                              DangConstantTree   **ptree,
@@ -230,41 +816,25 @@ constant_tree_get_pointer   (DangValueTreeTypes *tt,
                              DangError    **error)
 {
   DangConstantTree *tree = *ptree;
-  if (tree == NULL)
+  DangTreeNode *n = tree ? tree->top : NULL;
+  int cmp;
+  if (tree != NULL && tree->btree_top != NULL)
     {
-      if (may_create)
-        {
-          tree = dang_new (DangConstantTree, 1);
-          tree->ref_count = 1;
-          tree->top = NULL;
-          tree->compare = NULL;
-          tree->size = 0;
-          *ptree = tree;
-        }
-      else
-        {
-          if (error)
-            *error = dang_error_new ("key not found in tree");
-          return FALSE;
-        }
+      if (!btree_lookup (tt, tree, key, rv_ptr_out, error))
+        return FALSE;
+      if (*rv_ptr_out != NULL)
+        return TRUE;
     }
-  DangTreeNode *n = tree->top;
-  DangTreeNode *last = n;
-  int cmp;
   while (n != NULL)
     {
       if (!compare_node_keys (tt, tree, key, n + 1, &cmp, error))
         return FALSE;
-      last = n;
       if (cmp == 0)
         {
           *rv_ptr_out = ((char*)n) + tt->value_offset;
           return TRUE;
         }
-      else if (cmp < 0)
-        n = n->left;
-      else
-        n = n->right;
+      n = cmp < 0 ? n->left : n->right;
     }
   if (!may_create)
     {
@@ -272,34 +842,380 @@ constant_tree_get_pointer   (DangValueTreeTypes *tt,
         *error = dang_error_new ("key not found in tree");
       return FALSE;
     }
+  return constant_tree_get_pointer_for_write (tt, ptree, key, rv_ptr_out, error);
+}
+
+/* --- bulk construction and set operations --- */
+
+static DangConstantTree *
+new_constant_tree (void)
+{
+  DangConstantTree *tree = dang_new (DangConstantTree, 1);
+  tree->ref_count = 1;
+  tree->top = NULL;
+  tree->btree_top = NULL;
+  tree->compare = NULL;
+  tree->size = 0;
+  return tree;
+}
 
-  if (tt->recycling_list)
+/* A new tree holding copies of 'n' entries with strictly increasing keys:
+   a B-tree built in O(n) if it is large enough to be one anyway. */
+static DangConstantTree *
+build_constant_tree (DangValueTreeTypes *tt,
+                     size_t              n,
+                     const void        **keys,
+                     const void        **values)
+{
+  DangConstantTree *tree = new_constant_tree ();
+  void *value;
+  size_t i;
+  if (n > dang_tree_btree_threshold)
     {
-      n = tt->recycling_list;
-      tt->recycling_list = n->parent;
+      tree->btree_top = build_btree (tt, n, keys, values);
+      tree->size = n;
+      return tree;
     }
-  else
-    n = dang_malloc (tt->node_size);
+  for (i = 0; i < n; i++)
+    {
+      if (!constant_tree_get_pointer_for_write (tt, &tree, keys[i], &value, NULL))
+        dang_assert_not_reached ();
+      dang_value_init_assign (tt->value, value, values[i]);
+    }
+  return tree;
+}
+
+/* Sorts of at least this many keys are split between the workers. */
+#define SORT_MIN_SPLIT_KEYS     (1 << 16)
+
+typedef struct _KeySort KeySort;
+struct _KeySort
+{
+  DangValueType *type;
+  const char *keys;
+  uint32_t *indices;
+  uint32_t *tmp;
+  size_t n;
+};
+
+static inline int
+compare_key_indices (const KeySort *ks,
+                     uint32_t       a,
+                     uint32_t       b)
+{
+  size_t size = ks->type->sizeof_instance;
+  return ks->type->compare (ks->type, ks->keys + a * size, ks->keys + b * size);
+}
+
+/* Merge two sorted runs into 'out', taking from 'a' on ties
+   so that the sort is stable. */
+static void
+merge_key_indices (const KeySort  *ks,
+                   const uint32_t *a,
+                   size_t          n_a,
+                   const uint32_t *b,
+                   size_t          n_b,
+                   uint32_t       *out)
+{
+  while (n_a > 0 && n_b > 0)
+    {
+      if (compare_key_indices (ks, *a, *b) <= 0)
+        {
+          *out++ = *a++;
+          n_a--;
+        }
+      else
+        {
+          *out++ = *b++;
+          n_b--;
+        }
+    }
+  memcpy (out, a, n_a * sizeof (uint32_t));
+  memcpy (out + n_a, b, n_b * sizeof (uint32_t));
+}
+
+/* Stable merge sort; 'tmp' has room for 'n' indices. */
+static void
+sort_key_indices (const KeySort *ks,
+                  uint32_t      *indices,
+                  uint32_t      *tmp,
+                  size_t         n)
+{
+  size_t half, i, j;
+  if (n <= 16)
+    {
+      for (i = 1; i < n; i++)
+        {
+          uint32_t index = indices[i];
+          for (j = i; j > 0 && compare_key_indices (ks, indices[j - 1], index) > 0; j--)
+            indices[j] = indices[j - 1];
+          indices[j] = index;
+        }
+      return;
+    }
+  half = n / 2;
+  sort_key_indices (ks, indices, tmp, half);
+  sort_key_indices (ks, indices + half, tmp + half, n - half);
+  if (compare_key_indices (ks, indices[half - 1], indices[half]) <= 0)
+    return;
+  merge_key_indices (ks, indices, half, indices + half, n - half, tmp);
+  memcpy (indices, tmp, n * sizeof (uint32_t));
+}
+
+static void
+key_sort_part (unsigned part,
+               void    *data)
+{
+  KeySort *ks = (KeySort *) data + part;
+  sort_key_indices (ks, ks->indices, ks->tmp, ks->n);
+}
 
-  /* Initialize key/value */
-  dang_value_init_assign (tt->key, n+1, key);
-  memset ((char*)n + tt->value_offset, 0, tt->value->sizeof_instance);
+/* Sort 'indices' (0..n-1) by key, stably.  Large sorts are split
+   into one part per worker of the default scheduler (see
+   dang_scheduler_run_parts()), and the sorted parts are then merged. */
+static void
+sort_keys (DangValueType *type,
+           const void    *keys,
+           uint32_t      *indices,
+           size_t         n)
+{
+  DangScheduler *scheduler = NULL;
+  uint32_t *tmp = dang_new (uint32_t, n);
+  unsigned n_parts = 1, i;
+  size_t per_part;
+  KeySort *parts;
 
-  if (last == NULL)
+  if (n >= 2 * SORT_MIN_SPLIT_KEYS)
+    {
+      scheduler = dang_scheduler_get_default ();
+      n_parts = dang_scheduler_get_n_workers (scheduler);
+      if (n_parts > n / SORT_MIN_SPLIT_KEYS)
+        n_parts = n / SORT_MIN_SPLIT_KEYS;
+    }
+  per_part = (n + n_parts - 1) / n_parts;
+  n_parts = (n + per_part - 1) / per_part;
+  parts = dang_new (KeySort, n_parts);
+  for (i = 0; i < n_parts; i++)
     {
-      DangTreeNode *conflict;
-      GSK_RBTREE_INSERT (GET_TREE (tt, tree), n, conflict);
-      dang_assert (conflict == NULL);
+      parts[i].type = type;
+      parts[i].keys = keys;
+      parts[i].indices = indices + i * per_part;
+      parts[i].tmp = tmp + i * per_part;
+      parts[i].n = DANG_MIN (per_part, n - i * per_part);
     }
+  if (n_parts > 1)
+    dang_scheduler_run_parts (scheduler, n_parts, key_sort_part, parts);
   else
+    key_sort_part (0, parts);
+
+  /* merge each part into the ones before it, in order */
+  for (i = 1; i < n_parts; i++)
     {
-      dang_boolean is_right = (cmp > 0);
-      GSK_RBTREE_INSERT_AT (GET_TREE (tt, tree), last, is_right, n);
+      size_t n_before = parts[i].indices - indices;
+      merge_key_indices (parts, indices, n_before,
+                         parts[i].indices, parts[i].n, tmp);
+      memcpy (indices, tmp, (n_before + parts[i].n) * sizeof (uint32_t));
     }
-  *rv_ptr_out = ((char*)n) + tt->value_offset;
+  dang_free (parts);
+  dang_free (tmp);
+}
+
+/* Of equal keys, the last one's value is kept,
+   as if the entries were inserted in order. */
+DangConstantTree *
+dang_constant_tree_new_from_arrays (DangValueTypeTree *tree_type,
+                                    size_t             n,
+                                    const void        *keys,
+                                    const void        *values)
+{
+  DangValueTreeTypes *tt = tree_type->owner;
+  DangValueType *key_type = tt->key;
+  size_t key_size = key_type->sizeof_instance;
+  size_t value_size = tt->value->sizeof_instance;
+  const void **key_ptrs, **value_ptrs;
+  DangConstantTree *rv;
+  uint32_t *indices = NULL;
+  size_t i, n_entries;
+
+  for (i = 1; i < n; i++)
+    if (key_type->compare (key_type,
+                           (const char *) keys + (i - 1) * key_size,
+                           (const char *) keys + i * key_size) >= 0)
+      break;
+  if (i < n)
+    {
+      indices = dang_new (uint32_t, n);
+      for (i = 0; i < n; i++)
+        indices[i] = i;
+      sort_keys (key_type, keys, indices, n);
+    }
+
+  key_ptrs = dang_new (const void *, 2 * n);
+  value_ptrs = key_ptrs + n;
+  n_entries = 0;
+  for (i = 0; i < n; i++)
+    {
+      size_t index = indices ? indices[i] : i;
+      const void *key = (const char *) keys + index * key_size;
+      if (n_entries > 0
+       && key_type->compare (key_type, key_ptrs[n_entries - 1], key) == 0)
+        n_entries--;
+      key_ptrs[n_entries] = key;
+      value_ptrs[n_entries] = (const char *) values + index * value_size;
+      n_entries++;
+    }
+  rv = build_constant_tree (tt, n_entries, key_ptrs, value_ptrs);
+  dang_free (key_ptrs);
+  dang_free (indices);
+  return rv;
+}
+
+typedef enum
+{
+  SET_OP_UNION,
+  SET_OP_INTERSECTION,
+  SET_OP_DIFFERENCE
+} SetOp;
+
+/* Merge the entries of two trees in one pass, then build the result. */
+static dang_boolean
+merge_constant_trees (DangValueTreeTypes *tt,
+                      SetOp               op,
+                      DangConstantTree   *a,
+                      DangConstantTree   *b,
+                      DangConstantTree  **rv_out,
+                      DangError         **error)
+{
+  size_t n_a = a ? a->size : 0, n_b = b ? b->size : 0;
+  size_t i_a = 0, i_b = 0, n = 0;
+  GatherInfo info_a, info_b;
+  const void **keys, **values;
+  int cmp;
+
+  /* with an empty side, the result is empty or one of the trees */
+  if (n_a == 0 || n_b == 0)
+    {
+      DangConstantTree *rv = NULL;
+      if (op == SET_OP_UNION)
+        rv = n_b == 0 ? a : b;
+      else if (op == SET_OP_DIFFERENCE)
+        rv = a;
+      if (rv == NULL)
+        rv = new_constant_tree ();
+      else
+        DANG_REF_COUNT_INC (rv->ref_count);
+      *rv_out = rv;
+      return TRUE;
+    }
+
+  info_a.keys = dang_new (const void *, 2 * (n_a + n_b));
+  info_a.values = info_a.keys + n_a;
+  info_a.n = 0;
+  info_b.keys = info_a.values + n_a;
+  info_b.values = info_b.keys + n_b;
+  info_b.n = 0;
+  dang_constant_tree_foreach (&tt->types[1], a, gather_entry, &info_a);
+  dang_constant_tree_foreach (&tt->types[1], b, gather_entry, &info_b);
+  keys = dang_new (const void *, 2 * (n_a + n_b));
+  values = keys + n_a + n_b;
+
+  while (i_a < n_a && i_b < n_b)
+    {
+      if (!compare_node_keys (tt, a, info_a.keys[i_a], info_b.keys[i_b], &cmp, error))
+        {
+          dang_free (info_a.keys);
+          dang_free (keys);
+          return FALSE;
+        }
+      if (cmp < 0)
+        {
+          /* only in a */
+          if (op != SET_OP_INTERSECTION)
+            {
+              keys[n] = info_a.keys[i_a];
+              values[n++] = info_a.values[i_a];
+            }
+          i_a++;
+        }
+      else if (cmp > 0)
+        {
+          /* only in b */
+          if (op == SET_OP_UNION)
+            {
+              keys[n] = info_b.keys[i_b];
+              values[n++] = info_b.values[i_b];
+            }
+          i_b++;
+        }
+      else
+        {
+          /* in both: union takes b's value, like assigning b's entries */
+          if (op == SET_OP_UNION)
+            {
+              keys[n] = info_b.keys[i_b];
+              values[n++] = info_b.values[i_b];
+            }
+          else if (op == SET_OP_INTERSECTION)
+            {
+              keys[n] = info_a.keys[i_a];
+              values[n++] = info_a.values[i_a];
+            }
+          i_a++;
+          i_b++;
+        }
+    }
+  if (op != SET_OP_INTERSECTION)
+    for (; i_a < n_a; i_a++)
+      {
+        keys[n] = info_a.keys[i_a];
+        values[n++] = info_a.values[i_a];
+      }
+  if (op == SET_OP_UNION)
+    for (; i_b < n_b; i_b++)
+      {
+        keys[n] = info_b.keys[i_b];
+        values[n++] = info_b.values[i_b];
+      }
+
+  *rv_out = build_constant_tree (tt, n, keys, values);
+  dang_free (info_a.keys);
+  dang_free (keys);
   return TRUE;
 }
 
+/* for keys in both trees, the value is b's */
+dang_boolean
+dang_constant_tree_union (DangValueTypeTree *tree_type,
+                          DangConstantTree  *a,
+                          DangConstantTree  *b,
+                          DangConstantTree **rv_out,
+                          DangError        **error)
+{
+  return merge_constant_trees (tree_type->owner, SET_OP_UNION, a, b, rv_out, error);
+}
+
+/* the entries of a whose keys are in b */
+dang_boolean
+dang_constant_tree_intersection (DangValueTypeTree *tree_type,
+                                 DangConstantTree  *a,
+                                 DangConstantTree  *b,
+                                 DangConstantTree **rv_out,
+                                 DangError        **error)
+{
+  return merge_constant_trees (tree_type->owner, SET_OP_INTERSECTION, a, b, rv_out, error);
+}
+
+/* the entries of a whose keys are not in b */
+dang_boolean
+dang_constant_tree_difference (DangValueTypeTree *tree_type,
+                               DangConstantTree  *a,
+                               DangConstantTree  *b,
+                               DangConstantTree **rv_out,
+                               DangError        **error)
+{
+  return merge_constant_trees (tree_type->owner, SET_OP_DIFFERENCE, a, b, rv_out, error);
+}
+
 static dang_boolean
 index_set__mutable_tree   (DangValueIndexInfo *info,
                    void          *container,
@@ -317,18 +1233,11 @@ index_set__mutable_tree   (DangValueIndexInfo *info,
       dang_set_error (error, "null pointer exception");
       return FALSE;
     }
-  if (tree->v->ref_count > 1)
-    {
-      /* copy constant tree */
-      DangConstantTree *ctree = dang_new (DangConstantTree, 1);
-      ctree->ref_count = 1;
-      ctree->top = tt->copy_tree_node (tt, NULL, tree->v->top);
-      ctree->compare = tree->v->compare ? dang_function_ref (tree->v->compare) : NULL;
-      ctree->size = tree->v->size;
-      tree->v->ref_count -= 1;
-      tree->v = ctree;
-    }
-  if (!constant_tree_get_pointer (tt, &tree->v, indices[0], &value_ptr, may_create, error))
+  /* a missing key is an error unless may_create */
+  if (!may_create
+   && !constant_tree_get_pointer (tt, &tree->v, indices[0], &value_ptr, FALSE, error))
+    return FALSE;
+  if (!constant_tree_get_pointer_for_write (tt, &tree->v, indices[0], &value_ptr, error))
     return FALSE;
   dang_value_assign (tt->value, value_ptr, element_value);
   return TRUE;
@@ -353,7 +1262,7 @@ index_get__mutable_tree (DangValueIndexInfo *info,
     }
   if (!constant_tree_get_pointer (tt, &tree->v, indices[0], &value_ptr, may_create, error))
     return FALSE;
-  dang_value_assign (tt->value, rv_out, value_ptr);
+  dang_value_init_assign (tt->value, rv_out, value_ptr);
   return TRUE;
 }
 
@@ -370,7 +1279,7 @@ index_get__constant_tree (DangValueIndexInfo *info,
   void *value_ptr;
   if (!constant_tree_get_pointer (tt, container, indices[0], &value_ptr, may_create, error))
     return FALSE;
-  dang_value_assign (tt->value, rv_out, value_ptr);
+  dang_value_init_assign (tt->value, rv_out, value_ptr);
   return TRUE;
 }
 
@@ -381,7 +1290,7 @@ static DANG_SIMPLE_C_FUNC_DECLARE (constant_tree_to_mutable_tree)
   DANG_UNUSED (func_data);
   DANG_UNUSED (error);
   if (in)
-    in->ref_count += 1;
+    DANG_REF_COUNT_INC (in->ref_count);
   out = dang_new (DangTree, 1);
   out->ref_count = 1;
   out->v = in;
@@ -399,9 +1308,190 @@ static DANG_SIMPLE_C_FUNC_DECLARE (construct_empty_mutable_tree)
   tree->v = dang_new (DangConstantTree, 1);
   tree->v->ref_count = 1;
   tree->v->top = NULL;
+  tree->v->btree_top = NULL;
+  tree->v->compare = NULL;
+  tree->v->size = 0;
   * (DangTree **) rv_out = tree;
   return TRUE;
 }
+/* --- methods ---
+ *
+ * Except for make_empty(), make_from() and make_tree(), the methods are shared
+ * by the mutable and constant types; their func_data is
+ * the DangValueTypeTree of 'this'.
+ */
+static dang_boolean
+get_this (DangValueTypeTree *ttype,
+          void              *arg,
+          DangConstantTree **tree_out,
+          DangError        **error)
+{
+  if (ttype == &ttype->owner->types[0])
+    {
+      DangTree *tree = * (DangTree **) arg;
+      if (tree == NULL)
+        {
+          dang_set_error (error, "null pointer exception");
+          return FALSE;
+        }
+      *tree_out = tree->v;
+    }
+  else
+    *tree_out = * (DangConstantTree **) arg;
+  return TRUE;
+}
+
+static DANG_SIMPLE_C_FUNC_DECLARE (do_tree_size)
+{
+  DangConstantTree *tree;
+  if (!get_this (func_data, args[0], &tree, error))
+    return FALSE;
+  * (uint32_t *) rv_out = tree ? tree->size : 0;
+  return TRUE;
+}
+
+typedef struct _VectorInfo VectorInfo;
+struct _VectorInfo
+{
+  DangValueType *type;
+  dang_boolean values;
+  char *at;
+};
+static void
+append_entry_to_vector (const void *key,
+                        const void *value,
+                        void       *func_data)
+{
+  VectorInfo *info = func_data;
+  dang_value_init_assign (info->type, info->at, info->values ? value : key);
+  info->at += info->type->sizeof_instance;
+}
+
+/* keys() and values(), as vectors in order */
+static dang_boolean
+get_entries_vector (DangValueTypeTree *ttype,
+                    void              *arg,
+                    dang_boolean       values,
+                    DangVector       **rv_out,
+                    DangError        **error)
+{
+  DangConstantTree *tree;
+  DangVector *out;
+  VectorInfo info;
+  if (!get_this (ttype, arg, &tree, error))
+    return FALSE;
+  if (tree == NULL || tree->size == 0)
+    {
+      *rv_out = NULL;
+      return TRUE;
+    }
+  info.type = values ? ttype->owner->value : ttype->owner->key;
+  info.values = values;
+  out = dang_new (DangVector, 1);
+  out->ref_count = 1;
+  out->len = tree->size;
+  out->data = info.at = dang_malloc (info.type->sizeof_instance * tree->size);
+  dang_constant_tree_foreach (ttype, tree, append_entry_to_vector, &info);
+  *rv_out = out;
+  return TRUE;
+}
+static DANG_SIMPLE_C_FUNC_DECLARE (do_tree_keys)
+{
+  return get_entries_vector (func_data, args[0], FALSE, rv_out, error);
+}
+static DANG_SIMPLE_C_FUNC_DECLARE (do_tree_values)
+{
+  return get_entries_vector (func_data, args[0], TRUE, rv_out, error);
+}
+
+/* set_union(), set_intersection() and set_difference():
+   'other' has the same type as 'this', as does the result */
+static dang_boolean
+do_tree_set_op (DangValueTypeTree *ttype,
+                void             **args,
+                SetOp              op,
+                void              *rv_out,
+                DangError        **error)
+{
+  DangConstantTree *a, *b, *rv;
+  if (!get_this (ttype, args[0], &a, error)
+   || !get_this (ttype, args[1], &b, error)
+   || !merge_constant_trees (ttype->owner, op, a, b, &rv, error))
+    return FALSE;
+  if (ttype == &ttype->owner->types[0])
+    {
+      DangTree *out = dang_new (DangTree, 1);
+      out->ref_count = 1;
+      out->v = rv;
+      * (DangTree **) rv_out = out;
+    }
+  else
+    * (DangConstantTree **) rv_out = rv;
+  return TRUE;
+}
+static DANG_SIMPLE_C_FUNC_DECLARE (do_tree_set_union)
+{
+  return do_tree_set_op (func_data, args, SET_OP_UNION, rv_out, error);
+}
+static DANG_SIMPLE_C_FUNC_DECLARE (do_tree_set_intersection)
+{
+  return do_tree_set_op (func_data, args, SET_OP_INTERSECTION, rv_out, error);
+}
+static DANG_SIMPLE_C_FUNC_DECLARE (do_tree_set_difference)
+{
+  return do_tree_set_op (func_data, args, SET_OP_DIFFERENCE, rv_out, error);
+}
+
+/* make_from(keys, values) */
+static DANG_SIMPLE_C_FUNC_DECLARE (construct_mutable_tree_from_vectors)
+{
+  DangValueTypeTree *ttype = func_data;
+  DangVector *keys = * (DangVector **) args[0];
+  DangVector *values = * (DangVector **) args[1];
+  unsigned n_keys = keys ? keys->len : 0;
+  unsigned n_values = values ? values->len : 0;
+  DangTree *tree;
+  if (n_keys != n_values)
+    {
+      dang_set_error (error, "make_from: got %u keys but %u values",
+                      n_keys, n_values);
+      return FALSE;
+    }
+  tree = dang_new (DangTree, 1);
+  tree->ref_count = 1;
+  tree->v = dang_constant_tree_new_from_arrays (ttype, n_keys,
+                                                keys ? keys->data : NULL,
+                                                values ? values->data : NULL);
+  * (DangTree **) rv_out = tree;
+  return TRUE;
+}
+
+/* 'other' is NULL for methods without arguments */
+static void
+add_method (DangValueTypeTree *ttype,
+            const char        *name,
+            DangValueType     *rv_type,
+            DangValueType     *other,
+            DangSimpleCFunc    c_func)
+{
+  DangFunctionParam params[2];
+  DangSignature *sig;
+  DangFunction *func;
+  params[0].type = &ttype->base_type;
+  params[0].name = "this";
+  params[0].dir = DANG_FUNCTION_PARAM_IN;
+  params[1].type = other;
+  params[1].name = "other";
+  params[1].dir = DANG_FUNCTION_PARAM_IN;
+  sig = dang_signature_new (rv_type, other ? 2 : 1, params);
+  func = dang_function_new_simple_c (sig, c_func, ttype, NULL);
+  dang_value_type_add_constant_method (&ttype->base_type, name,
+                                       DANG_METHOD_FINAL|DANG_METHOD_PUBLIC,
+                                       func);
+  dang_function_unref (func);
+  dang_signature_unref (sig);
+}
+
 static DangValueTreeTypes *
 dang_value_tree_types (DangValueType *key,
                        DangValueType *value)
@@ -428,6 +1518,13 @@ dang_value_tree_types (DangValueType *key,
   align = DANG_MAX (DANG_ALIGNOF_POINTER, key->alignof_instance);
   align = DANG_MAX (align, value->alignof_instance);
   rv->node_size = DANG_ALIGN (rv->node_size, align);
+  rv->bnode_values_offset = sizeof (DangTreeBNode) + key->sizeof_instance * DANG_TREE_BNODE_MAX_KEYS;
+  rv->bnode_values_offset = DANG_ALIGN (rv->bnode_values_offset, value->alignof_instance);
+  rv->bnode_children_offset = rv->bnode_values_offset + value->sizeof_instance * DANG_TREE_BNODE_MAX_KEYS;
+  rv->bnode_children_offset = DANG_ALIGN (rv->bnode_children_offset, DANG_ALIGNOF_POINTER);
+  rv->bnode_leaf_size = rv->bnode_children_offset;
+  rv->bnode_internal_size = rv->bnode_children_offset
+                          + sizeof (DangTreeBNode *) * (DANG_TREE_BNODE_MAX_KEYS + 1);
 
   for (i = 0; i < 2; i++)
     {
@@ -478,7 +1575,7 @@ dang_value_tree_types (DangValueType *key,
   sig = dang_signature_new (&rv->types[0].base_type,
                             1, params);
   func = dang_function_new_simple_c (sig, constant_tree_to_mutable_tree, NULL, NULL);
-  dang_value_type_add_constant_method ((DangValueType *) &rv->types[0].base_type,
+  dang_value_type_add_constant_method ((DangValueType *) &rv->types[1].base_type,
                                        "make_tree",
                                        DANG_METHOD_FINAL|DANG_METHOD_PUBLIC,
                                        func);
@@ -495,17 +1592,43 @@ dang_value_tree_types (DangValueType *key,
   dang_signature_unref (sig);
   dang_function_unref (func);
 
+  params[0].type = dang_value_type_vector (key);
+  params[0].name = "keys";
+  params[0].dir = DANG_FUNCTION_PARAM_IN;
+  params[1].type = dang_value_type_vector (value);
+  params[1].name = "values";
+  params[1].dir = DANG_FUNCTION_PARAM_IN;
+  sig = dang_signature_new (&rv->types[0].base_type, 2, params);
+  func = dang_function_new_simple_c (sig, construct_mutable_tree_from_vectors, &rv->types[0], NULL);
+  dang_value_type_add_constant_method ((DangValueType *) &rv->types[0].base_type,
+                                       "make_from",
+                                       DANG_METHOD_FINAL|DANG_METHOD_PUBLIC|DANG_METHOD_STATIC,
+                                       func);
+  dang_signature_unref (sig);
+  dang_function_unref (func);
+
+  for (i = 0; i < 2; i++)
+    {
+      DangValueType *type = &rv->types[i].base_type;
+      add_method (&rv->types[i], "size", dang_value_type_uint32 (), NULL, do_tree_size);
+      add_method (&rv->types[i], "keys", dang_value_type_vector (key), NULL, do_tree_keys);
+      add_method (&rv->types[i], "values", dang_value_type_vector (value), NULL, do_tree_values);
+      add_method (&rv->types[i], "set_union", type, type, do_tree_set_union);
+      add_method (&rv->types[i], "set_intersection", type, type, do_tree_set_intersection);
+      add_method (&rv->types[i], "set_difference", type, type, do_tree_set_difference);
+    }
+
   if (key->init_assign)
     {
       if (value->init_assign)
         {
           rv->copy_tree_node = copy_tree_node__kv;
-          rv->destruct_tree_node = destruct_tree_node__kv;
+          rv->unref_tree_node = unref_tree_node__kv;
         }
       else
         {
           rv->copy_tree_node = copy_tree_node__k;
-          rv->destruct_tree_node = destruct_tree_node__k;
+          rv->unref_tree_node = unref_tree_node__k;
         }
     }
   else
@@ -513,12 +1636,12 @@ dang_value_tree_types (DangValueType *key,
       if (value->init_assign)
         {
           rv->copy_tree_node = copy_tree_node__v;
-          rv->destruct_tree_node = destruct_tree_node__v;
+          rv->unref_tree_node = unref_tree_node__v;
         }
       else
         {
           rv->copy_tree_node = copy_tree_node__none;
-          rv->destruct_tree_node = destruct_tree_node__none;
+          rv->unref_tree_node = unref_tree_node__none;
         }
     }
   return rv;
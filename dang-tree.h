@@ -1,6 +1,7 @@
 
 typedef struct _DangValueTypeTree DangValueTypeTree;
 typedef struct _DangTreeNode DangTreeNode;
+typedef struct _DangTreeBNode DangTreeBNode;
 typedef struct _DangConstantTree DangConstantTree;
 typedef struct _DangTree DangTree;
 
@@ -17,12 +18,18 @@ struct _DangValueTreeTypes
   unsigned value_offset;
   //DangValueType *node_type;
   unsigned node_size;
-  DangTreeNode *recycling_list;         /* connected by 'parent' */
 
-  void (*destruct_tree_node) (DangValueTreeTypes *, DangTreeNode *);
-  DangTreeNode *(*copy_tree_node) (DangValueTreeTypes *, DangTreeNode *, DangTreeNode *);
+  /* drop a reference to a node (and its subtrees) */
+  void (*unref_tree_node) (DangValueTreeTypes *, DangTreeNode *);
+  /* copy one node; the copy shares the node's subtrees */
+  DangTreeNode *(*copy_tree_node) (DangValueTreeTypes *, DangTreeNode *);
   DangFunction *constant_tree_set;
 
+  /* layout of DangTreeBNode */
+  unsigned bnode_values_offset;
+  unsigned bnode_children_offset;
+  unsigned bnode_leaf_size, bnode_internal_size;
+
   /* for the tree of tree-types */
   DangValueTreeTypes *parent,*left,*right;
   dang_boolean is_red;
@@ -31,20 +38,42 @@ struct _DangValueTreeTypes
 };
 
 
+/* The nodes form a left-leaning red-black tree.
+   They are reference-counted and shared between trees:
+   a node with ref_count > 1, or below such a node, is never modified;
+   instead the path to it is copied (see dang-tree.c). */
 struct _DangTreeNode
 {
-  unsigned is_red : 1;
-  unsigned is_defunct : 1;
-  unsigned visit_count : 30;
-  DangTreeNode *parent, *left, *right;
+  unsigned ref_count;
+  unsigned is_red;
+  DangTreeNode *left, *right;
 
   /* key and value follow */
 };
 
+/* Trees with more than dang_tree_btree_threshold entries
+   are converted to B-trees, whose nodes hold up to
+   DANG_TREE_BNODE_MAX_KEYS sorted keys, and are shared
+   and path-copied like the red-black nodes.
+   Every leaf is at the same depth. */
+#define DANG_TREE_BNODE_MIN_DEGREE      16
+#define DANG_TREE_BNODE_MAX_KEYS        (2 * DANG_TREE_BNODE_MIN_DEGREE - 1)
+struct _DangTreeBNode
+{
+  unsigned ref_count;
+  uint16_t n_keys;
+  uint16_t is_leaf;
+
+  /* DANG_TREE_BNODE_MAX_KEYS keys, then as many values,
+     then, unless is_leaf, DANG_TREE_BNODE_MAX_KEYS+1 children */
+};
+extern unsigned dang_tree_btree_threshold;
+
 struct _DangConstantTree
 {
   unsigned ref_count;
   DangTreeNode *top;
+  DangTreeBNode *btree_top;             /* if non-NULL, top is NULL */
   DangFunction *compare;		/* or NULL for default */
   unsigned size;
 };
@@ -64,3 +93,38 @@ void           dang_tree_insert     (DangValueTypeTree *tree_type,
                                      DangTree          *tree,
                                      const void        *key,
                                      const void        *value);
+
+/* Call 'func' on each entry, in order. */
+typedef void (*DangTreeForeachFunc) (const void *key,
+                                     const void *value,
+                                     void       *func_data);
+void           dang_constant_tree_foreach (DangValueTypeTree  *tree_type,
+                                           DangConstantTree   *tree,
+                                           DangTreeForeachFunc func,
+                                           void               *func_data);
+
+/* Build a tree from 'n' keys and values in O(n) if the keys are sorted,
+   sorting them first (in parallel, if there are many) if not.
+   Of equal keys, the last one's value is kept. */
+DangConstantTree *dang_constant_tree_new_from_arrays (DangValueTypeTree *tree_type,
+                                                      size_t             n,
+                                                      const void        *keys,
+                                                      const void        *values);
+
+/* Set operations, merging the entries of 'a' and 'b' in order.
+   Either tree may be NULL if empty. */
+dang_boolean   dang_constant_tree_union        (DangValueTypeTree *tree_type,
+                                                DangConstantTree  *a,
+                                                DangConstantTree  *b,
+                                                DangConstantTree **rv_out,
+                                                DangError        **error);
+dang_boolean   dang_constant_tree_intersection (DangValueTypeTree *tree_type,
+                                                DangConstantTree  *a,
+                                                DangConstantTree  *b,
+                                                DangConstantTree **rv_out,
+                                                DangError        **error);
+dang_boolean   dang_constant_tree_difference   (DangValueTypeTree *tree_type,
+                                                DangConstantTree  *a,
+                                                DangConstantTree  *b,
+                                                DangConstantTree **rv_out,
+                                                DangError        **error);
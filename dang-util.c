@@ -4,8 +4,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
 #include "dang.h"
 
+dang_boolean dang_is_threaded = FALSE;
+
 static void out_of_memory (void)
 {
   fprintf (stderr, "error: out of memory!\n\n");
@@ -323,14 +326,7 @@ dang_util_hex_escape_inplace (char *out,
 /* --- strings --- */
 DangString *dang_string_new  (const char *str)
 {
-  DangString *rv;
-  unsigned len = strlen (str);
-  rv = dang_malloc (sizeof (DangString) + len + 1);
-  rv->ref_count = 1;
-  rv->len = len;
-  rv->str = (char *)(rv+1);
-  memcpy (rv->str, str, rv->len + 1);
-  return rv;
+  return dang_string_new_len (str, strlen (str));
 }
 DangString *dang_string_new_raw  (unsigned len)
 {
@@ -340,6 +336,8 @@ DangString *dang_string_new_raw  (unsigned len)
   rv->len = len;
   rv->str = (char *)(rv+1);
   rv->str[len] = 0;
+  rv->hash = 0;
+  rv->is_interned = FALSE;
   return rv;
 }
 
@@ -351,19 +349,196 @@ DangString *dang_string_new_len  (const char *str,
   return rv;
 }
 
+/* --- interned strings ---
+ *
+ * The table does not hold references:  an interned string
+ * removes itself from the table when its last reference is dropped.
+ * With several workers, the table, and the last unref
+ * of each interned string, are serialized by intern_lock,
+ * so that a lookup cannot find a string that is being freed.
+ */
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+static DangString **intern_table = NULL;        /* open-addressed */
+static unsigned intern_table_size = 0;          /* a power of two */
+static unsigned intern_count = 0;
+
+static void
+intern_table_insert (DangString *str)
+{
+  unsigned mask = intern_table_size - 1;
+  unsigned i;
+  for (i = str->hash & mask; intern_table[i] != NULL; i = (i + 1) & mask)
+    ;
+  intern_table[i] = str;
+}
+
+static void
+intern_table_remove (DangString *str)
+{
+  unsigned mask = intern_table_size - 1;
+  unsigned i, j;
+  for (i = str->hash & mask; intern_table[i] != str; i = (i + 1) & mask)
+    ;
+  /* move the rest of the cluster back, so that it stays reachable */
+  for (j = (i + 1) & mask; intern_table[j] != NULL; j = (j + 1) & mask)
+    {
+      unsigned home = intern_table[j]->hash & mask;
+      if (((j - home) & mask) >= ((j - i) & mask))
+        {
+          intern_table[i] = intern_table[j];
+          i = j;
+        }
+    }
+  intern_table[i] = NULL;
+  intern_count--;
+}
+
+static DangString *
+intern_locked (DangString *str)
+{
+  unsigned mask, i;
+  DangString *rv;
+
+  if (intern_table_size != 0)
+    {
+      mask = intern_table_size - 1;
+      for (i = str->hash & mask; (rv = intern_table[i]) != NULL; i = (i + 1) & mask)
+        if (rv->hash == str->hash
+         && rv->len == str->len
+         && memcmp (rv->str, str->str, str->len) == 0)
+          {
+            DANG_REF_COUNT_INC (rv->ref_count);
+            return rv;
+          }
+    }
+
+  if ((intern_count + 1) * 2 > intern_table_size)
+    {
+      DangString **old_table = intern_table;
+      unsigned old_size = intern_table_size;
+      intern_table_size = old_size ? old_size * 2 : 64;
+      intern_table = dang_new0 (DangString *, intern_table_size);
+      for (i = 0; i < old_size; i++)
+        if (old_table[i] != NULL)
+          intern_table_insert (old_table[i]);
+      dang_free (old_table);
+    }
+
+  /* Only a string no one else refers to can be marked interned in place,
+     since its last unref must go through the lock. */
+  if (str->ref_count == 1)
+    rv = dang_string_ref (str);
+  else
+    {
+      rv = dang_string_new_len (str->str, str->len);
+      rv->hash = str->hash;
+    }
+  rv->is_interned = TRUE;
+  intern_table_insert (rv);
+  intern_count++;
+  return rv;
+}
+
+DangString *
+dang_string_intern (DangString *str)
+{
+  DangString *rv;
+  if (str->is_interned)
+    return str;
+  dang_string_hash (str);
+  if (DANG_UNLIKELY (dang_is_threaded))
+    {
+      pthread_mutex_lock (&intern_lock);
+      rv = intern_locked (str);
+      pthread_mutex_unlock (&intern_lock);
+    }
+  else
+    rv = intern_locked (str);
+  dang_string_unref (str);
+  return rv;
+}
+
+DangString *
+dang_string_new_interned (const char *str)
+{
+  return dang_string_intern (dang_string_new (str));
+}
+
+static void
+unref_interned (DangString *str)
+{
+  if (DANG_UNLIKELY (dang_is_threaded))
+    {
+      /* drop references other than the last without the lock */
+      unsigned rc = __atomic_load_n (&str->ref_count, __ATOMIC_RELAXED);
+      while (rc > 1)
+        if (__atomic_compare_exchange_n (&str->ref_count, &rc, rc - 1, FALSE,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+          return;
+      pthread_mutex_lock (&intern_lock);
+      if (DANG_REF_COUNT_DEC (str->ref_count) == 0)
+        intern_table_remove (str);
+      else
+        str = NULL;
+      pthread_mutex_unlock (&intern_lock);
+      if (str != NULL)
+        dang_free (str);
+    }
+  else if (--(str->ref_count) == 0)
+    {
+      intern_table_remove (str);
+      dang_free (str);
+    }
+}
+
 /*DangString *dang_string_new_printf (const char *str, ...) DANG_GNUC_PRINTF(1,2);*/
 void        dang_string_unref(DangString *str)
 {
   //dang_warning ("dang_string_unref: %p:%u: %s", str,str->ref_count,str->str);
-  if (--(str->ref_count) == 0)
+  if (str->is_interned)
+    unref_interned (str);
+  else if (DANG_REF_COUNT_DEC (str->ref_count) == 0)
     dang_free (str);
 }
 DangString *dang_string_ref  (DangString *str)
 {
   //dang_warning ("dang_string_ref: %p:%u: %s", str,str->ref_count,str->str);
-  ++(str->ref_count);
+  DANG_REF_COUNT_INC (str->ref_count);
   return str;
 }
+
+/* Compare the lengths, and the hashes if both are known,
+   before the bytes. */
+dang_boolean
+dang_strings_equal (DangString *a,
+                    DangString *b)
+{
+  uint32_t ha, hb;
+  if (a == b)
+    return TRUE;
+  if (a->len != b->len
+   || (a->is_interned && b->is_interned))
+    return FALSE;
+  ha = __atomic_load_n (&a->hash, __ATOMIC_RELAXED);
+  hb = __atomic_load_n (&b->hash, __ATOMIC_RELAXED);
+  if (ha != 0 && hb != 0 && ha != hb)
+    return FALSE;
+  return memcmp (a->str, b->str, a->len) == 0;
+}
+
+/* Strings are immutable once shared, so racing threads
+   can only store the same hash. */
+uint32_t
+dang_string_hash (DangString *str)
+{
+  uint32_t hash = __atomic_load_n (&str->hash, __ATOMIC_RELAXED);
+  if (hash == 0)
+    {
+      hash = dang_util_binary_data_hash (str->len, (const uint8_t *) str->str);
+      __atomic_store_n (&str->hash, hash, __ATOMIC_RELAXED);
+    }
+  return hash;
+}
 /* for debugging, copy the string when debugging, ref-count otherwise */
 DangString *dang_string_ref_copy  (DangString *str)
 {
@@ -371,7 +546,7 @@ DangString *dang_string_ref_copy  (DangString *str)
   str = dang_string_new (str->str);
   //dang_warning ("dang_string_ref_copy: %p:%u: %s", str,str->ref_count,str->str);
 #else
-  ++(str->ref_count);
+  DANG_REF_COUNT_INC (str->ref_count);
 #endif
   return str;
 }
@@ -382,10 +557,7 @@ DangString *dang_strings_concat (unsigned N,
   DangString *rv;
   for (i = 0; i < N; i++)
     len += strs[i] ? strs[i]->len : 0;
-  rv = dang_malloc (sizeof (DangString) + len + 1);
-  rv->ref_count = 1;
-  rv->len = len;
-  rv->str = (char *)(rv+1);
+  rv = dang_string_new_raw (len);
 
   len = 0;
   for (i = 0; i < N; i++)
@@ -415,8 +587,8 @@ DangString *dang_string_joinv (DangString *delim,
       char *at;
       for (i = 1; i < N; i++)
         len += (strs[i] ? strs[i]->len : 0) + dlen;
-      rv = dang_malloc (sizeof (DangString) + len + 1);
-      at = (char*)(rv + 1);
+      rv = dang_string_new_raw (len);
+      at = rv->str;
       if (strs[0])
         {
           memcpy (at, strs[0]->str, strs[0]->len);
@@ -432,10 +604,6 @@ DangString *dang_string_joinv (DangString *delim,
               at += strs[i]->len;
             }
         }
-      *at = 0;
-      rv->ref_count = 1;
-      rv->len = len;
-      rv->str = (char *)(rv+1);
       return rv;
     }
 }
@@ -443,8 +611,8 @@ DangString *dang_string_joinv (DangString *delim,
 DangString *dang_string_peek_boolean (dang_boolean b)
 {
   static DangString strs[2] = {
-    { 1, 5, "false" },
-    { 1, 4, "true" }
+    { 1, 5, "false", 0, FALSE },
+    { 1, 4, "true", 0, FALSE }
   };
   return &strs[b ? 1 : 0];
 }
@@ -539,7 +707,7 @@ DangBinaryData *dang_binary_data_new  (unsigned        len,
 DangBinaryData *dang_binary_data_ref  (DangBinaryData *bd)
 {
   DANG_BINARY_DATA_FUNC_DEBUG ("dang_binary_data_ref", bd);
-  ++(bd->ref_count);
+  DANG_REF_COUNT_INC (bd->ref_count);
   return bd;
 }
 /* for debugging, copy the string when debugging, ref-count otherwise */
@@ -549,14 +717,14 @@ DangBinaryData *dang_binary_data_ref_copy  (DangBinaryData *bd)
 #if defined(DANG_DEBUG)
   bd = dang_binary_data_new (bd->len, DANG_BINARY_DATA_PEEK_DATA (bd));
 #else
-  ++(bd->ref_count);
+  DANG_REF_COUNT_INC (bd->ref_count);
 #endif
   return bd;
 }
 void dang_binary_data_unref  (DangBinaryData *bd)
 {
   DANG_BINARY_DATA_FUNC_DEBUG ("dang_binary_data_unref", bd);
-  if (--(bd->ref_count) == 0)
+  if (DANG_REF_COUNT_DEC (bd->ref_count) == 0)
     dang_free (bd);
 }
 
@@ -720,13 +888,13 @@ dang_error_add_pos_suffix (DangError *error,
 
 DangError *dang_error_ref        (DangError  *error)
 {
-  ++(error->ref_count);
+  DANG_REF_COUNT_INC (error->ref_count);
   return error;
 }
 
 void       dang_error_unref      (DangError  *error)
 {
-  if (--(error->ref_count) == 0)
+  if (DANG_REF_COUNT_DEC (error->ref_count) == 0)
     {
       dang_free (error->message);
       dang_free (error->backtrace);
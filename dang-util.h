@@ -19,6 +19,18 @@ typedef int dang_boolean;
 #define DANG_UINT_TO_POINTER(i)   ((void*)(size_t)(unsigned)(i))
 #define DANG_POINTER_TO_UINT(i)   ((unsigned)(size_t)(i))
 
+/* Reference-counts of values that may be shared between the
+   workers of a DangScheduler (see dang-scheduler.h).
+   Once a scheduler has started, they are updated atomically.
+   Both macros evaluate to the new count. */
+extern dang_boolean dang_is_threaded;
+#define DANG_REF_COUNT_INC(rc)                                          \
+  (DANG_UNLIKELY (dang_is_threaded)                                     \
+   ? __atomic_add_fetch (&(rc), 1, __ATOMIC_RELAXED) : ++(rc))
+#define DANG_REF_COUNT_DEC(rc)                                          \
+  (DANG_UNLIKELY (dang_is_threaded)                                     \
+   ? __atomic_sub_fetch (&(rc), 1, __ATOMIC_ACQ_REL) : --(rc))
+
 /* DANG_GNUC_PRINTF(format_idx,arg_idx): Advise the compiler
  * that the arguments should be like printf(3); it may
  * optionally print type warnings.  */
@@ -107,6 +119,8 @@ struct _DangString
   unsigned ref_count;
   unsigned len;
   char *str;
+  uint32_t hash;                /* see dang_string_hash(); 0 until computed */
+  dang_boolean is_interned;
 };
 DangString *dang_string_new  (const char *str);
 DangString *dang_string_new_len  (const char *str,
@@ -115,6 +129,18 @@ DangString *dang_string_new_len  (const char *str,
 void        dang_string_unref(DangString *);
 DangString *dang_string_ref  (DangString *);
 
+/* the hash of the contents, cached in the string */
+uint32_t    dang_string_hash (DangString *str);
+dang_boolean dang_strings_equal (DangString *a,
+                                 DangString *b);
+
+/* Interned strings are unique:  two interned strings are equal
+   only if they are the same object.
+   dang_string_intern() takes over the reference to 'str'
+   and returns a reference to the interned string equal to it. */
+DangString *dang_string_intern        (DangString *str);
+DangString *dang_string_new_interned  (const char *str);
+
 
 /* for debugging, copy the string when debugging, ref-count otherwise */
 DangString *dang_string_ref_copy  (DangString *);
@@ -482,7 +482,12 @@ static DANG_VALUE_COMPARE_FUNC_DECLARE(string_compare)
   else if (sb == NULL)
     return 1;
   else
-    return strcmp (sa->str, sb->str);
+    {
+      int rv = memcmp (sa->str, sb->str, DANG_MIN (sa->len, sb->len));
+      if (rv != 0)
+        return rv;
+      return (sa->len < sb->len) ? -1 : (sa->len > sb->len) ? 1 : 0;
+    }
 }
 static DANG_VALUE_HASH_FUNC_DECLARE(string_hash)
 {
@@ -490,7 +495,7 @@ static DANG_VALUE_HASH_FUNC_DECLARE(string_hash)
   DANG_UNUSED (type);
   if (sa == NULL)
     return 0;
-  return dang_str_hash (sa->str);
+  return dang_string_hash (sa);
 }
 static DANG_VALUE_EQUAL_FUNC_DECLARE(string_equal)
 {
@@ -501,7 +506,7 @@ static DANG_VALUE_EQUAL_FUNC_DECLARE(string_equal)
     return TRUE;
   if (sa == NULL || sb == NULL)
     return FALSE;
-  return strcmp (sa->str, sb->str) == 0;
+  return dang_strings_equal (sa, sb);
 }
 static char *
 string_to_string (DangValueType *type,
@@ -737,6 +742,20 @@ dang_value_init_assign (DangValueType *type,
   else
     memcpy (dst, src, type->sizeof_instance);
 }
+/* Like dang_value_init_assign(), but strings are interned,
+   so that looking up an interned string finds the key by pointer. */
+void
+dang_value_init_assign_key (DangValueType *type,
+                            void *dst,
+                            const void *src)
+{
+  DangString *str;
+  if (type == dang_value_type_string ()
+   && (str = * (DangString * const *) src) != NULL)
+    * (DangString **) dst = dang_string_intern (dang_string_ref (str));
+  else
+    dang_value_init_assign (type, dst, src);
+}
 void
 dang_value_destroy (DangValueType *type,
                     void *dst)
@@ -154,6 +154,10 @@ void dang_value_init_assign (DangValueType *type,
 void dang_value_assign      (DangValueType *type,
                              void          *dst,
                              const void    *src);
+/* for the keys of trees and hashes */
+void dang_value_init_assign_key (DangValueType *type,
+                                 void          *dst,
+                                 const void    *src);
 void dang_value_destroy     (DangValueType *type,
                              void          *value);
 
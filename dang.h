@@ -52,7 +52,11 @@ typedef unsigned DangVarId;
 #include "dang-union.h"
 #include "dang-object.h"
 #include "dang-tree.h"
+#include "dang-hash.h"
+#include "dang-profile.h"
 #include "dang-thread.h"
+#include "dang-scheduler.h"
+#include "dang-event-loop.h"
 #include "dang-template.h"
 #include "dang-token.h"
 #include "dang-tokenizer.h"
@@ -69,7 +73,11 @@ typedef unsigned DangVarId;
 
 /* addons */
 #include "dang-tensor.h"
+#include "dang-tensor-kernels.h"
 #include "dang-array.h"
+#include "dang-spawn.h"
+#include "dang-channel.h"
+#include "dang-io.h"
 
 /* misc */
 #include "dang-cleanup.h"
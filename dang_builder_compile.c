@@ -15,12 +15,21 @@ static dang_boolean check__labels_targetted (DangBuilder *builder, DangError **)
 static dang_boolean check__variables (DangBuilder *builder, DangError **);
 static void add_inits_and_destructs (DangBuilder *builder);
 
+/* Whether the function may run on several threads at once:
+   see dang_function_is_pure(). */
+static dang_boolean check__is_pure (DangBuilder *builder);
+
 /* Allocate the locations of the return-value and
    parameters to this function. */
 static void
 allocate_stack__rv_and_params (Builder *builder,
                                unsigned *first_offset_out);
 
+/* Shorten the live ranges of plain-data variables
+   to end at their last use. */
+static void
+allocate_stack__narrow_live_ranges (Builder *builder);
+
 /* Allocate all the other variables for this function,
    (except variables which are merely aliases into
    other variebles). */
@@ -42,6 +51,9 @@ init_stack_infos__file_info (Builder *builder,
 
 #if DANG_DEBUG
 static void dump_insns (Builder *builder);
+static void report_frame_size (Builder *builder,
+                               unsigned first_offset,
+                               unsigned frame_size);
 #endif
 
 /* Function: dang_builder_compile
@@ -63,7 +75,7 @@ dang_builder_compile    (DangBuilder *builder,
   unsigned i;
   unsigned n_vars;
   Variable *vars;
-  unsigned frame_size;
+  unsigned frame_size, params_end;
   unsigned at, param_at;
   unsigned n_stack_info_vars;
   unsigned n_stack_info_params;
@@ -87,14 +99,21 @@ dang_builder_compile    (DangBuilder *builder,
   //fprintf(stderr, "BEFORE INITS AND DESTRUCTS\n"); dump_insns (builder);
   add_inits_and_destructs (builder);
   //fprintf(stderr, "AFTER INITS AND DESTRUCTS\n"); dump_insns (builder);
+  dang_builder_optimize (builder);
 #if DANG_DEBUG
   if (dang_debug_disassemble)
     dump_insns (builder);
 #endif
 
   allocate_stack__rv_and_params (builder, &frame_size);
+  params_end = frame_size;
+  allocate_stack__narrow_live_ranges (builder);
   allocate_stack__first_fit (builder, &frame_size);
   allocate_stack__aliases (builder);
+#if DANG_DEBUG
+  if (dang_debug_frame_sizes)
+    report_frame_size (builder, params_end, frame_size);
+#endif
 
   n_steps = builder->insns.len;
   steps = builder->insns.data;
@@ -107,7 +126,7 @@ dang_builder_compile    (DangBuilder *builder,
   DANG_UTIL_ARRAY_INIT (&context.label_fixups, DangInsnLabelFixup);
   DANG_UTIL_ARRAY_INIT (&context.destroys, DangInsnDestroy);
   labels = builder->labels.data;
-  final_step_offsets = dang_new (unsigned, n_steps);
+  final_step_offsets = dang_new (unsigned, n_steps + 1);
   context.n_vars = builder->vars.len;
   context.vars = builder->vars.data;
   context.labels = builder->labels.data;
@@ -116,6 +135,7 @@ dang_builder_compile    (DangBuilder *builder,
       final_step_offsets[i] = context.step_data.len;
       dang_insn_pack (steps + i, &context);
     }
+  final_step_offsets[n_steps] = context.step_data.len;   /* for catch block ends */
 #define GET_FINAL_STEP(step_num)      \
             (DangStep *) ((char*)context.step_data.data + final_step_offsets[(step_num)])
   for (i = 0; i < context.label_fixups.len; i++)
@@ -159,6 +179,7 @@ dang_builder_compile    (DangBuilder *builder,
         stack_info->vars[at].type = vars[i].type;
         at++;
       }
+  dang_function_stack_info_init_live_ranges (stack_info);
   stack_info->n_catch_blocks = builder->catch_blocks.len;
   stack_info->catch_blocks = dang_new (DangCatchBlock, builder->catch_blocks.len);
   src_catch_blocks = builder->catch_blocks.data;
@@ -198,6 +219,7 @@ dang_builder_compile    (DangBuilder *builder,
   rv.base.frame_size = frame_size;
   rv.base.steps = stack_info->first_step;
   rv.base.is_owned = builder->function->base.is_owned;
+  rv.is_pure = check__is_pure (builder);
   rv.n_destroy = context.destroys.len;
   rv.destroy = dang_new (DangFunctionDangDestruct, rv.n_destroy);
   for (i = 0; i < context.destroys.len; i++)
@@ -256,6 +278,132 @@ allocate_stack__rv_and_params (Builder *builder,
   *first_offset_out = offset;
 }
 
+/* Computing live ranges. */
+typedef struct
+{
+  DangStepNum *last_use;
+  DangStepNum step;
+} NoteUseData;
+static void
+note_var_use (DangInsn      *insn,
+              DangVarId      var,
+              DangInsnValue *value,
+              void          *data)
+{
+  NoteUseData *nud = data;
+  DANG_UNUSED (insn);
+  DANG_UNUSED (value);
+  nud->last_use[var] = nud->step;
+}
+
+typedef struct
+{
+  DangStepNum from, to;
+} Edge;
+
+/* A variable whose type has no constructor or destructor
+   is dead after its last use, unless a jump from later on
+   returns to a step where it is live:  such a variable's
+   range is ended just after the last use (or after the latest
+   source of such a jump) so that its slot may be shared.
+
+   Parameters, aliases, containers of aliases and
+   catch variables keep their scoped ranges. */
+static void
+allocate_stack__narrow_live_ranges (Builder *builder)
+{
+  unsigned n_vars = builder->vars.len;
+  Variable *vars = builder->vars.data;
+  unsigned n_insns = builder->insns.len;
+  DangInsn *insns = builder->insns.data;
+  Label *labels = builder->labels.data;
+  DangBuilderCatchBlock *catch_blocks = builder->catch_blocks.data;
+  DangStepNum *last_use = dang_new (DangStepNum, n_vars);
+  NoteUseData nud;
+  dang_boolean *keep = dang_new0 (dang_boolean, n_vars);
+  DangUtilArray edges = DANG_UTIL_ARRAY_STATIC_INIT (Edge);
+  Edge edge;
+  unsigned i, j;
+
+  nud.last_use = last_use;
+  for (i = 0; i < n_vars; i++)
+    {
+      last_use[i] = DANG_STEP_NUM_INVALID;
+      if (vars[i].container != DANG_VAR_ID_INVALID)
+        {
+          keep[i] = TRUE;
+          keep[vars[i].container] = TRUE;
+        }
+    }
+
+  for (i = 0; i < n_insns; i++)
+    {
+      DangLabelId target = DANG_LABEL_ID_INVALID;
+      nud.step = i;
+      dang_insn_foreach_var (insns + i, note_var_use, &nud);
+      if (insns[i].type == DANG_INSN_TYPE_JUMP)
+        target = insns[i].jump.target;
+      else if (insns[i].type == DANG_INSN_TYPE_JUMP_CONDITIONAL)
+        target = insns[i].jump_conditional.target;
+      else if (insns[i].type == DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED)
+        target = insns[i].run_simple_c_fused.target;
+      if (target != DANG_LABEL_ID_INVALID)
+        {
+          edge.from = i;
+          edge.to = labels[target].target;
+          dang_util_array_append (&edges, 1, &edge);
+        }
+    }
+
+  /* A throw anywhere in a catch block may land
+     at one of its clauses. */
+  for (i = 0; i < builder->catch_blocks.len; i++)
+    for (j = 0; j < catch_blocks[i].n_clauses; j++)
+      {
+        keep[catch_blocks[i].clauses[j].var_id] = TRUE;
+        edge.from = catch_blocks[i].end;
+        edge.to = labels[catch_blocks[i].clauses[j].target].target;
+        dang_util_array_append (&edges, 1, &edge);
+      }
+
+  for (i = 0; i < n_vars; i++)
+    {
+      DangStepNum end;
+      dang_boolean changed;
+      if (keep[i]
+       || vars[i].is_param
+       || vars[i].offset != 0
+       || vars[i].end == DANG_STEP_NUM_INVALID
+       || vars[i].type->init_assign != NULL
+       || vars[i].type->destruct != NULL)
+        continue;
+      if (last_use[i] == DANG_STEP_NUM_INVALID || last_use[i] < vars[i].start)
+        end = vars[i].start + 1;
+      else
+        end = last_use[i] + 1;
+      if (end >= vars[i].end)
+        continue;
+      do
+        {
+          Edge *e = edges.data;
+          changed = FALSE;
+          for (j = 0; j < edges.len; j++)
+            if (vars[i].start < e[j].to && e[j].to <= end
+             && end <= e[j].from)
+              {
+                end = DANG_MIN (e[j].from + 1, vars[i].end);
+                changed = TRUE;
+              }
+        }
+      while (changed && end < vars[i].end);
+      vars[i].end = end;
+    }
+
+  dang_util_array_clear (&edges);
+  dang_free (keep);
+  dang_free (last_use);
+}
+
 /* Assign offsets to variables. */
 typedef struct 
 {
@@ -341,7 +489,7 @@ allocate_stack__first_fit (Builder *builder,
         dang_boolean did_allocation = FALSE;
         DangValueType *type = actions[i].var->type;
         for (f = 0; f < free_blocks.len; f++)
-          if (free_block_accomodates (tmp_fbs, type, &offset))
+          if (free_block_accomodates (tmp_fbs + f, type, &offset))
             {
               unsigned size = type->sizeof_instance;
               dang_boolean at_start = offset == 0;
@@ -365,7 +513,7 @@ allocate_stack__first_fit (Builder *builder,
                 {
                   FreeBlock new;
                   new.start = tmp_fbs[f].start + offset + size;
-                  new.size = tmp_fbs[f].start - offset - size;
+                  new.size = tmp_fbs[f].size - offset - size;
                   tmp_fbs[f].size = offset;
                   dang_util_array_insert (&free_blocks, 1, &new, f+1);
                 }
@@ -375,8 +523,21 @@ allocate_stack__first_fit (Builder *builder,
 
         if (!did_allocation)
           {
-            /* Need to extend the stack. */
-            unsigned off = DANG_ALIGN (*frame_size_inout, type->alignof_instance);
+            /* Need to extend the stack.  If the last free block
+               runs up to the end of the frame, start in it. */
+            unsigned off;
+            if (free_blocks.len > 0
+             && tmp_fbs[free_blocks.len-1].start + tmp_fbs[free_blocks.len-1].size == *frame_size_inout)
+              {
+                unsigned last = free_blocks.len - 1;
+                off = DANG_ALIGN (tmp_fbs[last].start, type->alignof_instance);
+                if (off == tmp_fbs[last].start)
+                  dang_util_array_remove (&free_blocks, last, 1);
+                else
+                  tmp_fbs[last].size = off - tmp_fbs[last].start;
+              }
+            else
+              off = DANG_ALIGN (*frame_size_inout, type->alignof_instance);
             actions[i].var->offset = off;
             *frame_size_inout = off + type->sizeof_instance;
           }
@@ -443,6 +604,31 @@ allocate_stack__first_fit (Builder *builder,
   dang_util_array_clear (&free_blocks);
 }
 
+#if DANG_DEBUG
+/* Print the frame size next to the size it would have
+   without slot sharing: every variable laid out after the other. */
+static void
+report_frame_size (Builder *builder,
+                   unsigned first_offset,
+                   unsigned frame_size)
+{
+  Variable *vars = builder->vars.data;
+  DangInsn *insns = builder->insns.data;
+  unsigned unshared = first_offset;
+  unsigned i;
+  for (i = 0; i < builder->vars.len; i++)
+    if (vars[i].container == DANG_VAR_ID_INVALID && !vars[i].is_param)
+      unshared = DANG_ALIGN (unshared, vars[i].type->alignof_instance)
+               + vars[i].type->sizeof_instance;
+  fprintf (stderr, "frame-size: %s:%u: %u bytes; %u without slot sharing\n",
+           builder->insns.len > 0 && insns[0].base.cp.filename
+             ? insns[0].base.cp.filename->str : "(unknown)",
+           builder->insns.len > 0 ? insns[0].base.cp.line : 0,
+           frame_size, unshared);
+  dang_debug_note_frame_size (frame_size, unshared);
+}
+#endif
+
 static void
 allocate_stack__aliases (Builder *builder)
 {
@@ -631,10 +817,81 @@ check__variables (DangBuilder *builder,
   return TRUE;
 }
 
+/* A value that outlives the frame: a global, or something reached
+   through a pointer (an object member, say). */
+static inline dang_boolean
+is_shared_value (DangInsnValue *value)
+{
+  return value->location == DANG_INSN_LOCATION_GLOBAL
+      || value->location == DANG_INSN_LOCATION_POINTER;
+}
+
+/* Whether a simple-c call may have effects outside the frame:
+   the function is not marked pure, or it writes an output parameter
+   (or its return-value) into a shared value. */
+static dang_boolean
+simple_c_call_has_effects (DangFunction  *func,
+                        DangInsnValue *args)
+{
+  DangSignature *sig = func->base.sig;
+  unsigned i;
+  if (!func->simple_c.is_pure)
+    return TRUE;
+  if (sig->return_type != NULL && sig->return_type != dang_value_type_void ())
+    {
+      if (is_shared_value (args))
+        return TRUE;
+      args++;
+    }
+  for (i = 0; i < sig->n_params; i++)
+    if (sig->params[i].dir != DANG_FUNCTION_PARAM_IN
+     && is_shared_value (args + i))
+      return TRUE;
+  return FALSE;
+}
+
+/* A function is pure if it makes no calls (which might yield
+   or have effects of their own) and writes nothing but its own frame.
+   Simple-c functions cannot yield; those marked pure
+   only write their output parameters. */
+static dang_boolean
+check__is_pure (DangBuilder *builder)
+{
+  DangInsn *insns = builder->insns.data;
+  unsigned i;
+  for (i = 0; i < builder->insns.len; i++)
+    switch (insns[i].type)
+      {
+      case DANG_INSN_TYPE_FUNCTION_CALL:
+        return FALSE;
+      case DANG_INSN_TYPE_ASSIGN:
+        if (is_shared_value (&insns[i].assign.target))
+          return FALSE;
+        break;
+      case DANG_INSN_TYPE_INDEX:
+        if (insns[i].index.is_set)
+          return FALSE;
+        break;
+      case DANG_INSN_TYPE_RUN_SIMPLE_C:
+        if (simple_c_call_has_effects (insns[i].run_simple_c.func,
+                                    insns[i].run_simple_c.args))
+          return FALSE;
+        break;
+      case DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED:
+        if (simple_c_call_has_effects (insns[i].run_simple_c_fused.func,
+                                    insns[i].run_simple_c_fused.args))
+          return FALSE;
+        break;
+      default:
+        break;
+      }
+  return TRUE;
+}
+
 /* Modify JUMP, JUMP_CONDITIONAL, RETURN
    to add INIT and DESTRUCT operations as needed.
 
-   Fix up Variables and Labels. */
+   Fix up Variables, Labels and catch blocks. */
 typedef struct _VarFixupInsertion VarFixupInsertion;
 struct _VarFixupInsertion
 {
@@ -843,6 +1100,14 @@ static void add_inits_and_destructs (DangBuilder *builder)
   for (i = 0; i < builder->vars.len; i++)
     renumber_var ((DangBuilderVariable*)builder->vars.data + i,
                     fixups.len, fixups.data);
+
+  /* Renumber the catch blocks */
+  for (i = 0; i < builder->catch_blocks.len; i++)
+    {
+      DangBuilderCatchBlock *cb = (DangBuilderCatchBlock*)builder->catch_blocks.data + i;
+      renumber_step (&cb->start, fixups.len, fixups.data);
+      renumber_step (&cb->end, fixups.len, fixups.data);
+    }
   for (j = 0; j < fixups.len; j++)
     {
       VarFixupInsertion *fixup = (VarFixupInsertion*)fixups.data + (fixups.len - 1 - j);
@@ -890,6 +1155,9 @@ dump_insns (Builder *builder)
       add_label_step_pair (builder, &lab_step_pairs, steps[i].jump.target);
     else if (steps[i].type == DANG_INSN_TYPE_JUMP_CONDITIONAL)
       add_label_step_pair (builder, &lab_step_pairs, steps[i].jump_conditional.target);
+    else if (steps[i].type == DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED
+          && steps[i].run_simple_c_fused.target != DANG_LABEL_ID_INVALID)
+      add_label_step_pair (builder, &lab_step_pairs, steps[i].run_simple_c_fused.target);
   if (lab_step_pairs.len > 0)
     {
       LabelStepPair *arr;
@@ -912,8 +1180,27 @@ dump_insns (Builder *builder)
   LabelStepPair *pairs = lab_step_pairs.data;
   unsigned n_pairs = lab_step_pairs.len;
   unsigned pairs_at = 0;
-  for (i = 0; i < n_steps; i++)
+  for (i = 0; i <= n_steps; i++)
     {
+      DangBuilderCatchBlock *catch_blocks = builder->catch_blocks.data;
+      unsigned j, k;
+      for (j = 0; j < builder->catch_blocks.len; j++)
+        if (catch_blocks[j].end == i && catch_blocks[j].start != i)
+          {
+            dang_string_buffer_printf (&buf, "END_TRY$%u:", j);
+            for (k = 0; k < catch_blocks[j].n_clauses; k++)
+              dang_string_buffer_printf (&buf, " %s -> LABEL$%u",
+                                         catch_blocks[j].clauses[k].type
+                                         ? catch_blocks[j].clauses[k].type->full_name
+                                         : "*",
+                                         catch_blocks[j].clauses[k].target);
+            dang_string_buffer_append (&buf, "\n");
+          }
+      for (j = 0; j < builder->catch_blocks.len; j++)
+        if (catch_blocks[j].start == i && catch_blocks[j].end != i)
+          dang_string_buffer_printf (&buf, "TRY$%u:\n", j);
+      if (i == n_steps)
+        break;
       while (pairs_at < n_pairs && pairs[pairs_at].step == i)
         {
           if (labels[pairs[pairs_at].label].name)
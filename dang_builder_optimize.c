@@ -0,0 +1,904 @@
+#include <string.h>
+#include "dang.h"
+
+typedef DangBuilder         Builder;
+typedef DangBuilderVariable Variable;
+typedef DangBuilderLabel    Label;
+
+unsigned dang_builder_optimize_flags = DANG_BUILDER_OPTIMIZE_DEFAULT;
+
+#define MAX_FOLD_PASSES         4
+
+/* === Removing instructions === */
+
+/* Remove the instructions whose 'remove' flag is set.
+   The removed instructions must already have been destructed.
+
+   If 'merged', the removed instructions were merged into
+   the preceding instruction that was kept, and step numbers
+   that referred to them are mapped to it.
+   Otherwise they were simply deleted:  labels, the starts of
+   catch blocks and variable ends are mapped to the following
+   instruction, and variable starts and catch block ends
+   to the preceding one, so that no variable's range shrinks
+   and no catch block grows. */
+static void
+remove_insns (Builder *builder,
+              const dang_boolean *remove,
+              dang_boolean merged)
+{
+  unsigned n = builder->insns.len;
+  DangInsn *insns = builder->insns.data;
+  DangStepNum *prev_map = dang_new (DangStepNum, n + 1);
+  DangStepNum *next_map = merged ? prev_map : dang_new (DangStepNum, n + 1);
+  unsigned i, o = 0;
+  Label *labels;
+  Variable *vars;
+  DangBuilderCatchBlock *catch_blocks;
+
+  dang_assert (!merged || n == 0 || !remove[0]);
+  for (i = 0; i < n; i++)
+    if (remove[i])
+      {
+        prev_map[i] = o == 0 ? 0 : o - 1;
+        if (!merged)
+          next_map[i] = o;
+      }
+    else
+      {
+        prev_map[i] = next_map[i] = o;
+        if (o != i)
+          insns[o] = insns[i];
+        o++;
+      }
+  prev_map[n] = next_map[n] = o;
+  dang_util_array_set_size (&builder->insns, o);
+
+#define RENUMBER(stepnum, map)                             \
+  do { if ((stepnum) != DANG_STEP_NUM_INVALID)             \
+         { dang_assert ((stepnum) <= n);                   \
+           (stepnum) = map[(stepnum)]; } } while (0)
+  labels = builder->labels.data;
+  for (i = 0; i < builder->labels.len; i++)
+    {
+      RENUMBER (labels[i].target, next_map);
+      if (labels[i].type == DANG_FUNCTION_BUILDER_LABEL_TYPE_SCOPED)
+        {
+          RENUMBER (labels[i].first_active, next_map);
+          RENUMBER (labels[i].last_active, next_map);
+        }
+    }
+  vars = builder->vars.data;
+  for (i = 0; i < builder->vars.len; i++)
+    if (!vars[i].is_param)
+      {
+        RENUMBER (vars[i].start, prev_map);
+        RENUMBER (vars[i].end, next_map);
+      }
+  catch_blocks = builder->catch_blocks.data;
+  for (i = 0; i < builder->catch_blocks.len; i++)
+    {
+      RENUMBER (catch_blocks[i].start, next_map);
+      RENUMBER (catch_blocks[i].end, next_map);
+    }
+#undef RENUMBER
+  if (next_map != prev_map)
+    dang_free (next_map);
+  dang_free (prev_map);
+}
+
+/* Find the steps that may be reached other than from
+   the preceding step:  jump targets, catch clauses, and the
+   boundaries of catch blocks.  Returns an array of n_insns+1 flags. */
+static dang_boolean *
+find_block_starts (Builder *builder)
+{
+  unsigned n = builder->insns.len;
+  DangInsn *insns = builder->insns.data;
+  dang_boolean *is_target = dang_new0 (dang_boolean, n + 1);
+  Label *labels = builder->labels.data;
+  DangBuilderCatchBlock *catch_blocks = builder->catch_blocks.data;
+  unsigned i, j;
+  for (i = 0; i < n; i++)
+    {
+      DangLabelId target = DANG_LABEL_ID_INVALID;
+      if (insns[i].type == DANG_INSN_TYPE_JUMP)
+        target = insns[i].jump.target;
+      else if (insns[i].type == DANG_INSN_TYPE_JUMP_CONDITIONAL)
+        target = insns[i].jump_conditional.target;
+      else if (insns[i].type == DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED)
+        target = insns[i].run_simple_c_fused.target;
+      if (target != DANG_LABEL_ID_INVALID
+       && labels[target].target <= n)
+        is_target[labels[target].target] = TRUE;
+    }
+  for (i = 0; i < builder->catch_blocks.len; i++)
+    {
+      if (catch_blocks[i].start <= n)
+        is_target[catch_blocks[i].start] = TRUE;
+      if (catch_blocks[i].end <= n)
+        is_target[catch_blocks[i].end] = TRUE;
+      for (j = 0; j < catch_blocks[i].n_clauses; j++)
+        {
+          DangStepNum target = labels[catch_blocks[i].clauses[j].target].target;
+          if (target <= n)
+            is_target[target] = TRUE;
+        }
+    }
+  return is_target;
+}
+
+/* Can the variable be initialized with memset()
+   and copied with memcpy()? */
+static dang_boolean
+is_plain_stack_var (Builder *builder,
+                    DangInsnValue *value)
+{
+  DangValueType *type;
+  if (value->location != DANG_INSN_LOCATION_STACK)
+    return FALSE;
+  type = ((Variable *) builder->vars.data)[value->var].type;
+  return type->init_assign == NULL
+      && type->destruct == NULL;
+}
+
+/* Find the local variables whose value may be tracked
+   from instruction to instruction:  plain data which
+   is not a parameter, an alias, a container of aliases,
+   or the target of a catch clause. */
+static dang_boolean *
+find_trackable_vars (Builder *builder)
+{
+  unsigned n_vars = builder->vars.len;
+  Variable *vars = builder->vars.data;
+  DangBuilderCatchBlock *catch_blocks = builder->catch_blocks.data;
+  dang_boolean *rv = dang_new (dang_boolean, n_vars);
+  unsigned i, j;
+  for (i = 0; i < n_vars; i++)
+    rv[i] = !vars[i].is_param
+         && vars[i].type->init_assign == NULL
+         && vars[i].type->destruct == NULL;
+  for (i = 0; i < n_vars; i++)
+    if (vars[i].container != DANG_VAR_ID_INVALID)
+      rv[i] = rv[vars[i].container] = FALSE;
+  for (i = 0; i < builder->catch_blocks.len; i++)
+    for (j = 0; j < catch_blocks[i].n_clauses; j++)
+      rv[catch_blocks[i].clauses[j].var_id] = FALSE;
+  return rv;
+}
+
+/* Is 'value' an operand that the instruction only reads? */
+static dang_boolean
+is_read_only_operand (DangInsn *insn,
+                      DangInsnValue *value)
+{
+  DangSignature *sig;
+  DangInsnValue *args;
+  unsigned rv_offset;
+  int index;
+  if (value == NULL)
+    return FALSE;
+  switch (insn->type)
+    {
+    case DANG_INSN_TYPE_ASSIGN:
+      return value == &insn->assign.source;
+    case DANG_INSN_TYPE_JUMP_CONDITIONAL:
+      return TRUE;
+    case DANG_INSN_TYPE_FUNCTION_CALL:
+      if (value == &insn->function_call.function)
+        return TRUE;
+      sig = insn->function_call.sig;
+      args = insn->function_call.params;
+      break;
+    case DANG_INSN_TYPE_RUN_SIMPLE_C:
+      sig = insn->run_simple_c.func->base.sig;
+      args = insn->run_simple_c.args;
+      break;
+    default:
+      return FALSE;
+    }
+  rv_offset = (sig->return_type == NULL
+            || sig->return_type == dang_value_type_void ()) ? 0 : 1;
+  index = (int)(value - args) - (int) rv_offset;
+  return index >= 0
+      && index < (int) sig->n_params
+      && sig->params[index].dir == DANG_FUNCTION_PARAM_IN;
+}
+
+/* === Superinstruction fusion === */
+
+/* Would merging the instructions first..last
+   into 'first' let a variable share its stack space with
+   a variable the merged instruction writes?
+
+   Only 'rv_var' and 'assign_var' may start inside the range.
+   Other variables may end inside the range, provided they
+   are not read by the call; the return-value may not
+   be given their space otherwise. */
+static dang_boolean
+merge_disturbs_vars (Builder *builder,
+                     DangStepNum first,
+                     DangStepNum last,
+                     DangInsn_RunSimpleC *call,
+                     DangVarId assign_var)
+{
+  Variable *vars = builder->vars.data;
+  DangVarId rv_var = call->args[0].var;
+  unsigned n_args = call->func->base.sig->n_params + 1;
+  unsigned i, a;
+  for (i = 0; i < builder->vars.len; i++)
+    {
+      if (vars[i].is_param || i == rv_var || i == assign_var)
+        continue;
+      if (first < vars[i].start && vars[i].start <= last)
+        return TRUE;
+      if (first < vars[i].end && vars[i].end <= last)
+        for (a = 1; a < n_args; a++)
+          if ((call->args[a].location == DANG_INSN_LOCATION_STACK
+            || call->args[a].location == DANG_INSN_LOCATION_POINTER)
+           && (call->args[a].var == i || vars[call->args[a].var].container == i))
+            return TRUE;
+    }
+  return FALSE;
+}
+
+/* Merge RUN_SIMPLE_C with the INIT of its return-value
+   (if that immediately precedes it), and with a following
+   JUMP, a JUMP_CONDITIONAL testing the return-value,
+   or an ASSIGN of the return-value into another stack variable.
+   Returns the number of instructions removed. */
+static unsigned
+fuse_simple_c (Builder *builder)
+{
+  unsigned n = builder->insns.len;
+  DangInsn *insns = builder->insns.data;
+  dang_boolean *remove = dang_new0 (dang_boolean, n);
+  unsigned n_removed = 0;
+  unsigned i;
+
+  /* We may not remove anything which is a jump target
+     or the boundary of a catch block */
+  dang_boolean *is_target = find_block_starts (builder);
+
+  for (i = 0; i < n; i++)
+    {
+      DangInsn *call = insns + i;
+      DangInsn_RunSimpleCFused fused;
+      DangSignature *sig;
+      DangVarId rv_var;
+      DangStepNum first = i, last = i;
+      DangVarId assign_var = DANG_VAR_ID_INVALID;
+      DangInsnFusedTail tail = DANG_INSN_FUSED_TAIL_NONE;
+      DangLabelId target = DANG_LABEL_ID_INVALID;
+      dang_boolean init_rv = FALSE;
+
+      if (call->type != DANG_INSN_TYPE_RUN_SIMPLE_C)
+        continue;
+      sig = call->run_simple_c.func->base.sig;
+      if (sig->return_type == NULL
+       || sig->return_type == dang_value_type_void ()
+       || !is_plain_stack_var (builder, call->run_simple_c.args + 0))
+        continue;
+      rv_var = call->run_simple_c.args[0].var;
+
+      /* The INIT that precedes the call */
+      if (i > 0
+       && !remove[i - 1]
+       && !is_target[i]
+       && insns[i - 1].type == DANG_INSN_TYPE_INIT
+       && insns[i - 1].init.var == rv_var)
+        {
+          init_rv = TRUE;
+          first = i - 1;
+        }
+
+      /* The instruction that consumes the return-value */
+      if (i + 1 < n && !is_target[i + 1])
+        {
+          DangInsn *next = insns + i + 1;
+          switch (next->type)
+            {
+            case DANG_INSN_TYPE_JUMP:
+              tail = DANG_INSN_FUSED_TAIL_JUMP;
+              target = next->jump.target;
+              break;
+            case DANG_INSN_TYPE_JUMP_CONDITIONAL:
+              if (next->jump_conditional.test_value.location == DANG_INSN_LOCATION_STACK
+               && next->jump_conditional.test_value.var == rv_var)
+                {
+                  tail = next->jump_conditional.jump_if_zero
+                       ? DANG_INSN_FUSED_TAIL_JUMP_IF_ZERO
+                       : DANG_INSN_FUSED_TAIL_JUMP_IF_NONZERO;
+                  target = next->jump_conditional.target;
+                }
+              break;
+            case DANG_INSN_TYPE_ASSIGN:
+              if (next->assign.source.location == DANG_INSN_LOCATION_STACK
+               && next->assign.source.var == rv_var
+               && next->assign.target.type == next->assign.source.type
+               && next->assign.target.var != rv_var
+               && is_plain_stack_var (builder, &next->assign.target))
+                {
+                  tail = DANG_INSN_FUSED_TAIL_ASSIGN;
+                  assign_var = next->assign.target.var;
+                }
+              break;
+            default:
+              break;
+            }
+          if (tail != DANG_INSN_FUSED_TAIL_NONE)
+            last = i + 1;
+        }
+
+      if (first == last
+       || merge_disturbs_vars (builder, first, last, &call->run_simple_c, assign_var))
+        continue;
+
+      memset (&fused, 0, sizeof (fused));
+      fused.base = call->base;
+      fused.func = call->run_simple_c.func;
+      fused.args = call->run_simple_c.args;
+      fused.init_return_value = init_rv;
+      fused.tail = tail;
+      fused.target = target;
+      fused.assign_target = assign_var;
+
+      /* The RUN_SIMPLE_C's members now belong to 'fused'. */
+      if (init_rv)
+        {
+          dang_code_position_clear (&insns[first].base.cp);
+          remove[i] = TRUE;
+        }
+      if (last > i)
+        {
+          dang_insn_destruct (insns + last);
+          remove[last] = TRUE;
+        }
+      insns[first].run_simple_c_fused = fused;
+      insns[first].type = DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED;
+      n_removed += last - first;
+      i = last;
+    }
+
+  if (n_removed > 0)
+    remove_insns (builder, remove, TRUE);
+  dang_free (remove);
+  dang_free (is_target);
+  return n_removed;
+}
+
+/* === Constant folding and propagation === */
+
+typedef struct
+{
+  DangInsnValue **known;        /* literal value of each variable, or NULL */
+} FoldData;
+
+static void
+forget_written_var (DangInsn      *insn,
+                    DangVarId      var,
+                    DangInsnValue *value,
+                    void          *data)
+{
+  FoldData *fd = data;
+  if (!is_read_only_operand (insn, value))
+    fd->known[var] = NULL;
+}
+
+/* Replace a read of a variable whose value is a known literal
+   with the literal itself. */
+static dang_boolean
+propagate_literal (FoldData *fd,
+                   DangInsnValue *value)
+{
+  DangInsnValue *lit;
+  if (value->location != DANG_INSN_LOCATION_STACK)
+    return FALSE;
+  lit = fd->known[value->var];
+  if (lit == NULL || lit->type != value->type)
+    return FALSE;
+  dang_insn_value_copy (value, lit);
+  return TRUE;
+}
+
+/* Evaluate a call to a pure operator whose inputs
+   are all literals, turning it into an ASSIGN of the result.
+   Calls which fail (like division by zero) are left alone,
+   so that they throw at run-time. */
+static dang_boolean
+fold_simple_c (DangInsn *insn)
+{
+  DangFunction *func = insn->run_simple_c.func;
+  DangSignature *sig = func->base.sig;
+  DangInsnValue *args = insn->run_simple_c.args;
+  DangValueType *rv_type = sig->return_type;
+  void **arg_values;
+  void *rv;
+  DangError *error = NULL;
+  DangInsnValue target;
+  unsigned i;
+
+  if (rv_type == NULL
+   || rv_type == dang_value_type_void ()
+   || rv_type->init_assign != NULL
+   || rv_type->destruct != NULL
+   || args[0].location != DANG_INSN_LOCATION_STACK
+   || !dang_insn_pack_is_inline_op (func->simple_c.func))
+    return FALSE;
+  for (i = 0; i < sig->n_params; i++)
+    if (sig->params[i].dir != DANG_FUNCTION_PARAM_IN
+     || args[i + 1].location != DANG_INSN_LOCATION_LITERAL)
+      return FALSE;
+  arg_values = dang_new (void *, sig->n_params + 1);
+  for (i = 0; i < sig->n_params; i++)
+    arg_values[i] = args[i + 1].value;
+  rv = dang_malloc (rv_type->sizeof_instance);
+  memset (rv, 0, rv_type->sizeof_instance);
+  if (!func->simple_c.func (arg_values, rv, func->simple_c.func_data, &error))
+    {
+      if (error)
+        dang_error_unref (error);
+      dang_free (arg_values);
+      dang_free (rv);
+      return FALSE;
+    }
+  dang_free (arg_values);
+
+  target = args[0];
+  for (i = 1; i <= sig->n_params; i++)
+    dang_insn_value_clear (args + i);
+  dang_free (args);
+  dang_function_unref (func);
+
+  insn->assign.target = target;
+  insn->assign.source.location = DANG_INSN_LOCATION_LITERAL;
+  insn->assign.source.type = rv_type;
+  insn->assign.source.var = DANG_VAR_ID_INVALID;
+  insn->assign.source.offset = 0;
+  insn->assign.source.ns = NULL;
+  insn->assign.source.value = rv;
+  insn->assign.target_uninitialized = FALSE;
+  insn->type = DANG_INSN_TYPE_ASSIGN;
+  return TRUE;
+}
+
+/* Within each basic block, track which variables hold
+   a literal, substitute the literal for reads of them,
+   and evaluate operators whose inputs are all literals.
+   Returns the number of instructions changed. */
+static unsigned
+fold_constants (Builder *builder)
+{
+  unsigned n = builder->insns.len;
+  DangInsn *insns = builder->insns.data;
+  unsigned n_vars = builder->vars.len;
+  dang_boolean *is_target = find_block_starts (builder);
+  dang_boolean *trackable = find_trackable_vars (builder);
+  FoldData fd;
+  unsigned n_changed = 0;
+  unsigned i, k;
+
+  fd.known = dang_new0 (DangInsnValue *, n_vars);
+  for (i = 0; i < n; i++)
+    {
+      DangInsn *insn = insns + i;
+      dang_boolean changed = FALSE;
+      if (is_target[i])
+        memset (fd.known, 0, sizeof (DangInsnValue *) * n_vars);
+
+      switch (insn->type)
+        {
+        case DANG_INSN_TYPE_ASSIGN:
+          changed = propagate_literal (&fd, &insn->assign.source);
+          break;
+        case DANG_INSN_TYPE_JUMP_CONDITIONAL:
+          changed = propagate_literal (&fd, &insn->jump_conditional.test_value);
+          break;
+        case DANG_INSN_TYPE_RUN_SIMPLE_C:
+          {
+            DangSignature *sig = insn->run_simple_c.func->base.sig;
+            unsigned rv_offset = (sig->return_type == NULL
+                               || sig->return_type == dang_value_type_void ()) ? 0 : 1;
+            for (k = 0; k < sig->n_params; k++)
+              if (sig->params[k].dir == DANG_FUNCTION_PARAM_IN
+               && propagate_literal (&fd, insn->run_simple_c.args + k + rv_offset))
+                changed = TRUE;
+            if (fold_simple_c (insn))
+              changed = TRUE;
+          }
+          break;
+        default:
+          break;
+        }
+      if (changed)
+        n_changed++;
+
+      dang_insn_foreach_var (insn, forget_written_var, &fd);
+      if (insn->type == DANG_INSN_TYPE_ASSIGN
+       && insn->assign.target.location == DANG_INSN_LOCATION_STACK
+       && insn->assign.source.location == DANG_INSN_LOCATION_LITERAL
+       && insn->assign.source.type == insn->assign.target.type
+       && trackable[insn->assign.target.var])
+        fd.known[insn->assign.target.var] = &insn->assign.source;
+    }
+  dang_free (fd.known);
+  dang_free (trackable);
+  dang_free (is_target);
+  return n_changed;
+}
+
+/* === Dead code elimination === */
+
+/* Remove the instructions that cannot be reached
+   from the first instruction or from a catch clause,
+   and jumps to the following instruction.
+   Conditional jumps on a literal become unconditional,
+   or are removed.
+   Returns the number of instructions removed. */
+static unsigned
+remove_unreachable (Builder *builder)
+{
+  unsigned n = builder->insns.len;
+  DangInsn *insns = builder->insns.data;
+  Label *labels = builder->labels.data;
+  DangBuilderCatchBlock *catch_blocks = builder->catch_blocks.data;
+  dang_boolean *reachable = dang_new0 (dang_boolean, n + 1);
+  dang_boolean *remove = dang_new (dang_boolean, n);
+  DangUtilArray pending = DANG_UTIL_ARRAY_STATIC_INIT (DangStepNum);
+  DangStepNum step, next;
+  unsigned n_removed = 0;
+  unsigned i, j;
+
+#define ADD_PENDING(s)                                            \
+  do { next = (s); dang_util_array_append (&pending, 1, &next); } while (0)
+  ADD_PENDING (0);
+  for (i = 0; i < builder->catch_blocks.len; i++)
+    for (j = 0; j < catch_blocks[i].n_clauses; j++)
+      ADD_PENDING (labels[catch_blocks[i].clauses[j].target].target);
+  while (pending.len > 0)
+    {
+      DangInsn *insn;
+      step = ((DangStepNum *) pending.data)[--pending.len];
+      if (step >= n || reachable[step])
+        continue;
+      reachable[step] = TRUE;
+      insn = insns + step;
+      switch (insn->type)
+        {
+        case DANG_INSN_TYPE_RETURN:
+          break;
+        case DANG_INSN_TYPE_JUMP:
+          ADD_PENDING (labels[insn->jump.target].target);
+          break;
+        case DANG_INSN_TYPE_JUMP_CONDITIONAL:
+          {
+            DangInsnValue *v = &insn->jump_conditional.test_value;
+            dang_boolean can_jump = TRUE, can_fall_through = TRUE;
+            if (v->location == DANG_INSN_LOCATION_LITERAL)
+              {
+                dang_boolean is_zero = dang_util_is_zero (v->value, v->type->sizeof_instance);
+                can_jump = is_zero == insn->jump_conditional.jump_if_zero;
+                can_fall_through = !can_jump;
+              }
+            if (can_jump)
+              ADD_PENDING (labels[insn->jump_conditional.target].target);
+            if (can_fall_through)
+              ADD_PENDING (step + 1);
+          }
+          break;
+        case DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED:
+          if (insn->run_simple_c_fused.target != DANG_LABEL_ID_INVALID)
+            ADD_PENDING (labels[insn->run_simple_c_fused.target].target);
+          if (insn->run_simple_c_fused.tail != DANG_INSN_FUSED_TAIL_JUMP)
+            ADD_PENDING (step + 1);
+          break;
+        default:
+          ADD_PENDING (step + 1);
+          break;
+        }
+    }
+#undef ADD_PENDING
+
+  for (i = 0; i < n; i++)
+    {
+      DangInsn *insn = insns + i;
+      remove[i] = !reachable[i];
+      if (!remove[i]
+       && insn->type == DANG_INSN_TYPE_JUMP)
+        {
+          for (j = i + 1; j < n && !reachable[j]; j++)
+            ;
+          if (labels[insn->jump.target].target == j)
+            remove[i] = TRUE;
+        }
+      else if (!remove[i]
+       && insn->type == DANG_INSN_TYPE_JUMP_CONDITIONAL
+       && insn->jump_conditional.test_value.location == DANG_INSN_LOCATION_LITERAL)
+        {
+          DangInsnValue *v = &insn->jump_conditional.test_value;
+          dang_boolean is_zero = dang_util_is_zero (v->value, v->type->sizeof_instance);
+          if (is_zero == insn->jump_conditional.jump_if_zero)
+            {
+              DangLabelId target = insn->jump_conditional.target;
+              dang_insn_value_clear (v);
+              insn->jump.target = target;
+              insn->type = DANG_INSN_TYPE_JUMP;
+            }
+          else
+            remove[i] = TRUE;
+        }
+      if (remove[i])
+        {
+          dang_insn_destruct (insn);
+          n_removed++;
+        }
+    }
+  if (n_removed > 0)
+    remove_insns (builder, remove, FALSE);
+  dang_util_array_clear (&pending);
+  dang_free (remove);
+  dang_free (reachable);
+  return n_removed;
+}
+
+static void
+count_reads (DangInsn      *insn,
+             DangVarId      var,
+             DangInsnValue *value,
+             void          *data)
+{
+  unsigned *n_reads = data;
+  if (insn->type == DANG_INSN_TYPE_INIT
+   || insn->type == DANG_INSN_TYPE_DESTRUCT)
+    return;
+  if (insn->type == DANG_INSN_TYPE_ASSIGN
+   && value == &insn->assign.target
+   && value->location == DANG_INSN_LOCATION_STACK)
+    return;
+  n_reads[var]++;
+}
+
+/* Remove assignments (and INIT and DESTRUCT) of trackable
+   variables that are never read.  Only assignments from
+   literals and other variables are removed, since
+   those have no other effect.
+   Returns the number of instructions removed. */
+static unsigned
+remove_dead_stores (Builder *builder)
+{
+  unsigned n_vars = builder->vars.len;
+  dang_boolean *trackable = find_trackable_vars (builder);
+  unsigned *n_reads = dang_new (unsigned, n_vars);
+  unsigned n_removed = 0;
+  dang_boolean changed;
+  do
+    {
+      unsigned n = builder->insns.len;
+      DangInsn *insns = builder->insns.data;
+      dang_boolean *remove = dang_new0 (dang_boolean, n);
+      unsigned n_removed_this_pass = 0;
+      unsigned i;
+      memset (n_reads, 0, sizeof (unsigned) * n_vars);
+      for (i = 0; i < n; i++)
+        dang_insn_foreach_var (insns + i, count_reads, n_reads);
+      for (i = 0; i < n; i++)
+        {
+          DangInsn *insn = insns + i;
+          DangVarId var;
+          switch (insn->type)
+            {
+            case DANG_INSN_TYPE_INIT:
+              var = insn->init.var;
+              break;
+            case DANG_INSN_TYPE_DESTRUCT:
+              var = insn->destruct.var;
+              break;
+            case DANG_INSN_TYPE_ASSIGN:
+              if (insn->assign.target.location != DANG_INSN_LOCATION_STACK
+               || (insn->assign.source.location != DANG_INSN_LOCATION_LITERAL
+                && insn->assign.source.location != DANG_INSN_LOCATION_STACK))
+                continue;
+              var = insn->assign.target.var;
+              break;
+            default:
+              continue;
+            }
+          if (!trackable[var] || n_reads[var] > 0)
+            continue;
+          dang_insn_destruct (insn);
+          remove[i] = TRUE;
+          n_removed_this_pass++;
+        }
+      if (n_removed_this_pass > 0)
+        remove_insns (builder, remove, FALSE);
+      dang_free (remove);
+      n_removed += n_removed_this_pass;
+      changed = n_removed_this_pass > 0;
+    }
+  while (changed);
+  dang_free (n_reads);
+  dang_free (trackable);
+  return n_removed;
+}
+
+/* === Tail calls === */
+
+/* Is insn a call of the function being built
+   that may reuse its frame? */
+static dang_boolean
+is_self_call (Builder  *builder,
+              DangInsn *insn)
+{
+  DangInsnValue *function = &insn->function_call.function;
+  DangSignature *sig = insn->function_call.sig;
+  unsigned i;
+  if (insn->type != DANG_INSN_TYPE_FUNCTION_CALL
+   || insn->function_call.virtual_method_offset != 0
+   || function->location != DANG_INSN_LOCATION_LITERAL
+   || * (DangFunction **) function->value != builder->function)
+    return FALSE;
+  /* Output parameters belong to our caller. */
+  for (i = 0; i < sig->n_params; i++)
+    if (sig->params[i].dir != DANG_FUNCTION_PARAM_IN)
+      return FALSE;
+  return TRUE;
+}
+
+/* Is step i within the "try" body of a catch block? */
+static dang_boolean
+is_in_try_block (Builder    *builder,
+                 DangStepNum i)
+{
+  DangBuilderCatchBlock *catch_blocks = builder->catch_blocks.data;
+  unsigned j;
+  for (j = 0; j < builder->catch_blocks.len; j++)
+    if (catch_blocks[j].start <= i && i < catch_blocks[j].end)
+      return TRUE;
+  return FALSE;
+}
+
+/* Turn calls of the function to itself, followed
+   only by a copy into the return-value, destructs and a return,
+   into tail calls, which restart the function in the same frame.
+   The copy and the destructs are removed:  the destructs
+   are done by the call.
+   Calls in a "try" body are left alone, since whatever they throw
+   must still be caught by this frame.
+   Returns the number of calls converted. */
+static unsigned
+eliminate_tail_calls (Builder *builder)
+{
+  unsigned n = builder->insns.len;
+  DangInsn *insns = builder->insns.data;
+  dang_boolean *is_block_start;
+  dang_boolean *remove;
+  DangUtilArray destructs = DANG_UTIL_ARRAY_STATIC_INIT (DangVarId);
+  unsigned n_converted = 0;
+  unsigned i, j;
+
+  is_block_start = find_block_starts (builder);
+  remove = dang_new0 (dang_boolean, n);
+  for (i = 0; i < n; i++)
+    {
+      DangInsn *call = insns + i;
+      DangVarId rv_var = DANG_VAR_ID_INVALID;
+      dang_boolean copied_rv = FALSE;
+      if (!is_self_call (builder, call) || is_in_try_block (builder, i))
+        continue;
+      if (builder->has_return_value)
+        {
+          DangInsnValue *rv = call->function_call.params + 0;
+          if (rv->location != DANG_INSN_LOCATION_STACK)
+            continue;
+          rv_var = rv->var;
+          copied_rv = rv_var == 0;
+        }
+      dang_util_array_set_size (&destructs, 0);
+      for (j = i + 1; j < n && !is_block_start[j]; j++)
+        {
+          DangInsn *insn = insns + j;
+          if (insn->type == DANG_INSN_TYPE_DESTRUCT)
+            dang_util_array_append (&destructs, 1, &insn->destruct.var);
+          else if (!copied_rv
+                && insn->type == DANG_INSN_TYPE_ASSIGN
+                && insn->assign.target.location == DANG_INSN_LOCATION_STACK
+                && insn->assign.target.var == 0
+                && insn->assign.source.location == DANG_INSN_LOCATION_STACK
+                && insn->assign.source.var == rv_var)
+            copied_rv = TRUE;
+          else
+            break;
+        }
+      if (j == n || is_block_start[j]
+       || insns[j].type != DANG_INSN_TYPE_RETURN
+       || (builder->has_return_value && !copied_rv))
+        continue;
+
+      /* Convert: the copy and the destructs are dropped,
+         the RETURN is kept though it is no longer reached. */
+      call->function_call.is_tail_call = TRUE;
+      call->function_call.n_tail_destructs = destructs.len;
+      call->function_call.tail_destructs = dang_memdup (destructs.data,
+                                                        destructs.len * sizeof (DangVarId));
+      for (j = i + 1; insns[j].type != DANG_INSN_TYPE_RETURN; j++)
+        {
+          dang_insn_destruct (insns + j);
+          remove[j] = TRUE;
+        }
+      n_converted++;
+      i = j;
+    }
+  if (n_converted > 0)
+    remove_insns (builder, remove, FALSE);
+  dang_util_array_clear (&destructs);
+  dang_free (remove);
+  dang_free (is_block_start);
+  return n_converted;
+}
+
+/* Function: dang_builder_optimize_level_flags
+ * Get the optimization passes enabled at an
+ * optimization level, as given with -O on the command-line:
+ * 0 disables all passes, 1 only merges steps into superinstructions,
+ * and 2 (the default) also folds constants, removes dead code,
+ * eliminates tail calls and fuses element-wise tensor expressions
+ * (see dang_compile_fused_tensor_expr()).
+ *
+ * Parameters:
+ *     level - the optimization level.
+ * Returns:
+ *     the flags for dang_builder_optimize_flags.
+ */
+unsigned
+dang_builder_optimize_level_flags (unsigned level)
+{
+  switch (level)
+    {
+    case 0:
+      return 0;
+    case 1:
+      return DANG_BUILDER_OPTIMIZE_FUSE;
+    default:
+      return DANG_BUILDER_OPTIMIZE_FUSE
+           | DANG_BUILDER_OPTIMIZE_FOLD
+           | DANG_BUILDER_OPTIMIZE_DEAD_CODE
+           | DANG_BUILDER_OPTIMIZE_TAIL_CALLS
+           | DANG_BUILDER_OPTIMIZE_TENSOR_EXPRS;
+    }
+}
+
+/* Function: dang_builder_optimize
+ * Run the optimization passes enabled in
+ * dang_builder_optimize_flags on the builder's instructions.
+ * This is called by dang_builder_compile() after
+ * the INIT and DESTRUCT instructions have been added
+ * and before stack allocation.
+ *
+ * Parameters:
+ *     builder - the function builder object.
+ */
+void
+dang_builder_optimize (DangBuilder *builder)
+{
+  unsigned pass;
+
+  /* Removing jumps joins basic blocks, which may
+     let more constants be propagated, and so on. */
+  for (pass = 0; pass < MAX_FOLD_PASSES; pass++)
+    {
+      unsigned n_changed = 0;
+      if (dang_builder_optimize_flags & DANG_BUILDER_OPTIMIZE_FOLD)
+        n_changed += fold_constants (builder);
+      if (dang_builder_optimize_flags & DANG_BUILDER_OPTIMIZE_DEAD_CODE)
+        {
+          n_changed += remove_unreachable (builder);
+          n_changed += remove_dead_stores (builder);
+        }
+      if (n_changed == 0)
+        break;
+    }
+  if (dang_builder_optimize_flags & DANG_BUILDER_OPTIMIZE_TAIL_CALLS)
+    eliminate_tail_calls (builder);
+  if (dang_builder_optimize_flags & DANG_BUILDER_OPTIMIZE_FUSE)
+    fuse_simple_c (builder);
+}
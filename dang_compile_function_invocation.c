@@ -1,49 +1,18 @@
 #include <string.h>
 #include "dang.h"
 
-void
-dang_compile_literal_function_invocation (DangFunction        *function,
-                                          DangBuilder *builder,
-                                          DangCompileResult   *return_value_info,
-                                          unsigned             n_params,
-                                          DangCompileResult   *params)
-{
-  DangValueType *ftype = dang_value_type_function (function->base.sig);
-  DangCompileResult res;
-  dang_compile_result_init_literal (&res, ftype, &function);
-  dang_compile_function_invocation (&res, builder, return_value_info, n_params, params);
-  dang_compile_result_clear (&res, builder);
-}
-
-void
-dang_compile_function_invocation (DangCompileResult   *function,
-                                  DangBuilder *builder,
-                                  DangCompileResult   *return_value_info,
-                                  unsigned             n_params,
-                                  DangCompileResult   *params)
+static void
+add_function_call_insn (DangBuilder         *builder,
+                        DangCompileResult   *function,
+                        unsigned             virtual_method_offset,
+                        DangCompileResult   *return_value_info,
+                        unsigned             n_params,
+                        DangCompileResult   *params)
 {
   DangSignature *sig;
   DangInsn insn;
   unsigned i, out = 0, n_par;
   DangInsnValue *par;
-  /* If it's a constant function, see if has a specialized 'compile' method */
-  if (function->type == DANG_COMPILE_RESULT_LITERAL)
-    {
-      DangFunction *f = * (DangFunction **) function->literal.value;
-      if (f->base.compile != NULL)
-        {
-          dang_assert (f != NULL);
-          f->base.compile (f, builder, return_value_info, n_params, params);
-          return;
-        }
-      if (dang_function_needs_registration (f))
-        dang_compile_context_register (builder->function->stub.cc, f);
-    }
-  else if (function->type != DANG_COMPILE_RESULT_STACK)
-    {
-      DangCompileFlags flags = DANG_COMPILE_FLAGS_RVALUE_RESTRICTIVE;
-      dang_compile_obey_flags (builder, &flags, function);
-    }
 
   /* warmups.  make sure all output parameters are initialized
      (in the caller frame) */
@@ -57,7 +26,7 @@ dang_compile_function_invocation (DangCompileResult   *function,
     dang_compile_result_force_initialize (builder, return_value_info);
 
 
-  /* Otherwise, add a FUNCTION_CALL insn */
+  /* Add a FUNCTION_CALL insn */
   sig = ((DangValueTypeFunction*)function->any.return_type)->sig;
   dang_assert (sig->n_params == n_params);
   n_par = (return_value_info ? 1 : 0) + n_params;
@@ -74,6 +43,7 @@ dang_compile_function_invocation (DangCompileResult   *function,
   dang_insn_init (&insn, DANG_INSN_TYPE_FUNCTION_CALL);
   insn.function_call.sig = dang_signature_ref (sig);
   dang_insn_value_from_compile_result (&insn.function_call.function, function);
+  insn.function_call.virtual_method_offset = virtual_method_offset;
   insn.function_call.params = par;
   DangVarId frame_var_id;
   frame_var_id = dang_builder_add_tmp (builder, dang_value_type_reserved_pointer ());
@@ -100,3 +70,79 @@ dang_compile_function_invocation (DangCompileResult   *function,
       }
 }
 
+void
+dang_compile_literal_function_invocation (DangFunction        *function,
+                                          DangBuilder *builder,
+                                          DangCompileResult   *return_value_info,
+                                          unsigned             n_params,
+                                          DangCompileResult   *params)
+{
+  DangValueType *ftype = dang_value_type_function (function->base.sig);
+  DangCompileResult res;
+  dang_compile_result_init_literal (&res, ftype, &function);
+  dang_compile_function_invocation (&res, builder, return_value_info, n_params, params);
+  dang_compile_result_clear (&res, builder);
+}
+
+void
+dang_compile_function_invocation (DangCompileResult   *function,
+                                  DangBuilder *builder,
+                                  DangCompileResult   *return_value_info,
+                                  unsigned             n_params,
+                                  DangCompileResult   *params)
+{
+  /* If it's a constant function, see if has a specialized 'compile' method */
+  if (function->type == DANG_COMPILE_RESULT_LITERAL)
+    {
+      DangFunction *f = * (DangFunction **) function->literal.value;
+      if (f->base.compile != NULL)
+        {
+          dang_assert (f != NULL);
+          f->base.compile (f, builder, return_value_info, n_params, params);
+          return;
+        }
+      if (dang_function_needs_registration (f))
+        dang_compile_context_register (builder->function->stub.cc, f);
+    }
+  else if (function->type != DANG_COMPILE_RESULT_STACK)
+    {
+      DangCompileFlags flags = DANG_COMPILE_FLAGS_RVALUE_RESTRICTIVE;
+      dang_compile_obey_flags (builder, &flags, function);
+    }
+
+  add_function_call_insn (builder, function, 0,
+                          return_value_info, n_params, params);
+}
+
+
+/* Function: dang_compile_virtual_method_invocation
+ * Compile a call to a virtual method, looked up
+ * in the class of the object in params[0]
+ * when the call is run.
+ *
+ * Parameters:
+ *    sig - the signature of the method.
+ *    class_offset - the offset of the method in the class.
+ *    builder - the function builder.
+ *    return_value_info - where to store the return-value, or NULL.
+ *    n_params - the number of parameters, including 'this'.
+ *    params - the parameters. params[0] must be on the stack.
+ */
+void
+dang_compile_virtual_method_invocation (DangSignature       *sig,
+                                        unsigned             class_offset,
+                                        DangBuilder         *builder,
+                                        DangCompileResult   *return_value_info,
+                                        unsigned             n_params,
+                                        DangCompileResult   *params)
+{
+  DangValueType *ftype = dang_value_type_function (sig);
+  DangFunction *null_function = NULL;
+  DangCompileResult res;
+  dang_assert (class_offset != 0);
+  dang_assert (n_params > 0 && params[0].type == DANG_COMPILE_RESULT_STACK);
+  dang_compile_result_init_literal (&res, ftype, &null_function);
+  add_function_call_insn (builder, &res, class_offset,
+                          return_value_info, n_params, params);
+  dang_compile_result_clear (&res, builder);
+}
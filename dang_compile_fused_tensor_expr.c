@@ -0,0 +1,180 @@
+#include "dang.h"
+
+/* Larger expressions are fused in several pieces. */
+#define MAX_FUSED_STEPS         16
+
+/* While gathering, operands that are steps are marked with this bit,
+   since they are numbered after the parameters. */
+#define STEP_OPERAND            (1U << 30)
+
+typedef struct _FusedExprBuilder FusedExprBuilder;
+struct _FusedExprBuilder
+{
+  DangValueType *tensor_type;
+  unsigned n_params;
+  DangExpr *params[MAX_FUSED_STEPS + 1];
+  unsigned n_steps_started;
+  unsigned n_steps;
+  DangTensorFusedStep steps[MAX_FUSED_STEPS];
+};
+
+/* If 'expr' is a call to an element-wise tensor operator
+   returning 'tensor_type' (or any tensor, if NULL),
+   return the operator's resolved function. */
+static DangFunction *
+get_tensor_op (DangBuilder   *builder,
+               DangExpr      *expr,
+               DangValueType *tensor_type,
+               DangTensorOp  *op_out)
+{
+  DangExprTag *tag;
+  DangFunction *function;
+  if (!dang_expr_is_function (expr, "$invoke")
+   || expr->function.n_args != 3)
+    return NULL;
+  tag = dang_expr_get_annotation (builder->annotations, expr->function.args[0],
+                                  DANG_EXPR_ANNOTATION_TAG);
+  if (tag == NULL
+   || tag->tag_type != DANG_EXPR_TAG_FUNCTION_FAMILY
+   || (function = tag->info.ff.function) == NULL
+   || !dang_tensor_function_get_op (function, op_out))
+    return NULL;
+  if (tensor_type != NULL && function->base.sig->return_type != tensor_type)
+    return NULL;
+  return function;
+}
+
+/* Add 'expr' as a step if it is a fusable operator,
+   otherwise as a parameter.  The operands are gathered
+   left to right, so the parameters are evaluated in the same order
+   as the unfused expression's. */
+static unsigned
+add_operand (FusedExprBuilder *fb,
+             DangBuilder      *builder,
+             DangExpr         *expr,
+             dang_boolean      may_fuse)
+{
+  DangTensorOp op;
+  unsigned a, b;
+
+  if (!may_fuse
+   || fb->n_steps_started == MAX_FUSED_STEPS
+   || get_tensor_op (builder, expr, fb->tensor_type, &op) == NULL)
+    {
+      fb->params[fb->n_params] = expr;
+      return fb->n_params++;
+    }
+
+  fb->n_steps_started++;
+  if (op == DANG_TENSOR_OP_SCALE_LEFT)
+    {
+      b = add_operand (fb, builder, expr->function.args[1], FALSE);
+      a = add_operand (fb, builder, expr->function.args[2], TRUE);
+      op = DANG_TENSOR_OP_SCALE;
+    }
+  else
+    {
+      a = add_operand (fb, builder, expr->function.args[1], TRUE);
+      b = add_operand (fb, builder, expr->function.args[2],
+                       op != DANG_TENSOR_OP_SCALE);
+    }
+  fb->steps[fb->n_steps].op = op;
+  fb->steps[fb->n_steps].a = a;
+  fb->steps[fb->n_steps].b = b;
+  return STEP_OPERAND | fb->n_steps++;
+}
+
+/* Function: dang_compile_fused_tensor_expr
+ * Compile a chain of element-wise tensor operators,
+ * like 'a + b * 2.0 - c', as a single call
+ * (see dang_tensor_fused_function_new()),
+ * if the DANG_BUILDER_OPTIMIZE_TENSOR_EXPRS optimization is on.
+ *
+ * Parameters:
+ *    expr - an $invoke() expression.
+ *    builder - the function builder.
+ *    flags - the compile flags for the result.
+ *    result - set to the result if the expression was compiled.
+ *
+ * Returns:
+ *    whether the expression was compiled: FALSE if it is not
+ *    a chain of at least two operators.
+ */
+dang_boolean
+dang_compile_fused_tensor_expr (DangExpr          *expr,
+                                DangBuilder       *builder,
+                                DangCompileFlags  *flags,
+                                DangCompileResult *result)
+{
+  FusedExprBuilder fb;
+  DangFunction *root, *function;
+  DangTensorOp op;
+  DangValueType *param_types[MAX_FUSED_STEPS + 1];
+  DangCompileResult params[MAX_FUSED_STEPS + 1];
+  DangCompileFlags subflags = DANG_COMPILE_FLAGS_RVALUE_PERMISSIVE;
+  unsigned i;
+
+  if ((dang_builder_optimize_flags & DANG_BUILDER_OPTIMIZE_TENSOR_EXPRS) == 0)
+    return FALSE;
+  root = get_tensor_op (builder, expr, NULL, &op);
+  if (root == NULL)
+    return FALSE;
+
+  fb.tensor_type = root->base.sig->return_type;
+  fb.n_params = 0;
+  fb.n_steps_started = 0;
+  fb.n_steps = 0;
+  add_operand (&fb, builder, expr, TRUE);
+  if (fb.n_steps < 2)
+    return FALSE;
+  for (i = 0; i < fb.n_steps; i++)
+    {
+      if (fb.steps[i].a & STEP_OPERAND)
+        fb.steps[i].a = fb.n_params + (fb.steps[i].a & ~STEP_OPERAND);
+      if (fb.steps[i].b & STEP_OPERAND)
+        fb.steps[i].b = fb.n_params + (fb.steps[i].b & ~STEP_OPERAND);
+    }
+
+  for (i = 0; i < fb.n_params; i++)
+    {
+      DangExprTag *tag = dang_expr_get_annotation (builder->annotations,
+                                                   fb.params[i],
+                                                   DANG_EXPR_ANNOTATION_TAG);
+      if (tag == NULL || tag->tag_type != DANG_EXPR_TAG_VALUE)
+        return FALSE;
+      param_types[i] = tag->info.value.type;
+    }
+  function = dang_tensor_fused_function_new (fb.tensor_type,
+                                             fb.n_params, param_types,
+                                             fb.n_steps, fb.steps);
+  if (function == NULL)
+    return FALSE;
+
+  for (i = 0; i < fb.n_params; i++)
+    {
+      dang_compile (fb.params[i], builder, &subflags, params + i);
+      if (params[i].type == DANG_COMPILE_RESULT_ERROR)
+        {
+          *result = params[i];
+          while (i-- > 0)
+            dang_compile_result_clear (params + i, builder);
+          dang_function_unref (function);
+          return TRUE;
+        }
+    }
+
+  dang_compile_result_init_stack (result, fb.tensor_type,
+                                  dang_builder_add_tmp (builder, fb.tensor_type),
+                                  FALSE, TRUE, FALSE);
+  dang_compile_literal_function_invocation (function, builder, result,
+                                            fb.n_params, params);
+  for (i = 0; i < fb.n_params; i++)
+    dang_compile_result_clear (params + i, builder);
+  dang_function_unref (function);
+
+  result->any.is_lvalue = FALSE;
+  result->any.is_rvalue = TRUE;
+  result->stack.was_initialized = TRUE;
+  dang_compile_obey_flags (builder, flags, result);
+  return TRUE;
+}
@@ -43,6 +43,7 @@ dang_function_concat_peek (unsigned N)
       sig = dang_signature_new (dang_value_type_string (), N, params);
       *prv = dang_function_new_simple_c (sig, do_concat,
                                          (void*)N, NULL);
+      (*prv)->simple_c.is_pure = TRUE;
       dang_signature_unref (sig);
       dang_free (params);
     }
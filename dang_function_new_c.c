@@ -40,6 +40,11 @@ run_c_nonfirst   (void                 *step_data,
   DangError *error = NULL;
   dang_assert (function->type == DANG_FUNCTION_TYPE_C);
   DANG_UNUSED (step_data);
+
+  /* a function that yields may set these */
+  thread->info.yield.yield_cancel_func = NULL;
+  thread->info.yield.yield_cancel_func_data = NULL;
+
   switch (function->c.func (thread, args, rv,
                             frame + function->c.state_data_frame_offset,
                             function->c.func_data, &error))
@@ -49,22 +54,19 @@ run_c_nonfirst   (void                 *step_data,
       dang_error_unref (error);
       return;
     case DANG_C_FUNCTION_SUCCESS:
-      thread->stack_frame = stack_frame->caller;
       {
         DangValueType *type = function->c.state_type;
         if (type && type->destruct != NULL)
           type->destruct (type, (char*)stack_frame + function->c.state_data_frame_offset);
       }
+      /* may finish the thread, if this function was spawned */
+      dang_thread_pop_frame (thread);
       break;
     case DANG_C_FUNCTION_BEGAN_CALL:
       dang_assert (thread->stack_frame->caller == stack_frame);
       return;
     case DANG_C_FUNCTION_YIELDED:
       thread->status = DANG_THREAD_STATUS_YIELDED;
-      thread->info.yield.yield_cancel_func = NULL;
-      thread->info.yield.yield_cancel_func_data = NULL;
-      thread->info.yield.done_func = NULL;
-      thread->info.yield.done_func_data = NULL;
       return;
     }
 }
@@ -90,8 +92,10 @@ dang_function_new_c        (DangSignature   *sig,
   rv->base.steps = dang_new (DangStep, 2);
   rv->base.steps[0].func = run_c_first;
   rv->base.steps[0]._step_data_size = 0;
+  rv->base.steps[0].flags = 0;
   rv->base.steps[1].func = run_c_nonfirst;
   rv->base.steps[1]._step_data_size = 0;
+  rv->base.steps[1].flags = 0;
   rv->base.is_owned = FALSE;
   rv->c.state_type = state_type;
   rv->c.func = func;
@@ -134,6 +138,16 @@ dang_function_new_c        (DangSignature   *sig,
   stack_info->vars[0].end = rv->base.steps + 2;
   stack_info->vars[0].offset = rv->c.state_data_frame_offset;
   stack_info->vars[0].type = state_type;
+  dang_function_stack_info_init_live_ranges (stack_info);
+
+  /* so that the arguments are destructed if the function throws */
+  stack_info->n_params = sig->n_params;
+  stack_info->params = dang_new (DangFunctionStackParamInfo, sig->n_params);
+  for (i = 0; i < sig->n_params; i++)
+    {
+      stack_info->params[i].offset = rv->c.arg_frame_offsets[i];
+      stack_info->params[i].type = sig->params[i].type;
+    }
 
   return rv;
 }
@@ -146,7 +160,7 @@ dang_c_function_begin_subcall (DangThread *thread,
 {
   DangSignature *sig = function->base.sig;
   unsigned offset = sizeof (DangThreadStackFrame);
-  DangThreadStackFrame *new_frame = dang_malloc (function->base.frame_size);
+  DangThreadStackFrame *new_frame = dang_thread_alloc_frame (thread, function->base.frame_size);
   unsigned i;
   DangFunction *caller = thread->stack_frame->function;
   dang_assert (caller->type == DANG_FUNCTION_TYPE_C);
@@ -223,5 +237,5 @@ void                dang_c_function_end_subcall   (DangThread *thread,
         }
       offset += sig->params[i].type->sizeof_instance;
     }
-  dang_free (old_frame);
+  dang_thread_free_frame (thread, old_frame);
 }
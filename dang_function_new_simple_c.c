@@ -109,6 +109,7 @@ DangFunction *dang_function_new_simple_c (DangSignature   *sig,
   rv->base.steps = dang_new (DangStep, 1);
   rv->base.steps[0].func = run_simple_c;
   rv->base.steps[0]._step_data_size = 0;
+  rv->base.steps[0].flags = 0;
   rv->base.is_owned = FALSE;
 
   /* Compute frame-size for dynamic invocation */
@@ -122,6 +123,7 @@ DangFunction *dang_function_new_simple_c (DangSignature   *sig,
   rv->simple_c.func = func;
   rv->simple_c.func_data = func_data;
   rv->simple_c.func_data_destroy = func_data_destroy;
+  rv->simple_c.is_pure = FALSE;
   return rv;
 }
 
@@ -57,6 +57,36 @@ append_label (DangLabelId label,
     dang_string_buffer_printf (out, "LABEL$%u", label);
 }
 
+static void
+append_simple_c_call (DangFunction *func,
+                      DangInsnValue *args,
+                      DangBuilderVariable *vars,
+                      DangStringBuffer *out)
+{
+  unsigned i;
+  DangSignature *sig = func->base.sig;
+  unsigned rv_offset = (sig->return_type == NULL
+                     || sig->return_type == dang_value_type_void()) ? 0 : 1;
+  char *str = dang_function_to_string (func);
+  dang_string_buffer_append (out, str);
+  dang_free (str);
+  dang_string_buffer_append (out, "(");
+  for (i = 0; i < sig->n_params; i++)
+    {
+      if (i > 0)
+        dang_string_buffer_append (out, ", ");
+      if (sig->params[i].dir != DANG_FUNCTION_PARAM_IN)
+        dang_string_buffer_append (out, "& ");
+      append_location (args + i + rv_offset, vars, out);
+    }
+  dang_string_buffer_append (out, ")");
+  if (rv_offset)
+    {
+      dang_string_buffer_append (out, " -> ");
+      append_location (args, vars, out);
+    }
+}
+
 /* Function: dang_insn_dump
  * Dump an instruction in human-readable form to a buffer.
  *
@@ -120,8 +150,13 @@ dang_insn_dump (DangInsn *insn,
         DangSignature *sig = insn->function_call.sig;
         unsigned rv_offset = (sig->return_type == NULL
                            || sig->return_type == dang_value_type_void()) ? 0 : 1;
-        dang_string_buffer_printf (out, "    CALL ");
-        append_location (&insn->function_call.function, vars, out);
+        dang_string_buffer_printf (out, "    %sCALL ",
+                                   insn->function_call.is_tail_call ? "TAIL" : "");
+        if (insn->function_call.virtual_method_offset != 0)
+          dang_string_buffer_printf (out, "VIRTUAL[%u]",
+                                     insn->function_call.virtual_method_offset);
+        else
+          append_location (&insn->function_call.function, vars, out);
         dang_string_buffer_append (out, "(");
         for (i = 0; i < insn->function_call.sig->n_params; i++)
           {
@@ -138,47 +173,49 @@ dang_insn_dump (DangInsn *insn,
             dang_string_buffer_append (out, " -> ");
             append_location (insn->function_call.params, vars, out);
           }
+        for (i = 0; i < insn->function_call.n_tail_destructs; i++)
+          {
+            dang_string_buffer_append (out, i == 0 ? " +DESTRUCT " : ", ");
+            append_var (insn->function_call.tail_destructs[i], vars, out);
+          }
         dang_string_buffer_append (out, "\n");
         break;
       }
     case DANG_INSN_TYPE_RUN_SIMPLE_C:
+      dang_string_buffer_printf (out, "    CALL ");
+      append_simple_c_call (insn->run_simple_c.func, insn->run_simple_c.args,
+                            vars, out);
+      dang_string_buffer_append (out, "\n");
+      break;
+    case DANG_INSN_TYPE_RUN_SIMPLE_C_FUSED:
       {
-        unsigned i;
-        DangSignature *sig = insn->run_simple_c.func->base.sig;
-        unsigned rv_offset = (sig->return_type == NULL
-                           || sig->return_type == dang_value_type_void()) ? 0 : 1;
-        dang_string_buffer_printf (out, "    CALL ");
-        {
-          char *str = dang_function_to_string (insn->run_simple_c.func);
-          dang_string_buffer_append (out, str);
-          dang_free (str);
-        }
-        dang_string_buffer_append (out, "(");
-        for (i = 0; i < sig->n_params; i++)
-          {
-            if (i > 0)
-              dang_string_buffer_append (out, ", ");
-            if (sig->params[i].dir != DANG_FUNCTION_PARAM_IN)
-              dang_string_buffer_append (out, "& ");
-            append_location (insn->run_simple_c.args + i + rv_offset,
-                             vars, out);
-          }
-        dang_string_buffer_append (out, ")");
-        if (rv_offset)
+        DangInsn_RunSimpleCFused *fused = &insn->run_simple_c_fused;
+        dang_string_buffer_printf (out, "    %sCALL ",
+                                   fused->init_return_value ? "INIT+" : "");
+        append_simple_c_call (fused->func, fused->args, vars, out);
+        switch (fused->tail)
           {
-            dang_string_buffer_append (out, " -> ");
-            append_location (insn->run_simple_c.args, vars, out);
+          case DANG_INSN_FUSED_TAIL_NONE:
+            break;
+          case DANG_INSN_FUSED_TAIL_JUMP:
+            dang_string_buffer_append (out, " +JUMP ");
+            append_label (fused->target, labels, out);
+            break;
+          case DANG_INSN_FUSED_TAIL_JUMP_IF_ZERO:
+          case DANG_INSN_FUSED_TAIL_JUMP_IF_NONZERO:
+            dang_string_buffer_printf (out, " +JUMP %s ",
+                                       fused->tail == DANG_INSN_FUSED_TAIL_JUMP_IF_ZERO
+                                       ? "IF_ZERO" : "IF_NONZERO");
+            append_label (fused->target, labels, out);
+            break;
+          case DANG_INSN_FUSED_TAIL_ASSIGN:
+            dang_string_buffer_append (out, " +ASSIGN ");
+            append_var (fused->assign_target, vars, out);
+            break;
           }
         dang_string_buffer_append (out, "\n");
         break;
       }
-    case DANG_INSN_TYPE_PUSH_CATCH_GUARD:
-      dang_string_buffer_printf (out, "    PUSH_CATCH_GUARD %u\n",
-                                 insn->push_catch_guard.catch_block_index);
-      break;
-    case DANG_INSN_TYPE_POP_CATCH_GUARD:
-      dang_string_buffer_append (out, "    POP_CATCH_GUARD\n");
-      break;
     case DANG_INSN_TYPE_RETURN:
       dang_string_buffer_append (out, "    RETURN\n");
       break;
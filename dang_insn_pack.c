@@ -1,6 +1,10 @@
 #include <string.h>
+#include <math.h>
+#include <pthread.h>
 #include "config.h"
 #include "dang.h"
+#include "gskrbtreemacros.h"
+#include "gskqsortmacro.h"
 
 typedef struct _PackedValue PackedValue;
 struct _PackedValue
@@ -76,16 +80,18 @@ pack_value_location (DangInsnPackContext *context,
 }
 
 /* --- helper functions --- */
+static dang_boolean step_run_is_local (DangStepRun func);
+
 static void
-dang_insn_pack_context_append (DangInsnPackContext *context,
-                               DangStepRun          func,
-                               unsigned             step_data_size,
-                               const void          *step_data,
-                               DangDestroyNotify    step_data_destroy)
+dang_insn_pack_context_append_flags (DangInsnPackContext *context,
+                                     DangStepRun          func,
+                                     DangStepFlags        flags,
+                                     unsigned             step_data_size,
+                                     const void          *step_data,
+                                     DangDestroyNotify    step_data_destroy)
 {
-  DangStep step = { func, step_data_size };
+  DangStep step = { func, step_data_size, flags };
   unsigned step_data_offset = context->step_data.len + sizeof (DangStep);
-                      
   dang_util_array_append (&context->step_data, sizeof (step), &step);
   dang_util_array_append (&context->step_data, step_data_size, step_data);
   if (step_data_destroy != NULL)
@@ -99,6 +105,18 @@ dang_insn_pack_context_append (DangInsnPackContext *context,
     }
 }
 static void
+dang_insn_pack_context_append (DangInsnPackContext *context,
+                               DangStepRun          func,
+                               unsigned             step_data_size,
+                               const void          *step_data,
+                               DangDestroyNotify    step_data_destroy)
+{
+  dang_insn_pack_context_append_flags (context, func,
+                                       step_run_is_local (func) ? DANG_STEP_FLAG_LOCAL : 0,
+                                       step_data_size, step_data,
+                                       step_data_destroy);
+}
+static void
 dang_insn_pack_context_add_destroy (DangInsnPackContext *context,
                                     DangInsnDestroyNotify destroy,
                                     void *arg1,
@@ -1333,6 +1351,156 @@ struct _InvocationInputSubstep
   } info;
 };
 
+/* --- Inline caches for virtual method calls ---
+   Each virtual method call site remembers the classes
+   it has seen, and the method each class provides,
+   so that in the common case (a class seen before)
+   the method need not be fetched from the class.
+   After METHOD_CACHE_SIZE classes, the call site
+   is megamorphic and misses are no longer cached. */
+#define METHOD_CACHE_SIZE       4
+
+typedef struct _MethodCacheEntry MethodCacheEntry;
+struct _MethodCacheEntry
+{
+  DangObjectClass *the_class;
+  DangFunction *function;
+};
+
+typedef struct _MethodCache MethodCache;
+struct _MethodCache
+{
+  unsigned class_offset;
+  unsigned n_entries;
+  MethodCacheEntry entries[METHOD_CACHE_SIZE];
+
+  /* for --debug-method-caches; otherwise the counts stay 0
+     and the cache is not listed */
+  unsigned long n_hits;
+  unsigned long n_misses;
+  dang_boolean is_listed;
+  DangCodePosition cp;
+  MethodCache *prev, *next;
+};
+
+#ifdef DANG_DEBUG
+#define METHOD_CACHE_DEBUGGING  dang_debug_method_caches
+#else
+#define METHOD_CACHE_DEBUGGING  FALSE
+#endif
+
+/* the listed caches, guarded by method_cache_list_lock,
+   since code may be packed by any worker */
+static MethodCache *first_method_cache;
+static pthread_mutex_t method_cache_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Entries are only ever appended, and n_entries is stored after
+   the entry is written, so lookups need no lock.  With several
+   workers (see dang-scheduler.h), appends are serialized. */
+static pthread_mutex_t method_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+method_cache_add (MethodCache     *cache,
+                  DangObjectClass *the_class,
+                  DangFunction    *function)
+{
+  unsigned i, n = cache->n_entries;
+  for (i = 0; i < n; i++)
+    if (cache->entries[i].the_class == the_class)
+      return;                   /* another worker beat us to it */
+  if (n < METHOD_CACHE_SIZE)
+    {
+      /* Classes (and hence their methods) are never freed
+         while code is running, so no reference is needed. */
+      cache->entries[n].the_class = the_class;
+      cache->entries[n].function = function;
+      __atomic_store_n (&cache->n_entries, n + 1, __ATOMIC_RELEASE);
+    }
+}
+
+static inline DangFunction *
+method_cache_lookup (MethodCache *cache,
+                     DangObject  *object)
+{
+  DangObjectClass *the_class = object->the_class;
+  DangFunction *function;
+  unsigned i, n = __atomic_load_n (&cache->n_entries, __ATOMIC_ACQUIRE);
+  for (i = 0; i < n; i++)
+    if (cache->entries[i].the_class == the_class)
+      {
+        if (DANG_UNLIKELY (METHOD_CACHE_DEBUGGING))
+          __atomic_fetch_add (&cache->n_hits, 1, __ATOMIC_RELAXED);
+        return cache->entries[i].function;
+      }
+  if (DANG_UNLIKELY (METHOD_CACHE_DEBUGGING))
+    __atomic_fetch_add (&cache->n_misses, 1, __ATOMIC_RELAXED);
+  function = * (DangFunction **) ((char*)the_class + cache->class_offset);
+  if (n < METHOD_CACHE_SIZE)
+    {
+      if (DANG_UNLIKELY (dang_is_threaded))
+        {
+          pthread_mutex_lock (&method_cache_lock);
+          method_cache_add (cache, the_class, function);
+          pthread_mutex_unlock (&method_cache_lock);
+        }
+      else
+        method_cache_add (cache, the_class, function);
+    }
+  return function;
+}
+
+static void
+method_cache_note_debug (MethodCache *cache)
+{
+#ifdef DANG_DEBUG
+  dang_debug_note_method_cache (&cache->cp, cache->n_entries,
+                                cache->n_hits, cache->n_misses);
+#endif
+}
+
+static MethodCache *
+method_cache_new (unsigned          class_offset,
+                  DangCodePosition *cp)
+{
+  MethodCache *cache = dang_new0 (MethodCache, 1);
+  cache->class_offset = class_offset;
+  if (METHOD_CACHE_DEBUGGING)
+    {
+      dang_code_position_copy (&cache->cp, cp);
+      cache->is_listed = TRUE;
+      pthread_mutex_lock (&method_cache_list_lock);
+      cache->next = first_method_cache;
+      if (first_method_cache)
+        first_method_cache->prev = cache;
+      first_method_cache = cache;
+      pthread_mutex_unlock (&method_cache_list_lock);
+    }
+  return cache;
+}
+
+/* a DangInsnDestroyNotify */
+static void
+method_cache_free (void *data,
+                   void *unused)
+{
+  MethodCache *cache = data;
+  DANG_UNUSED (unused);
+  if (cache->is_listed)
+    {
+      pthread_mutex_lock (&method_cache_list_lock);
+      method_cache_note_debug (cache);
+      if (cache->prev)
+        cache->prev->next = cache->next;
+      else
+        first_method_cache = cache->next;
+      if (cache->next)
+        cache->next->prev = cache->prev;
+      pthread_mutex_unlock (&method_cache_list_lock);
+      dang_code_position_clear (&cache->cp);
+    }
+  dang_free (cache);
+}
+
 typedef struct _InvocationInputInfo InvocationInputInfo;
 struct _InvocationInputInfo
 {
@@ -1342,8 +1510,10 @@ struct _InvocationInputInfo
   dang_boolean is_literal_function;
   union {
     DangFunction *literal;
-    unsigned offset;            /* a pointer to a function on the stack */
+    unsigned offset;            /* a pointer to a function on the stack,
+                                   or to 'this' for a virtual method */
   } func;
+  MethodCache *method_cache;    /* for virtual methods */
   unsigned sizeof_step_data;
 
   /* Followed by unsigned[n_pointers]
@@ -1353,43 +1523,16 @@ struct _InvocationInputInfo
    */
 };
 
-static void
-run_compiled_function_invocation (void                 *step_data,
-                                  DangThreadStackFrame *stack_frame,
-                                  DangThread           *thread)
+/* Initialize the parameters of a new frame.
+   Literal values are stored in the step-data. */
+static inline void
+run_input_substeps (InvocationInputSubstep *substeps,
+                    unsigned                n_steps,
+                    char                   *frame,
+                    char                   *new_frame,
+                    void                   *step_data)
 {
-  InvocationInputInfo *iii = step_data;
-  unsigned *null_check_ptr_offsets = (unsigned *)(iii+1);
-  unsigned n_steps;
-  char *frame = (char*)stack_frame;
   unsigned i;
-  InvocationInputSubstep *substeps;
-  char *new_frame;
-  DangThreadStackFrame *new;
-  DangFunction *function;
-  if (iii->is_literal_function)
-    function = iii->func.literal;
-  else
-    {
-      function = * (DangFunction**) ((char*)stack_frame + iii->func.offset);
-      if (function == NULL)
-        {
-          dang_thread_throw_null_pointer_exception (thread);
-          return;
-        }
-    }
-  for (i = 0; i < iii->n_pointers; i++)
-    {
-      if (* (void **) (frame + *null_check_ptr_offsets) == NULL)
-        {
-          dang_thread_throw_null_pointer_exception (thread);
-          return;
-        }
-      null_check_ptr_offsets++;
-    }
-  substeps = (InvocationInputSubstep *) (null_check_ptr_offsets);
-  n_steps = iii->n_steps;
-  new_frame = dang_malloc (function->base.frame_size);
   for (i = 0; i < n_steps; i++)
     {
       char *ptr;
@@ -1448,6 +1591,35 @@ run_compiled_function_invocation (void                 *step_data,
           break;
         }
     }
+}
+
+static inline void
+invoke_function (InvocationInputInfo  *iii,
+                 DangFunction         *function,
+                 DangThreadStackFrame *stack_frame,
+                 DangThread           *thread)
+{
+  void *step_data = iii;
+  unsigned *null_check_ptr_offsets = (unsigned *)(iii+1);
+  unsigned n_steps;
+  char *frame = (char*)stack_frame;
+  unsigned i;
+  InvocationInputSubstep *substeps;
+  char *new_frame;
+  DangThreadStackFrame *new;
+  for (i = 0; i < iii->n_pointers; i++)
+    {
+      if (* (void **) (frame + *null_check_ptr_offsets) == NULL)
+        {
+          dang_thread_throw_null_pointer_exception (thread);
+          return;
+        }
+      null_check_ptr_offsets++;
+    }
+  substeps = (InvocationInputSubstep *) (null_check_ptr_offsets);
+  n_steps = iii->n_steps;
+  new_frame = dang_thread_alloc_frame (thread, function->base.frame_size);
+  run_input_substeps (substeps, n_steps, frame, new_frame, step_data);
 
   /* Advance our instruction pointer */
   dang_thread_stack_frame_advance_ip (stack_frame, iii->sizeof_step_data);
@@ -1463,6 +1635,50 @@ run_compiled_function_invocation (void                 *step_data,
   * (DangThreadStackFrame **) (frame + iii->return_frame_offset) = new;
 }
 
+static void
+run_compiled_function_invocation (void                 *step_data,
+                                  DangThreadStackFrame *stack_frame,
+                                  DangThread           *thread)
+{
+  InvocationInputInfo *iii = step_data;
+  DangFunction *function;
+  if (iii->is_literal_function)
+    function = iii->func.literal;
+  else
+    {
+      function = * (DangFunction**) ((char*)stack_frame + iii->func.offset);
+      if (function == NULL)
+        {
+          dang_thread_throw_null_pointer_exception (thread);
+          return;
+        }
+    }
+  invoke_function (iii, function, stack_frame, thread);
+}
+
+static void
+run_compiled_method_invocation (void                 *step_data,
+                                DangThreadStackFrame *stack_frame,
+                                DangThread           *thread)
+{
+  InvocationInputInfo *iii = step_data;
+  DangObject *object = * (DangObject **) ((char*)stack_frame + iii->func.offset);
+  DangFunction *function;
+  if (object == NULL)
+    {
+      dang_thread_throw_null_pointer_exception (thread);
+      return;
+    }
+  function = method_cache_lookup (iii->method_cache, object);
+  if (function == NULL)
+    {
+      /* abstract method */
+      dang_thread_throw_null_pointer_exception (thread);
+      return;
+    }
+  invoke_function (iii, function, stack_frame, thread);
+}
+
 static void
 invocation_input_info_destruct (void *step_data)
 {
@@ -1615,7 +1831,7 @@ run_compiled_function_output (void                 *step_data,
         }
     }
 
-  dang_free (called_frame);
+  dang_thread_free_frame (thread, called_frame);
 
   if (throw_null_pointer_exception)
     dang_thread_throw_null_pointer_exception (thread);
@@ -1787,6 +2003,401 @@ align_offset (unsigned *offset_inout, DangValueType *type)
 }
 
 
+/* --- Direct calls to literal functions ---
+   If the called function is known when packing, and all the
+   parameters are plain data on the stack or literals,
+   the parameter area of the new frame is initialized
+   from a precomputed image (holding the literals)
+   and the stack-held arguments are copied over it,
+   in as few block moves as possible. */
+typedef struct _FastCallCopy FastCallCopy;
+struct _FastCallCopy
+{
+  unsigned called_offset;
+  unsigned frame_offset;
+  unsigned size;
+};
+
+typedef struct _FastCallData FastCallData;
+struct _FastCallData
+{
+  DangFunction *function;
+  unsigned return_frame_offset;
+  unsigned image_size;          /* starting at sizeof(DangThreadStackFrame) */
+  unsigned n_copies;
+  unsigned sizeof_step_data;
+
+  /* Followed by FastCallCopy[n_copies],
+     then the image. */
+};
+
+typedef struct _FastCallReturnData FastCallReturnData;
+struct _FastCallReturnData
+{
+  unsigned return_frame_offset;
+  unsigned n_copies;
+  unsigned sizeof_step_data;
+
+  /* Followed by FastCallCopy[n_copies] */
+};
+
+static void
+step__fast_call (void                 *step_data,
+                 DangThreadStackFrame *stack_frame,
+                 DangThread           *thread)
+{
+  FastCallData *fcd = step_data;
+  FastCallCopy *copies = (FastCallCopy *) (fcd + 1);
+  DangFunction *function = fcd->function;
+  char *frame = (char *) stack_frame;
+  char *new_frame = dang_thread_alloc_frame (thread, function->base.frame_size);
+  DangThreadStackFrame *new = (DangThreadStackFrame *) new_frame;
+  unsigned i;
+
+  memcpy (new_frame + sizeof (DangThreadStackFrame),
+          copies + fcd->n_copies, fcd->image_size);
+  for (i = 0; i < fcd->n_copies; i++)
+    memcpy (new_frame + copies[i].called_offset,
+            frame + copies[i].frame_offset,
+            copies[i].size);
+
+  dang_thread_stack_frame_advance_ip (stack_frame, fcd->sizeof_step_data);
+  new->caller = stack_frame;
+  new->function = function;
+  new->ip = function->base.steps;
+  thread->stack_frame = new;
+  * (DangThreadStackFrame **) (frame + fcd->return_frame_offset) = new;
+}
+
+static void
+step__fast_call_return (void                 *step_data,
+                        DangThreadStackFrame *stack_frame,
+                        DangThread           *thread)
+{
+  FastCallReturnData *fcrd = step_data;
+  FastCallCopy *copies = (FastCallCopy *) (fcrd + 1);
+  char *frame = (char *) stack_frame;
+  char *called_frame = * (char **) (frame + fcrd->return_frame_offset);
+  unsigned i;
+  for (i = 0; i < fcrd->n_copies; i++)
+    memcpy (frame + copies[i].frame_offset,
+            called_frame + copies[i].called_offset,
+            copies[i].size);
+  dang_thread_free_frame (thread, called_frame);
+  dang_thread_stack_frame_advance_ip (stack_frame, fcrd->sizeof_step_data);
+}
+
+/* a DangInsnDestroyNotify for the called function */
+static void
+fast_call_unref_function (void *function,
+                          void *unused)
+{
+  DANG_UNUSED (unused);
+  dang_function_unref (function);
+}
+
+/* Add a copy, merging it with the previous one if both
+   the source and destination are adjacent. */
+static void
+fast_call_add_copy (DangUtilArray *copies,
+                    unsigned       called_offset,
+                    unsigned       frame_offset,
+                    unsigned       size)
+{
+  FastCallCopy copy;
+  if (copies->len > 0)
+    {
+      FastCallCopy *last = (FastCallCopy *) copies->data + copies->len - 1;
+      if (last->called_offset + last->size == called_offset
+       && last->frame_offset + last->size == frame_offset)
+        {
+          last->size += size;
+          return;
+        }
+    }
+  copy.called_offset = called_offset;
+  copy.frame_offset = frame_offset;
+  copy.size = size;
+  dang_util_array_append (copies, 1, &copy);
+}
+
+static inline dang_boolean
+is_fast_call_value (DangInsnValue *value,
+                    DangFunctionParamDir dir)
+{
+  if (value->type->init_assign != NULL
+   || value->type->destruct != NULL)
+    return FALSE;
+  if (value->location == DANG_INSN_LOCATION_STACK)
+    return TRUE;
+  return dir == DANG_FUNCTION_PARAM_IN
+      && value->location == DANG_INSN_LOCATION_LITERAL;
+}
+
+/* Try to pack a call to a literal function as a pair of
+   step__fast_call and step__fast_call_return steps.
+   Returns FALSE if the call is not suitable. */
+static dang_boolean
+pack_fast_function_call (DangInsn            *insn,
+                         DangInsnPackContext *context)
+{
+  DangInsnValue *function_res = &insn->function_call.function;
+  DangInsnValue *params = insn->function_call.params;
+  DangSignature *sig;
+  DangFunction *function;
+  unsigned first_param = 0;
+  unsigned offset, image_size, i;
+  unsigned frame_var_offset;
+  DangUtilArray in_copies, out_copies;
+  char *image;
+  unsigned data_size;
+  FastCallData *fcd;
+  FastCallReturnData *fcrd;
+
+  if (function_res->location != DANG_INSN_LOCATION_LITERAL)
+    return FALSE;
+  function = * (DangFunction **) function_res->value;
+  sig = ((DangValueTypeFunction*)function_res->type)->sig;
+  if (sig->return_type != NULL)
+    {
+      if (!is_fast_call_value (params + 0, DANG_FUNCTION_PARAM_OUT))
+        return FALSE;
+      first_param = 1;
+    }
+  for (i = 0; i < sig->n_params; i++)
+    if (!is_fast_call_value (params + first_param + i, sig->params[i].dir))
+      return FALSE;
+
+  /* Lay out the parameters as allocate_stack__rv_and_params() does */
+  offset = sizeof (DangThreadStackFrame);
+  if (sig->return_type != NULL)
+    offset = DANG_ALIGN (offset, sig->return_type->alignof_instance)
+           + sig->return_type->sizeof_instance;
+  for (i = 0; i < sig->n_params; i++)
+    offset = DANG_ALIGN (offset, sig->params[i].type->alignof_instance)
+           + sig->params[i].type->sizeof_instance;
+  image_size = offset - sizeof (DangThreadStackFrame);
+  image = dang_malloc (image_size + 1);
+  memset (image, 0, image_size + 1);
+
+  DANG_UTIL_ARRAY_INIT (&in_copies, FastCallCopy);
+  DANG_UTIL_ARRAY_INIT (&out_copies, FastCallCopy);
+  offset = sizeof (DangThreadStackFrame);
+  for (i = 0; i < first_param + sig->n_params; i++)
+    {
+      DangInsnValue *value = params + i;
+      DangFunctionParamDir dir = i < first_param ? DANG_FUNCTION_PARAM_OUT
+                               : sig->params[i - first_param].dir;
+      unsigned size = value->type->sizeof_instance;
+      offset = DANG_ALIGN (offset, value->type->alignof_instance);
+      if (value->location == DANG_INSN_LOCATION_LITERAL)
+        memcpy (image + offset - sizeof (DangThreadStackFrame), value->value, size);
+      else if (dir != DANG_FUNCTION_PARAM_OUT)
+        fast_call_add_copy (&in_copies, offset,
+                            context->vars[value->var].offset, size);
+      if (dir != DANG_FUNCTION_PARAM_IN)
+        fast_call_add_copy (&out_copies, offset,
+                            context->vars[value->var].offset, size);
+      offset += size;
+    }
+
+  frame_var_offset = context->vars[insn->function_call.frame_var_id].offset;
+  data_size = sizeof (FastCallData)
+            + sizeof (FastCallCopy) * in_copies.len
+            + image_size;
+  data_size = DANG_ALIGN (data_size, sizeof (void *));
+  fcd = dang_malloc (data_size);
+  memset (fcd, 0, data_size);
+  fcd->function = function;
+  fcd->return_frame_offset = frame_var_offset;
+  fcd->image_size = image_size;
+  fcd->n_copies = in_copies.len;
+  fcd->sizeof_step_data = data_size;
+  memcpy (fcd + 1, in_copies.data, sizeof (FastCallCopy) * in_copies.len);
+  memcpy ((FastCallCopy *) (fcd + 1) + in_copies.len, image, image_size);
+  if (!function->base.is_owned)
+    {
+      dang_function_ref (function);
+      dang_insn_pack_context_add_destroy (context, fast_call_unref_function, function, NULL);
+    }
+  dang_insn_pack_context_append (context, step__fast_call, data_size, fcd, NULL);
+  dang_free (fcd);
+
+  data_size = sizeof (FastCallReturnData)
+            + sizeof (FastCallCopy) * out_copies.len;
+  fcrd = dang_malloc (data_size);
+  fcrd->return_frame_offset = frame_var_offset;
+  fcrd->n_copies = out_copies.len;
+  fcrd->sizeof_step_data = data_size;
+  memcpy (fcrd + 1, out_copies.data, sizeof (FastCallCopy) * out_copies.len);
+  dang_insn_pack_context_append (context, step__fast_call_return, data_size, fcrd, NULL);
+  dang_free (fcrd);
+
+  dang_free (image);
+  dang_util_array_clear (&in_copies);
+  dang_util_array_clear (&out_copies);
+  return TRUE;
+}
+
+/* --- Tail calls ---
+   A function calling itself just before returning
+   (see eliminate_tail_calls() in dang_builder_optimize.c)
+   builds the new parameters in a scratch area,
+   destructs its variables and its old parameters,
+   moves the new parameters in and restarts. */
+typedef struct _TailCallDestruct TailCallDestruct;
+struct _TailCallDestruct
+{
+  DangValueType *type;
+  unsigned offset;
+};
+
+typedef struct _TailCallData TailCallData;
+struct _TailCallData
+{
+  unsigned n_pointers;
+  unsigned n_steps;
+  unsigned n_destructs;
+  unsigned params_end;          /* offset of the end of the parameters */
+
+  /* Followed by unsigned[n_pointers] to check for null-ptr exceptions,
+     then InvocationInputSubstep[n_steps],
+     then TailCallDestruct[n_destructs],
+     then the literal values. */
+};
+
+static void
+step__tail_call (void                 *step_data,
+                 DangThreadStackFrame *stack_frame,
+                 DangThread           *thread)
+{
+  TailCallData *tcd = step_data;
+  unsigned *null_check_ptr_offsets = (unsigned *) (tcd + 1);
+  InvocationInputSubstep *substeps = (InvocationInputSubstep *) (null_check_ptr_offsets + tcd->n_pointers);
+  TailCallDestruct *destructs = (TailCallDestruct *) (substeps + tcd->n_steps);
+  char *frame = (char *) stack_frame;
+  char *image;
+  unsigned i;
+  for (i = 0; i < tcd->n_pointers; i++)
+    if (* (void **) (frame + null_check_ptr_offsets[i]) == NULL)
+      {
+        dang_thread_throw_null_pointer_exception (thread);
+        return;
+      }
+  image = dang_thread_alloc_frame (thread, tcd->params_end);
+  run_input_substeps (substeps, tcd->n_steps, frame, image, step_data);
+  for (i = 0; i < tcd->n_destructs; i++)
+    destructs[i].type->destruct (destructs[i].type, frame + destructs[i].offset);
+  memcpy (frame + sizeof (DangThreadStackFrame),
+          image + sizeof (DangThreadStackFrame),
+          tcd->params_end - sizeof (DangThreadStackFrame));
+  dang_thread_free_frame (thread, image);
+  stack_frame->ip = stack_frame->function->base.steps;
+}
+
+static void
+tail_call_data_destruct (void *step_data)
+{
+  TailCallData *tcd = step_data;
+  unsigned *ptrs = (unsigned *) (tcd + 1);
+  InvocationInputSubstep *substeps = (InvocationInputSubstep *) (ptrs + tcd->n_pointers);
+  unsigned i;
+  for (i = 0; i < tcd->n_steps; i++)
+    if (substeps[i].type == INVOCATION_INPUT_SUBSTEP_VIRTUAL_LITERAL)
+      substeps[i].type_info.type->destruct (substeps[i].type_info.type,
+                                            (char*)step_data + substeps[i].info.literal.offset);
+}
+
+static void
+add_tail_call_destruct (DangUtilArray *destructs,
+                        DangValueType *type,
+                        unsigned       offset)
+{
+  TailCallDestruct d;
+  if (type->destruct == NULL)
+    return;
+  d.type = type;
+  d.offset = offset;
+  dang_util_array_append (destructs, 1, &d);
+}
+
+static void
+pack_tail_call (DangInsn            *insn,
+                DangInsnPackContext *context)
+{
+  DangSignature *sig = insn->function_call.sig;
+  DangUtilArray pointers, input_substeps, output_substeps, value_data, destructs;
+  unsigned cur_called_offset = sizeof (DangThreadStackFrame);
+  unsigned first_param = sig->return_type ? 1 : 0;
+  unsigned i, header_size, size;
+  TailCallData *tcd;
+  char *at;
+
+  DANG_UTIL_ARRAY_INIT (&pointers, unsigned);
+  DANG_UTIL_ARRAY_INIT (&input_substeps, InvocationInputSubstep);
+  DANG_UTIL_ARRAY_INIT (&output_substeps, InvocationOutputSubstep);
+  DANG_UTIL_ARRAY_INIT (&value_data, char);
+  DANG_UTIL_ARRAY_INIT (&destructs, TailCallDestruct);
+  for (i = 0; i < insn->function_call.n_tail_destructs; i++)
+    {
+      DangBuilderVariable *var = context->vars + insn->function_call.tail_destructs[i];
+      add_tail_call_destruct (&destructs, var->type, var->offset);
+    }
+
+  /* The parameters (and return-value) of the called function
+     are those of this frame, so the old values are destructed. */
+  for (i = 0; i < first_param + sig->n_params; i++)
+    {
+      DangValueType *type = i < first_param ? sig->return_type
+                          : sig->params[i - first_param].type;
+      align_offset (&cur_called_offset, type);
+      handle_param_substeps (context,
+                             &pointers, &input_substeps, &output_substeps,
+                             &value_data,
+                             insn->function_call.params + i,
+                             i < first_param ? DANG_FUNCTION_PARAM_OUT
+                                             : DANG_FUNCTION_PARAM_IN,
+                             cur_called_offset);
+      add_tail_call_destruct (&destructs, type, cur_called_offset);
+      cur_called_offset += type->sizeof_instance;
+    }
+
+  header_size = sizeof (TailCallData)
+              + sizeof (unsigned) * pointers.len
+              + sizeof (InvocationInputSubstep) * input_substeps.len
+              + sizeof (TailCallDestruct) * destructs.len;
+  for (i = 0; i < input_substeps.len; i++)
+    {
+      InvocationInputSubstep *sub = (InvocationInputSubstep*)input_substeps.data + i;
+      if (sub->type == INVOCATION_INPUT_SUBSTEP_MEMCPY_LITERAL
+       || sub->type == INVOCATION_INPUT_SUBSTEP_VIRTUAL_LITERAL)
+        sub->info.literal.offset += header_size;
+    }
+  size = header_size + value_data.len;
+  tcd = dang_malloc (size);
+  tcd->n_pointers = pointers.len;
+  tcd->n_steps = input_substeps.len;
+  tcd->n_destructs = destructs.len;
+  tcd->params_end = cur_called_offset;
+  at = (char *) (tcd + 1);
+  memcpy (at, pointers.data, sizeof (unsigned) * pointers.len);
+  at += sizeof (unsigned) * pointers.len;
+  memcpy (at, input_substeps.data, sizeof (InvocationInputSubstep) * input_substeps.len);
+  at += sizeof (InvocationInputSubstep) * input_substeps.len;
+  memcpy (at, destructs.data, sizeof (TailCallDestruct) * destructs.len);
+  at += sizeof (TailCallDestruct) * destructs.len;
+  memcpy (at, value_data.data, value_data.len);
+  dang_insn_pack_context_append (context, step__tail_call, size, tcd,
+                                 tail_call_data_destruct);
+  dang_free (tcd);
+
+  dang_util_array_clear (&pointers);
+  dang_util_array_clear (&input_substeps);
+  dang_util_array_clear (&output_substeps);
+  dang_util_array_clear (&value_data);
+  dang_util_array_clear (&destructs);
+}
+
 static void
 pack__function_call (DangInsn *insn,
                      DangInsnPackContext *context)
@@ -1803,7 +2414,16 @@ pack__function_call (DangInsn *insn,
   DangSignature *sig;
   DangInsnValue *function_res = &insn->function_call.function;
   dang_assert (dang_value_type_is_function (function_res->type));
-  if (function_res->location == DANG_INSN_LOCATION_LITERAL)
+  if (insn->function_call.is_tail_call)
+    {
+      pack_tail_call (insn, context);
+      return;
+    }
+  if (insn->function_call.virtual_method_offset != 0)
+    function = NULL;
+  else if (pack_fast_function_call (insn, context))
+    return;
+  else if (function_res->location == DANG_INSN_LOCATION_LITERAL)
     function = * (DangFunction **) function_res->value;
   else
     {
@@ -1863,7 +2483,20 @@ pack__function_call (DangInsn *insn,
   input_info->return_frame_offset = context->vars[insn->function_call.frame_var_id].offset;
   input_info->n_pointers = pointers.len;
   input_info->n_steps = input_substeps.len;
-  if (function == NULL)
+  input_info->method_cache = NULL;
+  if (insn->function_call.virtual_method_offset != 0)
+    {
+      DangInsnValue *this_value = insn->function_call.params
+                                + (sig->return_type ? 1 : 0);
+      input_info->is_literal_function = FALSE;
+      dang_assert (this_value->location == DANG_INSN_LOCATION_STACK);
+      input_info->func.offset = context->vars[this_value->var].offset;
+      input_info->method_cache = method_cache_new (insn->function_call.virtual_method_offset,
+                                                   &insn->base.cp);
+      dang_insn_pack_context_add_destroy (context, method_cache_free,
+                                          input_info->method_cache, NULL);
+    }
+  else if (function == NULL)
     {
       input_info->is_literal_function = FALSE;
       dang_assert (function_res->location == DANG_INSN_LOCATION_STACK);
@@ -1891,7 +2524,10 @@ pack__function_call (DangInsn *insn,
   at += sizeof (InvocationInputSubstep) * input_substeps.len;
   memcpy (at, value_data.data, value_data.len);
 
-  dang_insn_pack_context_append (context, run_compiled_function_invocation,
+  dang_insn_pack_context_append (context,
+                                 input_info->method_cache != NULL
+                                   ? run_compiled_method_invocation
+                                   : run_compiled_function_invocation,
                                  iii_size, input_info,
                                  invocation_input_info_destruct);
   dang_free (input_info);
@@ -1953,7 +2589,8 @@ struct _CompiledSimpleCInvocation
   /* ParamSourceInfos follow */
 };
 
-static inline void
+/* Returns FALSE if an exception was thrown. */
+static inline dang_boolean
 run_compiled (CompiledSimpleCInvocation *csi,
               DangThreadStackFrame *stack_frame,
               DangThread           *thread,
@@ -1978,7 +2615,7 @@ run_compiled (CompiledSimpleCInvocation *csi,
         if (ptr == NULL)
           {
             dang_thread_throw_null_pointer_exception (thread);
-            return;
+            return FALSE;
           }
         params[i] = (char*) ptr + psi[i].info.pointer.offset;
         break;
@@ -1996,9 +2633,9 @@ run_compiled (CompiledSimpleCInvocation *csi,
     {
       dang_thread_throw (thread, dang_value_type_error (), &error);
       dang_error_unref (error);
-      return;
+      return FALSE;
     }
-  dang_thread_stack_frame_advance_ip (stack_frame, csi->step_size);
+  return TRUE;
 }
 
 static void
@@ -2008,7 +2645,8 @@ step__run_simple_c__malloc   (void                 *step_data,
 {
   CompiledSimpleCInvocation *csi = step_data;
   void *slab = dang_malloc (csi->tmp_alloc);
-  run_compiled (csi, stack_frame, thread, slab);
+  if (run_compiled (csi, stack_frame, thread, slab))
+    dang_thread_stack_frame_advance_ip (stack_frame, csi->step_size);
   dang_free (slab);
 }
 
@@ -2019,7 +2657,8 @@ step__run_simple_c__alloca (void                 *step_data,
 {
   CompiledSimpleCInvocation *csi = step_data;
   void *slab = alloca (csi->tmp_alloc);
-  run_compiled (csi, stack_frame, thread, slab);
+  if (run_compiled (csi, stack_frame, thread, slab))
+    dang_thread_stack_frame_advance_ip (stack_frame, csi->step_size);
 }
 
 static void
@@ -2089,9 +2728,14 @@ compiled_simple_c_destruct_step_data (void *data)
 
 }
 
+/* Build the CompiledSimpleCInvocation (followed by its
+   ParamSourceInfos and literal data) into 'out'. */
 static void
-pack__run_simple_c (DangInsn *insn,
-                    DangInsnPackContext *context)
+compile_simple_c_invocation (DangInsnPackContext *context,
+                             DangFunction        *function,
+                             DangInsnValue       *args,
+                             DangUtilArray       *out,
+                             dang_boolean        *needs_destruct_out)
 {
   /* We must form a plan of action for each argument + return-value.
    * - if there is a void return-value or parameter,
@@ -2100,11 +2744,8 @@ pack__run_simple_c (DangInsn *insn,
    * - for literal, we will have to allocate the literal data as
    *   part of the step data.
    */
-  DangFunction *function = insn->run_simple_c.func;
-  DangInsnValue *args = insn->run_simple_c.args;
   DangSignature *sig = function->base.sig;
   unsigned n_params = sig->n_params;
-  DangUtilArray literal_data;
   CompiledSimpleCInvocation *csi;
   ParamSourceInfo *psi;
   unsigned tmp_size;
@@ -2113,11 +2754,11 @@ pack__run_simple_c (DangInsn *insn,
   unsigned i;
   unsigned offset;
 
-  DANG_UTIL_ARRAY_INIT (&literal_data, char);
+  DANG_UTIL_ARRAY_INIT (out, char);
   tmp_size = (n_params+1) * sizeof (void *);
   orig_step_size = sizeof (CompiledSimpleCInvocation)
                  + (sig->n_params + 1) * sizeof (ParamSourceInfo);
-  dang_util_array_set_size (&literal_data, orig_step_size);
+  dang_util_array_set_size (out, orig_step_size);
   csi = dang_alloca (orig_step_size);
   csi->n_param_source_infos = n_params + 1;
   psi = (ParamSourceInfo *) (csi + 1);
@@ -2128,12 +2769,12 @@ pack__run_simple_c (DangInsn *insn,
     }
   else
     {
-      init_param_source_info (psi + 0, args + 0, context, &literal_data, &needs_destruct);
+      init_param_source_info (psi + 0, args + 0, context, out, &needs_destruct);
       offset = 1;
     }
   for (i = 0; i < n_params; i++)
     {
-      init_param_source_info (psi + 1 + i, args + i + offset, context, &literal_data, &needs_destruct);
+      init_param_source_info (psi + 1 + i, args + i + offset, context, out, &needs_destruct);
     }
   csi->tmp_alloc = tmp_size;
   if (!function->base.is_owned)
@@ -2145,16 +2786,734 @@ pack__run_simple_c (DangInsn *insn,
   csi->function = function;
   csi->func = function->simple_c.func;
   csi->func_data = function->simple_c.func_data;
-  csi->step_size = literal_data.len;
+  csi->step_size = out->len;
+
+  memcpy (out->data, csi, orig_step_size);
+  *needs_destruct_out = needs_destruct;
+}
+
+/* === RUN_SIMPLE_C: inline operators === */
+/* Arithmetic, comparison and logical operators on the
+   primitive types are implemented as typed steps that
+   work directly on stack offsets and literals,
+   rather than going through CompiledSimpleCInvocation.
+
+   The simple-c functions implementing the operators
+   are registered with dang_insn_pack_register_inline_op().
+   An operand must be on the stack or a literal
+   (but not both literals); otherwise the regular
+   simple-c invocation is used. */
+typedef union
+{
+  int8_t v_int8;
+  uint8_t v_uint8;
+  int16_t v_int16;
+  uint16_t v_uint16;
+  int32_t v_int32;
+  uint32_t v_uint32;
+  int64_t v_int64;
+  uint64_t v_uint64;
+  float v_float;
+  double v_double;
+  char v_boolean;
+} InlineLiteral;
+
+typedef struct _InlineOpData InlineOpData;
+struct _InlineOpData
+{
+  DangStep *target;             /* must be first; for branches */
+  unsigned rv_offset, a_offset, b_offset;
+  char jump_if_nonzero;         /* for branches */
+  InlineLiteral literal;        /* for the literal operand */
+};
+
+/* Operand variants */
+typedef enum
+{
+  INLINE_OPERANDS_SS,           /* stack, stack */
+  INLINE_OPERANDS_SL,           /* stack, literal */
+  INLINE_OPERANDS_LS            /* literal, stack */
+} InlineOperands;
+
+typedef enum
+{
+  INLINE_OP_BINARY,             /* rv = a OP b */
+  INLINE_OP_DIVIDE,             /* rv = a OP b, throws if b==0 */
+  INLINE_OP_UNARY,              /* rv = OP a */
+  INLINE_OP_INCREMENT,          /* rv = a++, etc; a is inout */
+  INLINE_OP_ASSIGN              /* a OP= b; a is inout */
+} InlineOpKind;
+
+typedef struct _InlineOpInfo InlineOpInfo;
+struct _InlineOpInfo
+{
+  const char *op_name;
+  const char *type_name;
+  InlineOpKind kind;
+  DangStepRun run[3];           /* indexed by InlineOperands */
+  DangStepRun branch[3];        /* compare+jump, or NULL */
+};
+
+#define INLINE_S(ctype, member) \
+  (* (ctype *) ((char*) stack_frame + d->member))
+#define INLINE_L(ctype, member) \
+  (* (ctype *) &d->literal)
+#define INLINE_OP_DIV(a, b)     ((a) / (b))
+#define INLINE_OP_MOD(a, b)     ((a) % (b))
+#define INLINE_OP_FMOD(a, b)    fmod ((a), (b))
+#define INLINE_ORDER_PRE(a,b)   a;b;
+#define INLINE_ORDER_POST(a,b)  b;a;
+
+#define DEFINE_INLINE_BINARY(name, rtype, ctype, OP, A, B)                \
+static void                                                               \
+name (void                 *step_data,                                    \
+      DangThreadStackFrame *stack_frame,                                  \
+      DangThread           *thread)                                       \
+{                                                                         \
+  InlineOpData *d = step_data;                                            \
+  DANG_UNUSED (thread);                                                   \
+  INLINE_S (rtype, rv_offset) = A (ctype, a_offset) OP B (ctype, b_offset);\
+  dang_thread_stack_frame_advance_ip (stack_frame, sizeof (*d));          \
+}
+#define DEFINE_INLINE_BRANCH(name, ctype, OP, A, B)                       \
+static void                                                               \
+name (void                 *step_data,                                    \
+      DangThreadStackFrame *stack_frame,                                  \
+      DangThread           *thread)                                       \
+{                                                                         \
+  InlineOpData *d = step_data;                                            \
+  char v = A (ctype, a_offset) OP B (ctype, b_offset);                    \
+  DANG_UNUSED (thread);                                                   \
+  INLINE_S (char, rv_offset) = v;                                         \
+  if (v == d->jump_if_nonzero)                                            \
+    stack_frame->ip = d->target;                                          \
+  else                                                                    \
+    dang_thread_stack_frame_advance_ip (stack_frame, sizeof (*d));        \
+}
+#define DEFINE_INLINE_DIVIDE(name, ctype, OPFUNC, opstr, A, B)            \
+static void                                                               \
+name (void                 *step_data,                                    \
+      DangThreadStackFrame *stack_frame,                                  \
+      DangThread           *thread)                                       \
+{                                                                         \
+  InlineOpData *d = step_data;                                            \
+  ctype b = B (ctype, b_offset);                                          \
+  if (DANG_UNLIKELY (b == 0))                                             \
+    {                                                                     \
+      throw_division_by_zero (thread, opstr);                             \
+      return;                                                             \
+    }                                                                     \
+  INLINE_S (ctype, rv_offset) = OPFUNC (A (ctype, a_offset), b);          \
+  dang_thread_stack_frame_advance_ip (stack_frame, sizeof (*d));          \
+}
+#define DEFINE_INLINE_UNARY(name, rtype, ctype, EXPR)                     \
+static void                                                               \
+name (void                 *step_data,                                    \
+      DangThreadStackFrame *stack_frame,                                  \
+      DangThread           *thread)                                       \
+{                                                                         \
+  InlineOpData *d = step_data;                                            \
+  ctype a = INLINE_S (ctype, a_offset);                                   \
+  DANG_UNUSED (thread);                                                   \
+  INLINE_S (rtype, rv_offset) = EXPR;                                     \
+  dang_thread_stack_frame_advance_ip (stack_frame, sizeof (*d));          \
+}
+#define DEFINE_INLINE_INCREMENT(name, ctype, ORDER, OP)                   \
+static void                                                               \
+name (void                 *step_data,                                    \
+      DangThreadStackFrame *stack_frame,                                  \
+      DangThread           *thread)                                       \
+{                                                                         \
+  InlineOpData *d = step_data;                                            \
+  ctype *v = &INLINE_S (ctype, a_offset);                                 \
+  DANG_UNUSED (thread);                                                   \
+  ORDER (*v OP 1, INLINE_S (ctype, rv_offset) = *v)                       \
+  dang_thread_stack_frame_advance_ip (stack_frame, sizeof (*d));          \
+}
+#define DEFINE_INLINE_ASSIGN(name, ctype, OP, B)                          \
+static void                                                               \
+name (void                 *step_data,                                    \
+      DangThreadStackFrame *stack_frame,                                  \
+      DangThread           *thread)                                       \
+{                                                                         \
+  InlineOpData *d = step_data;                                            \
+  DANG_UNUSED (thread);                                                   \
+  INLINE_S (ctype, a_offset) OP B (ctype, b_offset);                      \
+  dang_thread_stack_frame_advance_ip (stack_frame, sizeof (*d));          \
+}
+
+static void
+throw_division_by_zero (DangThread *thread,
+                        const char *op)
+{
+  DangError *error = dang_error_new ("'%s' by zero", op);
+  dang_thread_throw (thread, dang_value_type_error (), &error);
+  dang_error_unref (error);
+}
+
+/* Each of these defines the ss, sl and ls variants */
+#define DEFINE_INLINE_BINARY_3(op, type, rtype, ctype, OP)                     \
+  DEFINE_INLINE_BINARY(inline__##op##_##type##_ss, rtype, ctype, OP, INLINE_S, INLINE_S) \
+  DEFINE_INLINE_BINARY(inline__##op##_##type##_sl, rtype, ctype, OP, INLINE_S, INLINE_L) \
+  DEFINE_INLINE_BINARY(inline__##op##_##type##_ls, rtype, ctype, OP, INLINE_L, INLINE_S)
+#define DEFINE_INLINE_COMPARE_3(op, type, ctype, OP)                           \
+  DEFINE_INLINE_BINARY_3(op, type, char, ctype, OP)                            \
+  DEFINE_INLINE_BRANCH(inline__##op##_##type##_ss_branch, ctype, OP, INLINE_S, INLINE_S) \
+  DEFINE_INLINE_BRANCH(inline__##op##_##type##_sl_branch, ctype, OP, INLINE_S, INLINE_L) \
+  DEFINE_INLINE_BRANCH(inline__##op##_##type##_ls_branch, ctype, OP, INLINE_L, INLINE_S)
+#define DEFINE_INLINE_DIVIDE_3(op, type, ctype, OPFUNC, opstr)                 \
+  DEFINE_INLINE_DIVIDE(inline__##op##_##type##_ss, ctype, OPFUNC, opstr, INLINE_S, INLINE_S) \
+  DEFINE_INLINE_DIVIDE(inline__##op##_##type##_sl, ctype, OPFUNC, opstr, INLINE_S, INLINE_L) \
+  DEFINE_INLINE_DIVIDE(inline__##op##_##type##_ls, ctype, OPFUNC, opstr, INLINE_L, INLINE_S)
+#define DEFINE_INLINE_ASSIGN_2(op, type, ctype, OP)                            \
+  DEFINE_INLINE_ASSIGN(inline__##op##_##type##_ss, ctype, OP, INLINE_S)        \
+  DEFINE_INLINE_ASSIGN(inline__##op##_##type##_sl, ctype, OP, INLINE_L)
+
+#define DEFINE_INLINE_NUMERIC_OPS(type, ctype, MODFUNC)                        \
+  DEFINE_INLINE_BINARY_3(add, type, ctype, ctype, +)                           \
+  DEFINE_INLINE_BINARY_3(subtract, type, ctype, ctype, -)                      \
+  DEFINE_INLINE_BINARY_3(multiply, type, ctype, ctype, *)                      \
+  DEFINE_INLINE_DIVIDE_3(divide, type, ctype, INLINE_OP_DIV, "/")              \
+  DEFINE_INLINE_DIVIDE_3(mod, type, ctype, MODFUNC, "%")                       \
+  DEFINE_INLINE_COMPARE_3(lessthan, type, ctype, <)                            \
+  DEFINE_INLINE_COMPARE_3(lesseq, type, ctype, <=)                             \
+  DEFINE_INLINE_COMPARE_3(greaterthan, type, ctype, >)                         \
+  DEFINE_INLINE_COMPARE_3(greatereq, type, ctype, >=)                          \
+  DEFINE_INLINE_COMPARE_3(equal, type, ctype, ==)                              \
+  DEFINE_INLINE_COMPARE_3(notequal, type, ctype, !=)                           \
+  DEFINE_INLINE_UNARY(inline__negate_##type##_s, ctype, ctype, -a)             \
+  DEFINE_INLINE_UNARY(inline__not_##type##_s, char, ctype, a == 0)             \
+  DEFINE_INLINE_INCREMENT(inline__preincrement_##type##_s, ctype, INLINE_ORDER_PRE, +=) \
+  DEFINE_INLINE_INCREMENT(inline__postincrement_##type##_s, ctype, INLINE_ORDER_POST, +=) \
+  DEFINE_INLINE_INCREMENT(inline__predecrement_##type##_s, ctype, INLINE_ORDER_PRE, -=) \
+  DEFINE_INLINE_INCREMENT(inline__postdecrement_##type##_s, ctype, INLINE_ORDER_POST, -=) \
+  DEFINE_INLINE_ASSIGN_2(assign_add, type, ctype, +=)                          \
+  DEFINE_INLINE_ASSIGN_2(assign_subtract, type, ctype, -=)                     \
+  DEFINE_INLINE_ASSIGN_2(assign_multiply, type, ctype, *=)
+
+DEFINE_INLINE_NUMERIC_OPS(int8, int8_t, INLINE_OP_MOD)
+DEFINE_INLINE_NUMERIC_OPS(uint8, uint8_t, INLINE_OP_MOD)
+DEFINE_INLINE_NUMERIC_OPS(int16, int16_t, INLINE_OP_MOD)
+DEFINE_INLINE_NUMERIC_OPS(uint16, uint16_t, INLINE_OP_MOD)
+DEFINE_INLINE_NUMERIC_OPS(int32, int32_t, INLINE_OP_MOD)
+DEFINE_INLINE_NUMERIC_OPS(uint32, uint32_t, INLINE_OP_MOD)
+DEFINE_INLINE_NUMERIC_OPS(int64, int64_t, INLINE_OP_MOD)
+DEFINE_INLINE_NUMERIC_OPS(uint64, uint64_t, INLINE_OP_MOD)
+DEFINE_INLINE_NUMERIC_OPS(float, float, INLINE_OP_FMOD)
+DEFINE_INLINE_NUMERIC_OPS(double, double, INLINE_OP_FMOD)
+DEFINE_INLINE_COMPARE_3(equal, boolean, char, ==)
+DEFINE_INLINE_COMPARE_3(notequal, boolean, char, !=)
+DEFINE_INLINE_UNARY(inline__not_boolean_s, char, char, !a)
+
+#define INLINE_INFO_3(op, type, kind) \
+  { "operator_" #op, #type, kind, \
+    { inline__##op##_##type##_ss, inline__##op##_##type##_sl, inline__##op##_##type##_ls }, \
+    { NULL, NULL, NULL } }
+#define INLINE_INFO_COMPARE(op, type) \
+  { "operator_" #op, #type, INLINE_OP_BINARY, \
+    { inline__##op##_##type##_ss, inline__##op##_##type##_sl, inline__##op##_##type##_ls }, \
+    { inline__##op##_##type##_ss_branch, inline__##op##_##type##_sl_branch, \
+      inline__##op##_##type##_ls_branch } }
+#define INLINE_INFO_1(op, type, kind) \
+  { "operator_" #op, #type, kind, \
+    { inline__##op##_##type##_s, NULL, NULL }, { NULL, NULL, NULL } }
+#define INLINE_INFO_ASSIGN(op, type) \
+  { "operator_" #op, #type, INLINE_OP_ASSIGN, \
+    { inline__##op##_##type##_ss, inline__##op##_##type##_sl, NULL }, \
+    { NULL, NULL, NULL } }
+#define INLINE_INFO_NUMERIC_OPS(type) \
+  INLINE_INFO_3(add, type, INLINE_OP_BINARY), \
+  INLINE_INFO_3(subtract, type, INLINE_OP_BINARY), \
+  INLINE_INFO_3(multiply, type, INLINE_OP_BINARY), \
+  INLINE_INFO_3(divide, type, INLINE_OP_DIVIDE), \
+  INLINE_INFO_3(mod, type, INLINE_OP_DIVIDE), \
+  INLINE_INFO_COMPARE(lessthan, type), \
+  INLINE_INFO_COMPARE(lesseq, type), \
+  INLINE_INFO_COMPARE(greaterthan, type), \
+  INLINE_INFO_COMPARE(greatereq, type), \
+  INLINE_INFO_COMPARE(equal, type), \
+  INLINE_INFO_COMPARE(notequal, type), \
+  INLINE_INFO_1(negate, type, INLINE_OP_UNARY), \
+  INLINE_INFO_1(not, type, INLINE_OP_UNARY), \
+  INLINE_INFO_1(preincrement, type, INLINE_OP_INCREMENT), \
+  INLINE_INFO_1(postincrement, type, INLINE_OP_INCREMENT), \
+  INLINE_INFO_1(predecrement, type, INLINE_OP_INCREMENT), \
+  INLINE_INFO_1(postdecrement, type, INLINE_OP_INCREMENT), \
+  INLINE_INFO_ASSIGN(assign_add, type), \
+  INLINE_INFO_ASSIGN(assign_subtract, type), \
+  INLINE_INFO_ASSIGN(assign_multiply, type)
+
+static InlineOpInfo inline_op_infos[] =
+{
+  INLINE_INFO_NUMERIC_OPS(int8),
+  INLINE_INFO_NUMERIC_OPS(uint8),
+  INLINE_INFO_NUMERIC_OPS(int16),
+  INLINE_INFO_NUMERIC_OPS(uint16),
+  INLINE_INFO_NUMERIC_OPS(int32),
+  INLINE_INFO_NUMERIC_OPS(uint32),
+  INLINE_INFO_NUMERIC_OPS(int64),
+  INLINE_INFO_NUMERIC_OPS(uint64),
+  INLINE_INFO_NUMERIC_OPS(float),
+  INLINE_INFO_NUMERIC_OPS(double),
+  INLINE_INFO_COMPARE(equal, boolean),
+  INLINE_INFO_COMPARE(notequal, boolean),
+  INLINE_INFO_1(not, boolean, INLINE_OP_UNARY)
+};
 
-  memcpy (literal_data.data, csi, orig_step_size);
+/* Map from simple-c function to InlineOpInfo */
+typedef struct _InlineFuncInfo InlineFuncInfo;
+struct _InlineFuncInfo
+{
+  char *func_ptr;
+  InlineOpInfo *info;
+  InlineFuncInfo *left, *right, *parent;
+  dang_boolean is_red;
+};
+static InlineFuncInfo *inline_func_info_tree = NULL;
+#define INLINE_GET_IS_RED(fi)  (fi)->is_red
+#define INLINE_SET_IS_RED(fi,v)  (fi)->is_red = v
+#define INLINE_FUNC_INFO_COMPARE(a,b, rv) \
+    GSK_QSORT_SIMPLE_COMPARATOR(a->func_ptr, b->func_ptr, rv)
+#define INLINE_COMPARE_KEY_TO_FI(a,b, rv) \
+      GSK_QSORT_SIMPLE_COMPARATOR(a, b->func_ptr, rv)
+#define GET_INLINE_FUNC_INFO_TREE() \
+  inline_func_info_tree, InlineFuncInfo *, INLINE_GET_IS_RED, INLINE_SET_IS_RED, \
+  parent, left, right, INLINE_FUNC_INFO_COMPARE
+
+/* Function: dang_insn_pack_register_inline_op
+ * Note that a simple-c function implements a standard operator
+ * on a primitive type, so that calls to it may be
+ * packed as a specialized step.
+ * Unsupported operators and types are ignored.
+ *
+ * Parameters:
+ *    func - the simple-c function.
+ *    op_name - the operator's function name, like "operator_add".
+ *    type - the type of the operands.
+ */
+void
+dang_insn_pack_register_inline_op (DangSimpleCFunc func,
+                                   const char     *op_name,
+                                   DangValueType  *type)
+{
+  char *key = (char*) func;
+  InlineFuncInfo *fi;
+  InlineFuncInfo *conflict;
+  unsigned i;
+  GSK_RBTREE_LOOKUP_COMPARATOR (GET_INLINE_FUNC_INFO_TREE (),
+                                key, INLINE_COMPARE_KEY_TO_FI,
+                                fi);
+  if (fi != NULL)
+    return;
+  for (i = 0; i < DANG_N_ELEMENTS (inline_op_infos); i++)
+    if (strcmp (inline_op_infos[i].op_name, op_name) == 0
+     && strcmp (inline_op_infos[i].type_name, type->full_name) == 0)
+      break;
+  if (i == DANG_N_ELEMENTS (inline_op_infos))
+    return;
+  fi = dang_new (InlineFuncInfo, 1);
+  fi->func_ptr = key;
+  fi->info = inline_op_infos + i;
+  GSK_RBTREE_INSERT (GET_INLINE_FUNC_INFO_TREE (), fi, conflict);
+  dang_assert (conflict == NULL);
+}
+
+/* Function: dang_insn_pack_is_inline_op
+ * Whether the simple-c function was registered with
+ * dang_insn_pack_register_inline_op().
+ * Such operators only depend on their arguments,
+ * so calls with literal arguments may be evaluated at compile-time.
+ *
+ * Parameters:
+ *    func - the simple-c function.
+ */
+dang_boolean
+dang_insn_pack_is_inline_op (DangSimpleCFunc func)
+{
+  char *key = (char*) func;
+  InlineFuncInfo *fi;
+  GSK_RBTREE_LOOKUP_COMPARATOR (GET_INLINE_FUNC_INFO_TREE (),
+                                key, INLINE_COMPARE_KEY_TO_FI,
+                                fi);
+  return fi != NULL;
+}
 
+static void
+free_inline_func_info_recursive (InlineFuncInfo *fi)
+{
+  if (fi->left)
+    free_inline_func_info_recursive (fi->left);
+  if (fi->right)
+    free_inline_func_info_recursive (fi->right);
+  dang_free (fi);
+}
+void
+_dang_insn_pack_cleanup (void)
+{
+  /* Method caches of functions which are still alive. */
+  pthread_mutex_lock (&method_cache_list_lock);
+  while (first_method_cache != NULL)
+    {
+      MethodCache *cache = first_method_cache;
+      first_method_cache = cache->next;
+      method_cache_note_debug (cache);
+      cache->is_listed = FALSE;
+      dang_code_position_clear (&cache->cp);
+    }
+  pthread_mutex_unlock (&method_cache_list_lock);
+  if (inline_func_info_tree)
+    free_inline_func_info_recursive (inline_func_info_tree);
+  inline_func_info_tree = NULL;
+}
+
+static dang_boolean
+inline_operand_is_ok (DangInsnValue *value)
+{
+  return value->location == DANG_INSN_LOCATION_STACK
+      || (value->location == DANG_INSN_LOCATION_LITERAL
+       && value->type->sizeof_instance <= sizeof (InlineLiteral));
+}
+
+/* If the function is an inlinable operator and the arguments
+   are suitable, fill in 'data' and return the step function,
+   otherwise return NULL.  If 'branch_out' is non-NULL,
+   return the compare+jump step function, if there is one.
+   'is_local_out' is set if the step cannot throw. */
+static DangStepRun
+inline_op_prepare (DangFunction        *function,
+                   DangInsnValue       *args,
+                   DangInsnPackContext *context,
+                   InlineOpData        *data,
+                   DangStepRun         *branch_out,
+                   dang_boolean        *is_local_out)
+{
+  char *key = (char*) function->simple_c.func;
+  InlineFuncInfo *fi;
+  InlineOpInfo *info;
+  InlineOperands operands;
+  DangInsnValue *a, *b = NULL;
+
+  GSK_RBTREE_LOOKUP_COMPARATOR (GET_INLINE_FUNC_INFO_TREE (),
+                                key, INLINE_COMPARE_KEY_TO_FI,
+                                fi);
+  if (fi == NULL)
+    return NULL;
+  info = fi->info;
+  memset (data, 0, sizeof (InlineOpData));
+  switch (info->kind)
+    {
+    case INLINE_OP_BINARY:
+    case INLINE_OP_DIVIDE:
+      if (args[0].location != DANG_INSN_LOCATION_STACK)
+        return NULL;
+      data->rv_offset = context->vars[args[0].var].offset;
+      a = args + 1;
+      b = args + 2;
+      break;
+    case INLINE_OP_UNARY:
+    case INLINE_OP_INCREMENT:
+      if (args[0].location != DANG_INSN_LOCATION_STACK)
+        return NULL;
+      data->rv_offset = context->vars[args[0].var].offset;
+      a = args + 1;
+      break;
+    case INLINE_OP_ASSIGN:
+      a = args + 0;
+      b = args + 1;
+      break;
+    default:
+      dang_assert_not_reached ();
+    }
+
+  if (!inline_operand_is_ok (a)
+   || (b != NULL && !inline_operand_is_ok (b)))
+    return NULL;
+  if (a->location == DANG_INSN_LOCATION_LITERAL)
+    {
+      if (b == NULL || b->location == DANG_INSN_LOCATION_LITERAL)
+        return NULL;
+      operands = INLINE_OPERANDS_LS;
+      memcpy (&data->literal, a->value, a->type->sizeof_instance);
+    }
+  else if (b != NULL && b->location == DANG_INSN_LOCATION_LITERAL)
+    {
+      operands = INLINE_OPERANDS_SL;
+      memcpy (&data->literal, b->value, b->type->sizeof_instance);
+    }
+  else
+    operands = INLINE_OPERANDS_SS;
+  if (info->run[operands] == NULL)
+    return NULL;
+  if (a->location == DANG_INSN_LOCATION_STACK)
+    data->a_offset = context->vars[a->var].offset;
+  if (b != NULL && b->location == DANG_INSN_LOCATION_STACK)
+    data->b_offset = context->vars[b->var].offset;
+  if (branch_out)
+    *branch_out = info->branch[operands];
+  *is_local_out = (info->kind != INLINE_OP_DIVIDE);
+  return info->run[operands];
+}
+
+static void
+inline_op_append (DangInsnPackContext *context,
+                  DangStepRun          run,
+                  dang_boolean         is_local,
+                  InlineOpData        *data)
+{
+  dang_insn_pack_context_append_flags (context, run,
+                                       is_local ? DANG_STEP_FLAG_LOCAL : 0,
+                                       sizeof (InlineOpData), data, NULL);
+}
+
+
+static void
+pack__run_simple_c (DangInsn *insn,
+                    DangInsnPackContext *context)
+{
+  DangUtilArray data;
+  dang_boolean needs_destruct;
+  CompiledSimpleCInvocation *csi;
   DangStepRun run_func;
-  run_func = (tmp_size > 2048) ? step__run_simple_c__malloc : step__run_simple_c__alloca;
+  InlineOpData inline_data;
+  dang_boolean is_local;
+
+  run_func = inline_op_prepare (insn->run_simple_c.func, insn->run_simple_c.args,
+                                context, &inline_data, NULL, &is_local);
+  if (run_func != NULL)
+    {
+      inline_op_append (context, run_func, is_local, &inline_data);
+      return;
+    }
+
+  compile_simple_c_invocation (context,
+                               insn->run_simple_c.func,
+                               insn->run_simple_c.args,
+                               &data, &needs_destruct);
+  csi = data.data;
+  run_func = (csi->tmp_alloc > 2048) ? step__run_simple_c__malloc : step__run_simple_c__alloca;
 
-  dang_insn_pack_context_append (context, run_func, literal_data.len, literal_data.data,
+  dang_insn_pack_context_append (context, run_func, data.len, data.data,
                                  needs_destruct ? compiled_simple_c_destruct_step_data : NULL);
-  dang_free (literal_data.data);
+  dang_free (data.data);
+}
+
+/* === RUN_SIMPLE_C_FUSED === */
+/* A simple-c invocation, optionally preceded by zeroing
+   the return-value, and followed by a jump or
+   an assignment of the return-value. */
+typedef struct _FusedSimpleCData FusedSimpleCData;
+struct _FusedSimpleCData
+{
+  DangStep *target;             /* must be first */
+  unsigned rv_offset, rv_size;
+  dang_boolean init_return_value;
+  unsigned assign_offset;
+
+  /* CompiledSimpleCInvocation follows */
+};
+#define FUSED_SIMPLE_C_HEADER_SIZE \
+  DANG_ALIGN (sizeof (FusedSimpleCData), sizeof (void *))
+#define FUSED_PEEK_CSI(fd) \
+  ((CompiledSimpleCInvocation *) ((char*)(fd) + FUSED_SIMPLE_C_HEADER_SIZE))
+
+/* Returns FALSE if an exception was thrown. */
+static inline dang_boolean
+run_fused_simple_c (FusedSimpleCData     *fd,
+                    DangThreadStackFrame *stack_frame,
+                    DangThread           *thread)
+{
+  CompiledSimpleCInvocation *csi = FUSED_PEEK_CSI (fd);
+  void *slab = alloca (csi->tmp_alloc);
+  if (fd->init_return_value)
+    memset ((char*)stack_frame + fd->rv_offset, 0, fd->rv_size);
+  return run_compiled (csi, stack_frame, thread, slab);
+}
+#define FUSED_STEP_SIZE(fd) \
+  (FUSED_SIMPLE_C_HEADER_SIZE + FUSED_PEEK_CSI (fd)->step_size)
+
+static void
+step__simple_c_fused (void                 *step_data,
+                      DangThreadStackFrame *stack_frame,
+                      DangThread           *thread)
+{
+  FusedSimpleCData *fd = step_data;
+  if (run_fused_simple_c (fd, stack_frame, thread))
+    dang_thread_stack_frame_advance_ip (stack_frame, FUSED_STEP_SIZE (fd));
+}
+
+static void
+step__simple_c_fused_jump (void                 *step_data,
+                           DangThreadStackFrame *stack_frame,
+                           DangThread           *thread)
+{
+  FusedSimpleCData *fd = step_data;
+  if (run_fused_simple_c (fd, stack_frame, thread))
+    stack_frame->ip = fd->target;
+}
+
+static void
+step__simple_c_fused_jump_if_zero (void                 *step_data,
+                                   DangThreadStackFrame *stack_frame,
+                                   DangThread           *thread)
+{
+  FusedSimpleCData *fd = step_data;
+  if (!run_fused_simple_c (fd, stack_frame, thread))
+    return;
+  if (dang_util_is_zero ((char*)stack_frame + fd->rv_offset, fd->rv_size))
+    stack_frame->ip = fd->target;
+  else
+    dang_thread_stack_frame_advance_ip (stack_frame, FUSED_STEP_SIZE (fd));
+}
+
+static void
+step__simple_c_fused_jump_if_nonzero (void                 *step_data,
+                                      DangThreadStackFrame *stack_frame,
+                                      DangThread           *thread)
+{
+  FusedSimpleCData *fd = step_data;
+  if (!run_fused_simple_c (fd, stack_frame, thread))
+    return;
+  if (dang_util_is_zero ((char*)stack_frame + fd->rv_offset, fd->rv_size))
+    dang_thread_stack_frame_advance_ip (stack_frame, FUSED_STEP_SIZE (fd));
+  else
+    stack_frame->ip = fd->target;
+}
+
+static void
+step__simple_c_fused_assign (void                 *step_data,
+                             DangThreadStackFrame *stack_frame,
+                             DangThread           *thread)
+{
+  FusedSimpleCData *fd = step_data;
+  if (!run_fused_simple_c (fd, stack_frame, thread))
+    return;
+  memcpy ((char*)stack_frame + fd->assign_offset,
+          (char*)stack_frame + fd->rv_offset,
+          fd->rv_size);
+  dang_thread_stack_frame_advance_ip (stack_frame, FUSED_STEP_SIZE (fd));
+}
+
+static void
+fused_simple_c_destruct_step_data (void *data)
+{
+  compiled_simple_c_destruct_step_data (FUSED_PEEK_CSI (data));
+}
+
+static void
+pack_inline_fused_tail (DangInsn_RunSimpleCFused *fused,
+                        DangStepRun               run_func,
+                        DangStepRun               branch_func,
+                        dang_boolean              is_local,
+                        InlineOpData             *inline_data,
+                        DangInsnPackContext      *context)
+{
+  switch (fused->tail)
+    {
+    case DANG_INSN_FUSED_TAIL_NONE:
+      inline_op_append (context, run_func, is_local, inline_data);
+      break;
+    case DANG_INSN_FUSED_TAIL_JUMP:
+      inline_op_append (context, run_func, is_local, inline_data);
+      add_unconditional_jump (context, fused->target);
+      break;
+    case DANG_INSN_FUSED_TAIL_JUMP_IF_ZERO:
+    case DANG_INSN_FUSED_TAIL_JUMP_IF_NONZERO:
+      if (branch_func != NULL)
+        {
+          inline_data->jump_if_nonzero = (fused->tail == DANG_INSN_FUSED_TAIL_JUMP_IF_NONZERO);
+          dang_insn_pack_context_note_target (context, fused->target, 0);
+          inline_op_append (context, branch_func, TRUE, inline_data);
+        }
+      else
+        {
+          DangInsn jump;
+          inline_op_append (context, run_func, is_local, inline_data);
+          jump.type = DANG_INSN_TYPE_JUMP_CONDITIONAL;
+          jump.jump_conditional.target = fused->target;
+          jump.jump_conditional.test_value = fused->args[0];
+          jump.jump_conditional.jump_if_zero = (fused->tail == DANG_INSN_FUSED_TAIL_JUMP_IF_ZERO);
+          pack__jump_conditional (&jump, context);
+        }
+      break;
+    case DANG_INSN_FUSED_TAIL_ASSIGN:
+      {
+        AssignData_Memcpy ad;
+        inline_op_append (context, run_func, is_local, inline_data);
+        ad.dst_offset = context->vars[fused->assign_target].offset;
+        ad.src_offset = context->vars[fused->args[0].var].offset;
+        ad.size = fused->args[0].type->sizeof_instance;
+        APPEND_RUN_DATA (assign_memcpy, ad);
+      }
+      break;
+    }
+}
+
+static void
+pack__run_simple_c_fused (DangInsn *insn,
+                          DangInsnPackContext *context)
+{
+  DangInsn_RunSimpleCFused *fused = &insn->run_simple_c_fused;
+  DangUtilArray data;
+  dang_boolean needs_destruct;
+  FusedSimpleCData *fd;
+  DangStepRun run_func = NULL;
+  DangValueType *rv_type = fused->args[0].type;
+  unsigned header_size = FUSED_SIMPLE_C_HEADER_SIZE;
+  InlineOpData inline_data;
+  DangStepRun branch_func;
+  dang_boolean is_local;
+
+  dang_assert (fused->args[0].location == DANG_INSN_LOCATION_STACK);
+
+  /* Inline operators overwrite the return-value,
+     so the INIT is unneeded; the tail becomes a separate step,
+     except for comparisons followed by a conditional jump. */
+  run_func = inline_op_prepare (fused->func, fused->args, context,
+                                &inline_data, &branch_func, &is_local);
+  if (run_func != NULL)
+    {
+      pack_inline_fused_tail (fused, run_func, branch_func,
+                              is_local, &inline_data, context);
+      return;
+    }
+  compile_simple_c_invocation (context, fused->func, fused->args,
+                               &data, &needs_destruct);
+  dang_assert (((CompiledSimpleCInvocation*)data.data)->tmp_alloc <= 2048);
+
+  /* Prepend the header */
+  fd = dang_alloca (header_size);
+  memset (fd, 0, header_size);
+  dang_util_array_insert (&data, header_size, fd, 0);
+  fd = data.data;
+  fd->rv_offset = context->vars[fused->args[0].var].offset;
+  fd->rv_size = rv_type->sizeof_instance;
+  fd->init_return_value = fused->init_return_value;
+  switch (fused->tail)
+    {
+    case DANG_INSN_FUSED_TAIL_NONE:
+      run_func = step__simple_c_fused;
+      break;
+    case DANG_INSN_FUSED_TAIL_JUMP:
+      run_func = step__simple_c_fused_jump;
+      break;
+    case DANG_INSN_FUSED_TAIL_JUMP_IF_ZERO:
+      run_func = step__simple_c_fused_jump_if_zero;
+      break;
+    case DANG_INSN_FUSED_TAIL_JUMP_IF_NONZERO:
+      run_func = step__simple_c_fused_jump_if_nonzero;
+      break;
+    case DANG_INSN_FUSED_TAIL_ASSIGN:
+      run_func = step__simple_c_fused_assign;
+      fd->assign_offset = context->vars[fused->assign_target].offset;
+      break;
+    }
+  if (fused->tail != DANG_INSN_FUSED_TAIL_NONE
+   && fused->tail != DANG_INSN_FUSED_TAIL_ASSIGN)
+    dang_insn_pack_context_note_target (context, fused->target, 0);
+
+  dang_insn_pack_context_append (context, run_func, data.len, data.data,
+                                 needs_destruct ? fused_simple_c_destruct_step_data : NULL);
+  dang_free (data.data);
 }
 
 /* === CREATE_CLOSURE === */
@@ -2258,55 +3617,6 @@ pack__create_closure (DangInsn *insn,
   dang_free (info);
 }
 
-/* === PUSH_CATCH_GUARD === */
-static void
-step__push_catch_guard (void *step_data,
-                           DangThreadStackFrame *stack_frame,
-                           DangThread           *thread)
-{
-  unsigned cb_index = *(unsigned*) step_data;
-  DangFunctionStackInfo *stack_info = stack_frame->function->base.stack_info;
-  dang_assert (stack_info);
-  dang_assert (cb_index < stack_info->n_catch_blocks);
-  dang_thread_push_catch_guard (thread,
-                                stack_frame,
-                                stack_info->catch_blocks + cb_index);
-  dang_thread_stack_frame_advance_ip (stack_frame, sizeof(unsigned));
-}
-
-static void
-pack__push_catch_guard (DangInsn *insn,
-                        DangInsnPackContext *context)
-{
-  dang_insn_pack_context_append (context,
-                                 step__push_catch_guard,
-                                 sizeof(unsigned),
-                                 &insn->push_catch_guard.catch_block_index,
-                                 NULL);
-}
-
-/* === POP_CATCH_GUARD === */
-
-static void
-step__pop_catch_guard  (void *step_data,
-                           DangThreadStackFrame *stack_frame,
-                           DangThread           *thread)
-{
-  DANG_UNUSED (step_data);
-  dang_thread_pop_catch_guard (thread);
-  dang_thread_stack_frame_advance_ip (stack_frame, 0);
-}
-
-static void
-pack__pop_catch_guard (DangInsn *insn,
-                       DangInsnPackContext *context)
-{
-  DANG_UNUSED (insn);
-  dang_insn_pack_context_append (context,
-                                 step__pop_catch_guard,
-                                 0, NULL, NULL);
-}
-
 /* === RETURN === */
 static void
 step__return    (void                 *step_data,
@@ -2492,6 +3802,45 @@ pack__new_tensor (DangInsn *insn,
   dang_insn_pack_context_append (context, stepfunc, sd_size, rv, NULL);
 }
 
+/* Steps which only touch the current frame (see DANG_STEP_FLAG_LOCAL).
+   Anything that may throw (null-pointer checks, simple-c calls,
+   indexing) or that changes the stack must not be listed here. */
+static DangStepRun local_step_funcs[] =
+{
+  step__init,
+  step__destruct,
+  assign_memcpy,
+  assign_virtual,
+  assign_memcpy_lglobal,
+  assign_virtual_lglobal,
+  assign_memcpy_rglobal,
+  assign_virtual_rglobal,
+  assign_memcpy_lglobal_rglobal,
+  assign_virtual_lglobal_rglobal,
+  assign_memcpy_rliteral,
+  assign_virtual_rliteral,
+  assign_memcpy_lglobal_rliteral,
+  assign_virtual_lglobal_rliteral,
+  step__jump,
+  step__jump_if_zero_global,
+  step__jump_if_nonzero_global,
+  step__jump_if_zero_stack,
+  step__jump_if_nonzero_stack,
+  step__jump_if_zero_stack1,
+  step__jump_if_nonzero_stack1,
+  step__new_tensor
+};
+
+static dang_boolean
+step_run_is_local (DangStepRun func)
+{
+  unsigned i;
+  for (i = 0; i < DANG_N_ELEMENTS (local_step_funcs); i++)
+    if (local_step_funcs[i] == func)
+      return TRUE;
+  return FALSE;
+}
+
 typedef void (*PackFunc) (DangInsn *insn,
                           DangInsnPackContext *context);
 
@@ -2506,12 +3855,12 @@ static PackFunc pack_funcs[13] =
   pack__jump_conditional,
   pack__function_call,
   pack__run_simple_c,
-  pack__push_catch_guard,
-  pack__pop_catch_guard,
   pack__return,
   pack__index,
   pack__create_closure,
-  pack__new_tensor
+  pack__new_tensor,
+  NULL,                         /* NEW_CONSTANT_TREE: not implemented */
+  pack__run_simple_c_fused
 };
 
 void
@@ -2519,5 +3868,6 @@ dang_insn_pack (DangInsn             *insn,
                 DangInsnPackContext  *context)
 {
   dang_assert (insn->type < DANG_N_ELEMENTS (pack_funcs));
+  dang_assert (pack_funcs[insn->type] != NULL);
   pack_funcs[insn->type] (insn, context);
 }